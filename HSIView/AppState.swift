@@ -8,6 +8,7 @@ final class AppState: ObservableObject {
     private static let defaultWavelengthEndDefaultsKey = "settings.default_wavelength.end"
     private static let pythonInterpreterPathDefaultsKey = "settings.python.interpreter_path"
     private static let roiCursorUpdateFPSDefaultsKey = "settings.tools.roi_cursor_update_fps"
+    private static let classificationMaxAngleDefaultsKey = "settings.classification.max_angle_degrees"
     private static let fallbackWavelengthStart = "400"
     private static let fallbackWavelengthEnd = "1000"
     private static let fallbackROICursorUpdateFPSLimit = 30
@@ -125,6 +126,9 @@ final class AppState: ObservableObject {
     
     @Published var pipelineOperations: [PipelineOperation] = []
     @Published var pipelineAutoApply: Bool = true
+    @Published var pipelinePreviewEnabled: Bool = true
+    @Published var pipelinePreviewImage: NSImage?
+    @Published var pipelinePreviewDuration: TimeInterval?
     @Published var showAlignmentVisualization: Bool = false {
         didSet {
             if !showAlignmentVisualization {
@@ -216,6 +220,14 @@ final class AppState: ObservableObject {
             UserDefaults.standard.set(roiCursorUpdateFPSLimit, forKey: Self.roiCursorUpdateFPSDefaultsKey)
         }
     }
+    /// Порог спектрального угла для классификации SAM, в градусах; 0 — без порога.
+    /// Пиксели дальше порога от всех опорных спектров остаются без класса.
+    @Published var classificationMaxAngleDegrees: Double = 0 {
+        didSet {
+            UserDefaults.standard.set(classificationMaxAngleDegrees, forKey: Self.classificationMaxAngleDefaultsKey)
+        }
+    }
+    @Published var pendingSpectralClassification: SpectralClassificationRequest?
     @Published var roiCursorSourceImage: NSImage?
     @Published var roiCursorPreviewImage: NSImage?
     @Published var maskLayerSamples: [SpectrumMaskLayerSample] = []
@@ -246,6 +258,11 @@ final class AppState: ObservableObject {
     private var pendingSessionRestore: CubeSessionSnapshot?
     private var spectralTrimRange: ClosedRange<Int>?
     private var libraryExportDismissWorkItem: DispatchWorkItem?
+    private let pipelinePreviewQueue = DispatchQueue(label: "com.hsiview.pipeline-preview", qos: .userInitiated)
+    private var pipelinePreviewGeneration = 0
+    /// Копия `pipelinePreviewGeneration` для фоновой очереди: устаревшие запросы пропускаются
+    private let pipelinePreviewLatestGeneration = PreviewGenerationCounter()
+    private var pipelinePreviewSettleWorkItem: DispatchWorkItem?
     private var spectrumColorCounter: Int = 0
     private var roiColorCounter: Int = 0
     private var maskLayerColorCounter: Int = 0
@@ -265,6 +282,20 @@ final class AppState: ObservableObject {
     private var roiCursorSourceCGImage: CGImage?
     private var roiCursorSourceLogicalSize: CGSize = .zero
     private var roiCursorPreviewSourceCache: ROICursorPreviewSourceCache?
+    private let roiIntegralIndexQueue = DispatchQueue(
+        label: "com.hsiview.roi_integral_index",
+        qos: .utility
+    )
+    /// Интегральные изображения каналов для средних спектров ROI-курсора за O(каналов)
+    private var roiIntegralIndex: SpectralIntegralIndex?
+    private var roiIntegralIndexBuildKey: ROIIntegralIndexKey?
+    private var librarySpectrumIndexCache: (revision: UInt64, index: LibrarySpectrumIndex)?
+    private let librarySpectrumIndexQueue = DispatchQueue(
+        label: "com.hsiview.library_spectrum_index",
+        qos: .userInitiated
+    )
+    /// Ближайшие спектры библиотеки для точки графика, открытые в поповере
+    @Published var librarySpectrumMatchResult: LibrarySpectrumMatchResult?
     private var suppressSpectrumRefresh: Bool = false
     private var spectrumRotationTurns: Int = 0
     private var spectrumSpatialSize: (width: Int, height: Int)?
@@ -273,6 +304,8 @@ final class AppState: ObservableObject {
     @Published var pcaPendingConfig: PCAVisualizationConfig?
     @Published var pcaRenderedImage: NSImage?
     @Published var isPCAApplying: Bool = false
+    /// Маппинг компонент, выбранный во время расчёта PCA
+    private var pcaMappingDuringApply: PCAComponentMapping?
     @Published var pcaProgressMessage: String?
     
     @Published var maskEditorState = MaskEditorState()
@@ -376,6 +409,7 @@ final class AppState: ObservableObject {
         } else {
             roiCursorUpdateFPSLimit = Self.fallbackROICursorUpdateFPSLimit
         }
+        classificationMaxAngleDegrees = max(0, UserDefaults.standard.double(forKey: Self.classificationMaxAngleDefaultsKey))
         let defaultRange = resolvedDefaultWavelengthRange()
         lambdaStart = defaultRange.start
         lambdaEnd = defaultRange.end
@@ -390,6 +424,10 @@ final class AppState: ObservableObject {
     }
 
     var roiCursorRefreshInterval: TimeInterval? {
+        // С готовым интегральным индексом средний спектр дешёвый — курсор обновляется с частотой кадров
+        if roiAggregationMode == .mean, let cube, readyROIIntegralIndex(cube: cube, layout: activeLayout) != nil {
+            return nil
+        }
         let fps = roiCursorUpdateFPSLimit
         guard fps > 0 else { return nil }
         return 1.0 / Double(fps)
@@ -796,10 +834,51 @@ final class AppState: ObservableObject {
             pcaPendingConfig?.basis = nil
             pcaPendingConfig?.clipUpper = nil
             pcaPendingConfig?.explainedVariance = nil
+            pcaPendingConfig?.totalVariance = nil
             pcaPendingConfig?.sourceCubeID = nil
         }
     }
 
+    /// Смена маппинга компонент. Если изображение построено по применённой конфигурации,
+    /// готовые плоскости проекции из `PCAResultCache` сразу перекрашиваются; во время расчёта
+    /// маппинг запоминается и применяется к его результату.
+    func updatePCAMapping(_ updater: (inout PCAComponentMapping) -> Void) {
+        if isPCAApplying {
+            var mapping = pcaMappingDuringApply ?? (pcaPendingConfig ?? colorSynthesisConfig.pcaConfig).mapping
+            updater(&mapping)
+            pcaMappingDuringApply = mapping
+            return
+        }
+        guard pcaRenderedImage != nil, pcaPendingConfig == nil, let cube else {
+            updatePCAConfig { updater(&$0.mapping) }
+            if pcaRenderedImage != nil {
+                applyPCAVisualization()
+            }
+            return
+        }
+        var config = colorSynthesisConfig.pcaConfig
+        updater(&config.mapping)
+        guard let image = PCARenderer.recolor(
+            cube: cube,
+            layout: activeLayout,
+            config: config,
+            roi: pcaROIRect(for: config)
+        ) else {
+            updatePCAConfig { updater(&$0.mapping) }
+            applyPCAVisualization()
+            return
+        }
+        colorSynthesisConfig.pcaConfig = config
+        hasCustomColorSynthesisMapping = true
+        pcaRenderedImage = image
+    }
+
+    /// Прямоугольник ROI, по которому считается PCA (nil — весь кадр или ROI не найден)
+    private func pcaROIRect(for config: PCAVisualizationConfig) -> SpectrumROIRect? {
+        guard config.computeScope == .roi, let roiID = config.selectedROI else { return nil }
+        return displayedROISamples.first(where: { $0.id == roiID })?.rect
+    }
+
     func applyPCAVisualization() {
         guard !isPCAApplying else { return }
         guard let cube = cube else { return }
@@ -807,8 +886,7 @@ final class AppState: ObservableObject {
         var configToApply = pcaPendingConfig ?? colorSynthesisConfig.pcaConfig
         var roiRect: SpectrumROIRect?
         if configToApply.computeScope == .roi {
-            guard let roiID = configToApply.selectedROI,
-                  let roi = displayedROISamples.first(where: { $0.id == roiID })?.rect else {
+            guard let roi = pcaROIRect(for: configToApply) else {
                 pcaProgressMessage = L("Выберите ROI для PCA")
                 return
             }
@@ -833,11 +911,20 @@ final class AppState: ObservableObject {
             )
             
             DispatchQueue.main.async {
-                self.colorSynthesisConfig.pcaConfig = result.updatedConfig
+                var updatedConfig = result.updatedConfig
+                var image = result.image
+                if let mapping = self.pcaMappingDuringApply {
+                    self.pcaMappingDuringApply = nil
+                    updatedConfig.mapping = mapping
+                    if image != nil {
+                        image = PCARenderer.recolor(cube: cube, layout: layout, config: updatedConfig, roi: roiRect) ?? image
+                    }
+                }
+                self.colorSynthesisConfig.pcaConfig = updatedConfig
                 self.pcaPendingConfig = nil
-                self.pcaRenderedImage = result.image
+                self.pcaRenderedImage = image
                 self.isPCAApplying = false
-                self.pcaProgressMessage = nil
+                self.pcaProgressMessage = result.errorMessage
             }
         }
     }
@@ -865,6 +952,7 @@ final class AppState: ObservableObject {
             colorSynthesisConfig.pcaConfig.basis = nil
             colorSynthesisConfig.pcaConfig.clipUpper = nil
             colorSynthesisConfig.pcaConfig.explainedVariance = nil
+            colorSynthesisConfig.pcaConfig.totalVariance = nil
             colorSynthesisConfig.pcaConfig.sourceCubeID = nil
         }
         if let roiID = colorSynthesisConfig.pcaConfig.selectedROI,
@@ -1475,6 +1563,7 @@ final class AppState: ObservableObject {
             cfg.basis = nil
             cfg.clipUpper = nil
             cfg.explainedVariance = nil
+            cfg.totalVariance = nil
             cfg.sourceCubeID = nil
         }
         return cfg
@@ -1642,7 +1731,9 @@ final class AppState: ObservableObject {
             isGraphPanelExpanded = true
         }
 
-        if force {
+        let integralIndex = roiAggregationMode == .mean ? ensureROIIntegralIndex(cube: cube, layout: layout) : nil
+        if force || integralIndex != nil {
+            roiCursorPendingSpectrumRequest = nil
             if let immediate = makeROISampleForSnapshot(
                 rect: normalizedRect,
                 cube: cube,
@@ -1651,7 +1742,8 @@ final class AppState: ObservableObject {
                 aggregationMode: roiAggregationMode,
                 colorIndex: colorIndex,
                 id: sampleID,
-                displayName: sampleName
+                displayName: sampleName,
+                integralIndex: integralIndex
             ) {
                 roiCursorSample = immediate
                 roiCursorRect = immediate.rect
@@ -1691,6 +1783,47 @@ final class AppState: ObservableObject {
         }
     }
 
+    /// Готовый индекс для куба и раскладки или nil
+    private func readyROIIntegralIndex(cube: HyperCube, layout: CubeLayout) -> SpectralIntegralIndex? {
+        guard let index = roiIntegralIndex,
+              let axes = cube.axes(for: layout),
+              index.matches(cube: cube, axes: axes) else {
+            return nil
+        }
+        return index
+    }
+
+    /// Возвращает готовый индекс; если его нет, запускает построение в фоне и возвращает nil
+    @discardableResult
+    private func ensureROIIntegralIndex(cube: HyperCube, layout: CubeLayout) -> SpectralIntegralIndex? {
+        if let index = readyROIIntegralIndex(cube: cube, layout: layout) {
+            return index
+        }
+        guard let axes = cube.axes(for: layout) else { return nil }
+        let key = ROIIntegralIndexKey(cubeID: cube.id, channel: axes.channel, height: axes.height, width: axes.width)
+        guard roiIntegralIndexBuildKey != key else { return nil }
+        roiIntegralIndexBuildKey = key
+        roiIntegralIndexQueue.async { [weak self] in
+            let index = SpectralIntegralIndex(cube: cube, axes: axes)
+            DispatchQueue.main.async { [weak self] in
+                guard let self, self.roiIntegralIndexBuildKey == key else { return }
+                // Ключ остаётся занятым и при nil (не хватило памяти), чтобы не повторять построение
+                guard let index, let current = self.cube, index.matches(cube: current, axes: axes) else { return }
+                self.roiIntegralIndex = index
+                // Последний ответ очереди отбрасывается при готовом индексе — спектр пересчитывается сразу
+                if self.activeAnalysisTool == .roiCursor, let rect = self.roiCursorRect {
+                    self.updateROICursorSpectrum(for: rect)
+                }
+            }
+        }
+        return nil
+    }
+
+    private func releaseROIIntegralIndex() {
+        roiIntegralIndex = nil
+        roiIntegralIndexBuildKey = nil
+    }
+
     private func invalidateROICursorPreviewSourceCache() {
         roiCursorPreviewQueue.async { [weak self] in
             self?.roiCursorPreviewSourceCache = nil
@@ -1727,6 +1860,11 @@ final class AppState: ObservableObject {
                 defer { self.processNextROICursorSpectrumRequestIfNeeded() }
                 guard self.activeAnalysisTool == .roiCursor else { return }
                 guard self.roiCursorComputationEpoch == request.epoch else { return }
+                // Пока считался запрос, мог появиться индекс: его результат свежее
+                if request.aggregationMode == .mean,
+                   self.readyROIIntegralIndex(cube: request.cube, layout: request.layout) != nil {
+                    return
+                }
                 if let sample {
                     self.roiCursorSample = sample
                 }
@@ -2603,6 +2741,7 @@ final class AppState: ObservableObject {
         if tool == .ruler {
             if activeAnalysisTool == .roiCursor {
                 clearROICursorState()
+                releaseROIIntegralIndex()
             }
             if activeAnalysisTool == .ruler {
                 rulerMode = (rulerMode == .measure) ? .edit : .measure
@@ -2625,8 +2764,12 @@ final class AppState: ObservableObject {
         }
         if activeAnalysisTool != .roiCursor {
             clearROICursorState()
+            releaseROIIntegralIndex()
         } else {
             pendingROISample = nil
+            if roiAggregationMode == .mean, let cube {
+                ensureROIIntegralIndex(cube: cube, layout: activeLayout)
+            }
         }
         selectedRulerPointID = nil
     }
@@ -2812,6 +2955,59 @@ final class AppState: ObservableObject {
         maskLayerSamples[idx] = sample
     }
 
+    /// Индекс поиска по кэшу спектров библиотеки на сетке длин волн текущего куба.
+    /// Строится в фоне при первом запросе и после изменения кэша или сетки;
+    /// `completion` вызывается на главном потоке, сразу — если индекс уже готов.
+    func loadLibrarySpectrumIndex(_ completion: @escaping (LibrarySpectrumIndex?) -> Void) {
+        guard cube != nil, channelCount > 0 else {
+            completion(nil)
+            return
+        }
+        let grid: [Double]
+        if let wavelengths, wavelengths.count == channelCount {
+            grid = wavelengths
+        } else {
+            grid = (0..<channelCount).map(Double.init)
+        }
+        let revision = librarySpectrumCache.revision
+        if let cached = librarySpectrumIndexCache, cached.revision == revision, cached.index.wavelengths == grid {
+            completion(cached.index)
+            return
+        }
+        let entries = Array(librarySpectrumCache.entries.values)
+        librarySpectrumIndexQueue.async { [weak self] in
+            let index = LibrarySpectrumIndex(entries: entries, wavelengths: grid)
+            DispatchQueue.main.async {
+                guard let self else { return }
+                if self.librarySpectrumCache.revision == revision {
+                    self.librarySpectrumIndexCache = (revision, index)
+                }
+                completion(index)
+            }
+        }
+    }
+
+    /// Ищет спектры библиотеки, ближайшие к точке графика; результат — в `librarySpectrumMatchResult`
+    func findLibrarySpectrumMatches(
+        for sample: SpectrumSample,
+        metric: LibrarySpectrumIndex.Metric = .spectralAngle,
+        count: Int = 5
+    ) {
+        librarySpectrumMatchResult = LibrarySpectrumMatchResult(sampleID: sample.id, metric: metric, matches: nil)
+        loadLibrarySpectrumIndex { [weak self] index in
+            guard let self,
+                  let pending = self.librarySpectrumMatchResult,
+                  pending.sampleID == sample.id, pending.metric == metric else { return }
+            let matches = index?.topMatches(
+                for: sample.values,
+                wavelengths: sample.wavelengths,
+                count: count,
+                metric: metric
+            ) ?? []
+            self.librarySpectrumMatchResult = LibrarySpectrumMatchResult(sampleID: sample.id, metric: metric, matches: matches)
+        }
+    }
+
     func updateROISampleRect(id: UUID, rect: SpectrumROIRect) -> Bool {
         if let idx = roiSamples.firstIndex(where: { $0.id == id }) {
             let existing = roiSamples[idx]
@@ -3074,7 +3270,138 @@ final class AppState: ObservableObject {
             }
         }
     }
-    
+
+    /// Классифицирует все пиксели куба по ROI-спектрам или спектрам библиотеки.
+    /// Каждый опорный спектр становится классом маски с его именем и цветом.
+    /// Для SAM действует порог `classificationMaxAngleDegrees`.
+    /// Если маска уже размечена, без `replacingMask` сначала запрашивается подтверждение замены.
+    func classifyCubeSpectra(
+        source: SpectralClassificationReferenceSource,
+        method: SpectralClassificationMethod,
+        replacingMask: Bool = false
+    ) {
+        guard let cube else {
+            loadError = L("classification.error.no_cube")
+            return
+        }
+        guard let size = cubeSpatialSize(for: cube),
+              let axes = cube.axes(for: activeLayout) else {
+            loadError = L("classification.error.spatial_size_unavailable")
+            return
+        }
+        if !replacingMask, maskEditorState.hasPaintedPixels {
+            pendingSpectralClassification = SpectralClassificationRequest(source: source, method: method)
+            return
+        }
+
+        beginBusy(message: L("classification.busy"))
+        let strides = cube.axisStrides(axes: axes)
+        let maxAngle = method == .spectralAngle && classificationMaxAngleDegrees > 0
+            ? classificationMaxAngleDegrees * .pi / 180
+            : nil
+        let sourceCubeID = cube.id
+        let referenceImage = currentMaskReferenceImage(for: cube)
+
+        func classify(references: [[Double]], classes: [MaskClassMetadata], skippedReferences: Int = 0) {
+            guard cube.id == self.cube?.id else {
+                endBusy()
+                return
+            }
+            guard !references.isEmpty else {
+                endBusy()
+                loadError = LF("classification.error.no_references", source.localizedTitle)
+                return
+            }
+            processingQueue.async { [weak self] in
+                guard let self else { return }
+                let result = SpectralClassifier.classify(
+                    cube: cube,
+                    strides: strides,
+                    references: references,
+                    method: method,
+                    maxAngle: maxAngle
+                )
+                DispatchQueue.main.async {
+                    self.endBusy()
+                    guard self.cube?.id == sourceCubeID else { return }
+                    guard let result, result.width == size.width, result.height == size.height else {
+                        self.loadError = L("classification.error.failed")
+                        return
+                    }
+                    self.maskEditorState.applyImportedMask(
+                        classMap: result.classMap,
+                        width: result.width,
+                        height: result.height,
+                        rgbImage: referenceImage
+                    )
+                    self.maskEditorState.applyImportedClassMetadata(
+                        classes,
+                        width: result.width,
+                        height: result.height,
+                        rgbImage: referenceImage
+                    )
+                    self.maskEditorCubePath = self.cubeURL?.standardizedFileURL.path
+                    self.trackMaskSpatialContextForCurrentPipeline()
+                    self.refreshMaskLayerSamples()
+                    if self.viewMode != .mask {
+                        self.viewMode = .mask
+                    }
+                    self.persistCurrentSession()
+                    // Карта классов UInt8 вмещает не больше maxClasses опорных спектров
+                    self.loadError = skippedReferences > 0
+                        ? LF("classification.references_truncated", references.count, references.count + skippedReferences)
+                        : nil
+                }
+            }
+        }
+
+        switch source {
+        case .roiSamples:
+            var references: [[Double]] = []
+            var classes: [MaskClassMetadata] = []
+            var skipped = 0
+            for sample in roiSamples where sample.values.count == channelCount {
+                guard references.count < SpectralClassifier.maxClasses else {
+                    skipped += 1
+                    continue
+                }
+                references.append(sample.values)
+                classes.append(MaskClassMetadata(
+                    id: references.count,
+                    name: sample.displayName ?? "ROI (\(sample.rect.minX), \(sample.rect.minY))",
+                    color: sample.nsColor
+                ))
+            }
+            classify(references: references, classes: classes, skippedReferences: skipped)
+        case .library:
+            // Индекс большой библиотеки (PCA-подпространство) строится в фоне
+            loadLibrarySpectrumIndex { index in
+                var references: [[Double]] = []
+                var classes: [MaskClassMetadata] = []
+                var skipped = 0
+                if let index {
+                    skipped = max(0, index.references.count - SpectralClassifier.maxClasses)
+                    let palette = SpectrumColorPalette.colors
+                    for (i, reference) in index.references.prefix(SpectralClassifier.maxClasses).enumerated() {
+                        references.append(index.spectrum(at: i))
+                        classes.append(MaskClassMetadata(
+                            id: references.count,
+                            name: reference.name,
+                            color: palette.isEmpty ? .systemPink : palette[reference.colorIndex % palette.count]
+                        ))
+                    }
+                }
+                classify(references: references, classes: classes, skippedReferences: skipped)
+            }
+        }
+    }
+
+    func confirmSpectralClassification() {
+        guard let request = pendingSpectralClassification else { return }
+        pendingSpectralClassification = nil
+        classifyCubeSpectra(source: request.source, method: request.method, replacingMask: true)
+    }
+
     func applyNormalization() {
         guard let original = originalCube else { return }
         
@@ -3410,6 +3737,16 @@ final class AppState: ObservableObject {
     }
     
     private func handleCubeChange(previousCube: HyperCube?) {
+        if previousCube?.id != cube?.id {
+            PCAResultCache.shared.removeAll(except: cube?.id)
+            // Ключи префиксов пайплайна привязаны к исходному кубу, а не к результату
+            PipelinePrefixCache.shared.removeAll(except: originalCube?.id)
+            releaseROIIntegralIndex()
+            librarySpectrumMatchResult = nil
+            if activeAnalysisTool == .roiCursor, roiAggregationMode == .mean, let cube {
+                ensureROIIntegralIndex(cube: cube, layout: activeLayout)
+            }
+        }
         adjustSpectrumGeometry(previousCube: previousCube, newCube: cube)
         adjustMaskGeometryForCurrentPipeline()
         updateMaskReferenceImage()
@@ -3918,6 +4255,7 @@ final class AppState: ObservableObject {
                 var pipelineErrorMessage: String?
                 let result = self.processPipeline(
                     original: baseCube,
+                    sourceID: sourceCubeID,
                     operations: &mutableOperations,
                     errorMessage: &pipelineErrorMessage
                 )
@@ -3949,6 +4287,104 @@ final class AppState: ObservableObject {
         }
     }
 
+    /// Предпросмотр операции с несохранёнными параметрами на уменьшенной копии входа.
+    /// Вход берётся из кэша префиксов, а если его там нет — предыдущие операции
+    /// выполняются на прокси. `onSettled` вызывается, когда параметры перестают меняться.
+    func requestPipelinePreview(for operation: PipelineOperation, onSettled: (() -> Void)? = nil) {
+        cancelPipelinePreviewSettle()
+        if let onSettled {
+            let workItem = DispatchWorkItem { [weak self] in
+                guard let self, self.pipelinePreviewSettleWorkItem != nil else { return }
+                self.pipelinePreviewSettleWorkItem = nil
+                onSettled()
+            }
+            pipelinePreviewSettleWorkItem = workItem
+            DispatchQueue.main.asyncAfter(deadline: .now() + 0.6, execute: workItem)
+        }
+
+        guard pipelinePreviewEnabled,
+              PipelinePreviewRenderer.isPreviewable(operation),
+              let original = originalCube,
+              let index = pipelineOperations.firstIndex(where: { $0.id == operation.id }) else {
+            pipelinePreviewImage = nil
+            pipelinePreviewDuration = nil
+            return
+        }
+
+        pipelinePreviewGeneration += 1
+        let generation = pipelinePreviewGeneration
+        pipelinePreviewLatestGeneration.set(generation)
+        let latestGeneration = pipelinePreviewLatestGeneration
+        let prefix = Array(pipelineOperations[..<index])
+        let sourceLayout = activeLayout
+        let sourceBaseWavelengths = baseWavelengths
+        let channel = Int(currentChannel)
+
+        pipelinePreviewQueue.async { [weak self] in
+            guard let self else { return }
+            guard latestGeneration.value == generation else { return }
+            let startTime = Date()
+
+            let baseCube = self.cubeWithWavelengthsIfNeeded(
+                original,
+                layout: sourceLayout,
+                baseWavelengths: sourceBaseWavelengths
+            )
+            var key = PipelinePrefixKey.root(sourceID: original.id, wavelengths: baseCube.wavelengths)
+            for op in prefix {
+                key = key.appending(op)
+            }
+
+            let layout = operation.layout
+            let input: HyperCube
+            let remaining: [PipelineOperation]
+            if prefix.isEmpty {
+                input = baseCube
+                remaining = [operation]
+            } else if let cached = PipelinePrefixCache.shared.cube(for: key) {
+                input = cached
+                remaining = [operation]
+            } else {
+                input = baseCube
+                remaining = prefix + [operation]
+            }
+            let subsampleBands = remaining.allSatisfy(PipelinePreviewRenderer.isBandAgnostic)
+            guard let proxy = PipelinePreviewRenderer.makeProxy(
+                of: input,
+                layout: layout,
+                keepChannel: channel,
+                subsampleBands: subsampleBands
+            ) else { return }
+
+            let result = PipelinePreviewRenderer.apply(remaining, to: proxy)
+            var resultLayout = layout
+            if operation.type == .transpose, let target = operation.transposeParameters?.targetLayout {
+                resultLayout = target
+            }
+            let image = PipelinePreviewRenderer.render(result, layout: resultLayout, channel: channel, proxy: proxy)
+            let duration = Date().timeIntervalSince(startTime)
+
+            DispatchQueue.main.async { [weak self] in
+                guard let self, self.pipelinePreviewGeneration == generation else { return }
+                self.pipelinePreviewImage = image
+                self.pipelinePreviewDuration = duration
+            }
+        }
+    }
+
+    func cancelPipelinePreview() {
+        cancelPipelinePreviewSettle()
+        pipelinePreviewGeneration += 1
+        pipelinePreviewLatestGeneration.set(pipelinePreviewGeneration)
+        pipelinePreviewImage = nil
+        pipelinePreviewDuration = nil
+    }
+
+    private func cancelPipelinePreviewSettle() {
+        pipelinePreviewSettleWorkItem?.cancel()
+        pipelinePreviewSettleWorkItem = nil
+    }
+
     private func cubeWithWavelengthsIfNeeded(
         _ cube: HyperCube,
         layout: CubeLayout,
@@ -4250,14 +4686,17 @@ final class AppState: ObservableObject {
         }
     }
     
+    /// `sourceID` — идентификатор исходного куба для кэша префиксов; nil отключает кэш
     private func processPipeline(
         original: HyperCube,
+        sourceID: UUID? = nil,
         operations: inout [PipelineOperation],
         errorMessage: inout String?
     ) -> HyperCube? {
         if DispatchQueue.getSpecific(key: Self.processingQueueKey) == Self.processingQueueValue {
             return processPipelineOnCurrentThread(
                 original: original,
+                sourceID: sourceID,
                 operations: &operations,
                 errorMessage: &errorMessage
             )
@@ -4268,6 +4707,7 @@ final class AppState: ObservableObject {
         let result = processingQueue.sync {
             processPipelineOnCurrentThread(
                 original: original,
+                sourceID: sourceID,
                 operations: &mutableOperations,
                 errorMessage: &localErrorMessage
             )
@@ -4279,22 +4719,65 @@ final class AppState: ObservableObject {
 
     private func processPipelineOnCurrentThread(
         original: HyperCube,
+        sourceID: UUID? = nil,
         operations: inout [PipelineOperation],
         errorMessage: inout String?
     ) -> HyperCube? {
         guard !operations.isEmpty else { return original }
 
         var result: HyperCube = original
+        let cache = PipelinePrefixCache.shared
+        // prefixKeys[k] — ключ результата первых k операций
+        var prefixKeys: [PipelinePrefixKey] = []
+        if let sourceID {
+            prefixKeys.append(.root(sourceID: sourceID, wavelengths: original.wavelengths))
+            for operation in operations {
+                prefixKeys.append(prefixKeys[prefixKeys.count - 1].appending(operation))
+            }
+        }
+
+        // Продолжаем с самого длинного неизменённого префикса
+        var i = 0
+        if !prefixKeys.isEmpty {
+            for k in stride(from: operations.count, through: 1, by: -1) where cache.contains(prefixKeys[k]) {
+                if let cached = cache.cube(for: prefixKeys[k]) {
+                    result = cached
+                    i = k
+                    break
+                }
+            }
+        }
+        var segmentStart = Date()
 
-        for i in 0..<operations.count {
-            result = applyPipelineOperationWithUpdate(
-                &operations[i],
-                to: result,
-                errorMessage: &errorMessage
-            )
-            if errorMessage != nil {
-                break
+        while i < operations.count {
+            // Подряд идущие поэлементные операции исполняются одним слитым проходом
+            var end = i
+            while end < operations.count, operations[end].isPointwise {
+                end += 1
+            }
+            if end > i {
+                result = PipelinePointwiseExecutor.apply(Array(operations[i..<end]), to: result)
+            } else {
+                result = applyPipelineOperationWithUpdate(
+                    &operations[i],
+                    to: result,
+                    errorMessage: &errorMessage
+                )
+                if errorMessage != nil {
+                    break
+                }
+                end = i + 1
             }
+
+            if !prefixKeys.isEmpty {
+                // Операция могла обновить свои параметры (например, найденные гомографии)
+                for k in i..<end {
+                    prefixKeys[k + 1] = prefixKeys[k].appending(operations[k])
+                }
+                cache.store(result, for: prefixKeys[end], computeSeconds: Date().timeIntervalSince(segmentStart))
+                segmentStart = Date()
+            }
+            i = end
         }
 
         return result
@@ -5288,6 +5771,21 @@ final class AppState: ObservableObject {
         }
     }
     
+    func updateLibraryExportProgress(_ progress: LibraryBatchProgress) {
+        DispatchQueue.main.async {
+            guard self.libraryExportProgressState != nil else { return }
+            self.libraryExportProgressState = LibraryExportProgressState(
+                phase: .running,
+                completed: progress.completed,
+                total: progress.total,
+                message: L("Экспорт библиотеки…"),
+                cubesPerMinute: progress.cubesPerMinute,
+                gigabytesPerSecond: progress.gigabytesPerSecond,
+                activeNames: progress.activeNames
+            )
+        }
+    }
+    
     func finishLibraryExportProgress(success: Bool, total: Int, message: String) {
         DispatchQueue.main.async {
             self.libraryExportDismissWorkItem?.cancel()
@@ -5522,6 +6020,7 @@ final class AppState: ObservableObject {
         pcaPendingConfig = nil
         pcaRenderedImage = nil
         isPCAApplying = false
+        pcaMappingDuringApply = nil
         pcaProgressMessage = nil
         hasCustomColorSynthesisMapping = false
         lastPipelineAppliedOperations = []
@@ -6216,7 +6715,25 @@ final class AppState: ObservableObject {
     ) -> SpectrumMaskLayerSample? {
         guard let layer = maskEditorState.maskLayers.first(where: { $0.id == layerID }) else { return nil }
         guard let spectrumValues = buildMaskLayerSpectrumValues(layer: layer) else { return nil }
-        return SpectrumMaskLayerSample(
+        return makeMaskLayerSample(
+            layer: layer,
+            spectrumValues: spectrumValues,
+            classValue: classValue,
+            colorIndex: colorIndex,
+            id: id,
+            displayName: displayName
+        )
+    }
+
+    private func makeMaskLayerSample(
+        layer: MaskLayer,
+        spectrumValues: [Double],
+        classValue: UInt8,
+        colorIndex: Int,
+        id: UUID,
+        displayName: String?
+    ) -> SpectrumMaskLayerSample {
+        SpectrumMaskLayerSample(
             id: id,
             layerID: layer.id,
             classValue: classValue,
@@ -6253,7 +6770,8 @@ final class AppState: ObservableObject {
         aggregationMode: SpectrumROIAggregationMode,
         colorIndex: Int,
         id: UUID,
-        displayName: String?
+        displayName: String?,
+        integralIndex: SpectralIntegralIndex? = nil
     ) -> SpectrumROISample? {
         guard let normalizedRect = normalizedROIRect(rect, cube: cube, layout: layout) else {
             return nil
@@ -6262,7 +6780,8 @@ final class AppState: ObservableObject {
             rect: normalizedRect,
             cube: cube,
             layout: layout,
-            aggregationMode: aggregationMode
+            aggregationMode: aggregationMode,
+            integralIndex: integralIndex
         ) else {
             return nil
         }
@@ -6290,7 +6809,8 @@ final class AppState: ObservableObject {
         rect: SpectrumROIRect,
         cube: HyperCube,
         layout: CubeLayout,
-        aggregationMode: SpectrumROIAggregationMode
+        aggregationMode: SpectrumROIAggregationMode,
+        integralIndex: SpectralIntegralIndex? = nil
     ) -> [Double]? {
         guard rect.width > 0, rect.height > 0 else { return nil }
 
@@ -6306,104 +6826,115 @@ final class AppState: ObservableObject {
         let pixelCount = rect.area
         guard pixelCount > 0 else { return nil }
 
-        var aggregated: [Double] = []
-        aggregated.reserveCapacity(channels)
-
-        for ch in 0..<channels {
-            switch aggregationMode {
-            case .mean:
+        let strides = cube.axisStrides(axes: axes)
+        if aggregationMode == .mean {
+            if let integralIndex, integralIndex.matches(cube: cube, axes: axes) {
+                return integralIndex.meanSpectrum(minX: rect.minX, minY: rect.minY, width: rect.width, height: rect.height)
+            }
+            // Без индекса: строки канала собираются в буфер через быстрый доступ к хранилищу
+            let row = UnsafeMutablePointer<Double>.allocate(capacity: rect.width)
+            defer { row.deallocate() }
+            var aggregated = [Double](repeating: 0, count: channels)
+            for ch in 0..<channels {
                 var sum = 0.0
                 for y in rect.minY..<(rect.minY + rect.height) {
-                    for x in rect.minX..<(rect.minX + rect.width) {
-                        var indices = [0, 0, 0]
-                        indices[axes.channel] = ch
-                        indices[axes.height] = y
-                        indices[axes.width] = x
-                        sum += cube.getValue(i0: indices[0], i1: indices[1], i2: indices[2])
-                    }
-                }
-                aggregated.append(sum / Double(pixelCount))
-            case .median:
-                var buffer: [Double] = []
-                buffer.reserveCapacity(pixelCount)
-                for y in rect.minY..<(rect.minY + rect.height) {
-                    for x in rect.minX..<(rect.minX + rect.width) {
-                        var indices = [0, 0, 0]
-                        indices[axes.channel] = ch
-                        indices[axes.height] = y
-                        indices[axes.width] = x
-                        buffer.append(cube.getValue(i0: indices[0], i1: indices[1], i2: indices[2]))
+                    cube.storage.gather(
+                        base: strides.offset(channel: ch, x: rect.minX, y: y),
+                        stride: strides.widthStride,
+                        count: rect.width,
+                        into: row
+                    )
+                    for i in 0..<rect.width {
+                        sum += row[i]
                     }
                 }
-                let sorted = buffer.sorted()
-                let mid = sorted.count / 2
-                if sorted.count % 2 == 0 {
-                    aggregated.append((sorted[mid - 1] + sorted[mid]) / 2.0)
-                } else {
-                    aggregated.append(sorted[mid])
-                }
+                aggregated[ch] = sum / Double(pixelCount)
             }
+            return aggregated
         }
 
-        return aggregated
+        return SpectralQuantileAggregator.quantileSpectrum(
+            cube: cube,
+            strides: strides,
+            pixelOffsets: SpectralQuantileAggregator.pixelOffsets(
+                strides: strides,
+                minX: rect.minX,
+                minY: rect.minY,
+                width: rect.width,
+                height: rect.height
+            )
+        )
     }
 
     private func buildMaskLayerSpectrumValues(layer: MaskLayer) -> [Double]? {
-        guard let cube = cube else { return nil }
-        let dims = cube.dims
-        let dimsArray = [dims.0, dims.1, dims.2]
-        guard let axes = cube.axes(for: activeLayout) else { return nil }
+        buildMaskLayerSpectrumValues(layers: [layer])[0]
+    }
 
-        let width = dimsArray[axes.width]
-        let height = dimsArray[axes.height]
-        let channels = dimsArray[axes.channel]
-        guard width > 0, height > 0, channels > 0 else { return nil }
-        guard layer.width == width, layer.height == height else { return nil }
-        guard layer.data.count >= width * height else { return nil }
+    /// Спектры слоёв маски по их ID (повторы и отсутствующие слои пропускаются)
+    private func buildMaskLayerSpectra(layerIDs: [UUID]) -> [UUID: (layer: MaskLayer, values: [Double])] {
+        var layers: [MaskLayer] = []
+        var seen = Set<UUID>()
+        for layerID in layerIDs where seen.insert(layerID).inserted {
+            if let layer = maskEditorState.maskLayers.first(where: { $0.id == layerID }) {
+                layers.append(layer)
+            }
+        }
+        var spectra: [UUID: (layer: MaskLayer, values: [Double])] = [:]
+        for (layer, values) in zip(layers, buildMaskLayerSpectrumValues(layers: layers)) {
+            if let values {
+                spectra[layer.id] = (layer, values)
+            }
+        }
+        return spectra
+    }
+
+    /// Спектры нескольких слоёв; средние считаются одним проходом по кубу сразу для всех слоёв.
+    /// nil на месте слоя другой геометрии или без отмеченных пикселей.
+    private func buildMaskLayerSpectrumValues(layers: [MaskLayer]) -> [[Double]?] {
+        var results = [[Double]?](repeating: nil, count: layers.count)
+        guard let cube, let strides = cube.axisStrides(for: activeLayout) else { return results }
+        let width = strides.width
+        let height = strides.height
+        guard width > 0, height > 0, strides.channels > 0 else { return results }
 
-        let activeIndices = layer.data.enumerated().compactMap { index, value -> Int? in
-            value == 0 ? nil : index
+        let validIndices = layers.indices.filter { index in
+            let layer = layers[index]
+            return layer.width == width
+                && layer.height == height
+                && layer.data.count >= width * height
+                && layer.data.contains { $0 != 0 }
         }
-        guard !activeIndices.isEmpty else { return nil }
+        guard !validIndices.isEmpty else { return results }
 
-        var aggregated = [Double](repeating: 0, count: channels)
-        for ch in 0..<channels {
-            switch roiAggregationMode {
-            case .mean:
-                var sum = 0.0
-                for linearIndex in activeIndices {
-                    let y = linearIndex / width
-                    let x = linearIndex - y * width
-                    var indices = [0, 0, 0]
-                    indices[axes.channel] = ch
-                    indices[axes.height] = y
-                    indices[axes.width] = x
-                    sum += cube.getValue(i0: indices[0], i1: indices[1], i2: indices[2])
-                }
-                aggregated[ch] = sum / Double(activeIndices.count)
-            case .median:
-                var buffer: [Double] = []
-                buffer.reserveCapacity(activeIndices.count)
-                for linearIndex in activeIndices {
-                    let y = linearIndex / width
-                    let x = linearIndex - y * width
-                    var indices = [0, 0, 0]
-                    indices[axes.channel] = ch
-                    indices[axes.height] = y
-                    indices[axes.width] = x
-                    buffer.append(cube.getValue(i0: indices[0], i1: indices[1], i2: indices[2]))
-                }
-                let sorted = buffer.sorted()
-                let mid = sorted.count / 2
-                if sorted.count % 2 == 0 {
-                    aggregated[ch] = (sorted[mid - 1] + sorted[mid]) / 2.0
-                } else {
-                    aggregated[ch] = sorted[mid]
+        switch roiAggregationMode {
+        case .mean:
+            guard let statistics = SpectralClassAggregator.accumulate(
+                cube: cube,
+                strides: strides,
+                layers: validIndices.map { layers[$0].data }
+            ) else {
+                return results
+            }
+            for (classIndex, layerIndex) in validIndices.enumerated() {
+                results[layerIndex] = statistics.mean(ofClass: classIndex)
+            }
+        case .median:
+            for layerIndex in validIndices {
+                let data = layers[layerIndex].data
+                var pixelOffsets: [Int] = []
+                for y in 0..<height {
+                    for x in 0..<width where data[y * width + x] != 0 {
+                        pixelOffsets.append(strides.pixelOffset(x: x, y: y))
+                    }
                 }
+                results[layerIndex] = SpectralQuantileAggregator.quantileSpectrum(
+                    cube: cube,
+                    strides: strides,
+                    pixelOffsets: pixelOffsets
+                )
             }
         }
-
-        return aggregated
+        return results
     }
 
     private func nextSpectrumColorIndex(in descriptors: [SpectrumSampleDescriptor]) -> Int {
@@ -6512,17 +7043,19 @@ final class AppState: ObservableObject {
             return
         }
 
+        // Все слои образцов пересчитываются одним проходом по кубу
+        let spectra = buildMaskLayerSpectra(layerIDs: maskLayerSamples.map(\.layerID))
         var updated: [SpectrumMaskLayerSample] = []
         for sample in maskLayerSamples {
-            if let refreshed = makeMaskLayerSample(
-                layerID: sample.layerID,
+            guard let spectrum = spectra[sample.layerID] else { continue }
+            updated.append(makeMaskLayerSample(
+                layer: spectrum.layer,
+                spectrumValues: spectrum.values,
                 classValue: sample.classValue,
                 colorIndex: sample.colorIndex,
                 id: sample.id,
                 displayName: sample.displayName
-            ) {
-                updated.append(refreshed)
-            }
+            ))
         }
         maskLayerSamples = updated
         let maxIndex = updated.map(\.colorIndex).max() ?? -1
@@ -7393,18 +7926,19 @@ final class AppState: ObservableObject {
 
         var restored: [SpectrumMaskLayerSample] = []
         var nextColorIndex = 0
+        let spectra = buildMaskLayerSpectra(layerIDs: descriptors.map(\.layerID))
 
         for descriptor in descriptors {
-            if let sample = makeMaskLayerSample(
-                layerID: descriptor.layerID,
+            guard let spectrum = spectra[descriptor.layerID] else { continue }
+            restored.append(makeMaskLayerSample(
+                layer: spectrum.layer,
+                spectrumValues: spectrum.values,
                 classValue: descriptor.classValue,
                 colorIndex: descriptor.colorIndex,
                 id: descriptor.id,
                 displayName: descriptor.displayName
-            ) {
-                restored.append(sample)
-                nextColorIndex = max(nextColorIndex, descriptor.colorIndex + 1)
-            }
+            ))
+            nextColorIndex = max(nextColorIndex, descriptor.colorIndex + 1)
         }
 
         maskLayerSamples = restored
@@ -7477,6 +8011,11 @@ struct LibraryExportProgressState: Equatable {
     var completed: Int
     var total: Int
     var message: String?
+    /// Пропускная способность пакетной обработки; nil, пока не обработан ни один куб
+    var cubesPerMinute: Double? = nil
+    var gigabytesPerSecond: Double? = nil
+    /// Кубы, обрабатываемые в данный момент
+    var activeNames: [String] = []
     
     var progress: Double {
         guard total > 0 else { return 0 }
@@ -7587,7 +8126,7 @@ enum SpectrumColorPalette {
     ]
 }
 
-struct SpectrumROIRect: Equatable {
+struct SpectrumROIRect: Hashable {
     var minX: Int
     var minY: Int
     var width: Int
@@ -7611,6 +8150,35 @@ struct SpectrumROIRect: Equatable {
             height: upperY - lowerY + 1
         )
     }
+    
+    func intersection(_ other: SpectrumROIRect) -> SpectrumROIRect? {
+        let lowerX = max(minX, other.minX)
+        let lowerY = max(minY, other.minY)
+        let upperX = min(maxX, other.maxX)
+        let upperY = min(maxY, other.maxY)
+        guard upperX >= lowerX, upperY >= lowerY else { return nil }
+        return SpectrumROIRect(minX: lowerX, minY: lowerY, width: upperX - lowerX + 1, height: upperY - lowerY + 1)
+    }
+    
+    /// Разбивает `self \ other` на не более чем четыре непересекающихся прямоугольника
+    func subtracting(_ other: SpectrumROIRect) -> [SpectrumROIRect] {
+        guard area > 0 else { return [] }
+        guard let inner = intersection(other) else { return [self] }
+        var parts: [SpectrumROIRect] = []
+        if inner.minY > minY {
+            parts.append(SpectrumROIRect(minX: minX, minY: minY, width: width, height: inner.minY - minY))
+        }
+        if inner.maxY < maxY {
+            parts.append(SpectrumROIRect(minX: minX, minY: inner.maxY + 1, width: width, height: maxY - inner.maxY))
+        }
+        if inner.minX > minX {
+            parts.append(SpectrumROIRect(minX: minX, minY: inner.minY, width: inner.minX - minX, height: inner.height))
+        }
+        if inner.maxX < maxX {
+            parts.append(SpectrumROIRect(minX: inner.maxX + 1, minY: inner.minY, width: maxX - inner.maxX, height: inner.height))
+        }
+        return parts
+    }
 }
 
 struct SpectrumROISample: Identifiable, Equatable {
@@ -7759,6 +8327,13 @@ enum SpectrumROIAggregationMode: String, CaseIterable, Identifiable {
         }
     }
 }
+    private struct ROIIntegralIndexKey: Equatable {
+        let cubeID: UUID
+        let channel: Int
+        let height: Int
+        let width: Int
+    }
+
     private struct ROICursorSpectrumRequest {
         let rect: SpectrumROIRect
         let cube: HyperCube
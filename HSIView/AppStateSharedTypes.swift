@@ -169,11 +169,7 @@ enum CubeMetricsEngine {
             var sumSquaredDiff: Double = 0
             var minValue: Double = Double.infinity
             var maxValue: Double = -Double.infinity
-            var sumX: Double = 0
-            var sumY: Double = 0
-            var sumXX: Double = 0
-            var sumYY: Double = 0
-            var sumXY: Double = 0
+            var moments = ImageSimilarity.Moments()
             var samDot: Double = 0
             var samNormX: Double = 0
             var samNormY: Double = 0
@@ -185,11 +181,7 @@ enum CubeMetricsEngine {
         var minValue = Double.infinity
         var maxValue = -Double.infinity
 
-        var sumX = 0.0
-        var sumY = 0.0
-        var sumXX = 0.0
-        var sumYY = 0.0
-        var sumXY = 0.0
+        var moments = ImageSimilarity.Moments()
 
         var samSum = 0.0
         var samCount = 0
@@ -226,21 +218,13 @@ enum CubeMetricsEngine {
                     minValue = min(minValue, left, right)
                     maxValue = max(maxValue, left, right)
 
-                    sumX += left
-                    sumY += right
-                    sumXX += left * left
-                    sumYY += right * right
-                    sumXY += left * right
+                    moments.add(left, right)
 
                     channelStats[channel].count += 1
                     channelStats[channel].sumSquaredDiff += diff * diff
                     channelStats[channel].minValue = min(channelStats[channel].minValue, left, right)
                     channelStats[channel].maxValue = max(channelStats[channel].maxValue, left, right)
-                    channelStats[channel].sumX += left
-                    channelStats[channel].sumY += right
-                    channelStats[channel].sumXX += left * left
-                    channelStats[channel].sumYY += right * right
-                    channelStats[channel].sumXY += left * right
+                    channelStats[channel].moments.add(left, right)
                     channelStats[channel].samDot += left * right
                     channelStats[channel].samNormX += left * left
                     channelStats[channel].samNormY += right * right
@@ -288,12 +272,7 @@ enum CubeMetricsEngine {
             throw CubeMetricsComputationError.invalidSSIMConstant
         }
         let ssimGlobal = computeSSIM(
-            sumX: sumX,
-            sumY: sumY,
-            sumXX: sumXX,
-            sumYY: sumYY,
-            sumXY: sumXY,
-            count: validVoxelCount,
+            moments,
             dynamicRange: ssimRangeGlobal,
             k1: settings.ssimK1,
             k2: settings.ssimK2
@@ -367,12 +346,7 @@ enum CubeMetricsEngine {
                     settings: settings
                 )
                 let value = computeSSIM(
-                    sumX: stats.sumX,
-                    sumY: stats.sumY,
-                    sumXX: stats.sumXX,
-                    sumYY: stats.sumYY,
-                    sumXY: stats.sumXY,
-                    count: stats.count,
+                    stats.moments,
                     dynamicRange: range,
                     k1: settings.ssimK1,
                     k2: settings.ssimK2
@@ -485,31 +459,15 @@ enum CubeMetricsEngine {
     }
 
     private static func computeSSIM(
-        sumX: Double,
-        sumY: Double,
-        sumXX: Double,
-        sumYY: Double,
-        sumXY: Double,
-        count: Int,
+        _ moments: ImageSimilarity.Moments,
         dynamicRange: Double,
         k1: Double,
         k2: Double
     ) -> Double {
-        let n = Double(count)
-        let meanX = sumX / n
-        let meanY = sumY / n
-
-        let varianceX = max(0.0, (sumXX / n) - meanX * meanX)
-        let varianceY = max(0.0, (sumYY / n) - meanY * meanY)
-        let covariance = (sumXY / n) - meanX * meanY
-
         let c1 = pow(k1 * dynamicRange, 2)
         let c2 = pow(k2 * dynamicRange, 2)
-
-        let numerator = (2.0 * meanX * meanY + c1) * (2.0 * covariance + c2)
-        let denominator = (meanX * meanX + meanY * meanY + c1) * (varianceX + varianceY + c2)
-        guard denominator != 0 else { return 1.0 }
-        return numerator / denominator
+        // c1, c2 > 0, поэтому знаменатель положителен; 1.0 — для вырожденного случая, как и прежде
+        return ImageSimilarity.ssim(moments, c1: c1, c2: c2, epsilon: 0, degenerate: 1.0)
     }
 
     private static func meanIgnoringNaN(_ values: [Double]) -> Double? {
@@ -519,3 +477,34 @@ enum CubeMetricsEngine {
     }
 }
 
+
+/// Ближайшие к точке графика спектры библиотеки; `matches == nil`, пока строится индекс
+struct LibrarySpectrumMatchResult {
+    let sampleID: UUID
+    let metric: LibrarySpectrumIndex.Metric
+    let matches: [LibrarySpectrumIndex.Match]?
+}
+
+
+enum SpectralClassificationReferenceSource: String, CaseIterable, Identifiable {
+    case roiSamples
+    case library
+
+    var id: String { rawValue }
+
+    var localizedTitle: String {
+        switch self {
+        case .roiSamples:
+            return L("classification.source.roi_samples")
+        case .library:
+            return L("classification.source.library")
+        }
+    }
+}
+
+/// Классификация, ожидающая подтверждения замены уже нарисованной маски
+struct SpectralClassificationRequest: Identifiable {
+    let id = UUID()
+    let source: SpectralClassificationReferenceSource
+    let method: SpectralClassificationMethod
+}
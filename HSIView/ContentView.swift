@@ -495,6 +495,22 @@ struct ContentView: View {
             MatVariableSelectionView(request: request)
                 .environmentObject(state)
         }
+        .alert(
+            state.localized("classification.replace_mask.title"),
+            isPresented: Binding(
+                get: { state.pendingSpectralClassification != nil },
+                set: { if !$0 { state.pendingSpectralClassification = nil } }
+            )
+        ) {
+            Button(state.localized("classification.replace_mask.confirm"), role: .destructive) {
+                state.confirmSpectralClassification()
+            }
+            Button(state.localized("common.cancel"), role: .cancel) {
+                state.pendingSpectralClassification = nil
+            }
+        } message: {
+            Text(state.localized("classification.replace_mask.message"))
+        }
         .sheet(isPresented: $state.showExportView) {
             ExportView()
                 .environmentObject(state)
@@ -775,92 +791,93 @@ struct ContentView: View {
         state.beginLibraryExportProgress(total: entries.count)
         
         DispatchQueue.global(qos: .userInitiated).async {
-            var completed = 0
+            let scheduler = LibraryBatchScheduler()
+            let items = LibraryBatchScheduler.items(for: entries)
             var allSuccess = true
             
-            for entry in entries {
-                autoreleasepool {
-                    guard let payload = state.exportPayload(for: entry) else {
-                        allSuccess = false
-                        completed += 1
-                        state.updateLibraryExportProgress(completed: completed, total: entries.count)
-                        print(LF("content.export.log.skip_no_data", entry.displayName))
-                        return
-                    }
-                    
-                    let baseName = payload.baseName
-                    let wavelengthsToExport = includeWavelengths ? payload.wavelengths : nil
-                    let result: Result<Void, Error>
-                    
-                    switch format {
-                    case .npy:
-                        let target = destinationFolder.appendingPathComponent(baseName).appendingPathExtension("npy")
-                        result = NpyExporter.export(cube: payload.cube, to: target, wavelengths: wavelengthsToExport)
-                    case .mat:
-                        let target = destinationFolder.appendingPathComponent(baseName).appendingPathExtension("mat")
-                        let varName = (matVariableName?.isEmpty == false ? matVariableName! : "hypercube")
-                        result = MatExporter.export(
-                            cube: payload.cube,
-                            to: target,
-                            variableName: varName,
-                            wavelengths: wavelengthsToExport,
-                            wavelengthsAsVariable: matWavelengthsAsVariable && includeWavelengths
-                        )
-                    case .tiff:
-                        let target = destinationFolder.appendingPathComponent(baseName).appendingPathExtension("tiff")
-                        result = TiffExporter.export(
-                            cube: payload.cube,
-                            to: target,
-                            wavelengths: wavelengthsToExport,
-                            layout: payload.layout,
-                            enviCompatible: tiffEnviCompatible
-                        )
-                    case .enviDat, .enviRaw:
-                        let target = destinationFolder.appendingPathComponent(baseName).appendingPathExtension(
-                            format == .enviRaw ? "raw" : "dat"
-                        )
-                        var exportOptions = enviOptions ?? EnviExportOptions.default(
-                            binaryFileType: format == .enviRaw ? .raw : .dat,
-                            sourceDataType: payload.cube.originalDataType
-                        )
-                        exportOptions.binaryFileType = format == .enviRaw ? .raw : .dat
-                        result = EnviExporter.export(
+            scheduler.run(items, load: { item -> CubeExportPayload? in
+                guard let payload = state.exportPayload(for: item.entry) else {
+                    print(LF("content.export.log.skip_no_data", item.entry.displayName))
+                    return nil
+                }
+                return payload
+            }, process: { item, payload in
+                let entry = item.entry
+                let baseName = payload.baseName
+                let wavelengthsToExport = includeWavelengths ? payload.wavelengths : nil
+                let result: Result<Void, Error>
+            
+                switch format {
+                case .npy:
+                    let target = destinationFolder.appendingPathComponent(baseName).appendingPathExtension("npy")
+                    result = NpyExporter.export(cube: payload.cube, to: target, wavelengths: wavelengthsToExport)
+                case .mat:
+                    let target = destinationFolder.appendingPathComponent(baseName).appendingPathExtension("mat")
+                    let varName = (matVariableName?.isEmpty == false ? matVariableName! : "hypercube")
+                    result = MatExporter.export(
+                        cube: payload.cube,
+                        to: target,
+                        variableName: varName,
+                        wavelengths: wavelengthsToExport,
+                        wavelengthsAsVariable: matWavelengthsAsVariable && includeWavelengths
+                    )
+                case .tiff:
+                    let target = destinationFolder.appendingPathComponent(baseName).appendingPathExtension("tiff")
+                    result = TiffExporter.export(
+                        cube: payload.cube,
+                        to: target,
+                        wavelengths: wavelengthsToExport,
+                        layout: payload.layout,
+                        enviCompatible: tiffEnviCompatible
+                    )
+                case .enviDat, .enviRaw:
+                    let target = destinationFolder.appendingPathComponent(baseName).appendingPathExtension(
+                        format == .enviRaw ? "raw" : "dat"
+                    )
+                    var exportOptions = enviOptions ?? EnviExportOptions.default(
+                        binaryFileType: format == .enviRaw ? .raw : .dat,
+                        sourceDataType: payload.cube.originalDataType
+                    )
+                    exportOptions.binaryFileType = format == .enviRaw ? .raw : .dat
+                    result = EnviExporter.export(
+                        cube: payload.cube,
+                        to: target,
+                        wavelengths: wavelengthsToExport,
+                        layout: payload.layout,
+                        options: exportOptions,
+                        colorSynthesisConfig: payload.colorSynthesisConfig
+                    )
+                case .pngChannels:
+                    let target = destinationFolder.appendingPathComponent(baseName)
+                    result = PngChannelsExporter.export(cube: payload.cube, to: target, wavelengths: wavelengthsToExport, layout: payload.layout)
+                case .quickPNG:
+                        let target = destinationFolder.appendingPathComponent(baseName).appendingPathExtension("png")
+                    let config = colorSynthesisConfig ?? payload.colorSynthesisConfig
+                        result = QuickPNGExporter.export(
                             cube: payload.cube,
                             to: target,
-                            wavelengths: wavelengthsToExport,
                             layout: payload.layout,
-                            options: exportOptions,
-                            colorSynthesisConfig: payload.colorSynthesisConfig
+                            wavelengths: payload.wavelengths,
+                        config: config
                         )
-                    case .pngChannels:
-                        let target = destinationFolder.appendingPathComponent(baseName)
-                        result = PngChannelsExporter.export(cube: payload.cube, to: target, wavelengths: wavelengthsToExport, layout: payload.layout)
-                    case .quickPNG:
-                            let target = destinationFolder.appendingPathComponent(baseName).appendingPathExtension("png")
-                        let config = colorSynthesisConfig ?? payload.colorSynthesisConfig
-                            result = QuickPNGExporter.export(
-                                cube: payload.cube,
-                                to: target,
-                                layout: payload.layout,
-                                wavelengths: payload.wavelengths,
-                            config: config
-                            )
-                    case .maskPNG, .maskNpy, .maskMat:
-                        result = .success(())
-                    }
-                    
-                    switch result {
-                    case .success:
-                        print(LF("content.export.log.exported", entry.displayName))
-                    case .failure(let error):
-                        print(LF("content.export.log.error", entry.displayName, error.localizedDescription))
-                        allSuccess = false
-                    }
-                    
-                    completed += 1
-                    state.updateLibraryExportProgress(completed: completed, total: entries.count)
+                case .maskPNG, .maskNpy, .maskMat:
+                    result = .success(())
                 }
-            }
+            
+                switch result {
+                case .success:
+                    print(LF("content.export.log.exported", entry.displayName))
+                    return true
+                case .failure(let error):
+                    print(LF("content.export.log.error", entry.displayName, error.localizedDescription))
+                    return false
+                }
+            }, progress: { progress in
+                if progress.failed > 0 {
+                    allSuccess = false
+                }
+                state.updateLibraryExportProgress(progress)
+            })
             
             let message = allSuccess
                 ? "Экспорт библиотеки завершён"
@@ -1864,8 +1881,8 @@ struct ContentView: View {
     @ViewBuilder
     private func pcaColorControls(cube: HyperCube) -> some View {
         let config = state.pcaPendingConfig ?? state.colorSynthesisConfig.pcaConfig
-        let maxComponents = max(1, min(state.channelCount, 3))
-        let componentOptions = Array(0..<maxComponents) // рассчитываем первые 3 компоненты
+        let maxComponents = max(1, min(state.channelCount, config.componentCount))
+        let componentOptions = Array(0..<maxComponents)
         
         VStack(alignment: .leading, spacing: 10) {
             HStack(spacing: 12) {
@@ -1896,6 +1913,7 @@ struct ContentView: View {
                                 $0.basis = nil
                                 $0.clipUpper = nil
                                 $0.explainedVariance = nil
+                                $0.totalVariance = nil
                             }
                         })) {
                         ForEach(PCAPreprocess.allCases) { mode in
@@ -1911,17 +1929,40 @@ struct ContentView: View {
                         .font(.system(size: 10, weight: .medium))
                     HStack(spacing: 8) {
                         pcaComponentPicker(label: "R", value: config.mapping.red, options: componentOptions) { newVal in
-                            state.updatePCAConfig { $0.mapping.red = newVal }
+                            state.updatePCAMapping { $0.red = newVal }
                         }
                         pcaComponentPicker(label: "G", value: config.mapping.green, options: componentOptions) { newVal in
-                            state.updatePCAConfig { $0.mapping.green = newVal }
+                            state.updatePCAMapping { $0.green = newVal }
                         }
                         pcaComponentPicker(label: "B", value: config.mapping.blue, options: componentOptions) { newVal in
-                            state.updatePCAConfig { $0.mapping.blue = newVal }
+                            state.updatePCAMapping { $0.blue = newVal }
                         }
                     }
                 }
                 
+                VStack(alignment: .leading, spacing: 4) {
+                    Text(state.localized("Компоненты"))
+                        .font(.system(size: 10, weight: .medium))
+                    Stepper(
+                        value: Binding(
+                            get: { config.componentCount },
+                            set: { newValue in
+                                state.updatePCAConfig {
+                                    $0.componentCount = newValue
+                                    $0.basis = nil
+                                    $0.explainedVariance = nil
+                                    $0.totalVariance = nil
+                                }
+                            }
+                        ),
+                        in: PCAVisualizationConfig.componentCountRange
+                    ) {
+                        Text("\(config.componentCount)")
+                            .font(.system(size: 10, design: .monospaced))
+                    }
+                    .frame(width: 80, alignment: .leading)
+                }
+                
                 Toggle("Lock basis", isOn: Binding(
                     get: { config.lockBasis },
                     set: { newValue in
@@ -1931,6 +1972,22 @@ struct ContentView: View {
                 .font(.system(size: 10))
                 .toggleStyle(.switch)
                 .frame(width: 140, alignment: .leading)
+                
+                Toggle(state.localized("Все пиксели"), isOn: Binding(
+                    get: { config.fullCoverage || config.computeScope == .roi },
+                    set: { newValue in
+                        state.updatePCAConfig {
+                            $0.fullCoverage = newValue
+                            $0.basis = nil
+                            $0.clipUpper = nil
+                        }
+                    })
+                )
+                .font(.system(size: 10))
+                .toggleStyle(.switch)
+                .frame(width: 140, alignment: .leading)
+                .disabled(config.computeScope == .roi)
+                .help(state.localized("Статистики PCA по всем пикселям за один проход вместо подвыборки"))
             }
             
             if config.computeScope == .roi {
@@ -1980,7 +2037,7 @@ struct ContentView: View {
             }
             
             if let ev = config.explainedVariance, !ev.isEmpty {
-                let total = ev.reduce(0, +)
+                let total = config.totalVariance ?? ev.reduce(0, +)
                 HStack(alignment: .bottom, spacing: 10) {
                     ForEach(Array(ev.enumerated()), id: \.0) { item in
                         let value = total > 0 ? item.element / total : 0
@@ -2020,7 +2077,7 @@ struct ContentView: View {
                         .progressViewStyle(.linear)
                         .frame(width: 160)
                 } else if state.pcaRenderedImage == nil {
-                    Text(state.localized("Настройте параметры и нажмите «Применить»"))
+                    Text(state.localized(state.pcaProgressMessage ?? "Настройте параметры и нажмите «Применить»"))
                         .font(.system(size: 9))
                         .foregroundColor(.secondary)
                 }
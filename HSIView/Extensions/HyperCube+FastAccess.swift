@@ -0,0 +1,115 @@
+import Foundation
+
+/// Размеры и шаги (в элементах) по осям канала, высоты и ширины для выбранного layout.
+/// Позволяет адресовать элементы без пересчёта `linearIndex` и временных массивов индексов.
+struct CubeAxisStrides {
+    let channels: Int
+    let height: Int
+    let width: Int
+    let channelStride: Int
+    let heightStride: Int
+    let widthStride: Int
+
+    var pixelCount: Int { height * width }
+
+    @inline(__always)
+    func pixelOffset(x: Int, y: Int) -> Int {
+        y * heightStride + x * widthStride
+    }
+
+    @inline(__always)
+    func offset(channel: Int, x: Int, y: Int) -> Int {
+        channel * channelStride + y * heightStride + x * widthStride
+    }
+}
+
+extension HyperCube {
+    /// Шаги в элементах для осей (0, 1, 2) с учётом порядка хранения
+    var elementStrides: (Int, Int, Int) {
+        let (d0, d1, d2) = dims
+        if isFortranOrder {
+            return (1, d0, d0 * d1)
+        }
+        return (d1 * d2, d2, 1)
+    }
+
+    func axisStrides(for layout: CubeLayout) -> CubeAxisStrides? {
+        guard let axes = axes(for: layout) else { return nil }
+        return axisStrides(axes: axes)
+    }
+
+    func axisStrides(axes: (channel: Int, height: Int, width: Int)) -> CubeAxisStrides {
+        let dimsArr = [dims.0, dims.1, dims.2]
+        let s = elementStrides
+        let stridesArr = [s.0, s.1, s.2]
+        return CubeAxisStrides(
+            channels: dimsArr[axes.channel],
+            height: dimsArr[axes.height],
+            width: dimsArr[axes.width],
+            channelStride: stridesArr[axes.channel],
+            heightStride: stridesArr[axes.height],
+            widthStride: stridesArr[axes.width]
+        )
+    }
+}
+
+extension DataStorage {
+    /// Копирует `count` значений, начиная с `base` с шагом `stride`, в `destination` как Double
+    func gather(base: Int, stride: Int, count: Int, into destination: UnsafeMutablePointer<Double>) {
+        switch self {
+        case .float64(let arr):
+            DataStorage.copyStrided(arr, base: base, stride: stride, count: count, into: destination) { $0 }
+        case .float32(let arr):
+            DataStorage.copyStrided(arr, base: base, stride: stride, count: count, into: destination) { Double($0) }
+        case .int8(let arr):
+            DataStorage.copyStrided(arr, base: base, stride: stride, count: count, into: destination) { Double($0) }
+        case .int16(let arr):
+            DataStorage.copyStrided(arr, base: base, stride: stride, count: count, into: destination) { Double($0) }
+        case .int32(let arr):
+            DataStorage.copyStrided(arr, base: base, stride: stride, count: count, into: destination) { Double($0) }
+        case .uint8(let arr):
+            DataStorage.copyStrided(arr, base: base, stride: stride, count: count, into: destination) { Double($0) }
+        case .uint16(let arr):
+            DataStorage.copyStrided(arr, base: base, stride: stride, count: count, into: destination) { Double($0) }
+        }
+    }
+
+    /// Копирует `count` значений, начиная с `base` с шагом `stride`, в `destination` как Float
+    func gather(base: Int, stride: Int, count: Int, into destination: UnsafeMutablePointer<Float>) {
+        switch self {
+        case .float64(let arr):
+            DataStorage.copyStrided(arr, base: base, stride: stride, count: count, into: destination) { Float($0) }
+        case .float32(let arr):
+            DataStorage.copyStrided(arr, base: base, stride: stride, count: count, into: destination) { $0 }
+        case .int8(let arr):
+            DataStorage.copyStrided(arr, base: base, stride: stride, count: count, into: destination) { Float($0) }
+        case .int16(let arr):
+            DataStorage.copyStrided(arr, base: base, stride: stride, count: count, into: destination) { Float($0) }
+        case .int32(let arr):
+            DataStorage.copyStrided(arr, base: base, stride: stride, count: count, into: destination) { Float($0) }
+        case .uint8(let arr):
+            DataStorage.copyStrided(arr, base: base, stride: stride, count: count, into: destination) { Float($0) }
+        case .uint16(let arr):
+            DataStorage.copyStrided(arr, base: base, stride: stride, count: count, into: destination) { Float($0) }
+        }
+    }
+
+    @inline(__always)
+    private static func copyStrided<S, D>(
+        _ source: [S],
+        base: Int,
+        stride: Int,
+        count: Int,
+        into destination: UnsafeMutablePointer<D>,
+        convert: (S) -> D
+    ) {
+        source.withUnsafeBufferPointer { src in
+            guard let ptr = src.baseAddress else { return }
+            var index = base
+            for k in 0..<count {
+                destination[k] = convert(ptr[index])
+                index += stride
+            }
+        }
+    }
+}
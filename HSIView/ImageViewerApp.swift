@@ -109,6 +109,25 @@ struct HSIViewApp: App {
                 }
                 .disabled(appState.cube == nil || appState.isBusy)
 
+                Menu(appState.localized("menu.classify_spectra")) {
+                    ForEach(SpectralClassificationReferenceSource.allCases) { source in
+                        Button(appState.localized("menu.classify_spectra.sam") + " — " + source.localizedTitle) {
+                            appState.classifyCubeSpectra(source: source, method: .spectralAngle)
+                        }
+                        Button(appState.localized("menu.classify_spectra.centroid") + " — " + source.localizedTitle) {
+                            appState.classifyCubeSpectra(source: source, method: .nearestCentroid)
+                        }
+                    }
+                    Divider()
+                    Picker(appState.localized("menu.classify_spectra.max_angle"), selection: $appState.classificationMaxAngleDegrees) {
+                        Text(appState.localized("menu.classify_spectra.max_angle.none")).tag(0.0)
+                        ForEach([5.0, 10.0, 15.0, 20.0, 30.0], id: \.self) { degrees in
+                            Text(String(format: "%.0f°", degrees)).tag(degrees)
+                        }
+                    }
+                }
+                .disabled(appState.cube == nil || appState.isBusy)
+
                 Divider()
 
                 Button(appState.localized("menu.assemble_hsi")) {
@@ -78,15 +78,23 @@ struct PCAVisualizationConfig: Equatable {
     var lockBasis: Bool
     var clipTopPercent: Double
     var selectedROI: UUID?
+    /// Сколько старших компонент вычислять (не меньше трёх для RGB-маппинга)
+    var componentCount: Int
+    /// Считать статистики по всем пикселям (потоково), а не по подвыборке
+    var fullCoverage: Bool
     
     // Кэш вычисленной базы
     var basis: [[Double]]?  // каждая компонента размера C
     var mean: [Double]?
     var std: [Double]?
     var explainedVariance: [Double]?
+    /// След ковариации — знаменатель для доли объяснённой дисперсии
+    var totalVariance: Double?
     var sourceCubeID: UUID?
     var clipUpper: [Double]?
     
+    static let componentCountRange = 3...16
+    
     static func `default`() -> PCAVisualizationConfig {
         PCAVisualizationConfig(
             computeScope: .fullImage,
@@ -95,10 +103,13 @@ struct PCAVisualizationConfig: Equatable {
             lockBasis: false,
             clipTopPercent: 0.5,
             selectedROI: nil,
+            componentCount: 3,
+            fullCoverage: false,
             basis: nil,
             mean: nil,
             std: nil,
             explainedVariance: nil,
+            totalVariance: nil,
             sourceCubeID: nil,
             clipUpper: nil
         )
@@ -54,7 +54,7 @@ enum NormalizationComputationPrecision: String, CaseIterable, Identifiable {
     var id: String { rawValue }
 }
 
-struct CubeNormalizationParameters {
+struct CubeNormalizationParameters: Equatable {
     var minValue: Double = 0.0
     var maxValue: Double = 1.0
     var lowerPercentile: Double = 2.0
@@ -462,8 +462,11 @@ class CubeNormalizer {
     }
     
     private static func shouldPreserveType(cube: HyperCube, normalizedData: [Double], targetMin: Double, targetMax: Double) -> DataType? {
-        let originalType = cube.originalDataType
-        
+        preservedDataType(for: cube.originalDataType, targetMin: targetMin, targetMax: targetMax)
+    }
+    
+    /// Тип хранения, который можно сохранить при линейном отображении в [targetMin, targetMax]
+    static func preservedDataType(for originalType: DataType, targetMin: Double, targetMax: Double) -> DataType? {
         switch originalType {
         case .uint8:
             if targetMin >= 0 && targetMax <= 255 {
@@ -66,7 +66,11 @@ struct CachedMaskLayerSample: Identifiable, Equatable {
 }
 
 class LibrarySpectrumCache: ObservableObject {
-    @Published var entries: [String: LibrarySpectrumEntry] = [:]
+    @Published var entries: [String: LibrarySpectrumEntry] = [:] {
+        didSet { revision &+= 1 }
+    }
+    /// Растёт при каждом изменении `entries`; по нему перестраиваются производные индексы
+    private(set) var revision: UInt64 = 0
     @Published var visibleEntries: Set<String> = []
     
     func updateEntry(
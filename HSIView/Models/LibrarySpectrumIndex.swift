@@ -0,0 +1,360 @@
+import Foundation
+import Accelerate
+
+/// Поиск спектров библиотеки, ближайших к заданному спектру (SAM / SID).
+/// Все образцы кэша приводятся к общей сетке длин волн и хранятся непрерывными матрицами
+/// «образец × канал»: единичные векторы (Float) для спектрального угла и нормированные
+/// распределения с логарифмами (Float64) для SID. Угол ко всей библиотеке — одно
+/// матрично-векторное произведение; в больших библиотеках он сначала оценивается
+/// в PCA-подпространстве единичных векторов, а точно пересчитывается для короткого списка
+/// и для всех образцов, у которых верхняя граница косинуса (проекция + ‖остаток образца‖·‖остаток запроса‖)
+/// не ниже k-го точного косинуса, поэтому результат совпадает с полным перебором.
+/// SID считается по неотрицательным слагаемым (p − q)·(log p − log q) в Float64.
+/// После построения объект только читается.
+final class LibrarySpectrumIndex {
+    enum Metric {
+        /// Спектральный угол в радианах
+        case spectralAngle
+        /// Симметричная дивергенция Кульбака — Лейблера нормированных спектров
+        case spectralInformationDivergence
+    }
+
+    enum SampleKind {
+        case point
+        case roi
+        case maskLayer
+    }
+
+    struct Reference {
+        let id: UUID
+        let libraryID: String
+        let kind: SampleKind
+        let name: String
+        let colorIndex: Int
+    }
+
+    struct Match {
+        let reference: Reference
+        /// Меньше — ближе (угол или дивергенция)
+        let score: Double
+    }
+
+    /// С этого числа образцов угол сначала оценивается в PCA-подпространстве
+    static let reducedIndexMinCount = 2_048
+    static let reducedDimension = 24
+    /// Размер короткого списка для точного пересчёта: max(k × factor, minimum)
+    static let shortlistFactor = 8
+    static let shortlistMinimum = 64
+    /// Запас границы косинуса на округление Float
+    private static let cosineBoundSlack: Float = 1e-4
+    private static let probabilityFloor = 1e-12
+
+    let wavelengths: [Double]
+    let references: [Reference]
+    var channels: Int { wavelengths.count }
+    /// Размерность PCA-подпространства; 0 — поиск всегда полный
+    let reducedDimension: Int
+
+    /// Образец × канал
+    private let unitVectors: [Float]
+    /// Спектры образцов на сетке индекса (Float64), образец × канал
+    private let spectra: [Double]
+    private let probabilities: [Double]
+    private let logProbabilities: [Double]
+    /// Компоненты × канал и образец × компонента
+    private let basis: [Float]
+    private let reducedVectors: [Float]
+    /// ‖r − P r‖ каждого образца: часть единичного вектора вне подпространства
+    private let residualNorms: [Float]
+
+    /// Образцы без длин волн принимаются, только если число каналов совпадает с сеткой;
+    /// образцы, диапазон которых не пересекается с сеткой, и нулевые/нечисловые спектры пропускаются.
+    init(entries: [LibrarySpectrumEntry], wavelengths: [Double]) {
+        let channels = wavelengths.count
+        var references: [Reference] = []
+        var unitVectors: [Float] = []
+        var spectra: [Double] = []
+        var probabilities: [Double] = []
+        var logProbabilities: [Double] = []
+        var resamplers: [[Double]: SpectralResamplingMatrix] = [:]
+
+        func append(_ reference: Reference, values: [Double], sourceWavelengths: [Double]?) {
+            guard let spectrum = Self.resample(values, from: sourceWavelengths, to: wavelengths, cache: &resamplers),
+                  let unit = Self.unitVector(spectrum),
+                  let distribution = Self.distribution(spectrum) else {
+                return
+            }
+            references.append(reference)
+            unitVectors.append(contentsOf: unit)
+            spectra.append(contentsOf: spectrum)
+            probabilities.append(contentsOf: distribution.probabilities)
+            logProbabilities.append(contentsOf: distribution.logarithms)
+        }
+
+        for entry in entries.sorted(by: { $0.libraryID < $1.libraryID }) where channels > 0 {
+            for sample in entry.spectrumSamples {
+                let reference = Reference(id: sample.id, libraryID: entry.libraryID, kind: .point, name: sample.effectiveName, colorIndex: sample.colorIndex)
+                append(reference, values: sample.values, sourceWavelengths: sample.wavelengths)
+            }
+            for sample in entry.roiSamples {
+                let reference = Reference(id: sample.id, libraryID: entry.libraryID, kind: .roi, name: sample.effectiveName, colorIndex: sample.colorIndex)
+                append(reference, values: sample.values, sourceWavelengths: sample.wavelengths)
+            }
+            for sample in entry.maskLayerSamples {
+                let reference = Reference(id: sample.id, libraryID: entry.libraryID, kind: .maskLayer, name: sample.effectiveName, colorIndex: sample.colorIndex)
+                append(reference, values: sample.values, sourceWavelengths: sample.wavelengths)
+            }
+        }
+
+        let reduced = Self.reducedSubspace(unitVectors: unitVectors, count: references.count, channels: channels)
+        self.wavelengths = wavelengths
+        self.references = references
+        self.unitVectors = unitVectors
+        self.spectra = spectra
+        self.probabilities = probabilities
+        self.logProbabilities = logProbabilities
+        self.basis = reduced?.basis ?? []
+        self.reducedVectors = reduced?.vectors ?? []
+        self.reducedDimension = reduced?.dimension ?? 0
+        self.residualNorms = reduced.map { Self.outOfSubspaceNorms($0.vectors, dimension: $0.dimension) } ?? []
+    }
+
+    /// `count` ближайших образцов по возрастанию оценки. `queryWavelengths` == nil означает,
+    /// что спектр уже задан на сетке индекса.
+    func topMatches(
+        for values: [Double],
+        wavelengths queryWavelengths: [Double]? = nil,
+        count k: Int,
+        metric: Metric = .spectralAngle
+    ) -> [Match] {
+        guard k > 0, !references.isEmpty else { return [] }
+        var resamplers: [[Double]: SpectralResamplingMatrix] = [:]
+        guard let spectrum = Self.resample(values, from: queryWavelengths, to: wavelengths, cache: &resamplers) else {
+            return []
+        }
+
+        let best: [(index: Int, score: Double)]
+        switch metric {
+        case .spectralAngle:
+            guard let query = Self.unitVector(spectrum) else { return [] }
+            best = angleMatches(query: query, count: k)
+        case .spectralInformationDivergence:
+            guard let query = Self.distribution(spectrum) else { return [] }
+            best = divergenceMatches(query: query, count: k)
+        }
+        return best.map { Match(reference: references[$0.index], score: $0.score) }
+    }
+
+    /// Спектр образца, приведённый к сетке индекса
+    func spectrum(at index: Int) -> [Double] {
+        guard index >= 0, index < references.count else { return [] }
+        return Array(spectra[(index * channels)..<((index + 1) * channels)])
+    }
+
+    // MARK: - Оценка
+
+    private func angleMatches(query: [Float], count k: Int) -> [(index: Int, score: Double)] {
+        let n = references.count
+        guard reducedDimension > 0 else {
+            var cosines = [Float](repeating: 0, count: n)
+            cblas_sgemv(CblasRowMajor, CblasNoTrans, Int32(n), Int32(channels),
+                        1, unitVectors, Int32(channels), query, 1, 0, &cosines, 1)
+            return Self.smallest(k, of: n) { acos(Double(max(-1, min(1, cosines[$0])))) }
+        }
+
+        // Косинусы в подпространстве → короткий список для точного пересчёта
+        var projected = [Float](repeating: 0, count: reducedDimension)
+        cblas_sgemv(CblasRowMajor, CblasNoTrans, Int32(reducedDimension), Int32(channels),
+                    1, basis, Int32(channels), query, 1, 0, &projected, 1)
+        var approximate = [Float](repeating: 0, count: n)
+        cblas_sgemv(CblasRowMajor, CblasNoTrans, Int32(n), Int32(reducedDimension),
+                    1, reducedVectors, Int32(reducedDimension), projected, 1, 0, &approximate, 1)
+        let shortlist = max(k * Self.shortlistFactor, Self.shortlistMinimum)
+        var candidates = Self.smallest(shortlist, of: n) { -Double(approximate[$0]) }.map(\.index)
+        var cosines = exactCosines(query: query, candidates: candidates)
+
+        // r·q ≤ (P r)·(P q) + ‖r − P r‖·‖q − P q‖: образцы, чья граница не ниже k-го
+        // точного косинуса, могут попасть в ответ и тоже пересчитываются точно
+        let kth = min(k, cosines.count) - 1
+        if kth >= 0, candidates.count < n {
+            let threshold = cosines.sorted(by: >)[kth]
+            let queryResidual = (max(0, 1 - projected.reduce(0) { $0 + $1 * $1 })).squareRoot()
+            var shortlisted = [Bool](repeating: false, count: n)
+            for index in candidates { shortlisted[index] = true }
+            let extra = (0..<n).filter { index in
+                !shortlisted[index]
+                    && approximate[index] + residualNorms[index] * queryResidual + Self.cosineBoundSlack >= threshold
+            }
+            if !extra.isEmpty {
+                candidates += extra
+                cosines += exactCosines(query: query, candidates: extra)
+            }
+        }
+        return Self.smallest(k, of: candidates.count) { slot in
+            acos(Double(max(-1, min(1, cosines[slot]))))
+        }.map { (index: candidates[$0.index], score: $0.score) }
+    }
+
+    private func exactCosines(query: [Float], candidates: [Int]) -> [Float] {
+        var cosines = [Float](repeating: 0, count: candidates.count)
+        unitVectors.withUnsafeBufferPointer { matrix in
+            for (slot, index) in candidates.enumerated() {
+                vDSP_dotpr(matrix.baseAddress! + index * channels, 1, query, 1, &cosines[slot], vDSP_Length(channels))
+            }
+        }
+        return cosines
+    }
+
+    /// SID(p, q) = Σ (p − q)·(log p − log q). Слагаемые неотрицательны, поэтому сумма в Float64
+    /// не теряет точность на близких спектрах, в отличие от разности Σ p·log p + Σ q·log q − перекрёстные.
+    private func divergenceMatches(query: Distribution, count k: Int) -> [(index: Int, score: Double)] {
+        let n = references.count
+        var divergences = [Double](repeating: 0, count: n)
+        probabilities.withUnsafeBufferPointer { probabilityMatrix in
+            logProbabilities.withUnsafeBufferPointer { logMatrix in
+                divergences.withUnsafeMutableBufferPointer { out in
+                    ParallelCompute.forEachChunk(count: n, minChunk: max(1, 16_384 / max(1, channels))) { _, range in
+                        let probabilityDelta = UnsafeMutablePointer<Double>.allocate(capacity: channels)
+                        let logDelta = UnsafeMutablePointer<Double>.allocate(capacity: channels)
+                        defer {
+                            probabilityDelta.deallocate()
+                            logDelta.deallocate()
+                        }
+                        let length = vDSP_Length(channels)
+                        for index in range {
+                            let offset = index * channels
+                            vDSP_vsubD(query.probabilities, 1, probabilityMatrix.baseAddress! + offset, 1, probabilityDelta, 1, length)
+                            vDSP_vsubD(query.logarithms, 1, logMatrix.baseAddress! + offset, 1, logDelta, 1, length)
+                            vDSP_dotprD(probabilityDelta, 1, logDelta, 1, &out[index], length)
+                        }
+                    }
+                }
+            }
+        }
+        return Self.smallest(k, of: n) { max(0, divergences[$0]) }
+    }
+
+    // MARK: - Подготовка спектров
+
+    private struct Distribution {
+        let probabilities: [Double]
+        let logarithms: [Double]
+    }
+
+    private static func resample(
+        _ values: [Double],
+        from source: [Double]?,
+        to target: [Double],
+        cache: inout [[Double]: SpectralResamplingMatrix]
+    ) -> [Double]? {
+        guard let source else {
+            return values.count == target.count ? values : nil
+        }
+        guard source.count == values.count, !source.isEmpty, let targetFirst = target.first, let targetLast = target.last else {
+            return nil
+        }
+        if source == target {
+            return values
+        }
+        let sourceMin = source.min()!
+        let sourceMax = source.max()!
+        guard sourceMax >= min(targetFirst, targetLast), sourceMin <= max(targetFirst, targetLast) else {
+            return nil
+        }
+        let matrix: SpectralResamplingMatrix
+        if let cached = cache[source] {
+            matrix = cached
+        } else {
+            matrix = SpectralResamplingMatrix(
+                sourceWavelengths: source,
+                targetWavelengths: target,
+                method: .linear,
+                extrapolation: .clamp
+            )
+            cache[source] = matrix
+        }
+        return matrix.apply(to: values)
+    }
+
+    private static func unitVector(_ spectrum: [Double]) -> [Float]? {
+        guard spectrum.allSatisfy({ $0.isFinite }) else { return nil }
+        let norm = sqrt(spectrum.reduce(0) { $0 + $1 * $1 })
+        guard norm > 0 else { return nil }
+        return spectrum.map { Float($0 / norm) }
+    }
+
+    /// Отрицательные значения обнуляются, вероятности ограничены снизу для конечного логарифма
+    private static func distribution(_ spectrum: [Double]) -> Distribution? {
+        guard spectrum.allSatisfy({ $0.isFinite }) else { return nil }
+        let total = spectrum.reduce(0) { $0 + max(0, $1) }
+        guard total > 0 else { return nil }
+        let probabilities = spectrum.map { max(max(0, $0) / total, probabilityFloor) }
+        return Distribution(probabilities: probabilities, logarithms: probabilities.map { log($0) })
+    }
+
+    /// Главные направления единичных векторов (без центрирования: сохраняются скалярные произведения)
+    private static func reducedSubspace(
+        unitVectors: [Float],
+        count n: Int,
+        channels: Int
+    ) -> (basis: [Float], vectors: [Float], dimension: Int)? {
+        let dimension = min(reducedDimension, channels)
+        guard n >= reducedIndexMinCount, channels > reducedDimension else { return nil }
+
+        var gram = [Float](repeating: 0, count: channels * channels)
+        cblas_sgemm(CblasRowMajor, CblasTrans, CblasNoTrans,
+                    Int32(channels), Int32(channels), Int32(n),
+                    1, unitVectors, Int32(channels), unitVectors, Int32(channels),
+                    0, &gram, Int32(channels))
+        guard let decomposition = try? SymmetricEigenSolver.topEigenpairs(
+            matrix: gram.map(Double.init),
+            dimension: channels,
+            count: dimension
+        ) else {
+            return nil
+        }
+        let basis = decomposition.vectors.flatMap { $0.map(Float.init) }
+        let found = decomposition.vectors.count
+
+        var vectors = [Float](repeating: 0, count: n * found)
+        cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans,
+                    Int32(n), Int32(found), Int32(channels),
+                    1, unitVectors, Int32(channels), basis, Int32(channels),
+                    0, &vectors, Int32(found))
+        return (basis, vectors, found)
+    }
+
+    private static func outOfSubspaceNorms(_ vectors: [Float], dimension: Int) -> [Float] {
+        let n = vectors.count / max(1, dimension)
+        return (0..<n).map { index in
+            var projectedSquared: Float = 0
+            for component in 0..<dimension {
+                let value = vectors[index * dimension + component]
+                projectedSquared += value * value
+            }
+            return max(0, 1 - projectedSquared).squareRoot()
+        }
+    }
+
+    /// `k` индексов из `0..<count` с наименьшей оценкой, по возрастанию (при равенстве — меньший индекс)
+    private static func smallest(_ k: Int, of count: Int, score: (Int) -> Double) -> [(index: Int, score: Double)] {
+        let limit = min(k, count)
+        guard limit > 0 else { return [] }
+        var best: [(index: Int, score: Double)] = []
+        best.reserveCapacity(limit + 1)
+        for index in 0..<count {
+            let value = score(index)
+            guard !value.isNaN else { continue }
+            if best.count == limit, value >= best[limit - 1].score { continue }
+            var position = best.count
+            while position > 0, best[position - 1].score > value {
+                position -= 1
+            }
+            best.insert((index, value), at: position)
+            if best.count > limit {
+                best.removeLast()
+            }
+        }
+        return best
+    }
+}
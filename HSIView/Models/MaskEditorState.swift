@@ -10,6 +10,8 @@ final class MaskEditorState: ObservableObject {
     
     var maskLayers: [MaskLayer] { layers.compactMap { $0 as? MaskLayer } }
     var referenceLayers: [ReferenceLayer] { layers.compactMap { $0 as? ReferenceLayer } }
+    /// Есть ли в маске хотя бы один размеченный пиксель
+    var hasPaintedPixels: Bool { maskLayers.contains { $0.data.contains { $0 != 0 } } }
     var activeLayer: MaskLayer? {
         guard let id = activeLayerID else { return nil }
         return maskLayers.first { $0.id == id }
@@ -0,0 +1,163 @@
+import Foundation
+
+/// Описание пайплайна для консольной пакетной обработки (`HSIViewCLI`).
+/// Формат повторяется в `HSIViewCLI/Sources/hsiview-batch/BatchPipelineSpec.swift`.
+struct PipelineBatchSpec: Codable, Equatable {
+    static let currentVersion = 1
+
+    var version: Int = PipelineBatchSpec.currentVersion
+    /// Раскладка осей исходных файлов (Auto, CHW, HWC, …)
+    var layout: String
+    var operations: [PipelineBatchOperationSpec]
+}
+
+struct PipelineBatchOperationSpec: Codable, Equatable {
+    var type: String
+    /// Раскладка осей, в которой операция читает куб (у каждой операции своя)
+    var layout: String?
+    /// Точность вычислений нормализации и ресайза (Float32, Float64)
+    var computePrecision: String?
+    /// Операция приложения, которую консольная утилита не выполняет (`type == "unsupported"`)
+    var operation: String?
+    var method: String?
+    var channelwise: Bool?
+    var preserveDataType: Bool?
+    var minValue: Double?
+    var maxValue: Double?
+    var sourceMin: Double?
+    var sourceMax: Double?
+    var targetMin: Double?
+    var targetMax: Double?
+    var lowerPercentile: Double?
+    var upperPercentile: Double?
+    var lower: Double?
+    var upper: Double?
+    var dataType: String?
+    var autoScale: Bool?
+    var degrees: Int?
+    var order: String?
+    var left: Int?
+    var right: Int?
+    var top: Int?
+    var bottom: Int?
+    var width: Int?
+    var height: Int?
+    var algorithm: String?
+    var startChannel: Int?
+    var endChannel: Int?
+
+    init(type: String) {
+        self.type = type
+    }
+}
+
+extension PipelineBatchSpec {
+    /// Операции, которые консольная утилита не поддерживает, записываются как `unsupported`
+    /// (hsiview-batch отказывается выполнять такой пайплайн) и возвращаются в `unsupported`
+    static func make(
+        from operations: [PipelineOperation],
+        layout: CubeLayout
+    ) -> (spec: PipelineBatchSpec, unsupported: [PipelineOperation]) {
+        var specs: [PipelineBatchOperationSpec] = []
+        var unsupported: [PipelineOperation] = []
+        for operation in operations {
+            if let spec = PipelineBatchOperationSpec(operation) {
+                specs.append(spec)
+            } else {
+                var placeholder = PipelineBatchOperationSpec(type: PipelineBatchOperationSpec.unsupportedType)
+                placeholder.operation = "\(operation.type)"
+                placeholder.layout = operation.layout.rawValue
+                specs.append(placeholder)
+                unsupported.append(operation)
+            }
+        }
+        return (PipelineBatchSpec(layout: layout.rawValue, operations: specs), unsupported)
+    }
+}
+
+extension PipelineBatchOperationSpec {
+    static let unsupportedType = "unsupported"
+
+    init?(_ operation: PipelineOperation) {
+        switch operation.type {
+        case .normalization, .channelwiseNormalization:
+            guard let normalization = operation.normalizationType else { return nil }
+            let params = operation.normalizationParams ?? .default
+            self.init(type: "normalization")
+            method = Self.methodName(for: normalization)
+            channelwise = operation.type == .channelwiseNormalization
+            preserveDataType = operation.preserveDataType ?? true
+            computePrecision = params.computePrecision.rawValue
+            switch normalization {
+            case .minMaxCustom:
+                minValue = params.minValue
+                maxValue = params.maxValue
+            case .manualRange:
+                sourceMin = params.sourceMin
+                sourceMax = params.sourceMax
+                targetMin = params.targetMin
+                targetMax = params.targetMax
+            case .percentile:
+                lowerPercentile = params.lowerPercentile
+                upperPercentile = params.upperPercentile
+            case .none, .minMax, .zScore, .log, .sqrt:
+                break
+            }
+        case .dataTypeConversion:
+            guard let target = operation.targetDataType, target != .unknown else { return nil }
+            self.init(type: "dataTypeConversion")
+            dataType = target.rawValue
+            autoScale = operation.autoScale ?? true
+        case .clipping:
+            let params = operation.clippingParams ?? .default
+            self.init(type: "clipping")
+            lower = params.lower
+            upper = params.upper
+        case .rotation:
+            guard let angle = operation.rotationAngle else { return nil }
+            self.init(type: "rotation")
+            degrees = angle.degrees
+        case .transpose:
+            guard let target = operation.transposeParameters?.targetLayout else { return nil }
+            self.init(type: "transpose")
+            order = target.rawValue
+        case .spatialCrop:
+            guard let params = operation.cropParameters else { return nil }
+            self.init(type: "spatialCrop")
+            left = params.left
+            right = params.right
+            top = params.top
+            bottom = params.bottom
+        case .resize:
+            guard let params = operation.resizeParameters,
+                  !params.antialias,
+                  params.algorithm == .nearest || params.algorithm == .bilinear else { return nil }
+            self.init(type: "resize")
+            width = params.targetWidth
+            height = params.targetHeight
+            algorithm = params.algorithm == .nearest ? "nearest" : "bilinear"
+            computePrecision = params.computePrecision.rawValue
+        case .spectralTrim:
+            guard let params = operation.spectralTrimParams else { return nil }
+            self.init(type: "spectralTrim")
+            startChannel = params.startChannel
+            endChannel = params.endChannel
+        case .calibration, .spectralInterpolation, .spectralAlignment, .customPython:
+            return nil
+        }
+        layout = operation.layout.rawValue
+    }
+
+    private static func methodName(for type: CubeNormalizationType) -> String {
+        switch type {
+        case .none: return "none"
+        case .minMax: return "minMax"
+        case .minMaxCustom: return "minMaxCustom"
+        case .manualRange: return "manualRange"
+        case .percentile: return "percentile"
+        case .zScore: return "zScore"
+        case .log: return "log"
+        case .sqrt: return "sqrt"
+        }
+    }
+}
@@ -0,0 +1,261 @@
+import Foundation
+
+/// Обратное отображение одной гомографии: для пикселя назначения — смещения четырёх соседей
+/// в плоскости канала и их билинейные веса. Пиксели вне кадра не читают источник.
+struct HomographyRemapSampler {
+    let width: Int
+    let height: Int
+    let heightStride: Int
+    let widthStride: Int
+    private let H: [Double]
+    private let Hinv: [Double]
+    private let isPerspective: Bool
+
+    /// `H` переводит координаты канала в координаты опорного кадра, как в `CubeSpectralAligner`
+    init(homography H: [Double], strides: CubeAxisStrides) {
+        self.width = strides.width
+        self.height = strides.height
+        self.heightStride = strides.heightStride
+        self.widthStride = strides.widthStride
+        self.H = H
+        self.Hinv = Self.invert(H)
+        self.isPerspective = abs(H[6]) > 1e-9 || abs(H[7]) > 1e-9
+    }
+
+    /// Наибольшее смещение соседа внутри канала
+    var maxOffset: Int { (height - 1) * heightStride + (width - 1) * widthStride }
+
+    /// nil — точка назначения отображается за пределы кадра
+    @inline(__always)
+    func sample(x: Int, y: Int) -> (offsets: SIMD4<Int>, weights: SIMD4<Double>)? {
+        let dx = Double(x)
+        let dy = Double(y)
+        let srcX: Double
+        let srcY: Double
+        if isPerspective {
+            let w = Hinv[6] * dx + Hinv[7] * dy + Hinv[8]
+            guard abs(w) > 1e-12 else { return nil }
+            srcX = (Hinv[0] * dx + Hinv[1] * dy + Hinv[2]) / w
+            srcY = (Hinv[3] * dx + Hinv[4] * dy + Hinv[5]) / w
+        } else {
+            srcX = dx - H[2]
+            srcY = dy - H[5]
+        }
+        guard srcX >= -0.5, srcX < Double(width) - 0.5,
+              srcY >= -0.5, srcY < Double(height) - 0.5 else { return nil }
+
+        let x0 = Int(floor(srcX))
+        let y0 = Int(floor(srcY))
+        let fx = srcX - Double(x0)
+        let fy = srcY - Double(y0)
+        // У края соседи прижимаются к последнему пикселю
+        let left = max(0, x0) * widthStride
+        let right = min(x0 + 1, width - 1) * widthStride
+        let top = max(0, y0) * heightStride
+        let bottom = min(y0 + 1, height - 1) * heightStride
+        return (
+            SIMD4(top + left, top + right, bottom + left, bottom + right),
+            SIMD4((1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy)
+        )
+    }
+
+    /// Интерполирует строки `rows` одного канала без таблицы, вычисляя отображение на лету
+    @inline(__always)
+    func apply<T>(
+        rows: Range<Int>,
+        source: UnsafePointer<T>,
+        destination: UnsafeMutablePointer<T>,
+        load: (T) -> Double,
+        store: (Double) -> T
+    ) {
+        for y in rows {
+            let row = destination + y * heightStride
+            for x in 0..<width {
+                guard let mapped = sample(x: x, y: y) else {
+                    row[x * widthStride] = store(0)
+                    continue
+                }
+                let o = mapped.offsets
+                let v = SIMD4(load(source[o[0]]), load(source[o[1]]), load(source[o[2]]), load(source[o[3]]))
+                row[x * widthStride] = store((v * mapped.weights).sum())
+            }
+        }
+    }
+
+    private static func invert(_ H: [Double]) -> [Double] {
+        guard H.count == 9 else { return [1, 0, 0, 0, 1, 0, 0, 0, 1] }
+        let det = H[0] * (H[4] * H[8] - H[5] * H[7]) - H[1] * (H[3] * H[8] - H[5] * H[6]) + H[2] * (H[3] * H[7] - H[4] * H[6])
+        guard abs(det) > 1e-12 else { return [1, 0, 0, 0, 1, 0, 0, 0, 1] }
+        let invDet = 1.0 / det
+        return [
+            (H[4] * H[8] - H[5] * H[7]) * invDet, (H[2] * H[7] - H[1] * H[8]) * invDet, (H[1] * H[5] - H[2] * H[4]) * invDet,
+            (H[5] * H[6] - H[3] * H[8]) * invDet, (H[0] * H[8] - H[2] * H[6]) * invDet, (H[2] * H[3] - H[0] * H[5]) * invDet,
+            (H[3] * H[7] - H[4] * H[6]) * invDet, (H[1] * H[6] - H[0] * H[7]) * invDet, (H[0] * H[4] - H[1] * H[3]) * invDet
+        ]
+    }
+}
+
+/// Таблица обратного отображения, общая для каналов с одной гомографией:
+/// смещения Int32 и веса Float64, 48 байт на пиксель. Веса те же, что у `HomographyRemapSampler`,
+/// поэтому результат не зависит от того, шёл канал через таблицу или без неё.
+/// Пиксели вне кадра получают нулевые веса и не читают источник.
+struct HomographyRemapTable {
+    let width: Int
+    let height: Int
+    let offsets: [SIMD4<Int32>]
+    let weights: [SIMD4<Double>]
+
+    /// Смещения таблицы должны помещаться в Int32 (см. `HomographyRemapSampler.maxOffset`)
+    init(sampler: HomographyRemapSampler) {
+        let width = sampler.width
+        let height = sampler.height
+        let count = width * height
+
+        var offsets = [SIMD4<Int32>](repeating: .zero, count: count)
+        var weights = [SIMD4<Double>](repeating: .zero, count: count)
+        offsets.withUnsafeMutableBufferPointer { offsetTable in
+            weights.withUnsafeMutableBufferPointer { weightTable in
+                ParallelCompute.forEachChunk(count: height, minChunk: max(1, 16_384 / max(1, width))) { _, rows in
+                    for y in rows {
+                        for x in 0..<width {
+                            guard let mapped = sampler.sample(x: x, y: y) else { continue }
+                            let index = y * width + x
+                            offsetTable[index] = SIMD4<Int32>(truncatingIfNeeded: mapped.offsets)
+                            weightTable[index] = mapped.weights
+                        }
+                    }
+                }
+            }
+        }
+        self.width = width
+        self.height = height
+        self.offsets = offsets
+        self.weights = weights
+    }
+
+    /// Интерполирует строки `rows` одного канала: `source` и `destination` указывают на начало канала
+    /// и адресуются теми же шагами, что и при построении таблицы
+    @inline(__always)
+    func apply<T>(
+        rows: Range<Int>,
+        source: UnsafePointer<T>,
+        destination: UnsafeMutablePointer<T>,
+        strides: CubeAxisStrides,
+        load: (T) -> Double,
+        store: (Double) -> T
+    ) {
+        offsets.withUnsafeBufferPointer { offsetTable in
+            weights.withUnsafeBufferPointer { weightTable in
+                for y in rows {
+                    let row = destination + y * strides.heightStride
+                    let rowStart = y * width
+                    for x in 0..<width {
+                        let w = weightTable[rowStart + x]
+                        guard w != .zero else {
+                            row[x * strides.widthStride] = store(0)
+                            continue
+                        }
+                        let o = SIMD4<Int>(truncatingIfNeeded: offsetTable[rowStart + x])
+                        let v = SIMD4(load(source[o[0]]), load(source[o[1]]), load(source[o[2]]), load(source[o[3]]))
+                        row[x * strides.widthStride] = store((v * w).sum())
+                    }
+                }
+            }
+        }
+    }
+}
+
+/// Применение гомографий ко всем каналам куба. Каналы с одинаковой гомографией делят
+/// одну таблицу отображения; таблица строится один раз и применяется построчно в несколько потоков.
+/// Одиночные каналы интерполируются без таблицы: её построение стоило бы столько же, сколько проход.
+enum HomographyRemap {
+    static func warp(cube: HyperCube, homographies: [[Double]], axes: (channel: Int, height: Int, width: Int)) -> DataStorage {
+        let strides = cube.axisStrides(axes: axes)
+        let groups = channelGroups(homographies: homographies, channels: strides.channels)
+
+        switch cube.storage {
+        case .float64(let arr):
+            return .float64(warp(arr, groups: groups, strides: strides, load: { $0 }, store: { $0 }))
+        case .float32(let arr):
+            return .float32(warp(arr, groups: groups, strides: strides, load: { Double($0) }, store: { Float($0) }))
+        case .uint16(let arr):
+            return .uint16(warp(arr, groups: groups, strides: strides, load: { Double($0) }, store: roundedInteger))
+        case .uint8(let arr):
+            return .uint8(warp(arr, groups: groups, strides: strides, load: { Double($0) }, store: roundedInteger))
+        case .int16(let arr):
+            return .int16(warp(arr, groups: groups, strides: strides, load: { Double($0) }, store: roundedInteger))
+        case .int32(let arr):
+            return .int32(warp(arr, groups: groups, strides: strides, load: { Double($0) }, store: roundedInteger))
+        case .int8(let arr):
+            return .int8(warp(arr, groups: groups, strides: strides, load: { Double($0) }, store: roundedInteger))
+        }
+    }
+
+    /// Каналы, сгруппированные по совпадающей гомографии, в порядке первого появления
+    private static func channelGroups(homographies: [[Double]], channels: Int) -> [(homography: [Double], channels: [Int])] {
+        let identity: [Double] = [1, 0, 0, 0, 1, 0, 0, 0, 1]
+        var groups: [(homography: [Double], channels: [Int])] = []
+        var groupIndex: [[Double]: Int] = [:]
+        for channel in 0..<channels {
+            let H = channel < homographies.count && homographies[channel].count == 9 ? homographies[channel] : identity
+            if let index = groupIndex[H] {
+                groups[index].channels.append(channel)
+            } else {
+                groupIndex[H] = groups.count
+                groups.append((homography: H, channels: [channel]))
+            }
+        }
+        return groups
+    }
+
+    @inline(__always)
+    private static func roundedInteger<T: FixedWidthInteger>(_ value: Double) -> T {
+        T(clamping: Int64(value.rounded()))
+    }
+
+    private static func warp<T>(
+        _ source: [T],
+        groups: [(homography: [Double], channels: [Int])],
+        strides: CubeAxisStrides,
+        load: (T) -> Double,
+        store: (Double) -> T
+    ) -> [T] {
+        let count = source.count
+        return [T](unsafeUninitializedCapacity: count) { buffer, initializedCount in
+            source.withUnsafeBufferPointer { src in
+                let input = src.baseAddress!
+                let output = buffer.baseAddress!
+                for group in groups {
+                    let sampler = HomographyRemapSampler(homography: group.homography, strides: strides)
+                    let table = group.channels.count > 1 && sampler.maxOffset <= Int(Int32.max)
+                        ? HomographyRemapTable(sampler: sampler)
+                        : nil
+                    ParallelCompute.forEachChunk(count: strides.height, minChunk: max(1, 16_384 / max(1, strides.width))) { _, rows in
+                        for channel in group.channels {
+                            let base = channel * strides.channelStride
+                            guard let table else {
+                                sampler.apply(
+                                    rows: rows,
+                                    source: input + base,
+                                    destination: output + base,
+                                    load: load,
+                                    store: store
+                                )
+                                continue
+                            }
+                            table.apply(
+                                rows: rows,
+                                source: input + base,
+                                destination: output + base,
+                                strides: strides,
+                                load: load,
+                                store: store
+                            )
+                        }
+                    }
+                }
+            }
+            initializedCount = count
+        }
+    }
+}
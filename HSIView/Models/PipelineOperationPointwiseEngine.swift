@@ -0,0 +1,545 @@
+import Foundation
+import Accelerate
+
+/// Элементарный шаг поэлементного ядра (значения обрабатываются как Double)
+enum PointwiseStep {
+    /// targetMin + (x − sourceMin) / sourceRange · targetRange
+    case linear(sourceMin: Double, sourceRange: Double, targetMin: Double, targetRange: Double)
+    case clamp(lower: Double, upper: Double)
+    /// log(max(0, x) + 1)
+    case log
+    /// sqrt(max(0, x))
+    case sqrt
+    /// Приведение к типу хранения: насыщение и округление для целых, Float для float32
+    case quantize(DataType, rounding: FloatingPointRoundingRule)
+    /// То же, что `linear`, `log` и `sqrt`, но в арифметике Float с округлением после каждой
+    /// операции — как в ветках `computePrecision == .float32` у `CubeNormalizer`
+    case linearFloat(sourceMin: Float, sourceRange: Float, targetMin: Float, targetRange: Float)
+    case logFloat
+    case sqrtFloat
+}
+
+extension PipelineOperation {
+    /// Операция меняет каждый элемент независимо (возможно, по глобальной статистике куба)
+    var isPointwise: Bool {
+        switch type {
+        case .normalization:
+            guard let normType = normalizationType, normalizationParams != nil else { return true }
+            return normType != .percentile
+        case .dataTypeConversion, .clipping:
+            return true
+        default:
+            return false
+        }
+    }
+}
+
+/// Исполнитель цепочек поэлементных операций конвейера (клиппинг, нормализация, смена типа).
+/// Последовательные операции компилируются в одно ядро и применяются за один многопоточный
+/// проход чтения/записи вместо отдельного куба на каждую операцию. Статистики, нужные
+/// операциям (min/max, mean/std), собираются одним общим предварительным проходом.
+/// Поэлементно результат совпадает с последовательным `PipelineOperation.apply`: после каждой
+/// операции значение приводится к её типу хранения, а нормализации с точностью Float32 считаются
+/// во Float. Исключение — mean/std для Z-Score с Float32: они накапливаются в Double параллельно
+/// (последовательная ветка суммирует во Float по порядку), поэтому могут отличаться в младших битах.
+enum PipelinePointwiseExecutor {
+    static let blockSize = 4096
+
+    private enum StatisticsRequirement {
+        case none
+        /// min/max — переносятся через монотонные шаги аналитически
+        case range
+        /// mean/std — считаются только на входе первой статистической операции сегмента
+        case moments
+    }
+
+    private struct ResolvedStage {
+        let steps: [PointwiseStep]
+        let outputType: DataType
+        let formatSuffix: String
+
+        static func identity(_ type: DataType) -> ResolvedStage {
+            ResolvedStage(steps: [], outputType: type, formatSuffix: "")
+        }
+    }
+
+    private struct Statistics {
+        var min: Double
+        var max: Double
+        var mean: Double
+        var stdDev: Double
+    }
+
+    static func apply(_ operations: [PipelineOperation], to cube: HyperCube) -> HyperCube {
+        guard cube.totalElements > 0 else {
+            return operations.reduce(cube) { current, op in op.apply(to: current) ?? current }
+        }
+
+        var result = cube
+        var start = 0
+        while start < operations.count {
+            let end = segmentEnd(operations, from: start)
+            result = applySegment(Array(operations[start..<end]), to: result)
+            start = end
+        }
+        return result
+    }
+
+    /// Сегмент содержит не более одной операции, требующей mean/std, и она должна быть
+    /// первой статистической: её вход вычисляется в предварительном проходе
+    private static func segmentEnd(_ operations: [PipelineOperation], from start: Int) -> Int {
+        var hasStatistics = false
+        var index = start
+        while index < operations.count {
+            let requirement = statisticsRequirement(for: operations[index])
+            if requirement == .moments && hasStatistics {
+                break
+            }
+            if requirement != .none {
+                hasStatistics = true
+            }
+            index += 1
+        }
+        return max(index, start + 1)
+    }
+
+    private static func applySegment(_ operations: [PipelineOperation], to cube: HyperCube) -> HyperCube {
+        // Стадии до первой статистической операции известны заранее
+        var stages: [ResolvedStage] = []
+        var currentType = cube.originalDataType
+        var index = 0
+        while index < operations.count, statisticsRequirement(for: operations[index]) == .none {
+            let stage = resolve(operations[index], inputType: currentType, statistics: nil)
+            stages.append(stage)
+            currentType = stage.outputType
+            index += 1
+        }
+
+        if index < operations.count {
+            let needsMoments = statisticsRequirement(for: operations[index]) == .moments
+            var statistics = collectStatistics(
+                storage: cube.storage,
+                count: cube.totalElements,
+                steps: stages.flatMap { $0.steps },
+                needsMoments: needsMoments
+            )
+            while index < operations.count {
+                let stage = resolve(operations[index], inputType: currentType, statistics: statistics)
+                stages.append(stage)
+                currentType = stage.outputType
+                // Все шаги монотонны, поэтому min/max следующей стадии — образы текущих
+                let lo = value(statistics.min, after: stage.steps)
+                let hi = value(statistics.max, after: stage.steps)
+                statistics.min = Swift.min(lo, hi)
+                statistics.max = Swift.max(lo, hi)
+                index += 1
+            }
+        }
+
+        let steps = stages.flatMap { $0.steps }
+        let suffix = stages.map { $0.formatSuffix }.joined()
+        guard !steps.isEmpty || currentType != cube.originalDataType else { return cube }
+        guard let storage = render(storage: cube.storage, count: cube.totalElements, steps: steps, outputType: currentType) else {
+            return cube
+        }
+        return HyperCube(
+            dims: cube.dims,
+            storage: storage,
+            sourceFormat: cube.sourceFormat + suffix,
+            isFortranOrder: cube.isFortranOrder,
+            wavelengths: cube.wavelengths,
+            geoReference: cube.geoReference
+        )
+    }
+
+    private static func statisticsRequirement(for operation: PipelineOperation) -> StatisticsRequirement {
+        switch operation.type {
+        case .normalization:
+            switch operation.normalizationType {
+            case .minMax, .minMaxCustom:
+                return .range
+            case .zScore:
+                return .moments
+            default:
+                return .none
+            }
+        case .dataTypeConversion:
+            return operation.autoScale == true ? .range : .none
+        default:
+            return .none
+        }
+    }
+
+    // MARK: - Компиляция операций
+
+    /// Шаги операции для входа типа `inputType`; повторяет ветви `CubeNormalizer`,
+    /// `DataTypeConverter` и `CubeClipper`, включая случаи, когда они возвращают куб без изменений
+    private static func resolve(
+        _ operation: PipelineOperation,
+        inputType: DataType,
+        statistics: Statistics?
+    ) -> ResolvedStage {
+        switch operation.type {
+        case .normalization:
+            guard let normType = operation.normalizationType,
+                  let params = operation.normalizationParams else { return .identity(inputType) }
+            let preserve = operation.preserveDataType ?? true
+            return resolveNormalization(normType, parameters: params, preserveDataType: preserve, inputType: inputType, statistics: statistics)
+
+        case .dataTypeConversion:
+            guard let targetType = operation.targetDataType,
+                  let autoScale = operation.autoScale,
+                  targetType != .unknown,
+                  targetType != inputType else { return .identity(inputType) }
+            let (targetMin, targetMax) = DataTypeConverter.getTypeRange(targetType)
+            let suffix = " [\(targetType.rawValue)]"
+            if autoScale, let statistics, statistics.max - statistics.min > 0 {
+                let steps: [PointwiseStep] = [
+                    .linear(sourceMin: statistics.min, sourceRange: statistics.max - statistics.min, targetMin: targetMin, targetRange: targetMax - targetMin),
+                    .quantize(targetType, rounding: .toNearestOrAwayFromZero)
+                ]
+                return ResolvedStage(steps: steps, outputType: targetType, formatSuffix: suffix)
+            }
+            let steps: [PointwiseStep] = [
+                .clamp(lower: targetMin, upper: targetMax),
+                .quantize(targetType, rounding: .toNearestOrAwayFromZero)
+            ]
+            return ResolvedStage(steps: steps, outputType: targetType, formatSuffix: suffix)
+
+        case .clipping:
+            guard let params = operation.clippingParams else { return .identity(inputType) }
+            let lower = min(params.lower, params.upper)
+            let upper = max(params.lower, params.upper)
+            guard lower != -Double.infinity || upper != Double.infinity else { return .identity(inputType) }
+            // CubeClipper усекает целые через Int64(_:), а не округляет
+            let steps: [PointwiseStep] = [
+                .clamp(lower: lower, upper: upper),
+                .quantize(inputType, rounding: .towardZero)
+            ]
+            return ResolvedStage(steps: steps, outputType: inputType, formatSuffix: "")
+
+        default:
+            return .identity(inputType)
+        }
+    }
+
+    private static func resolveNormalization(
+        _ type: CubeNormalizationType,
+        parameters: CubeNormalizationParameters,
+        preserveDataType: Bool,
+        inputType: DataType,
+        statistics: Statistics?
+    ) -> ResolvedStage {
+        let useFloat32 = parameters.computePrecision == .float32
+        let floatType: DataType = useFloat32 ? .float32 : .float64
+
+        func stage(_ steps: [PointwiseStep], _ suffix: String, outputType: DataType? = nil) -> ResolvedStage {
+            let output = outputType ?? floatType
+            // Float32-ветки нормализатора начинают с Float(x)
+            var steps = useFloat32 ? [PointwiseStep.quantize(.float32, rounding: .toNearestOrAwayFromZero)] + steps : steps
+            if output != .float64 {
+                steps.append(.quantize(output, rounding: .toNearestOrAwayFromZero))
+            }
+            return ResolvedStage(steps: steps, outputType: output, formatSuffix: suffix)
+        }
+
+        func preservedType(targetMin: Double, targetMax: Double) -> DataType {
+            guard !useFloat32, preserveDataType else { return floatType }
+            return CubeNormalizer.preservedDataType(for: inputType, targetMin: targetMin, targetMax: targetMax) ?? .float64
+        }
+
+        switch type {
+        case .none, .percentile:
+            return .identity(inputType)
+
+        case .minMax, .minMaxCustom:
+            guard let statistics else { return .identity(inputType) }
+            let targetMin = type == .minMax ? 0.0 : parameters.minValue
+            let targetMax = type == .minMax ? 1.0 : parameters.maxValue
+            var dataMin = statistics.min
+            var dataMax = statistics.max
+            if useFloat32 {
+                dataMin = Double(Float(dataMin))
+                dataMax = Double(Float(dataMax))
+            }
+            guard dataMax > dataMin else { return .identity(inputType) }
+            if useFloat32 {
+                return stage(
+                    [.linearFloat(
+                        sourceMin: Float(dataMin),
+                        sourceRange: Float(dataMax) - Float(dataMin),
+                        targetMin: Float(targetMin),
+                        targetRange: Float(targetMax - targetMin)
+                    )],
+                    " [MinMax]"
+                )
+            }
+            return stage(
+                [.linear(sourceMin: dataMin, sourceRange: dataMax - dataMin, targetMin: targetMin, targetRange: targetMax - targetMin)],
+                " [MinMax]",
+                outputType: preservedType(targetMin: targetMin, targetMax: targetMax)
+            )
+
+        case .manualRange:
+            guard parameters.sourceMax > parameters.sourceMin else { return .identity(inputType) }
+            if useFloat32 {
+                let sourceMin = Float(parameters.sourceMin)
+                let sourceMax = Float(parameters.sourceMax)
+                return stage(
+                    [
+                        .clamp(lower: Double(sourceMin), upper: Double(sourceMax)),
+                        .linearFloat(
+                            sourceMin: sourceMin,
+                            sourceRange: sourceMax - sourceMin,
+                            targetMin: Float(parameters.targetMin),
+                            targetRange: Float(parameters.targetMax - parameters.targetMin)
+                        )
+                    ],
+                    " [ManualRange]"
+                )
+            }
+            return stage(
+                [
+                    .clamp(lower: parameters.sourceMin, upper: parameters.sourceMax),
+                    .linear(
+                        sourceMin: parameters.sourceMin,
+                        sourceRange: parameters.sourceMax - parameters.sourceMin,
+                        targetMin: parameters.targetMin,
+                        targetRange: parameters.targetMax - parameters.targetMin
+                    )
+                ],
+                " [ManualRange]",
+                outputType: preservedType(targetMin: parameters.targetMin, targetMax: parameters.targetMax)
+            )
+
+        case .zScore:
+            guard let statistics, statistics.stdDev > 0 else { return .identity(inputType) }
+            if useFloat32 {
+                let std = Float(statistics.stdDev)
+                guard std > 0 else { return .identity(inputType) }
+                return stage(
+                    [.linearFloat(sourceMin: Float(statistics.mean), sourceRange: std, targetMin: 0, targetRange: 1)],
+                    " [Z-Score]"
+                )
+            }
+            return stage(
+                [.linear(sourceMin: statistics.mean, sourceRange: statistics.stdDev, targetMin: 0, targetRange: 1)],
+                " [Z-Score]"
+            )
+
+        case .log:
+            return stage([useFloat32 ? .logFloat : .log], " [Log]")
+
+        case .sqrt:
+            return stage([useFloat32 ? .sqrtFloat : .sqrt], " [Sqrt]")
+        }
+    }
+
+    // MARK: - Исполнение
+
+    /// Предварительный проход: min/max (и при необходимости mean/std) после шагов `steps`
+    private static func collectStatistics(
+        storage: DataStorage,
+        count: Int,
+        steps: [PointwiseStep],
+        needsMoments: Bool
+    ) -> Statistics {
+        let chunkCount = ParallelCompute.chunkCount(count: count, minChunk: blockSize)
+        var partials = [(min: Double, max: Double, count: Int, mean: Double, m2: Double)](
+            repeating: (Double.greatestFiniteMagnitude, -Double.greatestFiniteMagnitude, 0, 0.0, 0.0),
+            count: chunkCount
+        )
+
+        partials.withUnsafeMutableBufferPointer { partialPtr in
+            let partial = partialPtr.baseAddress!
+            ParallelCompute.forEachChunk(count: count, minChunk: blockSize) { chunkIndex, range in
+                let block = UnsafeMutablePointer<Double>.allocate(capacity: blockSize)
+                defer { block.deallocate() }
+                var acc = partial[chunkIndex]
+                var start = range.lowerBound
+                while start < range.upperBound {
+                    let n = Swift.min(blockSize, range.upperBound - start)
+                    storage.gather(base: start, stride: 1, count: n, into: block)
+                    run(steps, on: block, count: n)
+
+                    var blockMin = 0.0
+                    var blockMax = 0.0
+                    vDSP_minvD(block, 1, &blockMin, vDSP_Length(n))
+                    vDSP_maxvD(block, 1, &blockMax, vDSP_Length(n))
+                    acc.min = Swift.min(acc.min, blockMin)
+                    acc.max = Swift.max(acc.max, blockMax)
+
+                    if needsMoments {
+                        // Моменты блока относительно его среднего, затем слияние по Чану
+                        var blockMean = 0.0
+                        vDSP_meanvD(block, 1, &blockMean, vDSP_Length(n))
+                        var negMean = -blockMean
+                        vDSP_vsaddD(block, 1, &negMean, block, 1, vDSP_Length(n))
+                        var blockM2 = 0.0
+                        vDSP_svesqD(block, 1, &blockM2, vDSP_Length(n))
+                        let total = acc.count + n
+                        let delta = blockMean - acc.mean
+                        acc.mean += delta * Double(n) / Double(total)
+                        acc.m2 += blockM2 + delta * delta * Double(acc.count) * Double(n) / Double(total)
+                    }
+                    acc.count += n
+                    start += n
+                }
+                partial[chunkIndex] = acc
+            }
+        }
+
+        var result = Statistics(min: Double.greatestFiniteMagnitude, max: -Double.greatestFiniteMagnitude, mean: 0, stdDev: 0)
+        var total = 0
+        var m2 = 0.0
+        for p in partials where p.count > 0 {
+            result.min = Swift.min(result.min, p.min)
+            result.max = Swift.max(result.max, p.max)
+            let merged = total + p.count
+            let delta = p.mean - result.mean
+            result.mean += delta * Double(p.count) / Double(merged)
+            m2 += p.m2 + delta * delta * Double(total) * Double(p.count) / Double(merged)
+            total = merged
+        }
+        if total > 0 {
+            result.stdDev = Foundation.sqrt(m2 / Double(total))
+        }
+        return result
+    }
+
+    /// Основной проход: чтение, ядро и запись в хранилище итогового типа
+    private static func render(storage: DataStorage, count: Int, steps: [PointwiseStep], outputType: DataType) -> DataStorage? {
+        switch outputType {
+        case .float64:
+            return .float64(evaluate(storage: storage, count: count, steps: steps) { block, out, n in
+                out.update(from: block, count: Int(n))
+            })
+        case .float32:
+            return .float32(evaluate(storage: storage, count: count, steps: steps) { block, out, n in
+                vDSP_vdpsp(block, 1, out, 1, n)
+            })
+        // Значения уже целые и в диапазоне типа, поэтому усечение точно
+        case .int8:
+            return .int8(evaluate(storage: storage, count: count, steps: steps) { block, out, n in
+                vDSP_vfix8D(block, 1, out, 1, n)
+            })
+        case .int16:
+            return .int16(evaluate(storage: storage, count: count, steps: steps) { block, out, n in
+                vDSP_vfix16D(block, 1, out, 1, n)
+            })
+        case .int32:
+            return .int32(evaluate(storage: storage, count: count, steps: steps) { block, out, n in
+                vDSP_vfix32D(block, 1, out, 1, n)
+            })
+        case .uint8:
+            return .uint8(evaluate(storage: storage, count: count, steps: steps) { block, out, n in
+                vDSP_vfixu8D(block, 1, out, 1, n)
+            })
+        case .uint16:
+            return .uint16(evaluate(storage: storage, count: count, steps: steps) { block, out, n in
+                vDSP_vfixu16D(block, 1, out, 1, n)
+            })
+        case .unknown:
+            return nil
+        }
+    }
+
+    private static func evaluate<T>(
+        storage: DataStorage,
+        count: Int,
+        steps: [PointwiseStep],
+        store: (UnsafePointer<Double>, UnsafeMutablePointer<T>, vDSP_Length) -> Void
+    ) -> [T] {
+        [T](unsafeUninitializedCapacity: count) { buffer, initializedCount in
+            let output = buffer.baseAddress!
+            ParallelCompute.forEachChunk(count: count, minChunk: blockSize) { _, range in
+                let block = UnsafeMutablePointer<Double>.allocate(capacity: blockSize)
+                defer { block.deallocate() }
+                var start = range.lowerBound
+                while start < range.upperBound {
+                    let n = Swift.min(blockSize, range.upperBound - start)
+                    storage.gather(base: start, stride: 1, count: n, into: block)
+                    run(steps, on: block, count: n)
+                    store(block, output + start, vDSP_Length(n))
+                    start += n
+                }
+            }
+            initializedCount = count
+        }
+    }
+
+    private static func run(_ steps: [PointwiseStep], on block: UnsafeMutablePointer<Double>, count: Int) {
+        let n = vDSP_Length(count)
+        var length = Int32(count)
+        for step in steps {
+            switch step {
+            case .linear(let sourceMin, let sourceRange, let targetMin, let targetRange):
+                var negMin = -sourceMin
+                var range = sourceRange
+                var scale = targetRange
+                var offset = targetMin
+                vDSP_vsaddD(block, 1, &negMin, block, 1, n)
+                vDSP_vsdivD(block, 1, &range, block, 1, n)
+                vDSP_vsmsaD(block, 1, &scale, &offset, block, 1, n)
+            case .clamp(let lower, let upper):
+                var lo = lower
+                var hi = upper
+                vDSP_vclipD(block, 1, &lo, &hi, block, 1, n)
+            case .log:
+                var zero = 0.0
+                var one = 1.0
+                vDSP_vthrD(block, 1, &zero, block, 1, n)
+                vDSP_vsaddD(block, 1, &one, block, 1, n)
+                vvlog(block, block, &length)
+            case .sqrt:
+                var zero = 0.0
+                vDSP_vthrD(block, 1, &zero, block, 1, n)
+                vvsqrt(block, block, &length)
+            case .quantize(let type, let rounding):
+                quantize(block, count: count, to: type, rounding: rounding)
+            case .linearFloat(let sourceMin, let sourceRange, let targetMin, let targetRange):
+                for i in 0..<count {
+                    let normalized = (Float(block[i]) - sourceMin) / sourceRange
+                    block[i] = Double(targetMin + normalized * targetRange)
+                }
+            case .logFloat:
+                for i in 0..<count {
+                    block[i] = Double(Foundation.log(Swift.max(0, Float(block[i])) + 1.0))
+                }
+            case .sqrtFloat:
+                for i in 0..<count {
+                    block[i] = Double(Foundation.sqrt(Swift.max(0, Float(block[i]))))
+                }
+            }
+        }
+    }
+
+    private static func quantize(
+        _ block: UnsafeMutablePointer<Double>,
+        count: Int,
+        to type: DataType,
+        rounding: FloatingPointRoundingRule
+    ) {
+        switch type {
+        case .float64, .unknown:
+            return
+        case .float32:
+            for i in 0..<count {
+                block[i] = Double(Float(block[i]))
+            }
+        case .int8, .int16, .int32, .uint8, .uint16:
+            let (lower, upper) = DataTypeConverter.getTypeRange(type)
+            for i in 0..<count {
+                let value = block[i]
+                block[i] = value.isNaN ? 0 : Swift.min(upper, Swift.max(lower, value.rounded(rounding)))
+            }
+        }
+    }
+
+    /// Значение шагов в одной точке (для переноса min/max между стадиями)
+    private static func value(_ input: Double, after steps: [PointwiseStep]) -> Double {
+        var x = input
+        withUnsafeMutablePointer(to: &x) { run(steps, on: $0, count: 1) }
+        return x
+    }
+}
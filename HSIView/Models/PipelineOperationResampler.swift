@@ -0,0 +1,216 @@
+import Foundation
+import Accelerate
+
+/// Ядро интерполяции для разделимого ресэмплинга
+enum ResampleKernel {
+    case linear
+    case cubic(a: Double)
+    case lanczos(a: Int)
+
+    init?(algorithm: ResizeAlgorithm, bicubicA: Double, lanczosA: Int) {
+        switch algorithm {
+        case .nearest: return nil
+        case .bilinear: self = .linear
+        case .bicubic: self = .cubic(a: bicubicA)
+        case .bspline: self = .cubic(a: -1.0)
+        case .lanczos: self = .lanczos(a: max(1, lanczosA))
+        }
+    }
+
+    /// Полуширина носителя в пикселях исходной сетки
+    var radius: Int {
+        switch self {
+        case .linear: return 1
+        case .cubic: return 2
+        case .lanczos(let a): return a
+        }
+    }
+
+    /// Lanczos нормирует веса на их сумму, как и прежний попиксельный вариант
+    var isNormalized: Bool {
+        if case .lanczos = self { return true }
+        return false
+    }
+
+    func weight(_ t: Double) -> Double {
+        let at = abs(t)
+        switch self {
+        case .linear:
+            return max(0, 1 - at)
+        case .cubic(let a):
+            if at <= 1 {
+                return (a + 2) * at * at * at - (a + 3) * at * at + 1
+            } else if at < 2 {
+                return a * at * at * at - 5 * a * at * at + 8 * a * at - 4 * a
+            }
+            return 0
+        case .lanczos(let a):
+            if at >= Double(a) { return 0 }
+            return Self.sinc(at) * Self.sinc(at / Double(a))
+        }
+    }
+
+    private static func sinc(_ x: Double) -> Double {
+        if abs(x) < 1e-7 { return 1.0 }
+        return sin(Double.pi * x) / (Double.pi * x)
+    }
+}
+
+/// Таблица отсчётов по одной оси: для каждой выходной позиции `taps` индексов
+/// исходной сетки и их весов. Отсчёты за границей получают вес 0 (нулевое поле,
+/// как в прежнем попиксельном ресайзе) и индекс 0, чтобы цикл не ветвился.
+struct ResampleAxisTable {
+    let taps: Int
+    let indices: [Int]
+    let weights: [Double]
+
+    init(sourceCount: Int, targetCount: Int, kernel: ResampleKernel, antialias: Bool) {
+        let scale = Double(sourceCount) / Double(targetCount)
+        // При уменьшении с антиалиасингом ядро растягивается на `scale` исходных пикселей
+        let stretch = antialias && scale > 1 ? scale : 1
+        let radius = Int((Double(kernel.radius) * stretch).rounded(.up))
+        let taps = 2 * radius
+        let normalize = kernel.isNormalized || stretch > 1
+
+        var indices = [Int](repeating: 0, count: targetCount * taps)
+        var weights = [Double](repeating: 0, count: targetCount * taps)
+        for position in 0..<targetCount {
+            let center = (Double(position) + 0.5) * scale - 0.5
+            let first = Int(center.rounded(.down)) - radius + 1
+            var sum = 0.0
+            for k in 0..<taps {
+                let w = kernel.weight((Double(first + k) - center) / stretch)
+                weights[position * taps + k] = w
+                sum += w
+            }
+            for k in 0..<taps {
+                let index = first + k
+                let slot = position * taps + k
+                if normalize {
+                    weights[slot] = sum != 0 ? weights[slot] / sum : 0
+                }
+                if index < 0 || index >= sourceCount {
+                    weights[slot] = 0
+                } else {
+                    indices[slot] = index
+                }
+            }
+        }
+        self.taps = taps
+        self.indices = indices
+        self.weights = weights
+    }
+}
+
+/// Разделимый ресайз: сначала по строкам (ширина), затем по столбцам (высота).
+/// Таблицы весов строятся один раз на обе оси и используются для всех каналов;
+/// каналы обрабатываются параллельно, вертикальный проход накапливает непрерывные строки через vDSP.
+enum SeparableResampler {
+    static func resize(
+        cube: HyperCube,
+        axes: (channel: Int, height: Int, width: Int),
+        targetWidth: Int,
+        targetHeight: Int,
+        kernel: ResampleKernel,
+        antialias: Bool,
+        outputFloat32: Bool
+    ) -> DataStorage {
+        let src = cube.axisStrides(axes: axes)
+        let channels = src.channels
+        let srcWidth = src.width
+        let srcHeight = src.height
+
+        var dstDims = [cube.dims.0, cube.dims.1, cube.dims.2]
+        dstDims[axes.width] = targetWidth
+        dstDims[axes.height] = targetHeight
+        let dstElementStrides = cube.isFortranOrder
+            ? [1, dstDims[0], dstDims[0] * dstDims[1]]
+            : [dstDims[1] * dstDims[2], dstDims[2], 1]
+        let dstChannelStride = dstElementStrides[axes.channel]
+        let dstHeightStride = dstElementStrides[axes.height]
+        let dstWidthStride = dstElementStrides[axes.width]
+
+        let columns = ResampleAxisTable(sourceCount: srcWidth, targetCount: targetWidth, kernel: kernel, antialias: antialias)
+        let rows = ResampleAxisTable(sourceCount: srcHeight, targetCount: targetHeight, kernel: kernel, antialias: antialias)
+
+        let total = channels * targetWidth * targetHeight
+        var output64 = outputFloat32 ? [] : [Double](repeating: 0, count: total)
+        var output32 = outputFloat32 ? [Float](repeating: 0, count: total) : []
+
+        output64.withUnsafeMutableBufferPointer { out64 in
+            output32.withUnsafeMutableBufferPointer { out32 in
+                columns.indices.withUnsafeBufferPointer { colIndex in
+                    columns.weights.withUnsafeBufferPointer { colWeight in
+                        rows.indices.withUnsafeBufferPointer { rowIndex in
+                            rows.weights.withUnsafeBufferPointer { rowWeight in
+                                ParallelCompute.forEachChunk(count: channels) { _, channelRange in
+                                    let sourceRow = UnsafeMutablePointer<Double>.allocate(capacity: srcWidth)
+                                    let horizontal = UnsafeMutablePointer<Double>.allocate(capacity: srcHeight * targetWidth)
+                                    let outputRow = UnsafeMutablePointer<Double>.allocate(capacity: targetWidth)
+                                    defer {
+                                        sourceRow.deallocate()
+                                        horizontal.deallocate()
+                                        outputRow.deallocate()
+                                    }
+
+                                    for channel in channelRange {
+                                        // Проход по ширине: каждая исходная строка -> targetWidth значений
+                                        for y in 0..<srcHeight {
+                                            cube.storage.gather(
+                                                base: src.offset(channel: channel, x: 0, y: y),
+                                                stride: src.widthStride,
+                                                count: srcWidth,
+                                                into: sourceRow
+                                            )
+                                            let dst = horizontal + y * targetWidth
+                                            for x in 0..<targetWidth {
+                                                let base = x * columns.taps
+                                                var sum = 0.0
+                                                for k in 0..<columns.taps {
+                                                    sum += colWeight[base + k] * sourceRow[colIndex[base + k]]
+                                                }
+                                                dst[x] = sum
+                                            }
+                                        }
+
+                                        // Проход по высоте: взвешенная сумма целых строк
+                                        for y in 0..<targetHeight {
+                                            vDSP_vclrD(outputRow, 1, vDSP_Length(targetWidth))
+                                            let base = y * rows.taps
+                                            for k in 0..<rows.taps {
+                                                var w = rowWeight[base + k]
+                                                if w == 0 { continue }
+                                                vDSP_vsmaD(
+                                                    horizontal + rowIndex[base + k] * targetWidth, 1,
+                                                    &w,
+                                                    outputRow, 1,
+                                                    outputRow, 1,
+                                                    vDSP_Length(targetWidth)
+                                                )
+                                            }
+
+                                            var offset = channel * dstChannelStride + y * dstHeightStride
+                                            if outputFloat32 {
+                                                for x in 0..<targetWidth {
+                                                    out32[offset] = Float(outputRow[x])
+                                                    offset += dstWidthStride
+                                                }
+                                            } else {
+                                                for x in 0..<targetWidth {
+                                                    out64[offset] = outputRow[x]
+                                                    offset += dstWidthStride
+                                                }
+                                            }
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        return outputFloat32 ? .float32(output32) : .float64(output64)
+    }
+}
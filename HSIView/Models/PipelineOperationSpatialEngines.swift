@@ -65,95 +65,21 @@ class CubeResizer {
             }
         }
         
-        let useFloat32 = parameters.computePrecision == .float32
-        if useFloat32 {
-            var output = [Float](repeating: 0, count: total)
-            let scaleX = Float(srcWidth) / Float(dstWidth)
-            let scaleY = Float(srcHeight) / Float(dstHeight)
-            
-            for ch in 0..<channels {
-                for y in 0..<dstHeight {
-                    for x in 0..<dstWidth {
-                        let srcX = (Float(x) + 0.5) * scaleX - 0.5
-                        let srcY = (Float(y) + 0.5) * scaleY - 0.5
-                        let value = sampleFloat(
-                            cube: cube,
-                            axes: axes,
-                            channel: ch,
-                            x: srcX,
-                            y: srcY,
-                            algorithm: parameters.algorithm,
-                            bicubicA: Float(parameters.bicubicA),
-                            lanczosA: parameters.lanczosA
-                        )
-                        
-                        var outIndices = [0, 0, 0]
-                        outIndices[axes.width] = x
-                        outIndices[axes.height] = y
-                        outIndices[axes.channel] = ch
-                        
-                        let idx = linearIndex(
-                            dims: dimsArray,
-                            isFortran: cube.isFortranOrder,
-                            i0: outIndices[0],
-                            i1: outIndices[1],
-                            i2: outIndices[2]
-                        )
-                        output[idx] = value
-                    }
-                }
-            }
-            
-            let storage = DataStorage.float32(output)
-            return HyperCube(
-                dims: (dimsArray[0], dimsArray[1], dimsArray[2]),
-                storage: storage,
-                sourceFormat: cube.sourceFormat + " [Resize]",
-                isFortranOrder: cube.isFortranOrder,
-                wavelengths: cube.wavelengths,
-                geoReference: transformedGeo
-            )
-        }
-        
-        var output = [Double](repeating: 0.0, count: total)
-        
-        let scaleX = Double(srcWidth) / Double(dstWidth)
-        let scaleY = Double(srcHeight) / Double(dstHeight)
-        
-        for ch in 0..<channels {
-            for y in 0..<dstHeight {
-                for x in 0..<dstWidth {
-                    let srcX = (Double(x) + 0.5) * scaleX - 0.5
-                    let srcY = (Double(y) + 0.5) * scaleY - 0.5
-                    let value = sample(
-                        cube: cube,
-                        axes: axes,
-                        channel: ch,
-                        x: srcX,
-                        y: srcY,
-                        algorithm: parameters.algorithm,
-                        bicubicA: parameters.bicubicA,
-                        lanczosA: parameters.lanczosA
-                    )
-                    
-                    var outIndices = [0, 0, 0]
-                    outIndices[axes.width] = x
-                    outIndices[axes.height] = y
-                    outIndices[axes.channel] = ch
-                    
-                    let idx = linearIndex(
-                        dims: dimsArray,
-                        isFortran: cube.isFortranOrder,
-                        i0: outIndices[0],
-                        i1: outIndices[1],
-                        i2: outIndices[2]
-                    )
-                    output[idx] = value
-                }
-            }
-        }
+        guard let kernel = ResampleKernel(
+            algorithm: parameters.algorithm,
+            bicubicA: parameters.bicubicA,
+            lanczosA: parameters.lanczosA
+        ) else { return cube }
         
-        let storage = DataStorage.float64(output)
+        let storage = SeparableResampler.resize(
+            cube: cube,
+            axes: axes,
+            targetWidth: dstWidth,
+            targetHeight: dstHeight,
+            kernel: kernel,
+            antialias: parameters.antialias,
+            outputFloat32: parameters.computePrecision == .float32
+        )
         return HyperCube(
             dims: (dimsArray[0], dimsArray[1], dimsArray[2]),
             storage: storage,
@@ -164,58 +90,6 @@ class CubeResizer {
         )
     }
     
-    private static func sample(
-        cube: HyperCube,
-        axes: (channel: Int, height: Int, width: Int),
-        channel: Int,
-        x: Double,
-        y: Double,
-        algorithm: ResizeAlgorithm,
-        bicubicA: Double,
-        lanczosA: Int
-    ) -> Double {
-        switch algorithm {
-        case .nearest:
-            let nx = Int(round(x))
-            let ny = Int(round(y))
-            return value(atX: nx, y: ny, channel: channel, cube: cube, axes: axes)
-        case .bilinear:
-            return bilinearSample(cube: cube, axes: axes, channel: channel, x: x, y: y)
-        case .bicubic:
-            return bicubicSample(cube: cube, axes: axes, channel: channel, x: x, y: y, a: bicubicA)
-        case .bspline:
-            return bicubicSample(cube: cube, axes: axes, channel: channel, x: x, y: y, a: -1.0)
-        case .lanczos:
-            return lanczosSample(cube: cube, axes: axes, channel: channel, x: x, y: y, a: max(1, lanczosA))
-        }
-    }
-    
-    private static func sampleFloat(
-        cube: HyperCube,
-        axes: (channel: Int, height: Int, width: Int),
-        channel: Int,
-        x: Float,
-        y: Float,
-        algorithm: ResizeAlgorithm,
-        bicubicA: Float,
-        lanczosA: Int
-    ) -> Float {
-        switch algorithm {
-        case .nearest:
-            let nx = Int(round(x))
-            let ny = Int(round(y))
-            return Float(value(atX: nx, y: ny, channel: channel, cube: cube, axes: axes))
-        case .bilinear:
-            return Float(bilinearSample(cube: cube, axes: axes, channel: channel, x: Double(x), y: Double(y)))
-        case .bicubic:
-            return Float(bicubicSample(cube: cube, axes: axes, channel: channel, x: Double(x), y: Double(y), a: Double(bicubicA)))
-        case .bspline:
-            return Float(bicubicSample(cube: cube, axes: axes, channel: channel, x: Double(x), y: Double(y), a: -1.0))
-        case .lanczos:
-            return Float(lanczosSample(cube: cube, axes: axes, channel: channel, x: Double(x), y: Double(y), a: max(1, lanczosA)))
-        }
-    }
-
     private static func fillNearest<T>(
         from source: [T],
         into output: inout [T],
@@ -263,99 +137,6 @@ class CubeResizer {
         }
     }
     
-    private static func value(atX x: Int, y: Int, channel: Int, cube: HyperCube, axes: (channel: Int, height: Int, width: Int)) -> Double {
-        let dims = cube.dims
-        let dimsArray = [dims.0, dims.1, dims.2]
-        guard x >= 0, y >= 0,
-              x < dimsArray[axes.width],
-              y < dimsArray[axes.height] else { return 0 }
-        var indices = [0, 0, 0]
-        indices[axes.channel] = channel
-        indices[axes.height] = y
-        indices[axes.width] = x
-        return cube.getValue(i0: indices[0], i1: indices[1], i2: indices[2])
-    }
-    
-    private static func bilinearSample(cube: HyperCube, axes: (channel: Int, height: Int, width: Int), channel: Int, x: Double, y: Double) -> Double {
-        let x0 = Int(floor(x))
-        let x1 = x0 + 1
-        let y0 = Int(floor(y))
-        let y1 = y0 + 1
-        let fx = x - Double(x0)
-        let fy = y - Double(y0)
-        
-        let v00 = value(atX: x0, y: y0, channel: channel, cube: cube, axes: axes)
-        let v10 = value(atX: x1, y: y0, channel: channel, cube: cube, axes: axes)
-        let v01 = value(atX: x0, y: y1, channel: channel, cube: cube, axes: axes)
-        let v11 = value(atX: x1, y: y1, channel: channel, cube: cube, axes: axes)
-        
-        let vx0 = v00 * (1 - fx) + v10 * fx
-        let vx1 = v01 * (1 - fx) + v11 * fx
-        return vx0 * (1 - fy) + vx1 * fy
-    }
-    
-    private static func cubicWeight(_ t: Double, a: Double) -> Double {
-        let at = abs(t)
-        if at <= 1 {
-            return (a + 2) * pow(at, 3) - (a + 3) * pow(at, 2) + 1
-        } else if at < 2 {
-            return a * pow(at, 3) - 5 * a * pow(at, 2) + 8 * a * at - 4 * a
-        } else {
-            return 0
-        }
-    }
-    
-    private static func bicubicSample(cube: HyperCube, axes: (channel: Int, height: Int, width: Int), channel: Int, x: Double, y: Double, a: Double) -> Double {
-        let x0 = Int(floor(x))
-        let y0 = Int(floor(y))
-        
-        var result = 0.0
-        for m in -1...2 {
-            let wy = cubicWeight(Double(m) - (y - Double(y0)), a: a)
-            let sampleY = y0 + m
-            for n in -1...2 {
-                let wx = cubicWeight(Double(n) - (x - Double(x0)), a: a)
-                let sampleX = x0 + n
-                let v = value(atX: sampleX, y: sampleY, channel: channel, cube: cube, axes: axes)
-                result += v * wx * wy
-            }
-        }
-        return result
-    }
-    
-    private static func sinc(_ x: Double) -> Double {
-        if abs(x) < 1e-7 { return 1.0 }
-        return sin(Double.pi * x) / (Double.pi * x)
-    }
-    
-    private static func lanczosWeight(_ x: Double, a: Int) -> Double {
-        let ax = abs(x)
-        if ax >= Double(a) { return 0 }
-        return sinc(ax) * sinc(ax / Double(a))
-    }
-    
-    private static func lanczosSample(cube: HyperCube, axes: (channel: Int, height: Int, width: Int), channel: Int, x: Double, y: Double, a: Int) -> Double {
-        let xInt = Int(floor(x))
-        let yInt = Int(floor(y))
-        var sum = 0.0
-        var weightSum = 0.0
-        
-        for j in (yInt - a + 1)...(yInt + a) {
-            let wy = lanczosWeight(Double(j) - y, a: a)
-            if wy == 0 { continue }
-            for i in (xInt - a + 1)...(xInt + a) {
-                let wx = lanczosWeight(Double(i) - x, a: a)
-                let w = wx * wy
-                if w == 0 { continue }
-                let v = value(atX: i, y: j, channel: channel, cube: cube, axes: axes)
-                sum += v * w
-                weightSum += w
-            }
-        }
-        if weightSum == 0 { return 0 }
-        return sum / weightSum
-    }
-    
     private static func linearIndex(dims: [Int], isFortran: Bool, i0: Int, i1: Int, i2: Int) -> Int {
         if isFortran {
             return i0 + dims[0] * (i1 + dims[1] * i2)
@@ -394,151 +175,51 @@ class CubeTransposer {
             ? " [Transpose →\(targetLayout.rawValue)]"
             : " [Transpose \(sourceLayout.rawValue)→\(targetLayout.rawValue)]"
         
+        // Ось i результата берётся из оси permutation[i] источника
+        var permutation = [0, 1, 2]
+        permutation[targetAxes.channel] = sourceAxes.channel
+        permutation[targetAxes.height] = sourceAxes.height
+        permutation[targetAxes.width] = sourceAxes.width
+        
+        let storage: DataStorage
         switch cube.storage {
         case .float64(let arr):
-            var output = initializedBuffer(from: arr, count: totalElements)
-            remap(
-                source: arr,
-                output: &output,
-                srcDims: srcDims,
-                dstDims: dstDims,
-                sourceAxes: sourceAxes,
-                targetAxes: targetAxes,
-                isFortran: cube.isFortranOrder
-            )
-            return HyperCube(dims: (dstDims[0], dstDims[1], dstDims[2]), storage: .float64(output), sourceFormat: cube.sourceFormat + suffix, isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
+            storage = .float64(permuted(arr, srcDims: srcDims, permutation: permutation, isFortran: cube.isFortranOrder))
         case .float32(let arr):
-            var output = initializedBuffer(from: arr, count: totalElements)
-            remap(
-                source: arr,
-                output: &output,
-                srcDims: srcDims,
-                dstDims: dstDims,
-                sourceAxes: sourceAxes,
-                targetAxes: targetAxes,
-                isFortran: cube.isFortranOrder
-            )
-            return HyperCube(dims: (dstDims[0], dstDims[1], dstDims[2]), storage: .float32(output), sourceFormat: cube.sourceFormat + suffix, isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
+            storage = .float32(permuted(arr, srcDims: srcDims, permutation: permutation, isFortran: cube.isFortranOrder))
         case .int8(let arr):
-            var output = initializedBuffer(from: arr, count: totalElements)
-            remap(
-                source: arr,
-                output: &output,
-                srcDims: srcDims,
-                dstDims: dstDims,
-                sourceAxes: sourceAxes,
-                targetAxes: targetAxes,
-                isFortran: cube.isFortranOrder
-            )
-            return HyperCube(dims: (dstDims[0], dstDims[1], dstDims[2]), storage: .int8(output), sourceFormat: cube.sourceFormat + suffix, isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
+            storage = .int8(permuted(arr, srcDims: srcDims, permutation: permutation, isFortran: cube.isFortranOrder))
         case .int16(let arr):
-            var output = initializedBuffer(from: arr, count: totalElements)
-            remap(
-                source: arr,
-                output: &output,
-                srcDims: srcDims,
-                dstDims: dstDims,
-                sourceAxes: sourceAxes,
-                targetAxes: targetAxes,
-                isFortran: cube.isFortranOrder
-            )
-            return HyperCube(dims: (dstDims[0], dstDims[1], dstDims[2]), storage: .int16(output), sourceFormat: cube.sourceFormat + suffix, isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
+            storage = .int16(permuted(arr, srcDims: srcDims, permutation: permutation, isFortran: cube.isFortranOrder))
         case .int32(let arr):
-            var output = initializedBuffer(from: arr, count: totalElements)
-            remap(
-                source: arr,
-                output: &output,
-                srcDims: srcDims,
-                dstDims: dstDims,
-                sourceAxes: sourceAxes,
-                targetAxes: targetAxes,
-                isFortran: cube.isFortranOrder
-            )
-            return HyperCube(dims: (dstDims[0], dstDims[1], dstDims[2]), storage: .int32(output), sourceFormat: cube.sourceFormat + suffix, isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
+            storage = .int32(permuted(arr, srcDims: srcDims, permutation: permutation, isFortran: cube.isFortranOrder))
         case .uint8(let arr):
-            var output = initializedBuffer(from: arr, count: totalElements)
-            remap(
-                source: arr,
-                output: &output,
-                srcDims: srcDims,
-                dstDims: dstDims,
-                sourceAxes: sourceAxes,
-                targetAxes: targetAxes,
-                isFortran: cube.isFortranOrder
-            )
-            return HyperCube(dims: (dstDims[0], dstDims[1], dstDims[2]), storage: .uint8(output), sourceFormat: cube.sourceFormat + suffix, isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
+            storage = .uint8(permuted(arr, srcDims: srcDims, permutation: permutation, isFortran: cube.isFortranOrder))
         case .uint16(let arr):
-            var output = initializedBuffer(from: arr, count: totalElements)
-            remap(
-                source: arr,
-                output: &output,
-                srcDims: srcDims,
-                dstDims: dstDims,
-                sourceAxes: sourceAxes,
-                targetAxes: targetAxes,
-                isFortran: cube.isFortranOrder
-            )
-            return HyperCube(dims: (dstDims[0], dstDims[1], dstDims[2]), storage: .uint16(output), sourceFormat: cube.sourceFormat + suffix, isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
+            storage = .uint16(permuted(arr, srcDims: srcDims, permutation: permutation, isFortran: cube.isFortranOrder))
         }
+        return HyperCube(dims: (dstDims[0], dstDims[1], dstDims[2]), storage: storage, sourceFormat: cube.sourceFormat + suffix, isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
     }
     
-    private static func initializedBuffer<T>(from source: [T], count: Int) -> [T] {
-        guard count > 0, let first = source.first else { return [] }
-        return [T](repeating: first, count: count)
-    }
-    
-    private static func remap<T>(
-        source: [T],
-        output: inout [T],
-        srcDims: [Int],
-        dstDims: [Int],
-        sourceAxes: (channel: Int, height: Int, width: Int),
-        targetAxes: (channel: Int, height: Int, width: Int),
-        isFortran: Bool
-    ) {
-        let channelCount = srcDims[sourceAxes.channel]
-        let height = srcDims[sourceAxes.height]
-        let width = srcDims[sourceAxes.width]
-        
-        for c in 0..<channelCount {
-            for y in 0..<height {
-                for x in 0..<width {
-                    var srcIdx = [0, 0, 0]
-                    srcIdx[sourceAxes.channel] = c
-                    srcIdx[sourceAxes.height] = y
-                    srcIdx[sourceAxes.width] = x
-                    
-                    var dstIdx = [0, 0, 0]
-                    dstIdx[targetAxes.channel] = c
-                    dstIdx[targetAxes.height] = y
-                    dstIdx[targetAxes.width] = x
-                    
-                    let srcLinear = linearIndex(
-                        dims: srcDims,
-                        fortran: isFortran,
-                        i0: srcIdx[0],
-                        i1: srcIdx[1],
-                        i2: srcIdx[2]
-                    )
-                    let dstLinear = linearIndex(
-                        dims: dstDims,
-                        fortran: isFortran,
-                        i0: dstIdx[0],
-                        i1: dstIdx[1],
-                        i2: dstIdx[2]
+    /// Результат пишется сразу в неинициализированный буфер: каждый элемент заполняется ровно один раз
+    private static func permuted<T>(_ source: [T], srcDims: [Int], permutation: [Int], isFortran: Bool) -> [T] {
+        let count = source.count
+        return [T](unsafeUninitializedCapacity: count) { buffer, initializedCount in
+            if count > 0, let destination = buffer.baseAddress {
+                source.withUnsafeBytes { raw in
+                    CubePermutation.permute(
+                        source: raw.baseAddress!,
+                        destination: UnsafeMutableRawPointer(destination),
+                        elementSize: MemoryLayout<T>.stride,
+                        sourceDims: srcDims,
+                        permutation: permutation,
+                        fortranOrder: isFortran
                     )
-                    output[dstLinear] = source[srcLinear]
                 }
             }
+            initializedCount = count
         }
     }
-    
-    private static func linearIndex(dims: [Int], fortran: Bool, i0: Int, i1: Int, i2: Int) -> Int {
-        if fortran {
-            return i0 + dims[0] * (i1 + dims[1] * i2)
-        }
-        return i2 + dims[2] * (i1 + dims[1] * i0)
-    }
 }
 
 class CubeRotator {
@@ -548,7 +229,6 @@ class CubeRotator {
         
         guard let axes = cube.axes(for: layout) else { return cube }
         
-        let channels = dimsArray[axes.channel]
         let oldHeight = dimsArray[axes.height]
         let oldWidth = dimsArray[axes.width]
         
@@ -583,11 +263,8 @@ class CubeRotator {
                 source: arr,
                 axes: axes,
                 angle: angle,
-                channels: channels,
                 oldHeight: oldHeight,
                 oldWidth: oldWidth,
-                newHeight: newHeight,
-                newWidth: newWidth,
                 oldDims: (dims.0, dims.1, dims.2),
                 newDims: resultingDims,
                 fortran: cube.isFortranOrder
@@ -599,11 +276,8 @@ class CubeRotator {
                 source: arr,
                 axes: axes,
                 angle: angle,
-                channels: channels,
                 oldHeight: oldHeight,
                 oldWidth: oldWidth,
-                newHeight: newHeight,
-                newWidth: newWidth,
                 oldDims: (dims.0, dims.1, dims.2),
                 newDims: resultingDims,
                 fortran: cube.isFortranOrder
@@ -615,11 +289,8 @@ class CubeRotator {
                 source: arr,
                 axes: axes,
                 angle: angle,
-                channels: channels,
                 oldHeight: oldHeight,
                 oldWidth: oldWidth,
-                newHeight: newHeight,
-                newWidth: newWidth,
                 oldDims: (dims.0, dims.1, dims.2),
                 newDims: resultingDims,
                 fortran: cube.isFortranOrder
@@ -631,11 +302,8 @@ class CubeRotator {
                 source: arr,
                 axes: axes,
                 angle: angle,
-                channels: channels,
                 oldHeight: oldHeight,
                 oldWidth: oldWidth,
-                newHeight: newHeight,
-                newWidth: newWidth,
                 oldDims: (dims.0, dims.1, dims.2),
                 newDims: resultingDims,
                 fortran: cube.isFortranOrder
@@ -647,11 +315,8 @@ class CubeRotator {
                 source: arr,
                 axes: axes,
                 angle: angle,
-                channels: channels,
                 oldHeight: oldHeight,
                 oldWidth: oldWidth,
-                newHeight: newHeight,
-                newWidth: newWidth,
                 oldDims: (dims.0, dims.1, dims.2),
                 newDims: resultingDims,
                 fortran: cube.isFortranOrder
@@ -663,11 +328,8 @@ class CubeRotator {
                 source: arr,
                 axes: axes,
                 angle: angle,
-                channels: channels,
                 oldHeight: oldHeight,
                 oldWidth: oldWidth,
-                newHeight: newHeight,
-                newWidth: newWidth,
                 oldDims: (dims.0, dims.1, dims.2),
                 newDims: resultingDims,
                 fortran: cube.isFortranOrder
@@ -679,11 +341,8 @@ class CubeRotator {
                 source: arr,
                 axes: axes,
                 angle: angle,
-                channels: channels,
                 oldHeight: oldHeight,
                 oldWidth: oldWidth,
-                newHeight: newHeight,
-                newWidth: newWidth,
                 oldDims: (dims.0, dims.1, dims.2),
                 newDims: resultingDims,
                 fortran: cube.isFortranOrder
@@ -696,90 +355,60 @@ class CubeRotator {
         source: [T],
         axes: (channel: Int, height: Int, width: Int),
         angle: RotationAngle,
-        channels: Int,
         oldHeight: Int,
         oldWidth: Int,
-        newHeight: Int,
-        newWidth: Int,
         oldDims: (Int, Int, Int),
         newDims: (Int, Int, Int),
         fortran: Bool
     ) -> [T] {
         let totalElements = newDims.0 * newDims.1 * newDims.2
-        if totalElements == 0 { return [] }
-        guard let first = source.first else { return [] }
-        var buffer = [T](repeating: first, count: totalElements)
+        if totalElements == 0 || source.isEmpty { return [] }
         
         let oldStrides = strides(for: oldDims, fortran: fortran)
-        let newStrides = strides(for: newDims, fortran: fortran)
-        
         let channelStrideOld = oldStrides[axes.channel]
         let heightStrideOld = oldStrides[axes.height]
         let widthStrideOld = oldStrides[axes.width]
         
-        let channelStrideNew = newStrides[axes.channel]
-        let heightStrideNew = newStrides[axes.height]
-        let widthStrideNew = newStrides[axes.width]
+        // Поворот — это копирование со знаковыми шагами: (newY, newX) -> offset + newY·rowStep + newX·columnStep
+        let offset: Int
+        let rowStep: Int
+        let columnStep: Int
+        switch angle {
+        case .degree90:
+            // oldX = newY, oldY = oldHeight - 1 - newX
+            offset = (oldHeight - 1) * heightStrideOld
+            rowStep = widthStrideOld
+            columnStep = -heightStrideOld
+        case .degree180:
+            offset = (oldHeight - 1) * heightStrideOld + (oldWidth - 1) * widthStrideOld
+            rowStep = -heightStrideOld
+            columnStep = -widthStrideOld
+        case .degree270:
+            // oldX = oldWidth - 1 - newY, oldY = newX
+            offset = (oldWidth - 1) * widthStrideOld
+            rowStep = -widthStrideOld
+            columnStep = heightStrideOld
+        }
         
-        source.withUnsafeBufferPointer { src in
-            buffer.withUnsafeMutableBufferPointer { dst in
-                switch angle {
-                case .degree180:
-                    for ch in 0..<channels {
-                        let srcChannelBase = ch * channelStrideOld
-                        let dstChannelBase = ch * channelStrideNew
-                        for newY in 0..<newHeight {
-                            let oldY = oldHeight - 1 - newY
-                            let srcRowBase = srcChannelBase + oldY * heightStrideOld + (oldWidth - 1) * widthStrideOld
-                            let dstRowBase = dstChannelBase + newY * heightStrideNew
-                            var srcIndex = srcRowBase
-                            var dstIndex = dstRowBase
-                            for _ in 0..<newWidth {
-                                dst[dstIndex] = src[srcIndex]
-                                srcIndex -= widthStrideOld
-                                dstIndex += widthStrideNew
-                            }
-                        }
-                    }
-                case .degree90:
-                    for ch in 0..<channels {
-                        let srcChannelBase = ch * channelStrideOld
-                        let dstChannelBase = ch * channelStrideNew
-                        for newY in 0..<newHeight {
-                            let oldX = newY
-                            let srcRowBase = srcChannelBase + oldX * widthStrideOld + (oldHeight - 1) * heightStrideOld
-                            let dstRowBase = dstChannelBase + newY * heightStrideNew
-                            var srcIndex = srcRowBase
-                            var dstIndex = dstRowBase
-                            for _ in 0..<newWidth {
-                                dst[dstIndex] = src[srcIndex]
-                                srcIndex -= heightStrideOld
-                                dstIndex += widthStrideNew
-                            }
-                        }
-                    }
-                case .degree270:
-                    for ch in 0..<channels {
-                        let srcChannelBase = ch * channelStrideOld
-                        let dstChannelBase = ch * channelStrideNew
-                        for newY in 0..<newHeight {
-                            let oldX = oldWidth - 1 - newY
-                            let srcRowBase = srcChannelBase + oldX * widthStrideOld
-                            let dstRowBase = dstChannelBase + newY * heightStrideNew
-                            var srcIndex = srcRowBase
-                            var dstIndex = dstRowBase
-                            for _ in 0..<newWidth {
-                                dst[dstIndex] = src[srcIndex]
-                                srcIndex += heightStrideOld
-                                dstIndex += widthStrideNew
-                            }
-                        }
-                    }
-                }
+        var sourceStrides = [0, 0, 0]
+        sourceStrides[axes.channel] = channelStrideOld
+        sourceStrides[axes.height] = rowStep
+        sourceStrides[axes.width] = columnStep
+        
+        return [T](unsafeUninitializedCapacity: totalElements) { buffer, initializedCount in
+            source.withUnsafeBytes { raw in
+                CubePermutation.stridedCopy(
+                    source: raw.baseAddress!,
+                    destination: UnsafeMutableRawPointer(buffer.baseAddress!),
+                    elementSize: MemoryLayout<T>.stride,
+                    destinationDims: [newDims.0, newDims.1, newDims.2],
+                    sourceStrides: sourceStrides,
+                    sourceOffset: offset,
+                    fortranOrder: fortran
+                )
             }
+            initializedCount = totalElements
         }
-        
-        return buffer
     }
     
     private static func strides(for dims: (Int, Int, Int), fortran: Bool) -> [Int] {
@@ -967,6 +596,94 @@ class CubeAutoSpatialCropper {
         var score: Double
     }
 
+    /// Уровней пирамиды не больше этого числа, а сетка самого грубого — не мельче minCoarseGridSide
+    private static let maxPyramidLevels = 4
+    private static let minCoarseGridSide = 12
+    /// Сколько лучших кандидатов уровня уточняется на следующем
+    private static let seedLimit = 16
+    /// Сколько финалистов пересчитывается точной метрикой
+    private static let topCandidateLimit = 8
+
+    /// Оценка кандидата на сетке уровня пирамиды. Ячейки усредняются по интегральному
+    /// изображению канала и нормируются min-max, как и в точной оценке.
+    private struct GridScorer {
+        let metric: SpatialAutoCropMetric
+        let sources: [SummedAreaTable]
+        /// Нормированные сетки референса подряд, по одной на пару каналов
+        let references: [Double]
+        let gridWidth: Int
+        let gridHeight: Int
+        let prune: Bool
+
+        /// nil — кандидат заведомо хуже `bound` и досчитывать его не нужно
+        func score(
+            _ candidate: CropCandidate,
+            bound: Double?,
+            columnBounds: UnsafeMutablePointer<Int>,
+            rowBounds: UnsafeMutablePointer<Int>,
+            cells: UnsafeMutablePointer<Double>
+        ) -> Double? {
+            let cellCount = gridWidth * gridHeight
+            let pairCount = Double(sources.count)
+            let limit = prune ? bound : nil
+
+            return references.withUnsafeBufferPointer { referencePtr -> Double? in
+                var total = 0.0
+                for (pair, source) in sources.enumerated() {
+                    source.sampleGrid(
+                        x: candidate.x,
+                        y: candidate.y,
+                        width: candidate.width,
+                        height: candidate.height,
+                        gridWidth: gridWidth,
+                        gridHeight: gridHeight,
+                        columnBounds: columnBounds,
+                        rowBounds: rowBounds,
+                        into: cells
+                    )
+                    var minValue = Double.infinity
+                    var maxValue = -Double.infinity
+                    for i in 0..<cellCount {
+                        minValue = min(minValue, cells[i])
+                        maxValue = max(maxValue, cells[i])
+                    }
+                    let range = maxValue - minValue
+                    let scale = range > 1e-12 ? 1.0 / range : 0.0
+                    let reference = referencePtr.baseAddress! + pair * cellCount
+
+                    switch metric {
+                    case .mse:
+                        var sum = 0.0
+                        for row in 0..<gridHeight {
+                            let start = row * gridWidth
+                            for i in start..<(start + gridWidth) {
+                                let diff = (cells[i] - minValue) * scale - reference[i]
+                                sum += diff * diff
+                            }
+                            // Остальные слагаемые неотрицательны: частичная сумма — нижняя граница MSE
+                            if let limit, (total + sum / Double(cellCount)) / pairCount > limit {
+                                return nil
+                            }
+                        }
+                        total += sum / Double(cellCount)
+                    case .ssim:
+                        for i in 0..<cellCount {
+                            cells[i] = (cells[i] - minValue) * scale
+                        }
+                        let moments = ImageSimilarity.moments(cells, reference, count: cellCount)
+                        total += ImageSimilarity.ssim(moments, c1: 0.0001, c2: 0.0009, epsilon: 1e-12, degenerate: 0.0)
+                        // SSIM каждой оставшейся пары не больше 1 — верхняя граница среднего
+                        let remaining = pairCount - Double(pair + 1)
+                        if let limit, (total + remaining) / pairCount < limit {
+                            return nil
+                        }
+                    }
+                }
+                return total / pairCount
+            }
+        }
+    }
+
     static func findBestCrop(
         sourceCube: HyperCube,
         sourceLayout: CubeLayout,
@@ -1053,16 +770,61 @@ class CubeAutoSpatialCropper {
             }
         }
 
-        let coarsePositionStep = settings.useCoarseToFine ? max(positionStep * 2, positionStep) : positionStep
-        let coarseSizeStep = settings.useCoarseToFine ? max(sizeStep * 2, sizeStep) : sizeStep
-        let widthValues = steppedValues(min: minWidth, max: maxWidth, step: sizeStep)
-        let heightValues = steppedValues(min: minHeight, max: maxHeight, step: sizeStep)
-        let coarseWidthValues = settings.useCoarseToFine
-            ? steppedValues(min: minWidth, max: maxWidth, step: coarseSizeStep)
-            : widthValues
-        let coarseHeightValues = settings.useCoarseToFine
-            ? steppedValues(min: minHeight, max: maxHeight, step: coarseSizeStep)
-            : heightValues
+        // Пирамида сеток сравнения: уровень 0 — референс, уменьшенный в downsampleFactor раз,
+        // каждый следующий уровень вдвое грубее. На сетке кандидат оценивается усреднением
+        // ячеек по интегральному изображению канала, без вырезания и ресайза.
+        let finestGridWidth = max(1, referenceWidth / downsampleFactor)
+        let finestGridHeight = max(1, referenceHeight / downsampleFactor)
+        var levelCount = 1
+        if settings.useCoarseToFine {
+            while levelCount < maxPyramidLevels,
+                  min(finestGridWidth, finestGridHeight) >> levelCount >= minCoarseGridSide {
+                levelCount += 1
+            }
+        }
+
+        var sourceTables: [SummedAreaTable] = []
+        var referenceTables: [SummedAreaTable] = []
+        for idx in 0..<settings.sourceChannels.count {
+            guard let source = sourceChannelData[settings.sourceChannels[idx]],
+                  let reference = referenceChannelData[settings.referenceChannels[idx]] else {
+                return nil
+            }
+            sourceTables.append(SummedAreaTable(source, width: sourceWidth, height: sourceHeight))
+            referenceTables.append(SummedAreaTable(reference, width: referenceWidth, height: referenceHeight))
+        }
+
+        func makeScorer(level: Int) -> GridScorer {
+            let gridWidth = max(1, finestGridWidth >> level)
+            let gridHeight = max(1, finestGridHeight >> level)
+            var references: [Double] = []
+            references.reserveCapacity(referenceTables.count * gridWidth * gridHeight)
+            for table in referenceTables {
+                let grid = table.sampledGrid(
+                    x: 0,
+                    y: 0,
+                    width: referenceWidth,
+                    height: referenceHeight,
+                    gridWidth: gridWidth,
+                    gridHeight: gridHeight
+                )
+                references += normalizeData(grid)
+            }
+            return GridScorer(
+                metric: settings.metric,
+                sources: sourceTables,
+                references: references,
+                gridWidth: gridWidth,
+                gridHeight: gridHeight,
+                prune: settings.enableEarlyCandidatePruning
+            )
+        }
+
+        let coarseScale = 1 << (levelCount - 1)
+        let coarsePositionStep = positionStep * coarseScale
+        let coarseSizeStep = sizeStep * coarseScale
+        let coarseWidthValues = steppedValues(min: minWidth, max: maxWidth, step: coarseSizeStep)
+        let coarseHeightValues = steppedValues(min: minHeight, max: maxHeight, step: coarseSizeStep)
 
         let coarseCount = countCandidates(
             sourceWidth: sourceWidth,
@@ -1077,23 +839,35 @@ class CubeAutoSpatialCropper {
             : 0
         let refinePositionStep = max(1, positionStep / 2)
         let refineSizeStep = max(1, sizeStep / 2)
-        let topCandidateLimit = 8
-        let sizeRefineRadius = sizeStep + refinementReserve
-        let positionRefineRadius = positionStep + refinementReserve
-        let refineEstimatePerSeed = max(1, (2 * sizeRefineRadius / refineSizeStep + 1) * (2 * sizeRefineRadius / refineSizeStep + 1))
-            * max(1, (2 * positionRefineRadius / refinePositionStep + 1) * (2 * positionRefineRadius / refinePositionStep + 1))
-        let estimatedTotalCandidates = settings.useCoarseToFine
-            ? coarseCount + topCandidateLimit * refineEstimatePerSeed
-            : coarseCount
+        func neighbourhoodEstimate(sizeRadius: Int, sizeStep: Int, positionRadius: Int, positionStep: Int) -> Int {
+            let sizes = 2 * sizeRadius / max(1, sizeStep) + 1
+            let positions = 2 * positionRadius / max(1, positionStep) + 1
+            return sizes * sizes * positions * positions
+        }
+        // Между уровнями пирамиды окрестность — шаг предыдущего уровня (5×5 по размеру и позиции)
+        let levelRefineEstimate = (levelCount - 1) * seedLimit * neighbourhoodEstimate(
+            sizeRadius: 2, sizeStep: 1, positionRadius: 2, positionStep: 1
+        )
+        let polishEstimate = settings.useCoarseToFine
+            ? topCandidateLimit * neighbourhoodEstimate(
+                sizeRadius: sizeStep + refinementReserve,
+                sizeStep: refineSizeStep,
+                positionRadius: positionStep + refinementReserve,
+                positionStep: refinePositionStep
+            ) + topCandidateLimit
+            : 0
+        let estimatedTotalCandidates = coarseCount + levelRefineEstimate + polishEstimate
 
         var evaluatedCandidates = 0
         var bestCandidate: CropCandidate?
         var bestScore: Double?
-        var visited: Set<CropCandidate> = []
+        var reportedCandidates = 0
         let progressInterval = max(1, estimatedTotalCandidates / 200)
+        let progressLock = NSLock()
 
         func reportProgress(force: Bool = false) {
-            guard force || evaluatedCandidates % progressInterval == 0 else { return }
+            guard force || evaluatedCandidates - reportedCandidates >= progressInterval else { return }
+            reportedCandidates = evaluatedCandidates
             let progress = estimatedTotalCandidates > 0
                 ? min(0.99, Double(evaluatedCandidates) / Double(estimatedTotalCandidates))
                 : 0.0
@@ -1123,100 +897,170 @@ class CubeAutoSpatialCropper {
             )
         }
 
-        func maybeUpdateBest(candidate: CropCandidate, score: Double) -> Bool {
-            guard isFinite(score) else { return false }
-            if isBetter(score: score, than: bestScore, metric: settings.metric) {
-                bestScore = score
-                bestCandidate = candidate
-                return true
+        func isValid(_ candidate: CropCandidate) -> Bool {
+            candidate.width > 0 && candidate.height > 0
+                && candidate.x >= 0 && candidate.y >= 0
+                && candidate.x + candidate.width <= sourceWidth
+                && candidate.y + candidate.height <= sourceHeight
+                && matchesReferenceAspectRatio(width: candidate.width, height: candidate.height)
+        }
+
+        /// Оценивает кандидатов параллельно и возвращает `keep` лучших.
+        /// Каждый поток держит свой top-K; его худший элемент — граница отсечения для остальных кандидатов.
+        func evaluate(_ candidates: [CropCandidate], level: Int, keep: Int) -> [ScoredCandidate] {
+            guard !candidates.isEmpty else { return [] }
+            let scorer = makeScorer(level: level)
+            let maxChunks = ParallelCompute.workerCount * 8
+            let chunkCount = ParallelCompute.chunkCount(count: candidates.count, minChunk: 16, maxChunks: maxChunks)
+            var partials = [[ScoredCandidate]](repeating: [], count: chunkCount)
+
+            partials.withUnsafeMutableBufferPointer { partialPtr in
+                candidates.withUnsafeBufferPointer { list in
+                    ParallelCompute.forEachChunk(count: list.count, minChunk: 16, maxChunks: maxChunks) { chunkIndex, range in
+                        let columnBounds = UnsafeMutablePointer<Int>.allocate(capacity: scorer.gridWidth + 1)
+                        let rowBounds = UnsafeMutablePointer<Int>.allocate(capacity: scorer.gridHeight + 1)
+                        let cells = UnsafeMutablePointer<Double>.allocate(capacity: scorer.gridWidth * scorer.gridHeight)
+                        defer {
+                            columnBounds.deallocate()
+                            rowBounds.deallocate()
+                            cells.deallocate()
+                        }
+
+                        var top: [ScoredCandidate] = []
+                        for index in range {
+                            let candidate = list[index]
+                            let bound = top.count == keep ? top.last?.score : nil
+                            guard let score = scorer.score(
+                                candidate,
+                                bound: bound,
+                                columnBounds: columnBounds,
+                                rowBounds: rowBounds,
+                                cells: cells
+                            ), isFinite(score) else {
+                                continue
+                            }
+                            insertRanked(ScoredCandidate(candidate: candidate, score: score), into: &top, limit: keep, metric: settings.metric)
+                        }
+                        partialPtr[chunkIndex] = top
+
+                        progressLock.lock()
+                        evaluatedCandidates += range.count
+                        var improved = false
+                        if let first = top.first, isBetter(score: first.score, than: bestScore, metric: settings.metric) {
+                            bestScore = first.score
+                            bestCandidate = first.candidate
+                            improved = true
+                        }
+                        reportProgress(force: improved)
+                        progressLock.unlock()
+                    }
+                }
+            }
+
+            var merged: [ScoredCandidate] = []
+            for partial in partials {
+                for item in partial {
+                    insertRanked(item, into: &merged, limit: keep, metric: settings.metric)
+                }
             }
-            return false
+            return merged
         }
 
-        func evaluateCandidate(_ candidate: CropCandidate) -> Double? {
-            guard candidate.width > 0, candidate.height > 0 else { return nil }
-            guard candidate.x >= 0, candidate.y >= 0 else { return nil }
-            guard matchesReferenceAspectRatio(width: candidate.width, height: candidate.height) else { return nil }
-            guard candidate.x + candidate.width <= sourceWidth,
-                  candidate.y + candidate.height <= sourceHeight else {
-                return nil
+        /// Точная оценка кандидатов (вырезание, билинейный ресайз, усреднение) параллельно;
+        /// возвращает лучшего. При равных баллах побеждает более ранний кандидат списка.
+        func evaluateExact(_ candidates: [CropCandidate]) -> ScoredCandidate? {
+            guard !candidates.isEmpty else { return nil }
+            var scores = [Double](repeating: .nan, count: candidates.count)
+            scores.withUnsafeMutableBufferPointer { scorePtr in
+                candidates.withUnsafeBufferPointer { list in
+                    ParallelCompute.forEachChunk(
+                        count: list.count,
+                        maxChunks: ParallelCompute.workerCount * 8
+                    ) { _, range in
+                        var localBest: ScoredCandidate?
+                        for index in range {
+                            let score = exactScore(
+                                list[index],
+                                settings: settings,
+                                sourceChannelData: sourceChannelData,
+                                referenceEvalData: referenceEvalData,
+                                sourceWidth: sourceWidth,
+                                referenceWidth: referenceWidth,
+                                referenceHeight: referenceHeight,
+                                evalReferenceWidth: evalReferenceWidth,
+                                evalReferenceHeight: evalReferenceHeight
+                            ) ?? .nan
+                            scorePtr[index] = score
+                            if isFinite(score), isBetter(score: score, than: localBest?.score, metric: settings.metric) {
+                                localBest = ScoredCandidate(candidate: list[index], score: score)
+                            }
+                        }
+
+                        progressLock.lock()
+                        evaluatedCandidates += range.count
+                        var improved = false
+                        if let localBest, isBetter(score: localBest.score, than: bestScore, metric: settings.metric) {
+                            bestScore = localBest.score
+                            bestCandidate = localBest.candidate
+                            improved = true
+                        }
+                        reportProgress(force: improved)
+                        progressLock.unlock()
+                    }
+                }
             }
-            guard visited.insert(candidate).inserted else { return nil }
-
-            evaluatedCandidates += 1
-
-            var metricSum = 0.0
-            let pairCount = settings.sourceChannels.count
-            for idx in 0..<pairCount {
-                let sourceChannelIndex = settings.sourceChannels[idx]
-                let referenceChannelIndex = settings.referenceChannels[idx]
-                guard let source = sourceChannelData[sourceChannelIndex],
-                      let reference = referenceEvalData[referenceChannelIndex] else {
-                    return nil
+            var best: ScoredCandidate?
+            for (candidate, score) in zip(candidates, scores) where isFinite(score) {
+                if isBetter(score: score, than: best?.score, metric: settings.metric) {
+                    best = ScoredCandidate(candidate: candidate, score: score)
                 }
+            }
+            return best
+        }
+
+        /// Кандидаты вокруг затравок: размеры ±sizeRadius с шагом sizeStep, позиции ±positionRadius с шагом positionStep
+        func neighbourhood(
+            of seeds: [CropCandidate],
+            sizeRadius: Int,
+            sizeStep: Int,
+            positionRadius: Int,
+            positionStep: Int
+        ) -> [CropCandidate] {
+            var unique: Set<CropCandidate> = []
+            var result: [CropCandidate] = []
+            for seed in seeds {
+                let minLocalWidth = bounded(seed.width - sizeRadius, min: minWidth, max: maxWidth)
+                let maxLocalWidth = bounded(seed.width + sizeRadius, min: minLocalWidth, max: maxWidth)
+                let minLocalHeight = bounded(seed.height - sizeRadius, min: minHeight, max: maxHeight)
+                let maxLocalHeight = bounded(seed.height + sizeRadius, min: minLocalHeight, max: maxHeight)
 
-                let cropped = cropChannel(
-                    source,
+                let localSizes = enumerateSizePairs(
                     sourceWidth: sourceWidth,
-                    x: candidate.x,
-                    y: candidate.y,
-                    width: candidate.width,
-                    height: candidate.height
-                )
-                let resized = resizeBilinear(
-                    data: cropped,
-                    srcWidth: candidate.width,
-                    srcHeight: candidate.height,
-                    dstWidth: referenceWidth,
-                    dstHeight: referenceHeight
+                    sourceHeight: sourceHeight,
+                    widthValues: steppedValues(min: minLocalWidth, max: maxLocalWidth, step: sizeStep),
+                    heightValues: steppedValues(min: minLocalHeight, max: maxLocalHeight, step: sizeStep),
+                    sizeFilter: matchesReferenceAspectRatio
                 )
 
-                let evalData: [Double]
-                if downsampleFactor > 1 {
-                    evalData = downsampleMean(
-                        resized,
-                        width: referenceWidth,
-                        height: referenceHeight,
-                        factor: downsampleFactor
-                    ).data
-                } else {
-                    evalData = resized
-                }
+                for size in localSizes {
+                    let maxX = max(0, sourceWidth - size.width)
+                    let maxY = max(0, sourceHeight - size.height)
+                    let minLocalX = bounded(seed.x - positionRadius, min: 0, max: maxX)
+                    let maxLocalX = bounded(seed.x + positionRadius, min: minLocalX, max: maxX)
+                    let minLocalY = bounded(seed.y - positionRadius, min: 0, max: maxY)
+                    let maxLocalY = bounded(seed.y + positionRadius, min: minLocalY, max: maxY)
 
-                let score = computeMetric(
-                    candidate: evalData,
-                    reference: reference,
-                    width: evalReferenceWidth,
-                    height: evalReferenceHeight,
-                    metric: settings.metric
-                )
-                metricSum += score
-
-                if settings.metric == .mse,
-                   settings.enableEarlyCandidatePruning,
-                   let currentBest = bestScore {
-                    let partial = metricSum / Double(idx + 1)
-                    if partial > currentBest {
-                        return nil
+                    for y in steppedValues(min: minLocalY, max: maxLocalY, step: positionStep) {
+                        for x in steppedValues(min: minLocalX, max: maxLocalX, step: positionStep) {
+                            let candidate = CropCandidate(x: x, y: y, width: size.width, height: size.height)
+                            if isValid(candidate), unique.insert(candidate).inserted {
+                                result.append(candidate)
+                            }
+                        }
                     }
                 }
             }
-
-            let score = metricSum / Double(max(pairCount, 1))
-            let didImprove = maybeUpdateBest(candidate: candidate, score: score)
-            reportProgress(force: didImprove)
-            return score
-        }
-
-        var topCandidates: [ScoredCandidate] = []
-        func rememberTop(candidate: CropCandidate, score: Double) {
-            topCandidates.append(ScoredCandidate(candidate: candidate, score: score))
-            topCandidates.sort {
-                settings.metric == .ssim ? $0.score > $1.score : $0.score < $1.score
-            }
-            if topCandidates.count > topCandidateLimit {
-                topCandidates.removeLast(topCandidates.count - topCandidateLimit)
-            }
+            return result
         }
 
         progressCallback?(
@@ -1229,6 +1073,9 @@ class CubeAutoSpatialCropper {
             )
         )
 
+        // Самый грубый уровень: полный перебор с шагами, увеличенными пропорционально уровню
+        var coarseCandidates: [CropCandidate] = []
+        coarseCandidates.reserveCapacity(coarseCount)
         enumerateCandidates(
             sourceWidth: sourceWidth,
             sourceHeight: sourceHeight,
@@ -1237,52 +1084,53 @@ class CubeAutoSpatialCropper {
             positionStep: coarsePositionStep,
             sizeFilter: matchesReferenceAspectRatio
         ) { candidate in
-            guard let score = evaluateCandidate(candidate) else { return }
-            if settings.useCoarseToFine {
-                rememberTop(candidate: candidate, score: score)
+            if isValid(candidate) {
+                coarseCandidates.append(candidate)
             }
         }
-
+        let winner: ScoredCandidate?
         if settings.useCoarseToFine {
-            let seeds = topCandidates.map { $0.candidate }
-            for seed in seeds {
-                let sizeRadius = sizeStep + refinementReserve
-                let positionRadius = positionStep + refinementReserve
-                let minLocalWidth = bounded(seed.width - sizeRadius, min: minWidth, max: maxWidth)
-                let maxLocalWidth = bounded(seed.width + sizeRadius, min: minLocalWidth, max: maxWidth)
-                let minLocalHeight = bounded(seed.height - sizeRadius, min: minHeight, max: maxHeight)
-                let maxLocalHeight = bounded(seed.height + sizeRadius, min: minLocalHeight, max: maxHeight)
-
-                let localWidths = steppedValues(min: minLocalWidth, max: maxLocalWidth, step: refineSizeStep)
-                let localHeights = steppedValues(min: minLocalHeight, max: maxLocalHeight, step: refineSizeStep)
-                let localSizes = enumerateSizePairs(
-                    sourceWidth: sourceWidth,
-                    sourceHeight: sourceHeight,
-                    widthValues: localWidths,
-                    heightValues: localHeights,
-                    sizeFilter: matchesReferenceAspectRatio
-                )
-
-                for size in localSizes {
-                    let width = size.width
-                    let height = size.height
-                    let maxX = max(0, sourceWidth - width)
-                    let maxY = max(0, sourceHeight - height)
-                    let minLocalX = bounded(seed.x - positionRadius, min: 0, max: maxX)
-                    let maxLocalX = bounded(seed.x + positionRadius, min: minLocalX, max: maxX)
-                    let minLocalY = bounded(seed.y - positionRadius, min: 0, max: maxY)
-                    let maxLocalY = bounded(seed.y + positionRadius, min: minLocalY, max: maxY)
-
-                    let xValues = steppedValues(min: minLocalX, max: maxLocalX, step: refinePositionStep)
-                    let yValues = steppedValues(min: minLocalY, max: maxLocalY, step: refinePositionStep)
-                    for y in yValues {
-                        for x in xValues {
-                            _ = evaluateCandidate(CropCandidate(x: x, y: y, width: width, height: height))
-                        }
-                    }
+            let finalKeep = topCandidateLimit
+            var survivors = evaluate(coarseCandidates, level: levelCount - 1, keep: levelCount > 1 ? seedLimit : finalKeep)
+
+            // Уточнение на более детальных уровнях вокруг лучших кандидатов предыдущего
+            if levelCount > 1 {
+                for level in stride(from: levelCount - 2, through: 0, by: -1) {
+                    let scale = 1 << level
+                    let candidates = neighbourhood(
+                        of: survivors.map { $0.candidate },
+                        sizeRadius: 2 * sizeStep * scale,
+                        sizeStep: sizeStep * scale,
+                        positionRadius: 2 * positionStep * scale,
+                        positionStep: positionStep * scale
+                    )
+                    survivors = evaluate(candidates, level: level, keep: level > 0 ? seedLimit : finalKeep)
                 }
             }
+
+            // Финальная доводка на уровне 0 с половинным шагом, как в прежнем уточнении
+            let candidates = neighbourhood(
+                of: survivors.map { $0.candidate },
+                sizeRadius: sizeStep + refinementReserve,
+                sizeStep: refineSizeStep,
+                positionRadius: positionStep + refinementReserve,
+                positionStep: refinePositionStep
+            )
+            survivors = evaluate(candidates, level: 0, keep: finalKeep)
+
+            // Финалисты пересчитываются точной метрикой, чтобы итоговый балл
+            // совпадал по смыслу с полным перебором
+            progressLock.lock()
+            bestCandidate = nil
+            bestScore = nil
+            progressLock.unlock()
+            winner = evaluateExact(survivors.map { $0.candidate })
+        } else {
+            // Без грубого поиска — полный перебор сетки кандидатов точной метрикой, как раньше
+            winner = evaluateExact(coarseCandidates)
         }
+        bestCandidate = winner?.candidate
+        bestScore = winner?.score
 
         reportProgress(force: true)
 
@@ -1322,6 +1170,83 @@ class CubeAutoSpatialCropper {
         )
     }
 
+    /// Точная оценка кандидата: вырезание каналов, билинейный ресайз к референсу,
+    /// усреднение в downsampleFactor раз и метрика по нормированным данным
+    private static func exactScore(
+        _ candidate: CropCandidate,
+        settings: SpatialAutoCropSettings,
+        sourceChannelData: [Int: [Double]],
+        referenceEvalData: [Int: [Double]],
+        sourceWidth: Int,
+        referenceWidth: Int,
+        referenceHeight: Int,
+        evalReferenceWidth: Int,
+        evalReferenceHeight: Int
+    ) -> Double? {
+        let downsampleFactor = max(1, settings.downsampleFactor)
+        var metricSum = 0.0
+        let pairCount = settings.sourceChannels.count
+        for idx in 0..<pairCount {
+            guard let source = sourceChannelData[settings.sourceChannels[idx]],
+                  let reference = referenceEvalData[settings.referenceChannels[idx]] else {
+                return nil
+            }
+
+            let cropped = cropChannel(
+                source,
+                sourceWidth: sourceWidth,
+                x: candidate.x,
+                y: candidate.y,
+                width: candidate.width,
+                height: candidate.height
+            )
+            let resized = resizeBilinear(
+                data: cropped,
+                srcWidth: candidate.width,
+                srcHeight: candidate.height,
+                dstWidth: referenceWidth,
+                dstHeight: referenceHeight
+            )
+
+            let evalData: [Double]
+            if downsampleFactor > 1 {
+                evalData = downsampleMean(
+                    resized,
+                    width: referenceWidth,
+                    height: referenceHeight,
+                    factor: downsampleFactor
+                ).data
+            } else {
+                evalData = resized
+            }
+
+            metricSum += computeMetric(
+                candidate: evalData,
+                reference: reference,
+                width: evalReferenceWidth,
+                height: evalReferenceHeight,
+                metric: settings.metric
+            )
+        }
+        return metricSum / Double(max(pairCount, 1))
+    }
+
+    private static func insertRanked(
+        _ item: ScoredCandidate,
+        into list: inout [ScoredCandidate],
+        limit: Int,
+        metric: SpatialAutoCropMetric
+    ) {
+        if list.count == limit, let last = list.last, !isBetter(score: item.score, than: last.score, metric: metric) {
+            return
+        }
+        let position = list.firstIndex { isBetter(score: item.score, than: $0.score, metric: metric) } ?? list.count
+        list.insert(item, at: position)
+        if list.count > limit {
+            list.removeLast()
+        }
+    }
+
     private static func enumerateCandidates(
         sourceWidth: Int,
         sourceHeight: Int,
@@ -1430,18 +1355,16 @@ class CubeAutoSpatialCropper {
         channelIndex: Int,
         axes: (channel: Int, height: Int, width: Int)
     ) -> [Double] {
-        let dims = [cube.dims.0, cube.dims.1, cube.dims.2]
-        let width = dims[axes.width]
-        let height = dims[axes.height]
-        var result = [Double](repeating: 0, count: width * height)
-        for y in 0..<height {
-            for x in 0..<width {
-                var idx = [0, 0, 0]
-                idx[axes.channel] = channelIndex
-                idx[axes.height] = y
-                idx[axes.width] = x
-                let linear = cube.linearIndex(i0: idx[0], i1: idx[1], i2: idx[2])
-                result[y * width + x] = cube.getValue(at: linear)
+        let strides = cube.axisStrides(axes: axes)
+        var result = [Double](repeating: 0, count: strides.width * strides.height)
+        result.withUnsafeMutableBufferPointer { out in
+            for y in 0..<strides.height {
+                cube.storage.gather(
+                    base: strides.offset(channel: channelIndex, x: 0, y: y),
+                    stride: strides.widthStride,
+                    count: strides.width,
+                    into: out.baseAddress! + y * strides.width
+                )
             }
         }
         return result
@@ -1573,12 +1496,7 @@ class CubeAutoSpatialCropper {
         case .ssim:
             return computeSSIMDirect(normCandidate, normReference)
         case .mse:
-            var mse = 0.0
-            for i in 0..<normCandidate.count {
-                let diff = normCandidate[i] - normReference[i]
-                mse += diff * diff
-            }
-            return mse / Double(normCandidate.count)
+            return ImageSimilarity.meanSquaredError(normCandidate, normReference) ?? Double.infinity
         }
     }
 
@@ -1602,37 +1520,7 @@ class CubeAutoSpatialCropper {
     }
 
     private static func computeSSIMDirect(_ lhs: [Double], _ rhs: [Double]) -> Double {
-        guard lhs.count == rhs.count, !lhs.isEmpty else { return -1.0 }
-        let count = Double(lhs.count)
-
-        var sumL = 0.0
-        var sumR = 0.0
-        var sumSqL = 0.0
-        var sumSqR = 0.0
-        var sumProd = 0.0
-
-        for i in 0..<lhs.count {
-            let l = lhs[i]
-            let r = rhs[i]
-            sumL += l
-            sumR += r
-            sumSqL += l * l
-            sumSqR += r * r
-            sumProd += l * r
-        }
-
-        let muL = sumL / count
-        let muR = sumR / count
-        let sigmaLSq = max(0, sumSqL / count - muL * muL)
-        let sigmaRSq = max(0, sumSqR / count - muR * muR)
-        let sigmaLR = sumProd / count - muL * muR
-
-        let c1 = 0.0001
-        let c2 = 0.0009
-        let numerator = (2.0 * muL * muR + c1) * (2.0 * sigmaLR + c2)
-        let denominator = (muL * muL + muR * muR + c1) * (sigmaLSq + sigmaRSq + c2)
-        guard denominator > 1e-12 else { return 0.0 }
-        return numerator / denominator
+        ImageSimilarity.globalSSIM(lhs, rhs, c1: 0.0001, c2: 0.0009, epsilon: 1e-12, degenerate: 0.0) ?? -1.0
     }
 
     private static func isBetter(score: Double, than currentBest: Double?, metric: SpatialAutoCropMetric) -> Bool {
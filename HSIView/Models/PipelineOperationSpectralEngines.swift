@@ -266,52 +266,21 @@ class CubeSpectralInterpolator {
             targetWavelengths = buildTargetWavelengths(min: targetMin, max: targetMax, count: targetCount)
         }
         
-        let (sortedWavelengths, indexMap) = sortedWavelengthsIfNeeded(wavelengths)
-        let outputChannels = targetWavelengths.count
-        
-        dimsArray[axes.channel] = outputChannels
-        let totalElements = dimsArray[0] * dimsArray[1] * dimsArray[2]
-        
-        switch parameters.dataType {
-        case .float64:
-            var output = [Double](repeating: 0, count: totalElements)
-            fillOutput(
-                cube: cube,
-                axes: axes,
-                dims: dimsArray,
-                sortedWavelengths: sortedWavelengths,
-                indexMap: indexMap,
-                targetWavelengths: targetWavelengths,
-                method: parameters.method,
-                extrapolation: parameters.extrapolation,
-                into: &output
-            )
-            return HyperCube(
-                dims: (dimsArray[0], dimsArray[1], dimsArray[2]),
-                storage: .float64(output),
-                sourceFormat: cube.sourceFormat + " [Spectral]",
-                isFortranOrder: cube.isFortranOrder,
-                wavelengths: targetWavelengths, geoReference: cube.geoReference)
-        case .float32:
-            var output = [Float](repeating: 0, count: totalElements)
-            fillOutput(
-                cube: cube,
-                axes: axes,
-                dims: dimsArray,
-                sortedWavelengths: sortedWavelengths,
-                indexMap: indexMap,
-                targetWavelengths: targetWavelengths,
-                method: parameters.method,
-                extrapolation: parameters.extrapolation,
-                into: &output
-            )
-            return HyperCube(
-                dims: (dimsArray[0], dimsArray[1], dimsArray[2]),
-                storage: .float32(output),
-                sourceFormat: cube.sourceFormat + " [Spectral]",
-                isFortranOrder: cube.isFortranOrder,
-                wavelengths: targetWavelengths, geoReference: cube.geoReference)
-        }
+        let matrix = SpectralResamplingMatrix(
+            sourceWavelengths: wavelengths,
+            targetWavelengths: targetWavelengths,
+            method: parameters.method,
+            extrapolation: parameters.extrapolation
+        )
+        let storage = matrix.apply(cube: cube, axes: axes, outputFloat32: parameters.dataType == .float32)
+        
+        dimsArray[axes.channel] = targetWavelengths.count
+        return HyperCube(
+            dims: (dimsArray[0], dimsArray[1], dimsArray[2]),
+            storage: storage,
+            sourceFormat: cube.sourceFormat + " [Spectral]",
+            isFortranOrder: cube.isFortranOrder,
+            wavelengths: targetWavelengths, geoReference: cube.geoReference)
     }
     
     private static func buildTargetWavelengths(min: Double, max: Double, count: Int) -> [Double] {
@@ -325,325 +294,6 @@ class CubeSpectralInterpolator {
         guard wavelengths.allSatisfy({ $0.isFinite }) else { return nil }
         return wavelengths
     }
-    
-    private static func sortedWavelengthsIfNeeded(_ wavelengths: [Double]) -> ([Double], [Int]) {
-        let isSorted = zip(wavelengths, wavelengths.dropFirst()).allSatisfy { $0 < $1 }
-        if isSorted {
-            return (wavelengths, Array(0..<wavelengths.count))
-        }
-        let indices = wavelengths.indices.sorted { wavelengths[$0] < wavelengths[$1] }
-        let sorted = indices.map { wavelengths[$0] }
-        return (sorted, indices)
-    }
-    
-    private static func fillOutput(
-        cube: HyperCube,
-        axes: (channel: Int, height: Int, width: Int),
-        dims: [Int],
-        sortedWavelengths: [Double],
-        indexMap: [Int],
-        targetWavelengths: [Double],
-        method: SpectralInterpolationMethod,
-        extrapolation: SpectralExtrapolationMode,
-        into output: inout [Double]
-    ) {
-        let height = dims[axes.height]
-        let width = dims[axes.width]
-        let outputChannels = targetWavelengths.count
-        let inputChannels = sortedWavelengths.count
-        
-        var spectrum = [Double](repeating: 0, count: inputChannels)
-        
-        for y in 0..<height {
-            for x in 0..<width {
-                for (sortedIdx, originalIdx) in indexMap.enumerated() {
-                    var idx3 = [0, 0, 0]
-                    idx3[axes.channel] = originalIdx
-                    idx3[axes.height] = y
-                    idx3[axes.width] = x
-                    let lin = cube.linearIndex(i0: idx3[0], i1: idx3[1], i2: idx3[2])
-                    spectrum[sortedIdx] = cube.getValue(at: lin)
-                }
-                
-                for c in 0..<outputChannels {
-                    let lambda = targetWavelengths[c]
-                    let value = interpolate(
-                        x: lambda,
-                        xs: sortedWavelengths,
-                        ys: spectrum,
-                        method: method,
-                        extrapolation: extrapolation
-                    )
-                    
-                    var outIdx3 = [0, 0, 0]
-                    outIdx3[axes.channel] = c
-                    outIdx3[axes.height] = y
-                    outIdx3[axes.width] = x
-                    let outLin = linearIndex(dims: dims, fortran: cube.isFortranOrder, i0: outIdx3[0], i1: outIdx3[1], i2: outIdx3[2])
-                    output[outLin] = value
-                }
-            }
-        }
-    }
-    
-    private static func fillOutput(
-        cube: HyperCube,
-        axes: (channel: Int, height: Int, width: Int),
-        dims: [Int],
-        sortedWavelengths: [Double],
-        indexMap: [Int],
-        targetWavelengths: [Double],
-        method: SpectralInterpolationMethod,
-        extrapolation: SpectralExtrapolationMode,
-        into output: inout [Float]
-    ) {
-        let height = dims[axes.height]
-        let width = dims[axes.width]
-        let outputChannels = targetWavelengths.count
-        let inputChannels = sortedWavelengths.count
-        
-        let xs = sortedWavelengths.map { Float($0) }
-        let targets = targetWavelengths.map { Float($0) }
-        var spectrum = [Float](repeating: 0, count: inputChannels)
-        
-        for y in 0..<height {
-            for x in 0..<width {
-                for (sortedIdx, originalIdx) in indexMap.enumerated() {
-                    var idx3 = [0, 0, 0]
-                    idx3[axes.channel] = originalIdx
-                    idx3[axes.height] = y
-                    idx3[axes.width] = x
-                    let lin = cube.linearIndex(i0: idx3[0], i1: idx3[1], i2: idx3[2])
-                    spectrum[sortedIdx] = Float(cube.getValue(at: lin))
-                }
-                
-                for c in 0..<outputChannels {
-                    let lambda = targets[c]
-                    let value = interpolate(
-                        x: lambda,
-                        xs: xs,
-                        ys: spectrum,
-                        method: method,
-                        extrapolation: extrapolation
-                    )
-                    
-                    var outIdx3 = [0, 0, 0]
-                    outIdx3[axes.channel] = c
-                    outIdx3[axes.height] = y
-                    outIdx3[axes.width] = x
-                    let outLin = linearIndex(dims: dims, fortran: cube.isFortranOrder, i0: outIdx3[0], i1: outIdx3[1], i2: outIdx3[2])
-                    output[outLin] = value
-                }
-            }
-        }
-    }
-    
-    private static func linearIndex(dims: [Int], fortran: Bool, i0: Int, i1: Int, i2: Int) -> Int {
-        if fortran {
-            return i0 + dims[0] * (i1 + dims[1] * i2)
-        }
-        return i2 + dims[2] * (i1 + dims[1] * i0)
-    }
-    
-    private static func interpolate(
-        x: Double,
-        xs: [Double],
-        ys: [Double],
-        method: SpectralInterpolationMethod,
-        extrapolation: SpectralExtrapolationMode
-    ) -> Double {
-        guard xs.count == ys.count, !xs.isEmpty else { return 0 }
-        if xs.count == 1 { return ys[0] }
-        
-        switch method {
-        case .nearest:
-            return nearest(x: x, xs: xs, ys: ys, extrapolation: extrapolation)
-        case .linear:
-            return linear(x: x, xs: xs, ys: ys, extrapolation: extrapolation)
-        case .cubic:
-            return cubic(x: x, xs: xs, ys: ys, extrapolation: extrapolation)
-        }
-    }
-    
-    private static func interpolate(
-        x: Float,
-        xs: [Float],
-        ys: [Float],
-        method: SpectralInterpolationMethod,
-        extrapolation: SpectralExtrapolationMode
-    ) -> Float {
-        guard xs.count == ys.count, !xs.isEmpty else { return 0 }
-        if xs.count == 1 { return ys[0] }
-        
-        switch method {
-        case .nearest:
-            return nearest(x: x, xs: xs, ys: ys, extrapolation: extrapolation)
-        case .linear:
-            return linear(x: x, xs: xs, ys: ys, extrapolation: extrapolation)
-        case .cubic:
-            return cubic(x: x, xs: xs, ys: ys, extrapolation: extrapolation)
-        }
-    }
-    
-    private static func nearest(x: Double, xs: [Double], ys: [Double], extrapolation: SpectralExtrapolationMode) -> Double {
-        let n = xs.count
-        if x <= xs[0] { return ys[0] }
-        if x >= xs[n - 1] { return ys[n - 1] }
-        let i = lowerBound(x: x, xs: xs)
-        let left = max(0, min(i - 1, n - 1))
-        let right = max(0, min(i, n - 1))
-        return abs(xs[left] - x) <= abs(xs[right] - x) ? ys[left] : ys[right]
-    }
-    
-    private static func linear(x: Double, xs: [Double], ys: [Double], extrapolation: SpectralExtrapolationMode) -> Double {
-        let n = xs.count
-        if x <= xs[0] {
-            return extrapolation == .clamp ? ys[0] : linearSegment(x: x, x0: xs[0], x1: xs[1], y0: ys[0], y1: ys[1])
-        }
-        if x >= xs[n - 1] {
-            return extrapolation == .clamp ? ys[n - 1] : linearSegment(x: x, x0: xs[n - 2], x1: xs[n - 1], y0: ys[n - 2], y1: ys[n - 1])
-        }
-        let i = lowerBound(x: x, xs: xs)
-        let i0 = max(0, i - 1)
-        let i1 = min(n - 1, i)
-        return linearSegment(x: x, x0: xs[i0], x1: xs[i1], y0: ys[i0], y1: ys[i1])
-    }
-    
-    private static func cubic(x: Double, xs: [Double], ys: [Double], extrapolation: SpectralExtrapolationMode) -> Double {
-        let n = xs.count
-        if n < 4 {
-            return linear(x: x, xs: xs, ys: ys, extrapolation: extrapolation)
-        }
-        
-        if x <= xs[0] {
-            if extrapolation == .clamp { return ys[0] }
-            return cubicLagrange(x: x, xs: xs, ys: ys, i0: 0, i1: 1, i2: 2, i3: 3)
-        }
-        if x >= xs[n - 1] {
-            if extrapolation == .clamp { return ys[n - 1] }
-            return cubicLagrange(x: x, xs: xs, ys: ys, i0: n - 4, i1: n - 3, i2: n - 2, i3: n - 1)
-        }
-        
-        let i = lowerBound(x: x, xs: xs)
-        let i1 = max(1, min(i, n - 2))
-        let i0 = max(0, i1 - 1)
-        let i2 = min(n - 1, i1 + 1)
-        let i3 = min(n - 1, i1 + 2)
-        if i0 == i1 || i2 == i3 {
-            return linear(x: x, xs: xs, ys: ys, extrapolation: extrapolation)
-        }
-        return cubicLagrange(x: x, xs: xs, ys: ys, i0: i0, i1: i1, i2: i2, i3: i3)
-    }
-    
-    private static func lowerBound(x: Double, xs: [Double]) -> Int {
-        var low = 0
-        var high = xs.count
-        while low < high {
-            let mid = (low + high) / 2
-            if xs[mid] < x {
-                low = mid + 1
-            } else {
-                high = mid
-            }
-        }
-        return low
-    }
-    
-    private static func linearSegment(x: Double, x0: Double, x1: Double, y0: Double, y1: Double) -> Double {
-        let denom = x1 - x0
-        guard abs(denom) > 1e-12 else { return y0 }
-        let t = (x - x0) / denom
-        return y0 + t * (y1 - y0)
-    }
-    
-    private static func cubicLagrange(x: Double, xs: [Double], ys: [Double], i0: Int, i1: Int, i2: Int, i3: Int) -> Double {
-        let x0 = xs[i0], x1 = xs[i1], x2 = xs[i2], x3 = xs[i3]
-        let y0 = ys[i0], y1 = ys[i1], y2 = ys[i2], y3 = ys[i3]
-        let l0 = ((x - x1) * (x - x2) * (x - x3)) / ((x0 - x1) * (x0 - x2) * (x0 - x3))
-        let l1 = ((x - x0) * (x - x2) * (x - x3)) / ((x1 - x0) * (x1 - x2) * (x1 - x3))
-        let l2 = ((x - x0) * (x - x1) * (x - x3)) / ((x2 - x0) * (x2 - x1) * (x2 - x3))
-        let l3 = ((x - x0) * (x - x1) * (x - x2)) / ((x3 - x0) * (x3 - x1) * (x3 - x2))
-        return y0 * l0 + y1 * l1 + y2 * l2 + y3 * l3
-    }
-    
-    private static func nearest(x: Float, xs: [Float], ys: [Float], extrapolation: SpectralExtrapolationMode) -> Float {
-        let n = xs.count
-        if x <= xs[0] { return ys[0] }
-        if x >= xs[n - 1] { return ys[n - 1] }
-        let i = lowerBound(x: x, xs: xs)
-        let left = max(0, min(i - 1, n - 1))
-        let right = max(0, min(i, n - 1))
-        return abs(xs[left] - x) <= abs(xs[right] - x) ? ys[left] : ys[right]
-    }
-    
-    private static func linear(x: Float, xs: [Float], ys: [Float], extrapolation: SpectralExtrapolationMode) -> Float {
-        let n = xs.count
-        if x <= xs[0] {
-            return extrapolation == .clamp ? ys[0] : linearSegment(x: x, x0: xs[0], x1: xs[1], y0: ys[0], y1: ys[1])
-        }
-        if x >= xs[n - 1] {
-            return extrapolation == .clamp ? ys[n - 1] : linearSegment(x: x, x0: xs[n - 2], x1: xs[n - 1], y0: ys[n - 2], y1: ys[n - 1])
-        }
-        let i = lowerBound(x: x, xs: xs)
-        let i0 = max(0, i - 1)
-        let i1 = min(n - 1, i)
-        return linearSegment(x: x, x0: xs[i0], x1: xs[i1], y0: ys[i0], y1: ys[i1])
-    }
-    
-    private static func cubic(x: Float, xs: [Float], ys: [Float], extrapolation: SpectralExtrapolationMode) -> Float {
-        let n = xs.count
-        if n < 4 {
-            return linear(x: x, xs: xs, ys: ys, extrapolation: extrapolation)
-        }
-        if x <= xs[0] {
-            if extrapolation == .clamp { return ys[0] }
-            return cubicLagrange(x: x, xs: xs, ys: ys, i0: 0, i1: 1, i2: 2, i3: 3)
-        }
-        if x >= xs[n - 1] {
-            if extrapolation == .clamp { return ys[n - 1] }
-            return cubicLagrange(x: x, xs: xs, ys: ys, i0: n - 4, i1: n - 3, i2: n - 2, i3: n - 1)
-        }
-        let i = lowerBound(x: x, xs: xs)
-        let i1 = max(1, min(i, n - 2))
-        let i0 = max(0, i1 - 1)
-        let i2 = min(n - 1, i1 + 1)
-        let i3 = min(n - 1, i1 + 2)
-        if i0 == i1 || i2 == i3 {
-            return linear(x: x, xs: xs, ys: ys, extrapolation: extrapolation)
-        }
-        return cubicLagrange(x: x, xs: xs, ys: ys, i0: i0, i1: i1, i2: i2, i3: i3)
-    }
-    
-    private static func lowerBound(x: Float, xs: [Float]) -> Int {
-        var low = 0
-        var high = xs.count
-        while low < high {
-            let mid = (low + high) / 2
-            if xs[mid] < x {
-                low = mid + 1
-            } else {
-                high = mid
-            }
-        }
-        return low
-    }
-    
-    private static func linearSegment(x: Float, x0: Float, x1: Float, y0: Float, y1: Float) -> Float {
-        let denom = x1 - x0
-        if abs(denom) < 1e-7 { return y0 }
-        let t = (x - x0) / denom
-        return y0 + t * (y1 - y0)
-    }
-    
-    private static func cubicLagrange(x: Float, xs: [Float], ys: [Float], i0: Int, i1: Int, i2: Int, i3: Int) -> Float {
-        let x0 = xs[i0], x1 = xs[i1], x2 = xs[i2], x3 = xs[i3]
-        let y0 = ys[i0], y1 = ys[i1], y2 = ys[i2], y3 = ys[i3]
-        let l0 = ((x - x1) * (x - x2) * (x - x3)) / ((x0 - x1) * (x0 - x2) * (x0 - x3))
-        let l1 = ((x - x0) * (x - x2) * (x - x3)) / ((x1 - x0) * (x1 - x2) * (x1 - x3))
-        let l2 = ((x - x0) * (x - x1) * (x - x3)) / ((x2 - x0) * (x2 - x1) * (x2 - x3))
-        let l3 = ((x - x0) * (x - x1) * (x - x2)) / ((x3 - x0) * (x3 - x1) * (x3 - x2))
-        return y0 * l0 + y1 * l1 + y2 * l2 + y3 * l3
-    }
 }
 
 struct AlignmentProgressInfo {
@@ -685,71 +335,74 @@ class CubeSpectralAligner {
         progressCallback?(AlignmentProgressInfo(progress: 0.0, message: LF("pipeline.alignment.progress.extract_reference_channel", parameters.referenceChannel + 1), currentChannel: 0, totalChannels: channels, stage: "extract_ref"))
         
         let refChannel = extractChannel(cube: cube, channelIndex: parameters.referenceChannel, axes: axes)
-        var homographies: [[Double]] = []
-        var channelScores: [Double] = []
-        var channelOffsets: [(dx: Int, dy: Int)] = []
-        
-        let channelsToProcess = channels - 1
+        let correlator = PhaseCorrelator(reference: refChannel, width: width, height: height)
+        let reference = AlignmentReference(data: refChannel, width: width, height: height, multiscale: parameters.enableMultiscale)
+        let settings = parameters
+        
+        var homographies = [[Double]](repeating: [1, 0, 0, 0, 1, 0, 0, 0, 1], count: channels)
+        var channelScores = [Double](repeating: 1.0, count: channels)
+        var channelOffsets = [(dx: Int, dy: Int)](repeating: (dx: 0, dy: 0), count: channels)
+        
+        // Каналы выравниваются независимо друг от друга: потоки разбирают их по одному,
+        // у каждого потока свои буферы под канал, уровень пирамиды и деформированное изображение
+        let bands = (0..<channels).filter { $0 != settings.referenceChannel }
+        let channelsToProcess = bands.count
+        let bandWorkers = min(ParallelCompute.workerCount, channelsToProcess)
+        // Если каналов меньше, чем ядер, свободные ядра уходят на параллельную оценку кандидатов внутри канала
+        let candidateLanes = max(1, ParallelCompute.workerCount / max(1, bandWorkers))
+        let scratches = (0..<bandWorkers).map { _ in AlignmentScratch(candidateLanes: candidateLanes) }
+        let progressLock = NSLock()
         var processedChannels = 0
         
-        for ch in 0..<channels {
-            if ch == parameters.referenceChannel {
-                homographies.append([1, 0, 0, 0, 1, 0, 0, 0, 1])
-                channelScores.append(1.0)
-                channelOffsets.append((dx: 0, dy: 0))
-                continue
-            }
-            
-            let progress = Double(processedChannels) / Double(channelsToProcess) * 0.9
-            progressCallback?(AlignmentProgressInfo(
-                progress: progress,
-                message: LF("pipeline.alignment.progress.channel_extract_data", ch + 1, channels),
-                currentChannel: ch + 1,
-                totalChannels: channels,
-                stage: "extract"
-            ))
-            
-            let channelData = extractChannel(cube: cube, channelIndex: ch, axes: axes)
+        ParallelCompute.forEachDynamic(count: channelsToProcess, workers: scratches.count) { worker, index in
+            let ch = bands[index]
+            let scratch = scratches[worker]
             
+            progressLock.lock()
             progressCallback?(AlignmentProgressInfo(
-                progress: progress + 0.02,
+                progress: Double(processedChannels) / Double(channelsToProcess) * 0.9,
                 message: LF("pipeline.alignment.progress.channel_search_homography", ch + 1, channels),
                 currentChannel: ch + 1,
                 totalChannels: channels,
                 stage: "homography"
             ))
+            progressLock.unlock()
+            
+            extractChannel(cube: cube, channelIndex: ch, axes: axes, into: &scratch.channel)
             
             let (H, score) = findBestHomographyWithScore(
-                channelData: channelData,
-                refData: refChannel,
-                width: width,
-                height: height,
-                offsetMin: parameters.offsetMin,
-                offsetMax: parameters.offsetMax,
-                step: parameters.step,
-                metric: parameters.metric,
-                method: parameters.method,
-                iterations: parameters.iterations,
-                useRefinement: parameters.enableSubpixel,
-                useMultiscale: parameters.enableMultiscale
+                channelData: scratch.channel,
+                reference: reference,
+                offsetMin: settings.offsetMin,
+                offsetMax: settings.offsetMax,
+                step: settings.step,
+                metric: settings.metric,
+                method: settings.method,
+                iterations: settings.iterations,
+                useRefinement: settings.enableSubpixel,
+                useMultiscale: settings.enableMultiscale,
+                initialShift: correlator?.estimate(scratch.channel),
+                scratch: scratch
             )
-            homographies.append(H)
-            channelScores.append(score)
             
             let avgDx = (H[2] + H[0] * Double(width) / 2 + H[1] * Double(height) / 2) / H[8] - Double(width) / 2
             let avgDy = (H[5] + H[3] * Double(width) / 2 + H[4] * Double(height) / 2) / H[8] - Double(height) / 2
-            channelOffsets.append((dx: Int(round(avgDx)), dy: Int(round(avgDy))))
             
+            progressLock.lock()
+            homographies[ch] = H
+            channelScores[ch] = score
+            channelOffsets[ch] = (dx: Int(round(avgDx)), dy: Int(round(avgDy)))
             processedChannels += 1
             
             let scoreStr = String(format: "%.4f", score)
             progressCallback?(AlignmentProgressInfo(
                 progress: Double(processedChannels) / Double(channelsToProcess) * 0.9,
-                message: LF("pipeline.alignment.progress.channel_metric_score", ch + 1, channels, L(parameters.metric.rawValue), scoreStr),
+                message: LF("pipeline.alignment.progress.channel_metric_score", ch + 1, channels, L(settings.metric.rawValue), scoreStr),
                 currentChannel: ch + 1,
                 totalChannels: channels,
                 stage: "done"
             ))
+            progressLock.unlock()
         }
         
         let validScores = channelScores.filter { $0 > 0 && $0.isFinite }
@@ -772,33 +425,96 @@ class CubeSpectralAligner {
         return result
     }
     
-    private static func extractChannel(cube: HyperCube, channelIndex: Int, axes: (channel: Int, height: Int, width: Int)) -> [Double] {
-        let dims = cube.dims
-        let dimsArray = [dims.0, dims.1, dims.2]
-        let height = dimsArray[axes.height]
-        let width = dimsArray[axes.width]
-        
-        var result = [Double](repeating: 0, count: height * width)
-        
-        for y in 0..<height {
-            for x in 0..<width {
-                var idx = [0, 0, 0]
-                idx[axes.channel] = channelIndex
-                idx[axes.height] = y
-                idx[axes.width] = x
-                let linearIdx = cube.linearIndex(i0: idx[0], i1: idx[1], i2: idx[2])
-                result[y * width + x] = cube.getValue(at: linearIdx)
+    /// Поля, которые не участвуют в метрике после деформации
+    private static let warpMetricMargin = 10
+    
+    /// Опорный канал на одном уровне пирамиды вместе с нормированной областью для метрики
+    private struct ReferenceLevel {
+        let data: [Double]
+        let width: Int
+        let height: Int
+        /// Область без полей `warpMetricMargin`, приведённая к [0, 1]; nil, если поля занимают весь кадр
+        let normalizedRegion: [Double]?
+        
+        init(data: [Double], width: Int, height: Int) {
+            self.data = data
+            self.width = width
+            self.height = height
+            var region: [Double] = []
+            if CubeSpectralAligner.extractMetricRegion(data, width: width, height: height, into: &region) {
+                CubeSpectralAligner.normalizeInPlace(&region)
+                normalizedRegion = region
+            } else {
+                normalizedRegion = nil
             }
         }
+    }
+    
+    /// Опорный канал, общий для всех потоков: полное разрешение и уменьшенный вдвое уровень для больших кадров
+    private struct AlignmentReference {
+        static let coarseScale = 2
+        
+        let full: ReferenceLevel
+        let coarse: ReferenceLevel?
+        
+        init(data: [Double], width: Int, height: Int, multiscale: Bool) {
+            full = ReferenceLevel(data: data, width: width, height: height)
+            if multiscale && width > 200 && height > 200 {
+                var reduced: [Double] = []
+                CubeSpectralAligner.downsample(data, width: width, height: height, factor: Self.coarseScale, into: &reduced)
+                coarse = ReferenceLevel(data: reduced, width: width / Self.coarseScale, height: height / Self.coarseScale)
+            } else {
+                coarse = nil
+            }
+        }
+    }
+    
+    /// Буферы деформированного изображения и области метрики для одной оценки кандидата
+    private final class WarpBuffers {
+        var warped: [Double] = []
+        var region: [Double] = []
+    }
+    
+    /// Рабочие буферы одного потока выравнивания; переиспользуются от канала к каналу.
+    /// `lanes` — по набору буферов на каждую дорожку параллельной оценки кандидатов.
+    private final class AlignmentScratch {
+        var channel: [Double] = []
+        var coarseChannel: [Double] = []
+        let lanes: [WarpBuffers]
         
+        init(candidateLanes: Int) {
+            lanes = (0..<max(1, candidateLanes)).map { _ in WarpBuffers() }
+        }
+    }
+    
+    private static func extractChannel(cube: HyperCube, channelIndex: Int, axes: (channel: Int, height: Int, width: Int)) -> [Double] {
+        var result: [Double] = []
+        extractChannel(cube: cube, channelIndex: channelIndex, axes: axes, into: &result)
         return result
     }
     
+    private static func extractChannel(cube: HyperCube, channelIndex: Int, axes: (channel: Int, height: Int, width: Int), into result: inout [Double]) {
+        let strides = cube.axisStrides(axes: axes)
+        let width = strides.width
+        let height = strides.height
+        if result.count != width * height {
+            result = [Double](repeating: 0, count: width * height)
+        }
+        result.withUnsafeMutableBufferPointer { out in
+            for y in 0..<height {
+                cube.storage.gather(
+                    base: strides.offset(channel: channelIndex, x: 0, y: y),
+                    stride: strides.widthStride,
+                    count: width,
+                    into: out.baseAddress! + y * width
+                )
+            }
+        }
+    }
+    
     private static func findBestHomographyWithScore(
         channelData: [Double],
-        refData: [Double],
-        width: Int,
-        height: Int,
+        reference: AlignmentReference,
         offsetMin: Int,
         offsetMax: Int,
         step: Int,
@@ -806,70 +522,79 @@ class CubeSpectralAligner {
         method: SpectralAlignmentMethod,
         iterations: Int = 2,
         useRefinement: Bool = true,
-        useMultiscale: Bool = true
+        useMultiscale: Bool = true,
+        initialShift: PhaseCorrelator.Estimate? = nil,
+        scratch: AlignmentScratch
     ) -> ([Double], Double) {
         
         switch method {
         case .coordinateDescent:
             return fourPointHomographyOptimization(
                 channelData: channelData,
-                refData: refData,
-                width: width,
-                height: height,
+                reference: reference,
                 offsetMin: offsetMin,
                 offsetMax: offsetMax,
                 step: step,
                 metric: metric,
                 iterations: iterations,
                 useRefinement: false,
-                useMultiscale: useMultiscale
+                useMultiscale: useMultiscale,
+                initialShift: initialShift,
+                scratch: scratch
             )
             
         case .differentialEvolution:
             return fourPointHomographyOptimization(
                 channelData: channelData,
-                refData: refData,
-                width: width,
-                height: height,
+                reference: reference,
                 offsetMin: offsetMin,
                 offsetMax: offsetMax,
                 step: 1,
                 metric: metric,
                 iterations: iterations + 1,
                 useRefinement: useRefinement,
-                useMultiscale: useMultiscale
+                useMultiscale: useMultiscale,
+                initialShift: initialShift,
+                scratch: scratch
             )
             
         case .hybrid:
             return fourPointHomographyOptimization(
                 channelData: channelData,
-                refData: refData,
-                width: width,
-                height: height,
+                reference: reference,
                 offsetMin: offsetMin,
                 offsetMax: offsetMax,
                 step: step,
                 metric: metric,
                 iterations: iterations,
                 useRefinement: useRefinement,
-                useMultiscale: useMultiscale
+                useMultiscale: useMultiscale,
+                initialShift: initialShift,
+                scratch: scratch
             )
         }
     }
     
+    /// Минимальная высота пика фазовой корреляции, при которой сдвиг берётся за начальное приближение
+    private static let minPhaseResponse = 0.05
+    /// Полуширина окрестности перебора вокруг начального сдвига, в пикселях полного разрешения
+    private static let seededSearchRadius = 3
+    
     private static func fourPointHomographyOptimization(
         channelData: [Double],
-        refData: [Double],
-        width: Int,
-        height: Int,
+        reference: AlignmentReference,
         offsetMin: Int,
         offsetMax: Int,
         step: Int,
         metric: SpectralAlignmentMetric,
         iterations: Int,
         useRefinement: Bool,
-        useMultiscale: Bool
+        useMultiscale: Bool,
+        initialShift: PhaseCorrelator.Estimate? = nil,
+        scratch: AlignmentScratch
     ) -> ([Double], Double) {
+        let width = reference.full.width
+        let height = reference.full.height
         let margin = 0.15
         let w = Double(width)
         let h = Double(height)
@@ -883,63 +608,98 @@ class CubeSpectralAligner {
         
         var srcPoints = refPoints
         
-        var workingChannel = channelData
-        var workingRef = refData
-        var workingWidth = width
-        var workingHeight = height
+        var working = reference.full
         var scale = 1
         
-        if useMultiscale && width > 200 && height > 200 {
-            scale = 2
-            workingWidth = width / scale
-            workingHeight = height / scale
-            workingChannel = downsample(channelData, width: width, height: height, factor: scale)
-            workingRef = downsample(refData, width: width, height: height, factor: scale)
+        if useMultiscale, let coarse = reference.coarse {
+            scale = AlignmentReference.coarseScale
+            working = coarse
+            downsample(channelData, width: width, height: height, factor: scale, into: &scratch.coarseChannel)
         }
+        let workingChannel = scale > 1 ? scratch.coarseChannel : channelData
         
         let scaledRefPoints = refPoints.map { Point2D(x: $0.x / Double(scale), y: $0.y / Double(scale)) }
-        var scaledSrcPoints = scaledRefPoints
         
-        for iteration in 0..<iterations {
-            let currentStep = iteration == 0 ? max(1, step / scale) : max(1, step / scale / 2)
-            let scaledOffsetMin = offsetMin / scale
-            let scaledOffsetMax = offsetMax / scale
-            
-            for pointIdx in 0..<4 {
-                let (bestDx, bestDy) = optimizeSinglePoint(
-                    channelData: workingChannel,
-                    refData: workingRef,
-                    width: workingWidth,
-                    height: workingHeight,
-                    basePoints: scaledSrcPoints,
-                    refPoints: scaledRefPoints,
-                    pointIndex: pointIdx,
-                    offsetMin: scaledOffsetMin,
-                    offsetMax: scaledOffsetMax,
-                    step: currentStep,
-                    metric: metric
-                )
-                scaledSrcPoints[pointIdx].x += Double(bestDx)
-                scaledSrcPoints[pointIdx].y += Double(bestDy)
+        // Сдвиг из фазовой корреляции принимается, только если пик выражен и лежит в заданном диапазоне
+        let seed = initialShift.flatMap { shift -> Point2D? in
+            guard shift.response >= minPhaseResponse,
+                  Double(offsetMin) <= shift.dx, shift.dx <= Double(offsetMax),
+                  Double(offsetMin) <= shift.dy, shift.dy <= Double(offsetMax) else { return nil }
+            return Point2D(x: shift.dx / Double(scale), y: shift.dy / Double(scale))
+        }
+        let seededRadius = max(2, (seededSearchRadius + scale - 1) / scale)
+        
+        // Окрестность ±seededRadius вокруг текущего положения угла, обрезанная так,
+        // чтобы суммарный сдвиг угла от опорной точки оставался в offsetMin…offsetMax
+        let allowedMin = Double(offsetMin) / Double(scale)
+        let allowedMax = Double(offsetMax) / Double(scale)
+        func seededWindow(displacement: Double) -> ClosedRange<Int> {
+            let lower = max(-seededRadius, Int((allowedMin - displacement).rounded(.up)))
+            let upper = min(seededRadius, Int((allowedMax - displacement).rounded(.down)))
+            return lower <= upper ? lower...upper : 0...0
+        }
+        
+        // Покоординатный перебор углов. С начальным сдвигом углы сразу ставятся в найденное
+        // положение и перебирается только окрестность ±seededRadius с шагом 1; nil — оптимум
+        // упёрся в край окрестности (не в границу диапазона) на первом проходе,
+        // и нужен полный перебор offsetMin…offsetMax.
+        func optimizeCorners(from seed: Point2D?) -> [Point2D]? {
+            var points = scaledRefPoints.map { Point2D(x: $0.x + (seed?.x ?? 0), y: $0.y + (seed?.y ?? 0)) }
+            for iteration in 0..<iterations {
+                let currentStep = seed != nil
+                    ? 1
+                    : (iteration == 0 ? max(1, step / scale) : max(1, step / scale / 2))
+                
+                for pointIdx in 0..<4 {
+                    let xOffsets: ClosedRange<Int>
+                    let yOffsets: ClosedRange<Int>
+                    if seed != nil {
+                        xOffsets = seededWindow(displacement: points[pointIdx].x - scaledRefPoints[pointIdx].x)
+                        yOffsets = seededWindow(displacement: points[pointIdx].y - scaledRefPoints[pointIdx].y)
+                    } else {
+                        xOffsets = (offsetMin / scale)...(offsetMax / scale)
+                        yOffsets = xOffsets
+                    }
+                    let (bestDx, bestDy) = optimizeSinglePoint(
+                        channelData: workingChannel,
+                        level: working,
+                        basePoints: points,
+                        refPoints: scaledRefPoints,
+                        pointIndex: pointIdx,
+                        xOffsets: xOffsets,
+                        yOffsets: yOffsets,
+                        step: currentStep,
+                        metric: metric,
+                        scratch: scratch
+                    )
+                    if seed != nil, iteration == 0,
+                       abs(bestDx) == seededRadius || abs(bestDy) == seededRadius {
+                        return nil
+                    }
+                    points[pointIdx].x += Double(bestDx)
+                    points[pointIdx].y += Double(bestDy)
+                }
             }
+            return points
         }
         
+        let scaledSrcPoints = seed.flatMap { optimizeCorners(from: $0) } ?? optimizeCorners(from: nil) ?? scaledRefPoints
+        
         srcPoints = scaledSrcPoints.map { Point2D(x: $0.x * Double(scale), y: $0.y * Double(scale)) }
         
         if useRefinement {
             for pointIdx in 0..<4 {
                 let (bestDx, bestDy) = optimizeSinglePoint(
                     channelData: channelData,
-                    refData: refData,
-                    width: width,
-                    height: height,
+                    level: reference.full,
                     basePoints: srcPoints,
                     refPoints: refPoints,
                     pointIndex: pointIdx,
-                    offsetMin: -3,
-                    offsetMax: 3,
+                    xOffsets: -3...3,
+                    yOffsets: -3...3,
                     step: 1,
-                    metric: metric
+                    metric: metric,
+                    scratch: scratch
                 )
                 srcPoints[pointIdx].x += Double(bestDx)
                 srcPoints[pointIdx].y += Double(bestDy)
@@ -953,101 +713,111 @@ class CubeSpectralAligner {
             return ([1, 0, 0, 0, 1, 0, 0, 0, 1], 0.0)
         }
         
-        let warped = warpPerspective(channelData, width: width, height: height, H: H)
-        let score = computeMetricForWarped(warped: warped, refData: refData, width: width, height: height, metric: metric)
+        let buffers = scratch.lanes[0]
+        warpPerspective(channelData, width: width, height: height, H: H, into: &buffers.warped)
+        let score = computeMetricForWarped(level: reference.full, metric: metric, buffers: buffers)
         
         return (H, score)
     }
     
     private static func optimizeSinglePoint(
         channelData: [Double],
-        refData: [Double],
-        width: Int,
-        height: Int,
+        level: ReferenceLevel,
         basePoints: [Point2D],
         refPoints: [Point2D],
         pointIndex: Int,
-        offsetMin: Int,
-        offsetMax: Int,
+        xOffsets: ClosedRange<Int>,
+        yOffsets: ClosedRange<Int>,
         step: Int,
-        metric: SpectralAlignmentMetric
+        metric: SpectralAlignmentMetric,
+        scratch: AlignmentScratch
     ) -> (Int, Int) {
-        var bestDx = 0
-        var bestDy = 0
-        var bestScore = -Double.infinity
-        
-        for dx in stride(from: offsetMin, through: offsetMax, by: step) {
-            for dy in stride(from: offsetMin, through: offsetMax, by: step) {
-                var testPoints = basePoints
-                testPoints[pointIndex].x += Double(dx)
-                testPoints[pointIndex].y += Double(dy)
-                
-                let orderedSrc = orderPoints(testPoints)
-                let orderedRef = orderPoints(refPoints)
-                
-                guard let H = computeHomographyDLT(src: orderedSrc, dst: orderedRef) else { continue }
-                
-                let warped = warpPerspective(channelData, width: width, height: height, H: H)
-                let score = computeMetricForWarped(warped: warped, refData: refData, width: width, height: height, metric: metric)
-                
-                if score > bestScore {
-                    bestScore = score
-                    bestDx = dx
-                    bestDy = dy
+        let orderedRef = orderPoints(refPoints)
+        let dyValues = Array(stride(from: yOffsets.lowerBound, through: yOffsets.upperBound, by: step))
+        let candidates = stride(from: xOffsets.lowerBound, through: xOffsets.upperBound, by: step)
+            .flatMap { dx in dyValues.map { dy in (dx: dx, dy: dy) } }
+        
+        // Кандидаты независимы: каждая дорожка оценивает свой непрерывный диапазон в своих буферах,
+        // затем лучшие сравниваются в порядке дорожек — при равных оценках выигрывает более ранний
+        // кандидат, как и при последовательном переборе
+        let lanes = ParallelCompute.chunkCount(count: candidates.count, maxChunks: scratch.lanes.count)
+        var laneBest = [(score: Double, index: Int)](repeating: (score: -Double.infinity, index: -1), count: lanes)
+        laneBest.withUnsafeMutableBufferPointer { best in
+            ParallelCompute.forEachChunk(count: candidates.count, maxChunks: scratch.lanes.count) { lane, range in
+                let buffers = scratch.lanes[lane]
+                for index in range {
+                    var testPoints = basePoints
+                    testPoints[pointIndex].x += Double(candidates[index].dx)
+                    testPoints[pointIndex].y += Double(candidates[index].dy)
+                    
+                    let orderedSrc = orderPoints(testPoints)
+                    
+                    guard let H = computeHomographyDLT(src: orderedSrc, dst: orderedRef) else { continue }
+                    
+                    warpPerspective(channelData, width: level.width, height: level.height, H: H, into: &buffers.warped)
+                    let score = computeMetricForWarped(level: level, metric: metric, buffers: buffers)
+                    
+                    if score > best[lane].score {
+                        best[lane] = (score: score, index: index)
+                    }
                 }
             }
         }
         
-        return (bestDx, bestDy)
+        var winner = (score: -Double.infinity, index: -1)
+        for candidate in laneBest where candidate.score > winner.score {
+            winner = candidate
+        }
+        guard winner.index >= 0 else { return (0, 0) }
+        return (candidates[winner.index].dx, candidates[winner.index].dy)
     }
     
+    /// Метрика между `buffers.warped` и опорным уровнем по области без полей
     private static func computeMetricForWarped(
-        warped: [Double],
-        refData: [Double],
-        width: Int,
-        height: Int,
-        metric: SpectralAlignmentMetric
+        level: ReferenceLevel,
+        metric: SpectralAlignmentMetric,
+        buffers: WarpBuffers
     ) -> Double {
-        let margin = 10
-        let xStart = margin
-        let xEnd = width - margin
-        let yStart = margin
-        let yEnd = height - margin
-        
-        guard xEnd > xStart, yEnd > yStart else { return -1.0 }
-        
-        let regionWidth = xEnd - xStart
-        let regionHeight = yEnd - yStart
-        
-        var refRegion = [Double](repeating: 0, count: regionWidth * regionHeight)
-        var warpedRegion = [Double](repeating: 0, count: regionWidth * regionHeight)
-        
-        for y in yStart..<yEnd {
-            for x in xStart..<xEnd {
-                let srcIdx = y * width + x
-                let dstIdx = (y - yStart) * regionWidth + (x - xStart)
-                refRegion[dstIdx] = refData[srcIdx]
-                warpedRegion[dstIdx] = warped[srcIdx]
-            }
+        guard let normRef = level.normalizedRegion,
+              extractMetricRegion(buffers.warped, width: level.width, height: level.height, into: &buffers.region) else {
+            return -1.0
         }
-        
-        let (normRef, _, _) = normalizeData(refRegion)
-        let (normWarped, _, _) = normalizeData(warpedRegion)
+        normalizeInPlace(&buffers.region)
         
         switch metric {
         case .ssim:
             return computeWindowedSSIM(
                 img1: normRef,
-                img2: normWarped,
-                width: regionWidth,
-                height: regionHeight,
+                img2: buffers.region,
+                width: level.width - 2 * warpMetricMargin,
+                height: level.height - 2 * warpMetricMargin,
                 windowSize: 7,
                 useGaussian: true,
                 sigma: 1.5
             )
         case .psnr:
-            return computePSNRDirect(normRef, normWarped)
+            return computePSNRDirect(normRef, buffers.region)
+        }
+    }
+    
+    /// Копирует кадр без полей `warpMetricMargin` в `region`; false, если от кадра ничего не остаётся
+    private static func extractMetricRegion(_ data: [Double], width: Int, height: Int, into region: inout [Double]) -> Bool {
+        let margin = warpMetricMargin
+        let regionWidth = width - 2 * margin
+        let regionHeight = height - 2 * margin
+        guard regionWidth > 0, regionHeight > 0 else { return false }
+        
+        if region.count != regionWidth * regionHeight {
+            region = [Double](repeating: 0, count: regionWidth * regionHeight)
+        }
+        data.withUnsafeBufferPointer { src in
+            region.withUnsafeMutableBufferPointer { dst in
+                for y in 0..<regionHeight {
+                    (dst.baseAddress! + y * regionWidth).update(from: src.baseAddress! + (y + margin) * width + margin, count: regionWidth)
+                }
+            }
         }
+        return true
     }
     
     private static func multiScaleAlignment(
@@ -1204,9 +974,17 @@ class CubeSpectralAligner {
     }
     
     private static func downsample(_ data: [Double], width: Int, height: Int, factor: Int) -> [Double] {
+        var result: [Double] = []
+        downsample(data, width: width, height: height, factor: factor, into: &result)
+        return result
+    }
+    
+    private static func downsample(_ data: [Double], width: Int, height: Int, factor: Int, into result: inout [Double]) {
         let newWidth = width / factor
         let newHeight = height / factor
-        var result = [Double](repeating: 0, count: newWidth * newHeight)
+        if result.count != newWidth * newHeight {
+            result = [Double](repeating: 0, count: newWidth * newHeight)
+        }
         
         for y in 0..<newHeight {
             for x in 0..<newWidth {
@@ -1225,8 +1003,6 @@ class CubeSpectralAligner {
                 result[y * newWidth + x] = count > 0 ? sum / count : 0
             }
         }
-        
-        return result
     }
     
     private static func gridSearchAround(
@@ -1404,37 +1180,7 @@ class CubeSpectralAligner {
     }
     
     private static func computeSSIMDirect(_ img1: [Double], _ img2: [Double]) -> Double {
-        guard !img1.isEmpty, img1.count == img2.count else { return -1.0 }
-        
-        let count = Double(img1.count)
-        var sum1 = 0.0, sum2 = 0.0
-        var sumSq1 = 0.0, sumSq2 = 0.0
-        var sumProd = 0.0
-        
-        for i in 0..<img1.count {
-            let v1 = img1[i]
-            let v2 = img2[i]
-            sum1 += v1
-            sum2 += v2
-            sumSq1 += v1 * v1
-            sumSq2 += v2 * v2
-            sumProd += v1 * v2
-        }
-        
-        let mu1 = sum1 / count
-        let mu2 = sum2 / count
-        let sigma1Sq = max(0, sumSq1 / count - mu1 * mu1)
-        let sigma2Sq = max(0, sumSq2 / count - mu2 * mu2)
-        let sigma12 = sumProd / count - mu1 * mu2
-        
-        let c1 = 0.0001
-        let c2 = 0.0009
-        
-        let numerator = (2.0 * mu1 * mu2 + c1) * (2.0 * sigma12 + c2)
-        let denominator = (mu1 * mu1 + mu2 * mu2 + c1) * (sigma1Sq + sigma2Sq + c2)
-        
-        guard denominator > 1e-10 else { return 0.0 }
-        return numerator / denominator
+        ImageSimilarity.globalSSIM(img1, img2, c1: 0.0001, c2: 0.0009, epsilon: 1e-10, degenerate: 0.0) ?? -1.0
     }
     
     private static func computeWindowedSSIM(
@@ -1446,117 +1192,28 @@ class CubeSpectralAligner {
         useGaussian: Bool = true,
         sigma: Double = 1.5
     ) -> Double {
-        guard width > windowSize, height > windowSize else {
+        let window: ImageSimilarity.Window = useGaussian
+            ? .gaussian(size: windowSize, sigma: sigma)
+            : .box(size: windowSize)
+        guard let value = ImageSimilarity.windowedSSIM(
+            img1,
+            img2,
+            width: width,
+            height: height,
+            window: window,
+            c1: 0.0001,
+            c2: 0.0009,
+            epsilon: 1e-10
+        ) else {
             return computeSSIMDirect(img1, img2)
         }
-        
-        let kernel = useGaussian ? makeGaussianKernel(size: windowSize, sigma: sigma) : makeUniformKernel(size: windowSize)
-        
-        let mu1 = convolve2D(img1, width: width, height: height, kernel: kernel, kernelSize: windowSize)
-        let mu2 = convolve2D(img2, width: width, height: height, kernel: kernel, kernelSize: windowSize)
-        
-        var img1Sq = [Double](repeating: 0, count: img1.count)
-        var img2Sq = [Double](repeating: 0, count: img2.count)
-        var img12 = [Double](repeating: 0, count: img1.count)
-        for i in 0..<img1.count {
-            img1Sq[i] = img1[i] * img1[i]
-            img2Sq[i] = img2[i] * img2[i]
-            img12[i] = img1[i] * img2[i]
-        }
-        
-        let sigma1Sq = convolve2D(img1Sq, width: width, height: height, kernel: kernel, kernelSize: windowSize)
-        let sigma2Sq = convolve2D(img2Sq, width: width, height: height, kernel: kernel, kernelSize: windowSize)
-        let sigma12 = convolve2D(img12, width: width, height: height, kernel: kernel, kernelSize: windowSize)
-        
-        let c1 = 0.0001
-        let c2 = 0.0009
-        
-        let pad = windowSize / 2
-        var ssimSum = 0.0
-        var count = 0
-        
-        for y in pad..<(height - pad) {
-            for x in pad..<(width - pad) {
-                let idx = y * width + x
-                let m1 = mu1[idx]
-                let m2 = mu2[idx]
-                let s1 = max(0, sigma1Sq[idx] - m1 * m1)
-                let s2 = max(0, sigma2Sq[idx] - m2 * m2)
-                let s12 = sigma12[idx] - m1 * m2
-                
-                let num = (2.0 * m1 * m2 + c1) * (2.0 * s12 + c2)
-                let den = (m1 * m1 + m2 * m2 + c1) * (s1 + s2 + c2)
-                
-                if den > 1e-10 {
-                    ssimSum += num / den
-                    count += 1
-                }
-            }
-        }
-        
-        return count > 0 ? ssimSum / Double(count) : 0.0
-    }
-    
-    private static func makeGaussianKernel(size: Int, sigma: Double) -> [Double] {
-        var kernel = [Double](repeating: 0, count: size * size)
-        let center = size / 2
-        var sum = 0.0
-        
-        for y in 0..<size {
-            for x in 0..<size {
-                let dx = Double(x - center)
-                let dy = Double(y - center)
-                let val = exp(-(dx * dx + dy * dy) / (2.0 * sigma * sigma))
-                kernel[y * size + x] = val
-                sum += val
-            }
-        }
-        
-        for i in 0..<kernel.count {
-            kernel[i] /= sum
-        }
-        
-        return kernel
-    }
-    
-    private static func makeUniformKernel(size: Int) -> [Double] {
-        let val = 1.0 / Double(size * size)
-        return [Double](repeating: val, count: size * size)
-    }
-    
-    private static func convolve2D(_ data: [Double], width: Int, height: Int, kernel: [Double], kernelSize: Int) -> [Double] {
-        var result = [Double](repeating: 0, count: data.count)
-        let pad = kernelSize / 2
-        
-        for y in 0..<height {
-            for x in 0..<width {
-                var sum = 0.0
-                for ky in 0..<kernelSize {
-                    for kx in 0..<kernelSize {
-                        let srcY = min(max(y + ky - pad, 0), height - 1)
-                        let srcX = min(max(x + kx - pad, 0), width - 1)
-                        sum += data[srcY * width + srcX] * kernel[ky * kernelSize + kx]
-                    }
-                }
-                result[y * width + x] = sum
-            }
-        }
-        
-        return result
+        return value
     }
     
     private static func computePSNRDirect(_ img1: [Double], _ img2: [Double]) -> Double {
-        guard !img1.isEmpty, img1.count == img2.count else { return -Double.infinity }
-        
-        var mse = 0.0
-        for i in 0..<img1.count {
-            let diff = img1[i] - img2[i]
-            mse += diff * diff
-        }
-        mse /= Double(img1.count)
-        
+        guard let mse = ImageSimilarity.meanSquaredError(img1, img2) else { return -Double.infinity }
         guard mse > 1e-10 else { return 100.0 }
-        return 10.0 * log10(1.0 / mse)
+        return ImageSimilarity.psnr(mse: mse, peak: 1.0)
     }
     
     private static func coordinateDescent(
@@ -1682,6 +1339,25 @@ class CubeSpectralAligner {
         return (normalized, minVal, maxVal)
     }
     
+    /// То же приведение к [0, 1], что и `normalizeData`, без выделения памяти
+    private static func normalizeInPlace(_ data: inout [Double]) {
+        guard !data.isEmpty else { return }
+        var minVal = Double.infinity
+        var maxVal = -Double.infinity
+        for v in data {
+            if v < minVal { minVal = v }
+            if v > maxVal { maxVal = v }
+        }
+        let range = maxVal - minVal
+        if range < 1e-10 {
+            for i in 0..<data.count { data[i] = 0 }
+            return
+        }
+        for i in 0..<data.count {
+            data[i] = (data[i] - minVal) / range
+        }
+    }
+    
     private static func computeSSIM(
         channelData: [Double],
         refData: [Double],
@@ -1720,36 +1396,7 @@ class CubeSpectralAligner {
         let (normRef, _, _) = normalizeData(refRegion)
         let (normCh, _, _) = normalizeData(chRegion)
         
-        var sum1 = 0.0, sum2 = 0.0
-        var sumSq1 = 0.0, sumSq2 = 0.0
-        var sumProd = 0.0
-        let count = Double(normRef.count)
-        
-        for i in 0..<normRef.count {
-            let v1 = normRef[i]
-            let v2 = normCh[i]
-            sum1 += v1
-            sum2 += v2
-            sumSq1 += v1 * v1
-            sumSq2 += v2 * v2
-            sumProd += v1 * v2
-        }
-        
-        let mu1 = sum1 / count
-        let mu2 = sum2 / count
-        let sigma1Sq = max(0, sumSq1 / count - mu1 * mu1)
-        let sigma2Sq = max(0, sumSq2 / count - mu2 * mu2)
-        let sigma12 = sumProd / count - mu1 * mu2
-        
-        let c1 = 0.0001  // (0.01 * 1.0)^2 for data_range=1.0
-        let c2 = 0.0009  // (0.03 * 1.0)^2 for data_range=1.0
-        
-        let numerator = (2.0 * mu1 * mu2 + c1) * (2.0 * sigma12 + c2)
-        let denominator = (mu1 * mu1 + mu2 * mu2 + c1) * (sigma1Sq + sigma2Sq + c2)
-        
-        guard denominator > 1e-10 else { return 0.0 }
-        
-        return numerator / denominator
+        return computeSSIMDirect(normRef, normCh)
     }
     
     private static func computePSNR(
@@ -1790,18 +1437,7 @@ class CubeSpectralAligner {
         let (normRef, _, _) = normalizeData(refRegion)
         let (normCh, _, _) = normalizeData(chRegion)
         
-        var mse = 0.0
-        for i in 0..<normRef.count {
-            let diff = normRef[i] - normCh[i]
-            mse += diff * diff
-        }
-        
-        mse /= Double(normRef.count)
-        
-        guard mse > 1e-10 else { return 100.0 }
-        
-        let psnr = 10.0 * log10(1.0 / mse)
-        return psnr
+        return computePSNRDirect(normRef, normCh)
     }
     
     private static func applyHomographies(
@@ -1810,203 +1446,8 @@ class CubeSpectralAligner {
         axes: (channel: Int, height: Int, width: Int),
         layout: CubeLayout
     ) -> HyperCube? {
-        let dims = cube.dims
-        let dimsArray = [dims.0, dims.1, dims.2]
-        let height = dimsArray[axes.height]
-        let width = dimsArray[axes.width]
-        let channels = dimsArray[axes.channel]
-        
-        let totalElements = dims.0 * dims.1 * dims.2
-        
-        func bilinearSample<T: BinaryFloatingPoint>(source: [T], x: Double, y: Double, ch: Int) -> T {
-            let x0 = Int(floor(x))
-            let y0 = Int(floor(y))
-            let x1 = x0 + 1
-            let y1 = y0 + 1
-            
-            let fx = T(x - Double(x0))
-            let fy = T(y - Double(y0))
-            
-            func getVal(_ px: Int, _ py: Int) -> T {
-                let cx = max(0, min(width - 1, px))
-                let cy = max(0, min(height - 1, py))
-                var idx = [0, 0, 0]
-                idx[axes.channel] = ch
-                idx[axes.height] = cy
-                idx[axes.width] = cx
-                let linear = cube.linearIndex(i0: idx[0], i1: idx[1], i2: idx[2])
-                return source[linear]
-            }
-            
-            let v00 = getVal(x0, y0)
-            let v10 = getVal(x1, y0)
-            let v01 = getVal(x0, y1)
-            let v11 = getVal(x1, y1)
-            
-            let w00: T = (1 - fx) * (1 - fy)
-            let w10: T = fx * (1 - fy)
-            let w01: T = (1 - fx) * fy
-            let w11: T = fx * fy
-            
-            return v00 * w00 + v10 * w10 + v01 * w01 + v11 * w11
-        }
-        
-        func applyTransform<T: BinaryFloatingPoint>(source: [T], into output: inout [T]) {
-            for ch in 0..<channels {
-                let H = homographies[ch]
-                let Hinv = invertHomographyArray(H)
-                let isPerspective = abs(H[6]) > 1e-9 || abs(H[7]) > 1e-9
-                
-                for y in 0..<height {
-                    for x in 0..<width {
-                        var dstIdx = [0, 0, 0]
-                        dstIdx[axes.channel] = ch
-                        dstIdx[axes.height] = y
-                        dstIdx[axes.width] = x
-                        let dstLinear = linearIndex(dims: dimsArray, fortran: cube.isFortranOrder, i0: dstIdx[0], i1: dstIdx[1], i2: dstIdx[2])
-                        
-                        let dx = Double(x)
-                        let dy = Double(y)
-                        var srcX: Double
-                        var srcY: Double
-                        
-                        if isPerspective {
-                            let w = Hinv[6]*dx + Hinv[7]*dy + Hinv[8]
-                            guard abs(w) > 1e-12 else { output[dstLinear] = 0; continue }
-                            srcX = (Hinv[0]*dx + Hinv[1]*dy + Hinv[2]) / w
-                            srcY = (Hinv[3]*dx + Hinv[4]*dy + Hinv[5]) / w
-                        } else {
-                            srcX = dx - H[2]
-                            srcY = dy - H[5]
-                        }
-                        
-                        if srcX >= -0.5, srcX < Double(width) - 0.5, srcY >= -0.5, srcY < Double(height) - 0.5 {
-                            output[dstLinear] = bilinearSample(source: source, x: srcX, y: srcY, ch: ch)
-                        } else {
-                            output[dstLinear] = 0
-                        }
-                    }
-                }
-            }
-        }
-        
-        func applyTransformInt<T: FixedWidthInteger>(source: [T], into output: inout [T]) {
-            for ch in 0..<channels {
-                let H = homographies[ch]
-                let Hinv = invertHomographyArray(H)
-                let isPerspective = abs(H[6]) > 1e-9 || abs(H[7]) > 1e-9
-                
-                for y in 0..<height {
-                    for x in 0..<width {
-                        var dstIdx = [0, 0, 0]
-                        dstIdx[axes.channel] = ch
-                        dstIdx[axes.height] = y
-                        dstIdx[axes.width] = x
-                        let dstLinear = linearIndex(dims: dimsArray, fortran: cube.isFortranOrder, i0: dstIdx[0], i1: dstIdx[1], i2: dstIdx[2])
-                        
-                        let dx = Double(x)
-                        let dy = Double(y)
-                        var srcX: Double
-                        var srcY: Double
-                        
-                        if isPerspective {
-                            let w = Hinv[6]*dx + Hinv[7]*dy + Hinv[8]
-                            guard abs(w) > 1e-12 else { output[dstLinear] = 0; continue }
-                            srcX = (Hinv[0]*dx + Hinv[1]*dy + Hinv[2]) / w
-                            srcY = (Hinv[3]*dx + Hinv[4]*dy + Hinv[5]) / w
-                        } else {
-                            srcX = dx - H[2]
-                            srcY = dy - H[5]
-                        }
-                        
-                        if srcX >= -0.5, srcX < Double(width) - 0.5, srcY >= -0.5, srcY < Double(height) - 0.5 {
-                            let x0 = Int(floor(srcX))
-                            let y0 = Int(floor(srcY))
-                            let x1 = min(x0 + 1, width - 1)
-                            let y1 = min(y0 + 1, height - 1)
-                            let cx0 = max(0, x0)
-                            let cy0 = max(0, y0)
-                            
-                            let fx = srcX - Double(x0)
-                            let fy = srcY - Double(y0)
-                            
-                            func getVal(_ px: Int, _ py: Int) -> Double {
-                                var idx = [0, 0, 0]
-                                idx[axes.channel] = ch
-                                idx[axes.height] = py
-                                idx[axes.width] = px
-                                let linear = cube.linearIndex(i0: idx[0], i1: idx[1], i2: idx[2])
-                                return Double(source[linear])
-                            }
-                            
-                            let v00 = getVal(cx0, cy0)
-                            let v10 = getVal(x1, cy0)
-                            let v01 = getVal(cx0, y1)
-                            let v11 = getVal(x1, y1)
-                            
-                            let w00 = (1 - fx) * (1 - fy)
-                            let w10 = fx * (1 - fy)
-                            let w01 = (1 - fx) * fy
-                            let w11 = fx * fy
-                            let interpolated = v00*w00 + v10*w10 + v01*w01 + v11*w11
-                            
-                            output[dstLinear] = T(clamping: Int64(round(interpolated)))
-                        } else {
-                            output[dstLinear] = 0
-                        }
-                    }
-                }
-            }
-        }
-        
-        func invertHomographyArray(_ H: [Double]) -> [Double] {
-            guard H.count == 9 else { return [1,0,0, 0,1,0, 0,0,1] }
-            let m: [[Double]] = [[H[0], H[1], H[2]], [H[3], H[4], H[5]], [H[6], H[7], H[8]]]
-            let det = m[0][0]*(m[1][1]*m[2][2] - m[1][2]*m[2][1]) - m[0][1]*(m[1][0]*m[2][2] - m[1][2]*m[2][0]) + m[0][2]*(m[1][0]*m[2][1] - m[1][1]*m[2][0])
-            guard abs(det) > 1e-12 else { return [1,0,0, 0,1,0, 0,0,1] }
-            let invDet = 1.0 / det
-            return [(m[1][1]*m[2][2] - m[1][2]*m[2][1])*invDet, (m[0][2]*m[2][1] - m[0][1]*m[2][2])*invDet, (m[0][1]*m[1][2] - m[0][2]*m[1][1])*invDet,
-                    (m[1][2]*m[2][0] - m[1][0]*m[2][2])*invDet, (m[0][0]*m[2][2] - m[0][2]*m[2][0])*invDet, (m[0][2]*m[1][0] - m[0][0]*m[1][2])*invDet,
-                    (m[1][0]*m[2][1] - m[1][1]*m[2][0])*invDet, (m[0][1]*m[2][0] - m[0][0]*m[2][1])*invDet, (m[0][0]*m[1][1] - m[0][1]*m[1][0])*invDet]
-        }
-        
-        switch cube.storage {
-        case .float64(let arr):
-            var output = [Double](repeating: 0, count: totalElements)
-            applyTransform(source: arr, into: &output)
-            return HyperCube(dims: dims, storage: .float64(output), sourceFormat: cube.sourceFormat + " [Align]", isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
-        case .float32(let arr):
-            var output = [Float](repeating: 0, count: totalElements)
-            applyTransform(source: arr, into: &output)
-            return HyperCube(dims: dims, storage: .float32(output), sourceFormat: cube.sourceFormat + " [Align]", isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
-        case .uint16(let arr):
-            var output = [UInt16](repeating: 0, count: totalElements)
-            applyTransformInt(source: arr, into: &output)
-            return HyperCube(dims: dims, storage: .uint16(output), sourceFormat: cube.sourceFormat + " [Align]", isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
-        case .uint8(let arr):
-            var output = [UInt8](repeating: 0, count: totalElements)
-            applyTransformInt(source: arr, into: &output)
-            return HyperCube(dims: dims, storage: .uint8(output), sourceFormat: cube.sourceFormat + " [Align]", isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
-        case .int16(let arr):
-            var output = [Int16](repeating: 0, count: totalElements)
-            applyTransformInt(source: arr, into: &output)
-            return HyperCube(dims: dims, storage: .int16(output), sourceFormat: cube.sourceFormat + " [Align]", isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
-        case .int32(let arr):
-            var output = [Int32](repeating: 0, count: totalElements)
-            applyTransformInt(source: arr, into: &output)
-            return HyperCube(dims: dims, storage: .int32(output), sourceFormat: cube.sourceFormat + " [Align]", isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
-        case .int8(let arr):
-            var output = [Int8](repeating: 0, count: totalElements)
-            applyTransformInt(source: arr, into: &output)
-            return HyperCube(dims: dims, storage: .int8(output), sourceFormat: cube.sourceFormat + " [Align]", isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
-        }
-    }
-    
-    private static func linearIndex(dims: [Int], fortran: Bool, i0: Int, i1: Int, i2: Int) -> Int {
-        if fortran {
-            return i0 + dims[0] * (i1 + dims[1] * i2)
-        }
-        return i2 + dims[2] * (i1 + dims[1] * i0)
+        let storage = HomographyRemap.warp(cube: cube, homographies: homographies, axes: axes)
+        return HyperCube(dims: cube.dims, storage: storage, sourceFormat: cube.sourceFormat + " [Align]", isFortranOrder: cube.isFortranOrder, wavelengths: cube.wavelengths, geoReference: cube.geoReference)
     }
     
     // MARK: - Homography Functions
@@ -2071,8 +1512,10 @@ class CubeSpectralAligner {
         guard m >= 8 else { return nil }
         var AtA = [[Double]](repeating: [Double](repeating: 0, count: 9), count: 9)
         for i in 0..<9 { for j in 0..<9 { var sum = 0.0; for k in 0..<m { sum += A[k][i] * A[k][j] }; AtA[i][j] = sum } }
+        // Фиксированное зерно: одинаковые точки всегда дают одну и ту же гомографию
+        var generator = SplitMix64(seed: 0x5EED_A11C)
         var eigenvector = [Double](repeating: 0, count: 9)
-        for i in 0..<9 { eigenvector[i] = Double.random(in: -1...1) }
+        for i in 0..<9 { eigenvector[i] = Double.random(in: -1...1, using: &generator) }
         for _ in 0..<200 {
             var newVec = [Double](repeating: 0, count: 9)
             for i in 0..<9 { for j in 0..<9 { newVec[i] += AtA[i][j] * eigenvector[j] } }
@@ -2085,7 +1528,7 @@ class CubeSpectralAligner {
         for i in 0..<9 { maxEig += eigenvector[i] * tempVec[i] }
         for i in 0..<9 { AtA[i][i] -= maxEig * 1.001 }
         var minVec = [Double](repeating: 0, count: 9)
-        for i in 0..<9 { minVec[i] = Double.random(in: -1...1) }
+        for i in 0..<9 { minVec[i] = Double.random(in: -1...1, using: &generator) }
         for _ in 0..<200 {
             var newVec = [Double](repeating: 0, count: 9)
             for i in 0..<9 { for j in 0..<9 { newVec[i] += AtA[i][j] * minVec[j] } }
@@ -2113,13 +1556,29 @@ class CubeSpectralAligner {
     
     static func warpPerspective(_ data: [Double], width: Int, height: Int, H: [Double]) -> [Double] {
         guard H.count == 9 else { return data }
+        var result: [Double] = []
+        warpPerspective(data, width: width, height: height, H: H, into: &result)
+        return result
+    }
+    
+    /// Вариант с буфером назначения, который переиспользуется между вызовами
+    static func warpPerspective(_ data: [Double], width: Int, height: Int, H: [Double], into result: inout [Double]) {
+        guard H.count == 9 else {
+            result = data
+            return
+        }
         let Hinv = invertHomography(H)
-        var result = [Double](repeating: 0, count: width * height)
+        if result.count != width * height {
+            result = [Double](repeating: 0, count: width * height)
+        }
         for y in 0..<height {
             for x in 0..<width {
                 let dx = Double(x), dy = Double(y)
                 let w = Hinv[6]*dx + Hinv[7]*dy + Hinv[8]
-                guard abs(w) > 1e-12 else { continue }
+                guard abs(w) > 1e-12 else {
+                    result[y * width + x] = 0
+                    continue
+                }
                 let srcX = (Hinv[0]*dx + Hinv[1]*dy + Hinv[2]) / w
                 let srcY = (Hinv[3]*dx + Hinv[4]*dy + Hinv[5]) / w
                 if srcX >= 0 && srcX < Double(width - 1) && srcY >= 0 && srcY < Double(height - 1) {
@@ -2138,7 +1597,6 @@ class CubeSpectralAligner {
                 }
             }
         }
-        return result
     }
     
     private static func invertHomography(_ H: [Double]) -> [Double] {
@@ -0,0 +1,264 @@
+import Foundation
+import Accelerate
+
+/// Спектральная интерполяция как разреженная матрица (целевые каналы × исходные каналы).
+/// Сетки длин волн одинаковы для всех пикселей, поэтому поиск интервала и веса
+/// nearest/linear/cubic с выбранной экстраполяцией считаются один раз; в строке матрицы
+/// не больше четырёх ненулевых весов.
+struct SpectralResamplingMatrix {
+    let sourceCount: Int
+    let targetCount: Int
+    /// Начало строки `c` в `columns`/`weights`; `rowStarts[targetCount]` — общее число весов
+    let rowStarts: [Int]
+    /// Индексы исходных каналов в исходном (не отсортированном) порядке куба
+    let columns: [Int]
+    let weights: [Double]
+
+    init(
+        sourceWavelengths: [Double],
+        targetWavelengths: [Double],
+        method: SpectralInterpolationMethod,
+        extrapolation: SpectralExtrapolationMode
+    ) {
+        let (xs, indexMap) = Self.sortedWavelengthsIfNeeded(sourceWavelengths)
+        var rowStarts = [0]
+        var columns: [Int] = []
+        var weights: [Double] = []
+        rowStarts.reserveCapacity(targetWavelengths.count + 1)
+        columns.reserveCapacity(targetWavelengths.count * 4)
+        weights.reserveCapacity(targetWavelengths.count * 4)
+
+        for lambda in targetWavelengths {
+            for (index, weight) in Self.row(x: lambda, xs: xs, method: method, extrapolation: extrapolation) {
+                columns.append(indexMap[index])
+                weights.append(weight)
+            }
+            rowStarts.append(columns.count)
+        }
+
+        self.sourceCount = sourceWavelengths.count
+        self.targetCount = targetWavelengths.count
+        self.rowStarts = rowStarts
+        self.columns = columns
+        self.weights = weights
+    }
+
+    /// Применяет матрицу ко всем пикселям куба. Пиксели идут блоками вдоль строк: нужные исходные
+    /// каналы блока собираются в непрерывные плоскости, и каждый целевой канал — это сумма
+    /// не более четырёх плоскостей с весами (vDSP), записанная по шагам выходного куба.
+    func apply(cube: HyperCube, axes: (channel: Int, height: Int, width: Int), outputFloat32: Bool) -> DataStorage {
+        let src = cube.axisStrides(axes: axes)
+        let width = src.width
+        let height = src.height
+
+        var dstDims = [cube.dims.0, cube.dims.1, cube.dims.2]
+        dstDims[axes.channel] = targetCount
+        let dstElementStrides = cube.isFortranOrder
+            ? [1, dstDims[0], dstDims[0] * dstDims[1]]
+            : [dstDims[1] * dstDims[2], dstDims[2], 1]
+        let dstChannelStride = dstElementStrides[axes.channel]
+        let dstHeightStride = dstElementStrides[axes.height]
+        let dstWidthStride = dstElementStrides[axes.width]
+
+        // Собираются только каналы, на которые ссылается матрица; `slot` — их место в блоке
+        var slot = [Int](repeating: -1, count: sourceCount)
+        var usedChannels: [Int] = []
+        for column in columns where slot[column] < 0 {
+            slot[column] = usedChannels.count
+            usedChannels.append(column)
+        }
+        let slotColumns = columns.map { slot[$0] }
+        let blockPixels = max(64, min(4_096, 262_144 / max(1, usedChannels.count)))
+
+        let total = targetCount * width * height
+        var output64 = outputFloat32 ? [] : [Double](repeating: 0, count: total)
+        var output32 = outputFloat32 ? [Float](repeating: 0, count: total) : []
+
+        output64.withUnsafeMutableBufferPointer { out64 in
+            output32.withUnsafeMutableBufferPointer { out32 in
+                rowStarts.withUnsafeBufferPointer { rowStarts in
+                    slotColumns.withUnsafeBufferPointer { slotColumns in
+                        weights.withUnsafeBufferPointer { weights in
+                            ParallelCompute.forEachChunk(count: height) { _, rows in
+                                let planes = UnsafeMutablePointer<Double>.allocate(capacity: usedChannels.count * blockPixels)
+                                let result = UnsafeMutablePointer<Double>.allocate(capacity: blockPixels)
+                                defer {
+                                    planes.deallocate()
+                                    result.deallocate()
+                                }
+
+                                for y in rows {
+                                    var x0 = 0
+                                    while x0 < width {
+                                        let count = min(blockPixels, width - x0)
+                                        for (index, channel) in usedChannels.enumerated() {
+                                            cube.storage.gather(
+                                                base: src.offset(channel: channel, x: x0, y: y),
+                                                stride: src.widthStride,
+                                                count: count,
+                                                into: planes + index * count
+                                            )
+                                        }
+
+                                        for target in 0..<targetCount {
+                                            let start = rowStarts[target]
+                                            let end = rowStarts[target + 1]
+                                            if start == end {
+                                                vDSP_vclrD(result, 1, vDSP_Length(count))
+                                            } else {
+                                                var weight = weights[start]
+                                                vDSP_vsmulD(planes + slotColumns[start] * count, 1, &weight, result, 1, vDSP_Length(count))
+                                                for entry in (start + 1)..<end {
+                                                    weight = weights[entry]
+                                                    vDSP_vsmaD(planes + slotColumns[entry] * count, 1, &weight, result, 1, result, 1, vDSP_Length(count))
+                                                }
+                                            }
+
+                                            var offset = target * dstChannelStride + y * dstHeightStride + x0 * dstWidthStride
+                                            if outputFloat32 {
+                                                for i in 0..<count {
+                                                    out32[offset] = Float(result[i])
+                                                    offset += dstWidthStride
+                                                }
+                                            } else {
+                                                for i in 0..<count {
+                                                    out64[offset] = result[i]
+                                                    offset += dstWidthStride
+                                                }
+                                            }
+                                        }
+                                        x0 += count
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        return outputFloat32 ? .float32(output32) : .float64(output64)
+    }
+
+    /// Применяет матрицу к одному спектру, заданному в исходном порядке каналов
+    func apply(to values: [Double]) -> [Double] {
+        guard values.count >= sourceCount else { return [] }
+        return (0..<targetCount).map { target in
+            var sum = 0.0
+            for entry in rowStarts[target]..<rowStarts[target + 1] {
+                sum += weights[entry] * values[columns[entry]]
+            }
+            return sum
+        }
+    }
+
+    // MARK: - Веса одной строки
+
+    private static func sortedWavelengthsIfNeeded(_ wavelengths: [Double]) -> ([Double], [Int]) {
+        let isSorted = zip(wavelengths, wavelengths.dropFirst()).allSatisfy { $0 < $1 }
+        if isSorted {
+            return (wavelengths, Array(0..<wavelengths.count))
+        }
+        let indices = wavelengths.indices.sorted { wavelengths[$0] < wavelengths[$1] }
+        let sorted = indices.map { wavelengths[$0] }
+        return (sorted, indices)
+    }
+
+    /// Веса по отсортированной сетке `xs` для значения в точке `x`
+    private static func row(
+        x: Double,
+        xs: [Double],
+        method: SpectralInterpolationMethod,
+        extrapolation: SpectralExtrapolationMode
+    ) -> [(Int, Double)] {
+        guard !xs.isEmpty else { return [] }
+        if xs.count == 1 { return [(0, 1)] }
+
+        switch method {
+        case .nearest:
+            return nearest(x: x, xs: xs)
+        case .linear:
+            return linear(x: x, xs: xs, extrapolation: extrapolation)
+        case .cubic:
+            return cubic(x: x, xs: xs, extrapolation: extrapolation)
+        }
+    }
+
+    private static func nearest(x: Double, xs: [Double]) -> [(Int, Double)] {
+        let n = xs.count
+        if x <= xs[0] { return [(0, 1)] }
+        if x >= xs[n - 1] { return [(n - 1, 1)] }
+        let i = lowerBound(x: x, xs: xs)
+        let left = max(0, min(i - 1, n - 1))
+        let right = max(0, min(i, n - 1))
+        return [(abs(xs[left] - x) <= abs(xs[right] - x) ? left : right, 1)]
+    }
+
+    private static func linear(x: Double, xs: [Double], extrapolation: SpectralExtrapolationMode) -> [(Int, Double)] {
+        let n = xs.count
+        if x <= xs[0] {
+            return extrapolation == .clamp ? [(0, 1)] : linearSegment(x: x, xs: xs, i0: 0, i1: 1)
+        }
+        if x >= xs[n - 1] {
+            return extrapolation == .clamp ? [(n - 1, 1)] : linearSegment(x: x, xs: xs, i0: n - 2, i1: n - 1)
+        }
+        let i = lowerBound(x: x, xs: xs)
+        return linearSegment(x: x, xs: xs, i0: max(0, i - 1), i1: min(n - 1, i))
+    }
+
+    private static func cubic(x: Double, xs: [Double], extrapolation: SpectralExtrapolationMode) -> [(Int, Double)] {
+        let n = xs.count
+        if n < 4 {
+            return linear(x: x, xs: xs, extrapolation: extrapolation)
+        }
+        if x <= xs[0] {
+            if extrapolation == .clamp { return [(0, 1)] }
+            return cubicLagrange(x: x, xs: xs, indices: (0, 1, 2, 3))
+        }
+        if x >= xs[n - 1] {
+            if extrapolation == .clamp { return [(n - 1, 1)] }
+            return cubicLagrange(x: x, xs: xs, indices: (n - 4, n - 3, n - 2, n - 1))
+        }
+
+        let i = lowerBound(x: x, xs: xs)
+        let i1 = max(1, min(i, n - 2))
+        let i0 = max(0, i1 - 1)
+        let i2 = min(n - 1, i1 + 1)
+        let i3 = min(n - 1, i1 + 2)
+        if i0 == i1 || i2 == i3 {
+            return linear(x: x, xs: xs, extrapolation: extrapolation)
+        }
+        return cubicLagrange(x: x, xs: xs, indices: (i0, i1, i2, i3))
+    }
+
+    private static func lowerBound(x: Double, xs: [Double]) -> Int {
+        var low = 0
+        var high = xs.count
+        while low < high {
+            let mid = (low + high) / 2
+            if xs[mid] < x {
+                low = mid + 1
+            } else {
+                high = mid
+            }
+        }
+        return low
+    }
+
+    private static func linearSegment(x: Double, xs: [Double], i0: Int, i1: Int) -> [(Int, Double)] {
+        let denom = xs[i1] - xs[i0]
+        guard abs(denom) > 1e-12 else { return [(i0, 1)] }
+        let t = (x - xs[i0]) / denom
+        return [(i0, 1 - t), (i1, t)]
+    }
+
+    private static func cubicLagrange(x: Double, xs: [Double], indices: (Int, Int, Int, Int)) -> [(Int, Double)] {
+        let (i0, i1, i2, i3) = indices
+        let x0 = xs[i0], x1 = xs[i1], x2 = xs[i2], x3 = xs[i3]
+        let l0 = ((x - x1) * (x - x2) * (x - x3)) / ((x0 - x1) * (x0 - x2) * (x0 - x3))
+        let l1 = ((x - x0) * (x - x2) * (x - x3)) / ((x1 - x0) * (x1 - x2) * (x1 - x3))
+        let l2 = ((x - x0) * (x - x1) * (x - x3)) / ((x2 - x0) * (x2 - x1) * (x2 - x3))
+        let l3 = ((x - x0) * (x - x1) * (x - x2)) / ((x3 - x0) * (x3 - x1) * (x3 - x2))
+        return [(i0, l0), (i1, l1), (i2, l2), (i3, l3)]
+    }
+}
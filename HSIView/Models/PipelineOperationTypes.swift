@@ -92,6 +92,8 @@ struct ResizeParameters: Equatable {
     var lanczosA: Int
     var lockAspectRatio: Bool
     var computePrecision: ResizeComputationPrecision
+    /// При уменьшении расширять ядро по масштабу, чтобы усреднять, а не прореживать пиксели
+    var antialias: Bool = false
     
     static let `default` = ResizeParameters(
         targetWidth: 0,
@@ -0,0 +1,379 @@
+import Foundation
+
+/// Ключ промежуточного результата пайплайна: исходный куб и параметры всех операций префикса.
+/// Ключ префикса длины k+1 выводится из ключа длины k и параметров k-й операции,
+/// поэтому изменение шага N не трогает ключи до N.
+struct PipelinePrefixKey: Hashable {
+    let sourceID: UUID
+    let wavelengths: [Double]?
+    let operations: [PipelineOperationContentKey]
+
+    /// Корень цепочки: исходный куб и длины волн, подставленные перед запуском
+    static func root(sourceID: UUID, wavelengths: [Double]?) -> PipelinePrefixKey {
+        PipelinePrefixKey(sourceID: sourceID, wavelengths: wavelengths, operations: [])
+    }
+
+    func appending(_ operation: PipelineOperation) -> PipelinePrefixKey {
+        PipelinePrefixKey(
+            sourceID: sourceID,
+            wavelengths: wavelengths,
+            operations: operations + [PipelineOperationContentKey(operation)]
+        )
+    }
+}
+
+/// Параметры операции без идентификатора. Равенство сравнивает все параметры (массивы
+/// эталонов калибровки с общим буфером сравниваются без обхода), хэш берёт дешёвые поля,
+/// а от больших массивов — только размер и несколько отсчётов.
+/// При добавлении поля в `PipelineOperation` его нужно добавить и в `==`.
+struct PipelineOperationContentKey: Hashable {
+    let operation: PipelineOperation
+
+    init(_ operation: PipelineOperation) {
+        self.operation = operation
+    }
+
+    static func == (lhs: PipelineOperationContentKey, rhs: PipelineOperationContentKey) -> Bool {
+        let a = lhs.operation
+        let b = rhs.operation
+        return a.type == b.type
+            && a.layout == b.layout
+            && a.normalizationType == b.normalizationType
+            && a.normalizationParams == b.normalizationParams
+            && a.preserveDataType == b.preserveDataType
+            && a.targetDataType == b.targetDataType
+            && a.autoScale == b.autoScale
+            && a.clippingParams == b.clippingParams
+            && a.rotationAngle == b.rotationAngle
+            && a.transposeParameters == b.transposeParameters
+            && a.cropParameters == b.cropParameters
+            && a.calibrationParams == b.calibrationParams
+            && a.resizeParameters == b.resizeParameters
+            && a.spectralTrimParams == b.spectralTrimParams
+            && a.spectralInterpolationParams == b.spectralInterpolationParams
+            && a.spectralAlignmentParams == b.spectralAlignmentParams
+            && a.customPythonConfig == b.customPythonConfig
+    }
+
+    func hash(into hasher: inout Hasher) {
+        hasher.combine(operation.type)
+        hasher.combine(operation.layout)
+        hasher.combine(operation.normalizationType)
+        hasher.combine(operation.preserveDataType)
+        hasher.combine(operation.targetDataType)
+        hasher.combine(operation.autoScale)
+        hasher.combine(operation.rotationAngle)
+        hasher.combine(operation.normalizationParams?.computePrecision)
+        hasher.combine(operation.clippingParams?.lower)
+        hasher.combine(operation.clippingParams?.upper)
+        if let calibration = operation.calibrationParams {
+            Self.combineDigest(of: calibration.whiteRef?.values, into: &hasher)
+            Self.combineDigest(of: calibration.blackRef?.values, into: &hasher)
+            Self.combineDigest(of: calibration.whiteSpectrum?.values, into: &hasher)
+            Self.combineDigest(of: calibration.blackSpectrum?.values, into: &hasher)
+        }
+    }
+
+    /// Размер массива и до 16 равномерно взятых отсчётов
+    private static func combineDigest(of values: [Double]?, into hasher: inout Hasher) {
+        guard let values else {
+            hasher.combine(-1)
+            return
+        }
+        hasher.combine(values.count)
+        guard !values.isEmpty else { return }
+        let step = max(1, values.count / 16)
+        for index in stride(from: 0, to: values.count, by: step) {
+            hasher.combine(values[index])
+        }
+        hasher.combine(values[values.count - 1])
+    }
+}
+
+/// Кэш промежуточных кубов пайплайна в пределах бюджета памяти.
+/// Вытесняются давно не использованные записи; дорогие в расчёте (например,
+/// спектральное выравнивание) при вытеснении сбрасываются во временный файл.
+final class PipelinePrefixCache {
+    static let shared = PipelinePrefixCache()
+
+    /// Бюджет памяти под кубы в байтах
+    var memoryBudget: Int = {
+        let physical = Int(clamping: ProcessInfo.processInfo.physicalMemory)
+        return max(256 << 20, physical / 8)
+    }()
+    /// Сбрасывать ли вытесненные записи на диск
+    var spillToDisk = true
+    /// Минимальное время расчёта (с), при котором запись стоит сохранять на диск
+    var spillThresholdSeconds: Double = 1.0
+    var diskBudget: Int = 8 << 30
+
+    private struct SpilledCube {
+        let url: URL
+        let dims: (Int, Int, Int)
+        let dataType: DataType
+        let byteCount: Int
+        let sourceFormat: String
+        let isFortranOrder: Bool
+        let wavelengths: [Double]?
+        let geoReference: MapGeoReference?
+        let computeSeconds: Double
+    }
+
+    private struct MemoryEntry {
+        let cube: HyperCube
+        let computeSeconds: Double
+    }
+
+    private let lock = NSLock()
+    private var memoryEntries: [PipelinePrefixKey: MemoryEntry] = [:]
+    private var memoryOrder: [PipelinePrefixKey] = []
+    private var memoryBytes = 0
+    /// Вытесненные записи, файл которых ещё пишется; до завершения записи доступны из памяти
+    private var spillingEntries: [PipelinePrefixKey: MemoryEntry] = [:]
+    private var spilledEntries: [PipelinePrefixKey: SpilledCube] = [:]
+    private var spilledOrder: [PipelinePrefixKey] = []
+    private var spilledBytes = 0
+    /// Запись и удаление файлов идут вне `lock`, последовательно
+    private let diskQueue = DispatchQueue(label: "PipelinePrefixCache.disk", qos: .utility)
+
+    private let scratchDirectory = FileManager.default.temporaryDirectory
+        .appendingPathComponent("HSIViewPipelineCache", isDirectory: true)
+
+    private init() {
+        // Файлы прошлых запусков не имеют записей в памяти
+        try? FileManager.default.removeItem(at: scratchDirectory)
+    }
+
+    func cube(for key: PipelinePrefixKey) -> HyperCube? {
+        lock.lock()
+        if let entry = memoryEntries[key] {
+            touch(key)
+            lock.unlock()
+            return entry.cube
+        }
+        if let entry = spillingEntries[key] {
+            let evicted = insert(entry.cube, computeSeconds: entry.computeSeconds, for: key)
+            lock.unlock()
+            scheduleSpills(evicted)
+            return entry.cube
+        }
+        guard let spilled = spilledEntries[key] else {
+            lock.unlock()
+            return nil
+        }
+        forgetSpilled(key)
+        lock.unlock()
+
+        // Чтение файла — вне блокировки
+        let loaded = load(spilled)
+        diskQueue.async {
+            try? FileManager.default.removeItem(at: spilled.url)
+        }
+        guard let cube = loaded else { return nil }
+        lock.lock()
+        let evicted = memoryEntries[key] == nil
+            ? insert(cube, computeSeconds: spilled.computeSeconds, for: key)
+            : []
+        lock.unlock()
+        scheduleSpills(evicted)
+        return cube
+    }
+
+    func contains(_ key: PipelinePrefixKey) -> Bool {
+        lock.lock()
+        defer { lock.unlock() }
+        return memoryEntries[key] != nil || spillingEntries[key] != nil || spilledEntries[key] != nil
+    }
+
+    /// `computeSeconds` — время получения результата из предыдущего закэшированного префикса
+    func store(_ cube: HyperCube, for key: PipelinePrefixKey, computeSeconds: Double) {
+        lock.lock()
+        guard cube.storage.sizeInBytes <= memoryBudget else {
+            lock.unlock()
+            return
+        }
+        if memoryEntries[key] != nil {
+            touch(key)
+            lock.unlock()
+            return
+        }
+        if let spilled = spilledEntries[key] {
+            forgetSpilled(key)
+            deleteFile(spilled.url)
+        }
+        let evicted = insert(cube, computeSeconds: computeSeconds, for: key)
+        lock.unlock()
+        scheduleSpills(evicted)
+    }
+
+    /// Удаляет записи всех исходных кубов, кроме `sourceID`, вместе с их файлами на диске
+    func removeAll(except sourceID: UUID? = nil) {
+        lock.lock()
+        let keep: (PipelinePrefixKey) -> Bool = { $0.sourceID == sourceID }
+        memoryEntries = memoryEntries.filter { keep($0.key) }
+        memoryOrder.removeAll { !keep($0) }
+        memoryBytes = memoryEntries.values.reduce(0) { $0 + $1.cube.storage.sizeInBytes }
+        spillingEntries = spillingEntries.filter { keep($0.key) }
+        let purged = spilledOrder.filter { !keep($0) }
+        let urls = purged.compactMap { spilledEntries[$0]?.url }
+        for key in purged {
+            forgetSpilled(key)
+        }
+        lock.unlock()
+        for url in urls {
+            deleteFile(url)
+        }
+    }
+
+    // MARK: - Память
+
+    private func touch(_ key: PipelinePrefixKey) {
+        if let index = memoryOrder.firstIndex(of: key) {
+            memoryOrder.remove(at: index)
+        }
+        memoryOrder.append(key)
+    }
+
+    /// Вызывается под `lock`; возвращает вытесненные записи, которые стоит сбросить на диск
+    private func insert(_ cube: HyperCube, computeSeconds: Double, for key: PipelinePrefixKey) -> [(PipelinePrefixKey, MemoryEntry)] {
+        spillingEntries.removeValue(forKey: key)
+        memoryEntries[key] = MemoryEntry(cube: cube, computeSeconds: computeSeconds)
+        memoryOrder.append(key)
+        memoryBytes += cube.storage.sizeInBytes
+        var evicted: [(PipelinePrefixKey, MemoryEntry)] = []
+        while memoryBytes > memoryBudget, memoryOrder.count > 1 {
+            let evictedKey = memoryOrder.removeFirst()
+            guard let entry = memoryEntries.removeValue(forKey: evictedKey) else { continue }
+            memoryBytes -= entry.cube.storage.sizeInBytes
+            if spillToDisk,
+               entry.computeSeconds >= spillThresholdSeconds,
+               entry.cube.storage.sizeInBytes <= diskBudget {
+                spillingEntries[evictedKey] = entry
+                evicted.append((evictedKey, entry))
+            }
+        }
+        return evicted
+    }
+
+    // MARK: - Диск
+
+    private func scheduleSpills(_ evicted: [(PipelinePrefixKey, MemoryEntry)]) {
+        for (key, entry) in evicted {
+            diskQueue.async { [weak self] in
+                self?.spill(entry, for: key)
+            }
+        }
+    }
+
+    /// Выполняется на `diskQueue`: файл пишется без блокировки, затем запись регистрируется,
+    /// если за это время куб не вернулся в память и кэш не был очищен
+    private func spill(_ entry: MemoryEntry, for key: PipelinePrefixKey) {
+        lock.lock()
+        let stillPending = spillingEntries[key] != nil
+        lock.unlock()
+        guard stillPending else { return }
+
+        let cube = entry.cube
+        let byteCount = cube.storage.sizeInBytes
+        let url = scratchDirectory.appendingPathComponent(UUID().uuidString).appendingPathExtension("bin")
+        do {
+            try FileManager.default.createDirectory(at: scratchDirectory, withIntermediateDirectories: true)
+            try rawData(of: cube.storage).write(to: url)
+        } catch {
+            lock.lock()
+            spillingEntries.removeValue(forKey: key)
+            lock.unlock()
+            return
+        }
+
+        lock.lock()
+        guard spillingEntries.removeValue(forKey: key) != nil else {
+            lock.unlock()
+            try? FileManager.default.removeItem(at: url)
+            return
+        }
+        var obsolete: [URL] = []
+        while spilledBytes + byteCount > diskBudget, let oldest = spilledOrder.first {
+            if let spilled = spilledEntries[oldest] {
+                obsolete.append(spilled.url)
+            }
+            forgetSpilled(oldest)
+        }
+        spilledEntries[key] = SpilledCube(
+            url: url,
+            dims: cube.dims,
+            dataType: cube.originalDataType,
+            byteCount: byteCount,
+            sourceFormat: cube.sourceFormat,
+            isFortranOrder: cube.isFortranOrder,
+            wavelengths: cube.wavelengths,
+            geoReference: cube.geoReference,
+            computeSeconds: entry.computeSeconds
+        )
+        spilledOrder.append(key)
+        spilledBytes += byteCount
+        lock.unlock()
+        for url in obsolete {
+            try? FileManager.default.removeItem(at: url)
+        }
+    }
+
+    /// Вызывается под `lock`: убирает запись о файле, сам файл удаляется отдельно
+    private func forgetSpilled(_ key: PipelinePrefixKey) {
+        guard let spilled = spilledEntries.removeValue(forKey: key) else { return }
+        spilledOrder.removeAll { $0 == key }
+        spilledBytes -= spilled.byteCount
+    }
+
+    private func deleteFile(_ url: URL) {
+        diskQueue.async {
+            try? FileManager.default.removeItem(at: url)
+        }
+    }
+
+    private func load(_ spilled: SpilledCube) -> HyperCube? {
+        guard let data = try? Data(contentsOf: spilled.url, options: .alwaysMapped),
+              data.count == spilled.byteCount else { return nil }
+        let count = spilled.dims.0 * spilled.dims.1 * spilled.dims.2
+        let storage: DataStorage
+        switch spilled.dataType {
+        case .float64: storage = .float64(Self.array(from: data, count: count))
+        case .float32: storage = .float32(Self.array(from: data, count: count))
+        case .int8: storage = .int8(Self.array(from: data, count: count))
+        case .int16: storage = .int16(Self.array(from: data, count: count))
+        case .int32: storage = .int32(Self.array(from: data, count: count))
+        case .uint8: storage = .uint8(Self.array(from: data, count: count))
+        case .uint16: storage = .uint16(Self.array(from: data, count: count))
+        case .unknown: return nil
+        }
+        return HyperCube(
+            dims: spilled.dims,
+            storage: storage,
+            sourceFormat: spilled.sourceFormat,
+            isFortranOrder: spilled.isFortranOrder,
+            wavelengths: spilled.wavelengths,
+            geoReference: spilled.geoReference
+        )
+    }
+
+    private func rawData(of storage: DataStorage) -> Data {
+        switch storage {
+        case .float64(let arr): return arr.withUnsafeBytes { Data($0) }
+        case .float32(let arr): return arr.withUnsafeBytes { Data($0) }
+        case .int8(let arr): return arr.withUnsafeBytes { Data($0) }
+        case .int16(let arr): return arr.withUnsafeBytes { Data($0) }
+        case .int32(let arr): return arr.withUnsafeBytes { Data($0) }
+        case .uint8(let arr): return arr.withUnsafeBytes { Data($0) }
+        case .uint16(let arr): return arr.withUnsafeBytes { Data($0) }
+        }
+    }
+
+    private static func array<T>(from data: Data, count: Int) -> [T] {
+        [T](unsafeUninitializedCapacity: count) { buffer, initializedCount in
+            data.withUnsafeBytes { raw in
+                UnsafeMutableRawBufferPointer(buffer).copyMemory(from: raw)
+            }
+            initializedCount = count
+        }
+    }
+}
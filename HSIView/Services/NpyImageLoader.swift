@@ -40,6 +40,19 @@ class NpyImageLoader: ImageLoader {
         ))
     }
     
+    /// Форма и размер элемента по заголовку, без чтения данных
+    static func peekLayout(of url: URL) -> (shape: [Int], bytesPerElement: Int)? {
+        guard let handle = try? FileHandle(forReadingFrom: url) else { return nil }
+        defer { try? handle.close() }
+        guard let prefix = try? handle.read(upToCount: 64 * 1024),
+              let header = parseNpyHeader(data: prefix) else {
+            return nil
+        }
+        let digits = header.dtype.drop { !$0.isNumber }
+        guard let bytes = Int(digits), bytes > 0 else { return nil }
+        return (header.shape, bytes)
+    }
+    
     private struct NpyHeader {
         let dtype: String
         let shape: [Int]
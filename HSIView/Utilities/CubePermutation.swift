@@ -0,0 +1,165 @@
+import Foundation
+
+/// Перестановка осей трёхмерного массива (смена `CubeLayout`, повороты) для C- и Fortran-порядка.
+/// Копирование идёт по памяти назначения; если самая быстрая ось меняется, массив
+/// обходится плитками, в пределах которых и чтение, и запись остаются в кэше.
+/// Ядро работает с битовыми образами элементов, поэтому Float32/Int32 и т.п.
+/// используют одну специализацию на размер элемента. Файл зависит только от Foundation
+/// и `ParallelCompute`, чтобы его можно было собрать в `HSIViewCLI`.
+enum CubePermutation {
+    /// Сторона плитки в элементах: 32×32 для 8-байтных элементов, 64×64 для остальных
+    static func tileSize(elementSize: Int) -> Int {
+        elementSize >= 8 ? 32 : 64
+    }
+
+    /// Размеры результата: ось `i` назначения берётся из оси `permutation[i]` источника
+    static func permutedDims(_ sourceDims: [Int], permutation: [Int]) -> [Int] {
+        permutation.map { sourceDims[$0] }
+    }
+
+    static func permute(
+        source: UnsafeRawPointer,
+        destination: UnsafeMutableRawPointer,
+        elementSize: Int,
+        sourceDims: [Int],
+        permutation: [Int],
+        fortranOrder: Bool
+    ) {
+        precondition(sourceDims.count == 3 && Set(permutation) == [0, 1, 2])
+        let sourceStrides = elementStrides(sourceDims, fortranOrder: fortranOrder)
+        stridedCopy(
+            source: source,
+            destination: destination,
+            elementSize: elementSize,
+            destinationDims: permutedDims(sourceDims, permutation: permutation),
+            sourceStrides: permutation.map { sourceStrides[$0] },
+            sourceOffset: 0,
+            fortranOrder: fortranOrder
+        )
+    }
+
+    static func elementStrides(_ dims: [Int], fortranOrder: Bool) -> [Int] {
+        fortranOrder
+            ? [1, dims[0], dims[0] * dims[1]]
+            : [dims[1] * dims[2], dims[2], 1]
+    }
+
+    /// Общий случай: элемент назначения (i0, i1, i2) берётся из
+    /// `source[sourceOffset + i0·s0 + i1·s1 + i2·s2]`. Шаги могут быть отрицательными —
+    /// так выражаются отражения и повороты на 90/180/270°.
+    static func stridedCopy(
+        source: UnsafeRawPointer,
+        destination: UnsafeMutableRawPointer,
+        elementSize: Int,
+        destinationDims: [Int],
+        sourceStrides: [Int],
+        sourceOffset: Int,
+        fortranOrder: Bool
+    ) {
+        guard destinationDims.count == 3, destinationDims.allSatisfy({ $0 > 0 }) else { return }
+
+        // Оси назначения от самой медленной к самой быстрой в памяти
+        let memoryOrder = fortranOrder ? [2, 1, 0] : [0, 1, 2]
+        let extents = memoryOrder.map { destinationDims[$0] }
+        let strides = memoryOrder.map { sourceStrides[$0] }
+        let start = source + sourceOffset * elementSize
+
+        switch elementSize {
+        case 1:
+            copy(UInt8.self, start, destination, extents: extents, sourceStrides: strides)
+        case 2:
+            copy(UInt16.self, start, destination, extents: extents, sourceStrides: strides)
+        case 4:
+            copy(UInt32.self, start, destination, extents: extents, sourceStrides: strides)
+        case 8:
+            copy(UInt64.self, start, destination, extents: extents, sourceStrides: strides)
+        default:
+            preconditionFailure("Unsupported element size \(elementSize)")
+        }
+    }
+
+    /// `extents` — размеры назначения в порядке памяти, `sourceStrides` — шаги источника по тем же осям
+    private static func copy<T>(
+        _: T.Type,
+        _ sourceRaw: UnsafeRawPointer,
+        _ destinationRaw: UnsafeMutableRawPointer,
+        extents: [Int],
+        sourceStrides: [Int]
+    ) {
+        let source = sourceRaw.assumingMemoryBound(to: T.self)
+        let destination = destinationRaw.assumingMemoryBound(to: T.self)
+        let inner = extents[2]
+        let innerStride = sourceStrides[2]
+
+        // Быстрая ось не меняется: строки копируются целиком
+        if innerStride == 1 {
+            let rows = extents[0] * extents[1]
+            let middle = extents[1]
+            ParallelCompute.forEachChunk(count: rows, minChunk: max(1, 16_384 / inner)) { _, range in
+                for row in range {
+                    let from = source + (row / middle) * sourceStrides[0] + (row % middle) * sourceStrides[1]
+                    (destination + row * inner).update(from: from, count: inner)
+                }
+            }
+            return
+        }
+
+        // Ось `a` читается из источника почти подряд (наименьший |шаг|), ось `b` — внешняя
+        let a = abs(sourceStrides[0]) < abs(sourceStrides[1]) ? 0 : 1
+        let b = 1 - a
+        let countA = extents[a]
+        let countB = extents[b]
+        let strideA = sourceStrides[a]
+        let strideB = sourceStrides[b]
+        let destinationStrides = [extents[1] * inner, inner]
+        let destinationStrideA = destinationStrides[a]
+        let destinationStrideB = destinationStrides[b]
+
+        let tile = tileSize(elementSize: MemoryLayout<T>.size)
+        let blocksA = (countA + tile - 1) / tile
+        ParallelCompute.forEachChunk(count: countB * blocksA) { _, range in
+            for work in range {
+                let indexB = work / blocksA
+                let startA = (work % blocksA) * tile
+                let endA = min(countA, startA + tile)
+                let sourceBase = source + indexB * strideB
+                let destinationBase = destination + indexB * destinationStrideB
+
+                var startInner = 0
+                while startInner < inner {
+                    let endInner = min(inner, startInner + tile)
+                    var indexA = startA
+                    // Блок 4×1: четыре соседних по `a` элемента источника за шаг раскладываются в четыре строки назначения
+                    while indexA + 4 <= endA {
+                        let from = sourceBase + indexA * strideA
+                        let to0 = destinationBase + indexA * destinationStrideA
+                        let to1 = to0 + destinationStrideA
+                        let to2 = to1 + destinationStrideA
+                        let to3 = to2 + destinationStrideA
+                        var offset = startInner * innerStride
+                        for k in startInner..<endInner {
+                            let p = from + offset
+                            to0[k] = p[0]
+                            to1[k] = p[strideA]
+                            to2[k] = p[2 * strideA]
+                            to3[k] = p[3 * strideA]
+                            offset += innerStride
+                        }
+                        indexA += 4
+                    }
+                    while indexA < endA {
+                        let from = sourceBase + indexA * strideA
+                        let to = destinationBase + indexA * destinationStrideA
+                        var offset = startInner * innerStride
+                        for k in startInner..<endInner {
+                            to[k] = from[offset]
+                            offset += innerStride
+                        }
+                        indexA += 1
+                    }
+                    startInner = endInner
+                }
+            }
+        }
+    }
+}
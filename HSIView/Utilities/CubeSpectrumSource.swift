@@ -0,0 +1,77 @@
+import Foundation
+import Accelerate
+
+/// Источник спектров пикселей для потоковых вычислений (PCA и т.п.).
+/// Пиксели адресуются линейным индексом `y * width + x` внутри области источника.
+/// Реализации должны допускать одновременное чтение из нескольких потоков.
+protocol CubeSpectrumSource {
+    var channels: Int { get }
+    var width: Int { get }
+    var height: Int { get }
+
+    /// Читает спектр пикселя `pixel` (`channels` значений) в `destination`
+    func readSpectrum(pixel: Int, into destination: UnsafeMutablePointer<Double>)
+
+    /// Читает `count` соседних пикселей одной строки, начиная с `pixel`, в блок `count × channels`
+    func readSpectra(pixel: Int, count: Int, into destination: UnsafeMutablePointer<Double>)
+}
+
+extension CubeSpectrumSource {
+    var pixelCount: Int { width * height }
+
+    func readSpectra(pixel: Int, count: Int, into destination: UnsafeMutablePointer<Double>) {
+        for i in 0..<count {
+            readSpectrum(pixel: pixel + i, into: destination + i * channels)
+        }
+    }
+}
+
+/// Спектры загруженного в память куба в пределах прямоугольной области
+struct InMemoryCubeSpectrumSource: CubeSpectrumSource {
+    let cube: HyperCube
+    let strides: CubeAxisStrides
+    let region: SpectrumROIRect
+
+    init(cube: HyperCube, axes: (channel: Int, height: Int, width: Int), region: SpectrumROIRect) {
+        self.cube = cube
+        self.strides = cube.axisStrides(axes: axes)
+        self.region = region
+    }
+
+    var channels: Int { strides.channels }
+    var width: Int { region.width }
+    var height: Int { region.height }
+
+    func readSpectrum(pixel: Int, into destination: UnsafeMutablePointer<Double>) {
+        let y = pixel / region.width
+        let x = pixel - y * region.width
+        cube.storage.gather(
+            base: strides.pixelOffset(x: region.minX + x, y: region.minY + y),
+            stride: strides.channelStride,
+            count: strides.channels,
+            into: destination
+        )
+    }
+
+    /// Отрезок строки читается по каналам (последовательно для CHW) и транспонируется в спектры
+    func readSpectra(pixel: Int, count: Int, into destination: UnsafeMutablePointer<Double>) {
+        guard count > 1 else {
+            if count == 1 { readSpectrum(pixel: pixel, into: destination) }
+            return
+        }
+        let y = pixel / region.width
+        let x = pixel - y * region.width
+        let channels = strides.channels
+        let planes = UnsafeMutablePointer<Double>.allocate(capacity: channels * count)
+        defer { planes.deallocate() }
+        for ch in 0..<channels {
+            cube.storage.gather(
+                base: strides.offset(channel: ch, x: region.minX + x, y: region.minY + y),
+                stride: strides.widthStride,
+                count: count,
+                into: planes + ch * count
+            )
+        }
+        vDSP_mtransD(planes, 1, destination, 1, vDSP_Length(count), vDSP_Length(channels))
+    }
+}
@@ -60,7 +60,7 @@ class DataTypeConverter {
         return wrapInTargetStorage(clampedData, targetType: targetType)
     }
     
-    private static func getTypeRange(_ type: DataType) -> (min: Double, max: Double) {
+    static func getTypeRange(_ type: DataType) -> (min: Double, max: Double) {
         switch type {
         case .float64:
             return (-Double.greatestFiniteMagnitude, Double.greatestFiniteMagnitude)
@@ -0,0 +1,418 @@
+import Foundation
+import Accelerate
+
+/// Общие ядра метрик сходства двух плоскостей одинакового размера: SSIM (глобальный
+/// и оконный), MSE и PSNR. Считается в Float64, поэтому значения совпадают с прежними
+/// скалярными реализациями с точностью до порядка суммирования.
+enum ImageSimilarity {
+    /// Пять моментов пары сигналов: Σx, Σy, Σx², Σy², Σxy
+    struct Moments {
+        var sumX = 0.0
+        var sumY = 0.0
+        var sumXX = 0.0
+        var sumYY = 0.0
+        var sumXY = 0.0
+        var count = 0
+
+        @inline(__always)
+        mutating func add(_ x: Double, _ y: Double) {
+            sumX += x
+            sumY += y
+            sumXX += x * x
+            sumYY += y * y
+            sumXY += x * y
+            count += 1
+        }
+    }
+
+    enum Window {
+        case gaussian(size: Int, sigma: Double)
+        case box(size: Int)
+
+        var size: Int {
+            switch self {
+            case .gaussian(let size, _), .box(let size):
+                return size
+            }
+        }
+    }
+
+    // MARK: - Моменты, MSE, PSNR
+
+    /// Все пять моментов за один проход по четыре элемента
+    static func moments(_ x: UnsafePointer<Double>, _ y: UnsafePointer<Double>, count: Int) -> Moments {
+        var sx = SIMD4<Double>()
+        var sy = SIMD4<Double>()
+        var sxx = SIMD4<Double>()
+        var syy = SIMD4<Double>()
+        var sxy = SIMD4<Double>()
+        let rawX = UnsafeRawPointer(x)
+        let rawY = UnsafeRawPointer(y)
+        var i = 0
+        while i + 4 <= count {
+            let a = rawX.loadUnaligned(fromByteOffset: i * 8, as: SIMD4<Double>.self)
+            let b = rawY.loadUnaligned(fromByteOffset: i * 8, as: SIMD4<Double>.self)
+            sx += a
+            sy += b
+            sxx += a * a
+            syy += b * b
+            sxy += a * b
+            i += 4
+        }
+        var result = Moments(
+            sumX: sx.sum(),
+            sumY: sy.sum(),
+            sumXX: sxx.sum(),
+            sumYY: syy.sum(),
+            sumXY: sxy.sum(),
+            count: i
+        )
+        while i < count {
+            result.add(x[i], y[i])
+            i += 1
+        }
+        return result
+    }
+
+    static func moments(_ x: [Double], _ y: [Double]) -> Moments {
+        let count = min(x.count, y.count)
+        return x.withUnsafeBufferPointer { xPtr in
+            y.withUnsafeBufferPointer { yPtr in
+                guard count > 0 else { return Moments() }
+                return moments(xPtr.baseAddress!, yPtr.baseAddress!, count: count)
+            }
+        }
+    }
+
+    /// SSIM по моментам. `degenerate` возвращается, если знаменатель не больше `epsilon`
+    @inline(__always)
+    static func ssim(_ m: Moments, c1: Double, c2: Double, epsilon: Double, degenerate: Double) -> Double {
+        let n = Double(m.count)
+        let muX = m.sumX / n
+        let muY = m.sumY / n
+        let varianceX = max(0, m.sumXX / n - muX * muX)
+        let varianceY = max(0, m.sumYY / n - muY * muY)
+        let covariance = m.sumXY / n - muX * muY
+
+        let numerator = (2.0 * muX * muY + c1) * (2.0 * covariance + c2)
+        let denominator = (muX * muX + muY * muY + c1) * (varianceX + varianceY + c2)
+        guard denominator > epsilon else { return degenerate }
+        return numerator / denominator
+    }
+
+    /// Глобальный SSIM по всей плоскости; nil для пустых или разных по длине данных
+    static func globalSSIM(
+        _ x: [Double],
+        _ y: [Double],
+        c1: Double,
+        c2: Double,
+        epsilon: Double,
+        degenerate: Double
+    ) -> Double? {
+        guard !x.isEmpty, x.count == y.count else { return nil }
+        return ssim(moments(x, y), c1: c1, c2: c2, epsilon: epsilon, degenerate: degenerate)
+    }
+
+    static func meanSquaredError(_ x: [Double], _ y: [Double]) -> Double? {
+        guard !x.isEmpty, x.count == y.count else { return nil }
+        let count = x.count
+        return x.withUnsafeBufferPointer { xPtr in
+            y.withUnsafeBufferPointer { yPtr in
+                let rawX = UnsafeRawPointer(xPtr.baseAddress!)
+                let rawY = UnsafeRawPointer(yPtr.baseAddress!)
+                var lanes = SIMD4<Double>()
+                var i = 0
+                while i + 4 <= count {
+                    let diff = rawX.loadUnaligned(fromByteOffset: i * 8, as: SIMD4<Double>.self)
+                        - rawY.loadUnaligned(fromByteOffset: i * 8, as: SIMD4<Double>.self)
+                    lanes += diff * diff
+                    i += 4
+                }
+                var sum = lanes.sum()
+                while i < count {
+                    let diff = xPtr[i] - yPtr[i]
+                    sum += diff * diff
+                    i += 1
+                }
+                return sum / Double(count)
+            }
+        }
+    }
+
+    /// 10·log10(peak² / mse); вырожденные случаи (mse = 0) обрабатывает вызывающий код
+    @inline(__always)
+    static func psnr(mse: Double, peak: Double) -> Double {
+        10.0 * log10(peak * peak / mse)
+    }
+
+    // MARK: - Оконный SSIM
+
+    /// Средний SSIM по окнам, целиком лежащим внутри плоскости (как и прежде, края не учитываются).
+    /// Пиксели с знаменателем не больше `epsilon` пропускаются. nil, если окно не помещается.
+    /// Гауссово окно фильтруется раздельно (строки, затем столбцы), прямоугольное — через
+    /// интегральные изображения пяти моментов. Строки результата считаются параллельно,
+    /// частичные суммы складываются в порядке строк.
+    static func windowedSSIM(
+        _ x: [Double],
+        _ y: [Double],
+        width: Int,
+        height: Int,
+        window: Window,
+        c1: Double,
+        c2: Double,
+        epsilon: Double
+    ) -> Double? {
+        let size = window.size
+        guard size > 0, width > size, height > size,
+              x.count == width * height, y.count == x.count else {
+            return nil
+        }
+        let pad = size / 2
+        let outputWidth = width - 2 * pad
+        let outputHeight = height - 2 * pad
+
+        var rowSums = [Double](repeating: 0, count: outputHeight)
+        var rowCounts = [Int](repeating: 0, count: outputHeight)
+
+        rowSums.withUnsafeMutableBufferPointer { sums in
+            rowCounts.withUnsafeMutableBufferPointer { counts in
+                x.withUnsafeBufferPointer { xPtr in
+                    y.withUnsafeBufferPointer { yPtr in
+                        let rows = RowAccumulator(
+                            sums: sums.baseAddress!,
+                            counts: counts.baseAddress!,
+                            width: outputWidth,
+                            c1: c1,
+                            c2: c2,
+                            epsilon: epsilon
+                        )
+                        switch window {
+                        case .gaussian(let size, let sigma):
+                            separableGaussian(
+                                xPtr.baseAddress!,
+                                yPtr.baseAddress!,
+                                width: width,
+                                outputHeight: outputHeight,
+                                taps: gaussianTaps(size: size, sigma: sigma),
+                                rows: rows
+                            )
+                        case .box(let size):
+                            boxFilter(
+                                xPtr.baseAddress!,
+                                yPtr.baseAddress!,
+                                width: width,
+                                height: height,
+                                size: size,
+                                outputHeight: outputHeight,
+                                rows: rows
+                            )
+                        }
+                    }
+                }
+            }
+        }
+
+        var total = 0.0
+        var count = 0
+        for row in 0..<outputHeight {
+            total += rowSums[row]
+            count += rowCounts[row]
+        }
+        return count > 0 ? total / Double(count) : 0.0
+    }
+
+    /// Нормированное одномерное гауссово ядро; его внешнее произведение равно прежнему 2D-ядру
+    static func gaussianTaps(size: Int, sigma: Double) -> [Double] {
+        let center = size / 2
+        var taps = (0..<size).map { index -> Double in
+            let d = Double(index - center)
+            return exp(-(d * d) / (2.0 * sigma * sigma))
+        }
+        let sum = taps.reduce(0, +)
+        for i in taps.indices {
+            taps[i] /= sum
+        }
+        return taps
+    }
+
+    /// Складывает SSIM строки по отфильтрованным моментам окна
+    private struct RowAccumulator {
+        let sums: UnsafeMutablePointer<Double>
+        let counts: UnsafeMutablePointer<Int>
+        let width: Int
+        let c1: Double
+        let c2: Double
+        let epsilon: Double
+
+        /// `mean*` — средние по окну для каждого пикселя строки результата `row`
+        @inline(__always)
+        func accumulate(
+            row: Int,
+            meanX: UnsafePointer<Double>,
+            meanY: UnsafePointer<Double>,
+            meanXX: UnsafePointer<Double>,
+            meanYY: UnsafePointer<Double>,
+            meanXY: UnsafePointer<Double>
+        ) {
+            var sum = 0.0
+            var count = 0
+            for i in 0..<width {
+                let m1 = meanX[i]
+                let m2 = meanY[i]
+                let s1 = max(0, meanXX[i] - m1 * m1)
+                let s2 = max(0, meanYY[i] - m2 * m2)
+                let s12 = meanXY[i] - m1 * m2
+
+                let numerator = (2.0 * m1 * m2 + c1) * (2.0 * s12 + c2)
+                let denominator = (m1 * m1 + m2 * m2 + c1) * (s1 + s2 + c2)
+                if denominator > epsilon {
+                    sum += numerator / denominator
+                    count += 1
+                }
+            }
+            sums[row] = sum
+            counts[row] = count
+        }
+    }
+
+    private static func separableGaussian(
+        _ x: UnsafePointer<Double>,
+        _ y: UnsafePointer<Double>,
+        width: Int,
+        outputHeight: Int,
+        taps: [Double],
+        rows: RowAccumulator
+    ) {
+        let size = taps.count
+        let outputWidth = rows.width
+        let minRows = max(1, 16_384 / max(1, width))
+
+        taps.withUnsafeBufferPointer { tapPtr in
+            let kernel = tapPtr.baseAddress!
+            ParallelCompute.forEachChunk(count: outputHeight, minChunk: minRows) { _, range in
+                // Горизонтальный проход для строк входа range.lowerBound ..< range.upperBound + size - 1
+                let inputRows = range.count + size - 1
+                let planeSize = inputRows * outputWidth
+                let horizontal = UnsafeMutablePointer<Double>.allocate(capacity: 5 * planeSize)
+                let products = UnsafeMutablePointer<Double>.allocate(capacity: 3 * width)
+                let vertical = UnsafeMutablePointer<Double>.allocate(capacity: 5 * outputWidth)
+                defer {
+                    horizontal.deallocate()
+                    products.deallocate()
+                    vertical.deallocate()
+                }
+                let xx = products
+                let yy = products + width
+                let xy = products + 2 * width
+
+                for local in 0..<inputRows {
+                    let row = range.lowerBound + local
+                    let rowX = x + row * width
+                    let rowY = y + row * width
+                    vDSP_vsqD(rowX, 1, xx, 1, vDSP_Length(width))
+                    vDSP_vsqD(rowY, 1, yy, 1, vDSP_Length(width))
+                    vDSP_vmulD(rowX, 1, rowY, 1, xy, 1, vDSP_Length(width))
+                    func filter(_ signal: UnsafePointer<Double>, plane: Int) {
+                        vDSP_convD(
+                            signal, 1,
+                            kernel, 1,
+                            horizontal + plane * planeSize + local * outputWidth, 1,
+                            vDSP_Length(outputWidth),
+                            vDSP_Length(size)
+                        )
+                    }
+                    filter(rowX, plane: 0)
+                    filter(rowY, plane: 1)
+                    filter(xx, plane: 2)
+                    filter(yy, plane: 3)
+                    filter(xy, plane: 4)
+                }
+
+                for row in range {
+                    let local = row - range.lowerBound
+                    for plane in 0..<5 {
+                        let out = vertical + plane * outputWidth
+                        vDSP_vclrD(out, 1, vDSP_Length(outputWidth))
+                        for k in 0..<size {
+                            var weight = kernel[k]
+                            vDSP_vsmaD(
+                                horizontal + plane * planeSize + (local + k) * outputWidth, 1,
+                                &weight,
+                                out, 1,
+                                out, 1,
+                                vDSP_Length(outputWidth)
+                            )
+                        }
+                    }
+                    rows.accumulate(
+                        row: row,
+                        meanX: vertical,
+                        meanY: vertical + outputWidth,
+                        meanXX: vertical + 2 * outputWidth,
+                        meanYY: vertical + 3 * outputWidth,
+                        meanXY: vertical + 4 * outputWidth
+                    )
+                }
+            }
+        }
+    }
+
+    private static func boxFilter(
+        _ x: UnsafePointer<Double>,
+        _ y: UnsafePointer<Double>,
+        width: Int,
+        height: Int,
+        size: Int,
+        outputHeight: Int,
+        rows: RowAccumulator
+    ) {
+        // Интегральные изображения всех пяти моментов за один проход
+        let stride = width + 1
+        let planeSize = stride * (height + 1)
+        let tables = UnsafeMutablePointer<Double>.allocate(capacity: 5 * planeSize)
+        defer { tables.deallocate() }
+        tables.initialize(repeating: 0, count: 5 * planeSize)
+        for row in 0..<height {
+            var running = SIMD8<Double>()
+            let above = row * stride
+            let current = (row + 1) * stride
+            for column in 0..<width {
+                let a = x[row * width + column]
+                let b = y[row * width + column]
+                running += SIMD8(a, b, a * a, b * b, a * b, 0, 0, 0)
+                for plane in 0..<5 {
+                    let base = tables + plane * planeSize
+                    base[current + column + 1] = base[above + column + 1] + running[plane]
+                }
+            }
+        }
+
+        let outputWidth = rows.width
+        let area = Double(size * size)
+        ParallelCompute.forEachChunk(count: outputHeight, minChunk: max(1, 16_384 / max(1, width))) { _, range in
+            let means = UnsafeMutablePointer<Double>.allocate(capacity: 5 * outputWidth)
+            defer { means.deallocate() }
+            for row in range {
+                let top = row * stride
+                let bottom = (row + size) * stride
+                for plane in 0..<5 {
+                    let table = tables + plane * planeSize
+                    let out = means + plane * outputWidth
+                    for column in 0..<outputWidth {
+                        let left = column
+                        let right = column + size
+                        out[column] = (table[bottom + right] - table[top + right] - table[bottom + left] + table[top + left]) / area
+                    }
+                }
+                rows.accumulate(
+                    row: row,
+                    meanX: means,
+                    meanY: means + outputWidth,
+                    meanXX: means + 2 * outputWidth,
+                    meanYY: means + 3 * outputWidth,
+                    meanXY: means + 4 * outputWidth
+                )
+            }
+        }
+    }
+}
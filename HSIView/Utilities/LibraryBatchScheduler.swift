@@ -0,0 +1,171 @@
+import Foundation
+
+/// Оценка памяти, нужной для обработки куба, по размерам и типу данных без загрузки
+enum CubeFootprintEstimator {
+    /// Байты исходных данных и рабочей Float64-копии, которую создают операции пайплайна
+    static func estimatedBytes(for url: URL) -> Int {
+        let elements: Int
+        let bytesPerElement: Int
+        if let layout = rawLayout(for: url) {
+            elements = layout.elements
+            bytesPerElement = layout.bytesPerElement
+        } else {
+            // Для MAT/TIFF считаем файл несжатым 16-битным кубом
+            let fileSize = (try? url.resourceValues(forKeys: [.fileSizeKey]).fileSize) ?? 0
+            bytesPerElement = 2
+            elements = max(1, fileSize / bytesPerElement)
+        }
+        return elements * bytesPerElement + elements * MemoryLayout<Double>.size
+    }
+
+    private static func rawLayout(for url: URL) -> (elements: Int, bytesPerElement: Int)? {
+        let ext = url.pathExtension.lowercased()
+        if ext == "npy" {
+            guard let layout = NpyImageLoader.peekLayout(of: url) else { return nil }
+            return (layout.shape.reduce(1, *), layout.bytesPerElement)
+        }
+        if EnviImageLoader.supportedExtensions.contains(ext) {
+            let hdrURL = ext == "hdr" ? url : url.deletingPathExtension().appendingPathExtension("hdr")
+            guard let header = try? EnviHeaderParser.parse(from: hdrURL) else { return nil }
+            return (header.height * header.width * header.channels, header.bytesPerPixel)
+        }
+        return nil
+    }
+}
+
+struct LibraryBatchProgress {
+    let completed: Int
+    let failed: Int
+    let total: Int
+    let elapsed: TimeInterval
+    /// Оценочный объём уже обработанных кубов
+    let processedBytes: Int
+    /// Кубы, которые сейчас загружаются или обрабатываются
+    let activeNames: [String]
+
+    var cubesPerMinute: Double {
+        elapsed > 0 ? Double(completed) / elapsed * 60 : 0
+    }
+
+    var gigabytesPerSecond: Double {
+        elapsed > 0 ? Double(processedBytes) / elapsed / 1_000_000_000 : 0
+    }
+}
+
+/// Параллельная обработка кубов библиотеки одним и тем же пайплайном.
+/// Число одновременно обрабатываемых кубов ограничено бюджетом памяти (по оценке
+/// `CubeFootprintEstimator`) и числом ядер. Загрузка следующего куба идёт, пока
+/// предыдущие ещё обрабатываются; куб больше бюджета выполняется в одиночку.
+final class LibraryBatchScheduler {
+    struct Item {
+        let entry: CubeLibraryEntry
+        let estimatedBytes: Int
+    }
+
+    let memoryBudget: Int
+    let maxConcurrent: Int
+
+    private let condition = NSCondition()
+    private var bytesInUse = 0
+    private var itemsInFlight = 0
+
+    init(
+        memoryBudget: Int = Int(clamping: ProcessInfo.processInfo.physicalMemory / 2),
+        maxConcurrent: Int = ParallelCompute.workerCount
+    ) {
+        self.memoryBudget = max(1, memoryBudget)
+        self.maxConcurrent = max(1, maxConcurrent)
+    }
+
+    static func items(for entries: [CubeLibraryEntry]) -> [Item] {
+        entries.map { Item(entry: $0, estimatedBytes: CubeFootprintEstimator.estimatedBytes(for: $0.url)) }
+    }
+
+    /// Выполняет `load`, затем `process` для каждого элемента; вызывающий поток блокируется
+    /// до завершения всех элементов. `progress` вызывается после каждого куба с любого потока.
+    func run<Loaded>(
+        _ items: [Item],
+        load: @escaping (Item) -> Loaded?,
+        process: @escaping (Item, Loaded) -> Bool,
+        progress: @escaping (LibraryBatchProgress) -> Void
+    ) {
+        guard !items.isEmpty else { return }
+        let startTime = Date()
+        let group = DispatchGroup()
+        let workers = DispatchQueue(label: "com.hsiview.library-batch", qos: .userInitiated, attributes: .concurrent)
+        let statsLock = NSLock()
+        var completed = 0
+        var failed = 0
+        var processedBytes = 0
+        var active: [String: Int] = [:]
+
+        func report() {
+            let snapshot = LibraryBatchProgress(
+                completed: completed,
+                failed: failed,
+                total: items.count,
+                elapsed: Date().timeIntervalSince(startTime),
+                processedBytes: processedBytes,
+                activeNames: active.keys.sorted()
+            )
+            progress(snapshot)
+        }
+
+        for item in items {
+            let reserved = acquire(item.estimatedBytes)
+            statsLock.lock()
+            active[item.entry.displayName, default: 0] += 1
+            statsLock.unlock()
+
+            group.enter()
+            workers.async {
+                var success = false
+                autoreleasepool {
+                    if let loaded = load(item) {
+                        success = process(item, loaded)
+                    }
+                }
+                self.release(reserved)
+
+                statsLock.lock()
+                completed += 1
+                if success {
+                    processedBytes += item.estimatedBytes
+                } else {
+                    failed += 1
+                }
+                let name = item.entry.displayName
+                if let count = active[name], count > 1 {
+                    active[name] = count - 1
+                } else {
+                    active.removeValue(forKey: name)
+                }
+                report()
+                statsLock.unlock()
+                group.leave()
+            }
+        }
+        group.wait()
+    }
+
+    /// Резервирует память под элемент; ждёт, пока завершатся другие, если бюджет исчерпан
+    private func acquire(_ bytes: Int) -> Int {
+        let reserved = min(bytes, memoryBudget)
+        condition.lock()
+        while itemsInFlight > 0 && (bytesInUse + reserved > memoryBudget || itemsInFlight >= maxConcurrent) {
+            condition.wait()
+        }
+        bytesInUse += reserved
+        itemsInFlight += 1
+        condition.unlock()
+        return reserved
+    }
+
+    private func release(_ reserved: Int) {
+        condition.lock()
+        bytesInUse -= reserved
+        itemsInFlight -= 1
+        condition.broadcast()
+        condition.unlock()
+    }
+}
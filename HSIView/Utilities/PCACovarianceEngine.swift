@@ -0,0 +1,434 @@
+import Foundation
+import Accelerate
+
+/// Статистики выборки спектров после предобработки PCA
+struct PCASampleStatistics {
+    let mean: [Double]
+    let std: [Double]
+    let clipUpper: [Double]
+    let sampleCount: Int
+}
+
+struct PCACovarianceResult {
+    let statistics: PCASampleStatistics
+    /// Симметричная матрица C×C (row-major)
+    let covariance: [Double]
+    let usedSamples: Int
+}
+
+/// Равномерная подвыборка пикселей источника: отсчёт `k` соответствует пикселю `k * stride`.
+struct PCASampleGrid {
+    let pixelCount: Int
+    let stride: Int
+
+    var count: Int {
+        guard pixelCount > 0 else { return 0 }
+        return (pixelCount + stride - 1) / stride
+    }
+
+    @inline(__always)
+    func pixel(sample: Int) -> Int {
+        sample * stride
+    }
+}
+
+/// Блочный многопоточный расчёт ковариации для PCA.
+/// Спектры подвыборки собираются в непрерывные блоки (пиксели × каналы); среднее, дисперсия
+/// и выборка для порога отсечения считаются в том же проходе. Ковариация обновляется через
+/// SYRK в поточные частичные матрицы, которые затем суммируются.
+enum PCACovarianceEngine {
+    static let blockRows = 256
+
+    static func compute(
+        source: CubeSpectrumSource,
+        grid: PCASampleGrid,
+        preprocess: PCAPreprocess,
+        clipTopPercent: Double,
+        clipCapacity: Int,
+        progress: ((String) -> Void)? = nil
+    ) -> PCACovarianceResult {
+        progress?("Оценка среднего и дисперсии…")
+        let statistics = sampleStatistics(
+            source: source,
+            grid: grid,
+            preprocess: preprocess,
+            clipTopPercent: clipTopPercent,
+            clipCapacity: clipCapacity
+        )
+
+        progress?("Расчёт ковариации…")
+        let covariance = covarianceMatrix(
+            source: source,
+            grid: grid,
+            preprocess: preprocess,
+            statistics: statistics
+        )
+
+        return PCACovarianceResult(
+            statistics: statistics,
+            covariance: covariance,
+            usedSamples: grid.count
+        )
+    }
+
+    /// Полный (без подвыборки) проход по всем пикселям источника с ограниченной памятью.
+    /// Порог отсечения и опорный сдвиг берутся из быстрой пилотной подвыборки, после чего
+    /// куб читается один раз: каждый поток накапливает суммы и матрицу Грама своих пикселей
+    /// относительно сдвига, а частичные результаты затем сворачиваются.
+    static func computeStreaming(
+        source: CubeSpectrumSource,
+        preprocess: PCAPreprocess,
+        clipTopPercent: Double,
+        pilotSamples: Int,
+        clipCapacity: Int,
+        progress: ((String) -> Void)? = nil
+    ) -> PCACovarianceResult {
+        progress?("Оценка среднего и дисперсии…")
+        var accumulator = makeStreamingAccumulator(
+            source: source,
+            preprocess: preprocess,
+            clipTopPercent: clipTopPercent,
+            pilotSamples: pilotSamples,
+            clipCapacity: clipCapacity
+        )
+
+        progress?("Расчёт ковариации…")
+        accumulator.add(
+            source: source,
+            rect: SpectrumROIRect(minX: 0, minY: 0, width: source.width, height: source.height)
+        )
+        return accumulator.result()
+    }
+
+    /// Пустой аккумулятор моментов со сдвигом и порогом отсечения из пилотной подвыборки источника
+    static func makeStreamingAccumulator(
+        source: CubeSpectrumSource,
+        preprocess: PCAPreprocess,
+        clipTopPercent: Double,
+        pilotSamples: Int,
+        clipCapacity: Int
+    ) -> PCAMomentAccumulator {
+        let pilot = pilotStatistics(
+            source: source,
+            preprocess: preprocess,
+            clipTopPercent: clipTopPercent,
+            pilotSamples: pilotSamples,
+            clipCapacity: clipCapacity
+        )
+        return PCAMomentAccumulator(
+            channels: source.channels,
+            preprocess: preprocess,
+            shift: pilot.mean,
+            clipUpper: pilot.clipUpper
+        )
+    }
+
+    /// Среднее, std и порог отсечения по равномерной подвыборке (не больше `pilotSamples` пикселей)
+    static func pilotStatistics(
+        source: CubeSpectrumSource,
+        preprocess: PCAPreprocess,
+        clipTopPercent: Double,
+        pilotSamples: Int,
+        clipCapacity: Int
+    ) -> PCASampleStatistics {
+        let pixelCount = source.pixelCount
+        return sampleStatistics(
+            source: source,
+            grid: PCASampleGrid(pixelCount: pixelCount, stride: max(1, pixelCount / max(1, pilotSamples))),
+            preprocess: preprocess,
+            clipTopPercent: clipTopPercent,
+            clipCapacity: clipCapacity
+        )
+    }
+
+    // MARK: - Gather
+
+    /// Собирает спектры отсчётов `samples` в блок `rows × channels` и применяет предобработку.
+    /// `pixel` переводит номер отсчёта в линейный индекс пикселя источника. Подряд идущие
+    /// пиксели одной строки читаются одним отрезком (`readSpectra`).
+    static func gatherBlock(
+        source: CubeSpectrumSource,
+        samples: Range<Int>,
+        pixel: (Int) -> Int,
+        preprocess: PCAPreprocess,
+        into block: UnsafeMutablePointer<Double>
+    ) {
+        let channels = source.channels
+        let width = source.width
+        var row = block
+        var k = samples.lowerBound
+        while k < samples.upperBound {
+            let first = pixel(k)
+            let rowEnd = (first / width + 1) * width
+            var run = 1
+            while k + run < samples.upperBound, first + run < rowEnd, pixel(k + run) == first + run {
+                run += 1
+            }
+            source.readSpectra(pixel: first, count: run, into: row)
+            row += run * channels
+            k += run
+        }
+        applyPreprocess(block, count: samples.count * channels, mode: preprocess)
+    }
+
+    /// Поэлементная предобработка PCA: для `.log` — log(max(0, x) + 1), остальные режимы не меняют значения
+    static func applyPreprocess(_ values: UnsafeMutablePointer<Double>, count: Int, mode: PCAPreprocess) {
+        guard mode == .log, count > 0 else { return }
+        var zero = 0.0
+        vDSP_vthrD(values, 1, &zero, values, 1, vDSP_Length(count))
+        var n = Int32(count)
+        vvlog1p(values, values, &n)
+    }
+
+    /// Ограничение сверху, центрирование и (для `.standardize`) нормировка строки спектра
+    @inline(__always)
+    static func centerRow(
+        _ row: UnsafeMutablePointer<Double>,
+        channels: Int,
+        clipUpper: UnsafePointer<Double>,
+        mean: UnsafePointer<Double>,
+        std: UnsafePointer<Double>,
+        standardize: Bool
+    ) {
+        let n = vDSP_Length(channels)
+        vDSP_vminD(row, 1, clipUpper, 1, row, 1, n)
+        vDSP_vsubD(mean, 1, row, 1, row, 1, n)
+        if standardize {
+            vDSP_vdivD(std, 1, row, 1, row, 1, n)
+        }
+    }
+
+    // MARK: - Pass 1: mean / std / clip samples
+
+    private static func sampleStatistics(
+        source: CubeSpectrumSource,
+        grid: PCASampleGrid,
+        preprocess: PCAPreprocess,
+        clipTopPercent: Double,
+        clipCapacity: Int
+    ) -> PCASampleStatistics {
+        let channels = source.channels
+        let sampleCount = grid.count
+        let clipRows = clipTopPercent > 0 ? min(sampleCount, clipCapacity) : 0
+        let chunkCount = ParallelCompute.chunkCount(count: sampleCount, minChunk: blockRows)
+
+        let partialCount = UnsafeMutablePointer<Int>.allocate(capacity: chunkCount)
+        let partialMean = UnsafeMutablePointer<Double>.allocate(capacity: chunkCount * channels)
+        let partialM2 = UnsafeMutablePointer<Double>.allocate(capacity: chunkCount * channels)
+        let clipValues = UnsafeMutablePointer<Double>.allocate(capacity: max(1, clipRows * channels))
+        defer {
+            partialCount.deallocate()
+            partialMean.deallocate()
+            partialM2.deallocate()
+            clipValues.deallocate()
+        }
+        partialCount.initialize(repeating: 0, count: chunkCount)
+        partialMean.initialize(repeating: 0, count: chunkCount * channels)
+        partialM2.initialize(repeating: 0, count: chunkCount * channels)
+
+        ParallelCompute.forEachChunk(count: sampleCount, minChunk: blockRows) { chunkIndex, range in
+            let block = UnsafeMutablePointer<Double>.allocate(capacity: blockRows * channels)
+            let blockMean = UnsafeMutablePointer<Double>.allocate(capacity: channels)
+            let blockM2 = UnsafeMutablePointer<Double>.allocate(capacity: channels)
+            let diff = UnsafeMutablePointer<Double>.allocate(capacity: channels)
+            defer {
+                block.deallocate()
+                blockMean.deallocate()
+                blockM2.deallocate()
+                diff.deallocate()
+            }
+
+            let runMean = partialMean + chunkIndex * channels
+            let runM2 = partialM2 + chunkIndex * channels
+            var runCount = 0
+            let n = vDSP_Length(channels)
+
+            var start = range.lowerBound
+            while start < range.upperBound {
+                let end = min(start + blockRows, range.upperBound)
+                let rows = end - start
+                gatherBlock(source: source, samples: start..<end, pixel: grid.pixel, preprocess: preprocess, into: block)
+
+                if start < clipRows {
+                    for r in 0..<min(rows, clipRows - start) {
+                        let row = block + r * channels
+                        let k = start + r
+                        for c in 0..<channels {
+                            clipValues[c * clipRows + k] = row[c]
+                        }
+                    }
+                }
+
+                // Двухпроходные момент-оценки внутри блока
+                blockMean.initialize(repeating: 0, count: channels)
+                blockM2.initialize(repeating: 0, count: channels)
+                for r in 0..<rows {
+                    vDSP_vaddD(blockMean, 1, block + r * channels, 1, blockMean, 1, n)
+                }
+                var invRows = 1.0 / Double(rows)
+                vDSP_vsmulD(blockMean, 1, &invRows, blockMean, 1, n)
+                for r in 0..<rows {
+                    vDSP_vsubD(blockMean, 1, block + r * channels, 1, diff, 1, n)
+                    vDSP_vmaD(diff, 1, diff, 1, blockM2, 1, blockM2, 1, n)
+                }
+
+                mergeMoments(
+                    count: &runCount,
+                    mean: runMean,
+                    m2: runM2,
+                    otherCount: rows,
+                    otherMean: blockMean,
+                    otherM2: blockM2,
+                    channels: channels
+                )
+                start = end
+            }
+            partialCount[chunkIndex] = runCount
+        }
+
+        var totalCount = 0
+        var mean = [Double](repeating: 0, count: channels)
+        var m2 = [Double](repeating: 0, count: channels)
+        mean.withUnsafeMutableBufferPointer { meanPtr in
+            m2.withUnsafeMutableBufferPointer { m2Ptr in
+                for chunk in 0..<chunkCount {
+                    mergeMoments(
+                        count: &totalCount,
+                        mean: meanPtr.baseAddress!,
+                        m2: m2Ptr.baseAddress!,
+                        otherCount: partialCount[chunk],
+                        otherMean: partialMean + chunk * channels,
+                        otherM2: partialM2 + chunk * channels,
+                        channels: channels
+                    )
+                }
+            }
+        }
+
+        var std = [Double](repeating: 1.0, count: channels)
+        for c in 0..<channels {
+            let variance = totalCount > 1 ? m2[c] / Double(totalCount - 1) : 0
+            std[c] = variance > 1e-12 ? sqrt(variance) : 1.0
+        }
+
+        var clipUpper = [Double](repeating: Double.greatestFiniteMagnitude, count: channels)
+        if clipRows > 0 {
+            let rank = Int(Double(clipRows - 1) * (100.0 - clipTopPercent) / 100.0)
+            let clampedRank = max(0, min(clipRows - 1, rank))
+            clipUpper.withUnsafeMutableBufferPointer { upperPtr in
+                let upper = upperPtr.baseAddress!
+                ParallelCompute.forEachChunk(count: channels) { _, channelRange in
+                    for c in channelRange {
+                        var values = UnsafeMutableBufferPointer(start: clipValues + c * clipRows, count: clipRows)
+                        values.sort()
+                        upper[c] = values[clampedRank]
+                    }
+                }
+            }
+        }
+
+        return PCASampleStatistics(mean: mean, std: std, clipUpper: clipUpper, sampleCount: totalCount)
+    }
+
+    /// Объединение (count, mean, M2) по формуле Чана
+    private static func mergeMoments(
+        count: inout Int,
+        mean: UnsafeMutablePointer<Double>,
+        m2: UnsafeMutablePointer<Double>,
+        otherCount: Int,
+        otherMean: UnsafePointer<Double>,
+        otherM2: UnsafePointer<Double>,
+        channels: Int
+    ) {
+        guard otherCount > 0 else { return }
+        if count == 0 {
+            mean.update(from: otherMean, count: channels)
+            m2.update(from: otherM2, count: channels)
+            count = otherCount
+            return
+        }
+        let nA = Double(count)
+        let nB = Double(otherCount)
+        let n = nA + nB
+        for c in 0..<channels {
+            let delta = otherMean[c] - mean[c]
+            mean[c] += delta * nB / n
+            m2[c] += otherM2[c] + delta * delta * nA * nB / n
+        }
+        count += otherCount
+    }
+
+    // MARK: - Pass 2: blocked SYRK covariance
+
+    private static func covarianceMatrix(
+        source: CubeSpectrumSource,
+        grid: PCASampleGrid,
+        preprocess: PCAPreprocess,
+        statistics: PCASampleStatistics
+    ) -> [Double] {
+        let channels = source.channels
+        let sampleCount = grid.count
+        let matrixSize = channels * channels
+        let chunkCount = ParallelCompute.chunkCount(count: sampleCount, minChunk: blockRows)
+        let standardize = preprocess == .standardize
+
+        let partials = UnsafeMutablePointer<Double>.allocate(capacity: chunkCount * matrixSize)
+        defer { partials.deallocate() }
+        partials.initialize(repeating: 0, count: chunkCount * matrixSize)
+
+        statistics.mean.withUnsafeBufferPointer { meanPtr in
+            statistics.std.withUnsafeBufferPointer { stdPtr in
+                statistics.clipUpper.withUnsafeBufferPointer { clipPtr in
+                    ParallelCompute.forEachChunk(count: sampleCount, minChunk: blockRows) { chunkIndex, range in
+                        let block = UnsafeMutablePointer<Double>.allocate(capacity: blockRows * channels)
+                        defer { block.deallocate() }
+                        let partial = partials + chunkIndex * matrixSize
+
+                        var start = range.lowerBound
+                        while start < range.upperBound {
+                            let end = min(start + blockRows, range.upperBound)
+                            let rows = end - start
+                            gatherBlock(source: source, samples: start..<end, pixel: grid.pixel, preprocess: preprocess, into: block)
+                            for r in 0..<rows {
+                                centerRow(
+                                    block + r * channels,
+                                    channels: channels,
+                                    clipUpper: clipPtr.baseAddress!,
+                                    mean: meanPtr.baseAddress!,
+                                    std: stdPtr.baseAddress!,
+                                    standardize: standardize
+                                )
+                            }
+                            // partial += blockᵀ · block (верхний треугольник)
+                            cblas_dsyrk(
+                                CblasRowMajor, CblasUpper, CblasTrans,
+                                Int32(channels), Int32(rows),
+                                1.0, block, Int32(channels),
+                                1.0, partial, Int32(channels)
+                            )
+                            start = end
+                        }
+                    }
+                }
+            }
+        }
+
+        var cov = [Double](repeating: 0, count: matrixSize)
+        cov.withUnsafeMutableBufferPointer { covPtr in
+            let dst = covPtr.baseAddress!
+            for chunk in 0..<chunkCount {
+                vDSP_vaddD(dst, 1, partials + chunk * matrixSize, 1, dst, 1, vDSP_Length(matrixSize))
+            }
+        }
+
+        let scale = sampleCount > 1 ? 1.0 / Double(sampleCount - 1) : 1.0
+        for i in 0..<channels {
+            for j in i..<channels {
+                let value = cov[i * channels + j] * scale
+                cov[i * channels + j] = value
+                cov[j * channels + i] = value
+            }
+        }
+        return cov
+    }
+}
@@ -0,0 +1,179 @@
+import Foundation
+import Accelerate
+
+/// Сдвинутые моменты спектров для PCA: n, Σu, Σu², Σz и Σzzᵀ, где u = x − s, z = min(x, clip) − s.
+/// Сдвиг `s` и порог `clip` фиксируются при создании, поэтому прямоугольные области можно
+/// как добавлять, так и вычитать — ковариация ROI пересчитывается по изменившимся полосам.
+struct PCAMomentAccumulator {
+    let channels: Int
+    let preprocess: PCAPreprocess
+    let shift: [Double]
+    let clipUpper: [Double]
+
+    private(set) var count = 0
+    private var sumU: [Double]
+    private var sumU2: [Double]
+    private var sumZ: [Double]
+    /// Верхний треугольник Σzzᵀ (row-major C×C)
+    private var gram: [Double]
+
+    init(channels: Int, preprocess: PCAPreprocess, shift: [Double], clipUpper: [Double]) {
+        self.channels = channels
+        self.preprocess = preprocess
+        self.shift = shift
+        self.clipUpper = clipUpper
+        self.sumU = [Double](repeating: 0, count: channels)
+        self.sumU2 = [Double](repeating: 0, count: channels)
+        self.sumZ = [Double](repeating: 0, count: channels)
+        self.gram = [Double](repeating: 0, count: channels * channels)
+    }
+
+    /// Добавляет пиксели прямоугольника `rect` (в координатах источника)
+    mutating func add(source: CubeSpectrumSource, rect: SpectrumROIRect) {
+        accumulate(source: source, rect: rect, sign: 1.0)
+    }
+
+    /// Вычитает ранее добавленные пиксели прямоугольника `rect`
+    mutating func subtract(source: CubeSpectrumSource, rect: SpectrumROIRect) {
+        accumulate(source: source, rect: rect, sign: -1.0)
+    }
+
+    private mutating func accumulate(source: CubeSpectrumSource, rect: SpectrumROIRect, sign: Double) {
+        let area = rect.area
+        guard area > 0, source.channels == channels else { return }
+
+        let blockRows = PCACovarianceEngine.blockRows
+        let channels = self.channels
+        let matrixSize = channels * channels
+        let preprocess = self.preprocess
+        let sourceWidth = source.width
+        let chunkCount = ParallelCompute.chunkCount(count: area, minChunk: blockRows)
+
+        let partialSumU = UnsafeMutablePointer<Double>.allocate(capacity: chunkCount * channels)
+        let partialSumU2 = UnsafeMutablePointer<Double>.allocate(capacity: chunkCount * channels)
+        let partialSumZ = UnsafeMutablePointer<Double>.allocate(capacity: chunkCount * channels)
+        let partialGram = UnsafeMutablePointer<Double>.allocate(capacity: chunkCount * matrixSize)
+        defer {
+            partialSumU.deallocate()
+            partialSumU2.deallocate()
+            partialSumZ.deallocate()
+            partialGram.deallocate()
+        }
+        partialSumU.initialize(repeating: 0, count: chunkCount * channels)
+        partialSumU2.initialize(repeating: 0, count: chunkCount * channels)
+        partialSumZ.initialize(repeating: 0, count: chunkCount * channels)
+        partialGram.initialize(repeating: 0, count: chunkCount * matrixSize)
+
+        let pixelAt: (Int) -> Int = { index in
+            let row = index / rect.width
+            let col = index - row * rect.width
+            return (rect.minY + row) * sourceWidth + rect.minX + col
+        }
+
+        shift.withUnsafeBufferPointer { shiftPtr in
+            clipUpper.withUnsafeBufferPointer { clipPtr in
+                let shift = shiftPtr.baseAddress!
+                let clip = clipPtr.baseAddress!
+                ParallelCompute.forEachChunk(count: area, minChunk: blockRows) { chunkIndex, range in
+                    let block = UnsafeMutablePointer<Double>.allocate(capacity: blockRows * channels)
+                    let unclipped = UnsafeMutablePointer<Double>.allocate(capacity: channels)
+                    defer {
+                        block.deallocate()
+                        unclipped.deallocate()
+                    }
+                    let sumU = partialSumU + chunkIndex * channels
+                    let sumU2 = partialSumU2 + chunkIndex * channels
+                    let sumZ = partialSumZ + chunkIndex * channels
+                    let gram = partialGram + chunkIndex * matrixSize
+                    let n = vDSP_Length(channels)
+
+                    var start = range.lowerBound
+                    while start < range.upperBound {
+                        let end = min(start + blockRows, range.upperBound)
+                        let rows = end - start
+                        PCACovarianceEngine.gatherBlock(
+                            source: source,
+                            samples: start..<end,
+                            pixel: pixelAt,
+                            preprocess: preprocess,
+                            into: block
+                        )
+                        for r in 0..<rows {
+                            let row = block + r * channels
+                            vDSP_vsubD(shift, 1, row, 1, unclipped, 1, n)
+                            vDSP_vaddD(sumU, 1, unclipped, 1, sumU, 1, n)
+                            vDSP_vmaD(unclipped, 1, unclipped, 1, sumU2, 1, sumU2, 1, n)
+                            vDSP_vminD(row, 1, clip, 1, row, 1, n)
+                            vDSP_vsubD(shift, 1, row, 1, row, 1, n)
+                            vDSP_vaddD(sumZ, 1, row, 1, sumZ, 1, n)
+                        }
+                        cblas_dsyrk(
+                            CblasRowMajor, CblasUpper, CblasTrans,
+                            Int32(channels), Int32(rows),
+                            1.0, block, Int32(channels),
+                            1.0, gram, Int32(channels)
+                        )
+                        start = end
+                    }
+                }
+            }
+        }
+
+        for chunk in 0..<chunkCount {
+            for c in 0..<channels {
+                sumU[c] += sign * partialSumU[chunk * channels + c]
+                sumU2[c] += sign * partialSumU2[chunk * channels + c]
+                sumZ[c] += sign * partialSumZ[chunk * channels + c]
+            }
+            var alpha = sign
+            gram.withUnsafeMutableBufferPointer { gramPtr in
+                let dst = gramPtr.baseAddress!
+                vDSP_vsmaD(partialGram + chunk * matrixSize, 1, &alpha, dst, 1, dst, 1, vDSP_Length(matrixSize))
+            }
+        }
+        count += sign > 0 ? area : -area
+    }
+
+    /// Среднее, std и ковариация (с нормировкой для `.standardize`) по накопленным пикселям
+    func result() -> PCACovarianceResult {
+        let n = Double(count)
+        var mean = [Double](repeating: 0, count: channels)
+        var std = [Double](repeating: 1.0, count: channels)
+        var delta = [Double](repeating: 0, count: channels)
+        if count > 0 {
+            for c in 0..<channels {
+                delta[c] = sumU[c] / n
+                mean[c] = shift[c] + delta[c]
+                let variance = count > 1 ? max(0, sumU2[c] - sumU[c] * delta[c]) / (n - 1) : 0
+                std[c] = variance > 1e-12 ? sqrt(variance) : 1.0
+            }
+        }
+
+        // Σ(z − d)(z − d)ᵀ = Σzzᵀ − (Σz)dᵀ − d(Σz)ᵀ + n·ddᵀ, где d = mean − s
+        var cov = [Double](repeating: 0, count: channels * channels)
+        let scale = count > 1 ? 1.0 / (n - 1) : 1.0
+        let standardize = preprocess == .standardize
+        for i in 0..<channels {
+            for j in i..<channels {
+                var value = gram[i * channels + j]
+                    - sumZ[i] * delta[j]
+                    - delta[i] * sumZ[j]
+                    + n * delta[i] * delta[j]
+                value *= scale
+                if standardize {
+                    value /= std[i] * std[j]
+                }
+                cov[i * channels + j] = value
+                cov[j * channels + i] = value
+            }
+        }
+
+        let statistics = PCASampleStatistics(
+            mean: mean,
+            std: std,
+            clipUpper: clipUpper,
+            sampleCount: count
+        )
+        return PCACovarianceResult(statistics: statistics, covariance: cov, usedSamples: count)
+    }
+}
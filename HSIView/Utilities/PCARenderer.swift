@@ -5,6 +5,7 @@ import AppKit
 struct PCAImageResult {
     let image: NSImage?
     let updatedConfig: PCAVisualizationConfig
+    var errorMessage: String? = nil
 }
 
 enum PCARenderError: Error {
@@ -47,7 +48,6 @@ final class PCARenderer {
             return PCAImageResult(image: nil, updatedConfig: config)
         }
         
-        let totalPixels = regionWidth * regionHeight
         if channels == 1 {
             // Одноканальный случай: просто нормализация в градации серого
             let slice = extractChannel(cube: cube, axes: axes, channelIndex: 0, region: region)
@@ -58,302 +58,435 @@ final class PCARenderer {
         }
         
         // Проверяем, можем ли использовать зафиксированный базис
+        let fitted: PCAFittedBasis
+        var updatedConfig = config
         if config.lockBasis,
-           let basis = config.basis,
-           basis.count >= 3,
-           basis.first?.count == channels,
-           let mean = config.mean,
-           mean.count == channels {
+           let locked = PCAFittedBasis(config: config),
+           !locked.basis.isEmpty,
+           locked.basis.first?.count == channels,
+           locked.mean.count == channels {
             progress?("Используем сохранённый базис…")
-            return projectWithExistingBasis(
+            fitted = locked
+        } else {
+            let incrementalROI = config.computeScope == .roi && roi != nil
+            let key = PCABasisKey(
+                cubeID: cube.id,
+                layout: layout,
+                region: region,
+                config: config,
+                fullCoverage: incrementalROI || config.fullCoverage
+            )
+            if let cached = PCAResultCache.shared.fittedBasis(for: key) {
+                progress?("Используем сохранённый базис…")
+                fitted = cached
+            } else {
+                // Статистики, порог отсечения, ковариация и базис — блочно и многопоточно
+                do {
+                    if incrementalROI {
+                        fitted = try fitROIBasisIncrementally(
+                            cube: cube,
+                            axes: axes,
+                            layout: layout,
+                            region: region,
+                            config: config,
+                            progress: progress
+                        )
+                    } else {
+                        let source = InMemoryCubeSpectrumSource(cube: cube, axes: axes, region: region)
+                        let fittedConfig = try fitBasis(source: source, config: config, progress: progress)
+                        guard let result = PCAFittedBasis(config: fittedConfig) else {
+                            throw PCARenderError.notEnoughChannels
+                        }
+                        fitted = result
+                    }
+                } catch {
+                    return PCAImageResult(
+                        image: nil,
+                        updatedConfig: config,
+                        errorMessage: "Не удалось вычислить собственные векторы"
+                    )
+                }
+                PCAResultCache.shared.storeFittedBasis(fitted, for: key)
+            }
+            updatedConfig = fitted.applied(to: config)
+            updatedConfig.sourceCubeID = cube.id
+        }
+        
+        let projection: PCAProjectionPlanes
+        if let cached = PCAResultCache.shared.projection(
+            cubeID: cube.id,
+            layout: layout,
+            region: region,
+            preprocess: config.preprocess,
+            fitted: fitted
+        ) {
+            projection = cached
+        } else {
+            progress?("Проекция и нормализация…")
+            projection = projectComponents(
                 cube: cube,
                 layoutAxes: axes,
-                width: regionWidth,
-                height: regionHeight,
                 channels: channels,
-                config: config,
-                mean: mean,
-                std: config.std ?? Array(repeating: 1.0, count: channels),
-                basis: basis,
+                preprocess: config.preprocess,
+                fitted: fitted,
                 region: region
             )
+            PCAResultCache.shared.storeProjection(
+                projection,
+                cubeID: cube.id,
+                layout: layout,
+                region: region,
+                preprocess: config.preprocess,
+                fitted: fitted
+            )
         }
         
-        // Ограничиваем число пикселей для оценки ковариации, чтобы не перегружать CPU
-        let maxSamples = 50_000
-        let sampleStride = max(1, totalPixels / maxSamples)
-        let statsStride = sampleStride
-        
-        // Первичный проход: собираем статистики (после выбранной предобработки)
-        progress?("Оценка среднего и дисперсии…")
-        var mean = Array(repeating: 0.0, count: channels)
-        var m2 = Array(repeating: 0.0, count: channels)
-        var sampleCount = 0
-        var clipSamples: [[Double]] = Array(repeating: [], count: channels)
-        let clipCapacity = min(maxSamples, max(10_000, channels * 100))
-        clipSamples = clipSamples.map { _ in [] }
-        
-        for linear in stride(from: 0, to: totalPixels, by: statsStride) {
-            let (hIdx, wIdx) = linearToHW(linear: linear, width: region.width)
-            let srcY = region.minY + hIdx
-            let srcX = region.minX + wIdx
-            var vector = [Double](repeating: 0.0, count: channels)
-            for c in 0..<channels {
-                var idx3 = [0, 0, 0]
-                idx3[axes.channel] = c
-                idx3[axes.height] = srcY
-                idx3[axes.width] = srcX
-                let idx = cube.linearIndex(i0: idx3[0], i1: idx3[1], i2: idx3[2])
-                let raw = cube.getValue(at: idx)
-                vector[c] = preprocessValue(raw, mode: config.preprocess)
-            }
-            
-            sampleCount += 1
-            // Welford для среднего и дисперсии
-            for c in 0..<channels {
-                let delta = vector[c] - mean[c]
-                mean[c] += delta / Double(sampleCount)
-                m2[c] += delta * (vector[c] - mean[c])
-                if clipSamples[c].count < clipCapacity {
-                    clipSamples[c].append(vector[c])
-                }
-            }
+        let image = composeImage(projection: projection, mapping: config.mapping)
+        return PCAImageResult(image: image, updatedConfig: updatedConfig)
+    }
+    
+    /// Перекраска уже построенного изображения по новому маппингу из кэшированных плоскостей
+    /// проекции, без пересчёта базиса и проекции. nil, если плоскостей для `config` в кэше нет.
+    static func recolor(
+        cube: HyperCube,
+        layout: CubeLayout,
+        config: PCAVisualizationConfig,
+        roi: SpectrumROIRect? = nil
+    ) -> NSImage? {
+        guard let strides = cube.axisStrides(for: layout),
+              let fitted = PCAFittedBasis(config: config) else {
+            return nil
         }
-        
-        var std = Array(repeating: 1.0, count: channels)
-        for c in 0..<channels {
-            let variance = sampleCount > 1 ? m2[c] / Double(sampleCount - 1) : 0
-            std[c] = variance > 1e-12 ? sqrt(variance) : 1.0
+        let region = roi ?? SpectrumROIRect(minX: 0, minY: 0, width: strides.width, height: strides.height)
+        guard let projection = PCAResultCache.shared.projection(
+            cubeID: cube.id,
+            layout: layout,
+            region: region,
+            preprocess: config.preprocess,
+            fitted: fitted
+        ) else {
+            return nil
         }
+        return composeImage(projection: projection, mapping: config.mapping)
+    }
+    
+    /// Базис для ROI через аккумулятор моментов: при перемещении или изменении размера ROI
+    /// вычитаются ушедшие полосы пикселей и добавляются новые, если это дешевле полного пересчёта.
+    /// Сдвиг берётся из подвыборки всего куба и не зависит от ROI, порог отсечения — из подвыборки
+    /// текущего ROI; аккумулятор переиспользуется только при том же пороге, поэтому результат
+    /// не зависит от того, каким путём пользователь пришёл к этому ROI.
+    private static func fitROIBasisIncrementally(
+        cube: HyperCube,
+        axes: (channel: Int, height: Int, width: Int),
+        layout: CubeLayout,
+        region: SpectrumROIRect,
+        config: PCAVisualizationConfig,
+        progress: ((String) -> Void)?
+    ) throws -> PCAFittedBasis {
+        let strides = cube.axisStrides(axes: axes)
+        let fullSource = InMemoryCubeSpectrumSource(
+            cube: cube,
+            axes: axes,
+            region: SpectrumROIRect(minX: 0, minY: 0, width: strides.width, height: strides.height)
+        )
+        let roiSource = InMemoryCubeSpectrumSource(cube: cube, axes: axes, region: region)
+        let key = PCAROIAccumulatorKey(
+            cubeID: cube.id,
+            layout: layout,
+            preprocess: config.preprocess,
+            clipTopPercent: config.clipTopPercent
+        )
+        let maxSamples = 50_000
         
-        // Оценка порога отсечения выбросов
-        var clipUpper: [Double] = Array(repeating: Double.greatestFiniteMagnitude, count: channels)
+        // Без отсечения порог не зависит от ROI и подвыборку считать не нужно
+        var clipUpper = [Double](repeating: Double.greatestFiniteMagnitude, count: roiSource.channels)
         if config.clipTopPercent > 0 {
-            for c in 0..<channels {
-                let values = clipSamples[c].sorted()
-                if values.isEmpty { continue }
-                let rank = Int(Double(values.count - 1) * (100.0 - config.clipTopPercent) / 100.0)
-                clipUpper[c] = values[max(0, min(values.count - 1, rank))]
-            }
+            progress?("Оценка среднего и дисперсии…")
+            clipUpper = PCACovarianceEngine.pilotStatistics(
+                source: roiSource,
+                preprocess: config.preprocess,
+                clipTopPercent: config.clipTopPercent,
+                pilotSamples: maxSamples,
+                clipCapacity: min(maxSamples, max(10_000, roiSource.channels * 100))
+            ).clipUpper
         }
         
-        // Строим ковариационную матрицу на подвыборке
-        progress?("Расчёт ковариации…")
-        var cov = Array(repeating: 0.0, count: channels * channels)
-        var usedSamples = 0
-        for linear in stride(from: 0, to: totalPixels, by: sampleStride) {
-            let (hIdx, wIdx) = linearToHW(linear: linear, width: region.width)
-            let srcY = region.minY + hIdx
-            let srcX = region.minX + wIdx
-            var centered = [Double](repeating: 0.0, count: channels)
-            for c in 0..<channels {
-                var idx3 = [0, 0, 0]
-                idx3[axes.channel] = c
-                idx3[axes.height] = srcY
-                idx3[axes.width] = srcX
-                let idx = cube.linearIndex(i0: idx3[0], i1: idx3[1], i2: idx3[2])
-                let raw = cube.getValue(at: idx)
-                var val = preprocessValue(raw, mode: config.preprocess)
-                val = min(val, clipUpper[c])
-                val = (val - mean[c])
-                if config.preprocess == .standardize {
-                    val /= std[c]
+        let cached = PCAResultCache.shared.roiAccumulator(for: key)
+        var accumulator: PCAMomentAccumulator
+        if let cached, cached.accumulator.clipUpper == clipUpper {
+            let removed = cached.rect.subtracting(region)
+            let added = region.subtracting(cached.rect)
+            let deltaArea = (removed + added).reduce(0) { $0 + $1.area }
+            if deltaArea < region.area {
+                progress?("Обновление ковариации ROI…")
+                accumulator = cached.accumulator
+                for rect in removed {
+                    accumulator.subtract(source: fullSource, rect: rect)
                 }
-                centered[c] = val
-            }
-            usedSamples += 1
-            
-            for i in 0..<channels {
-                let vi = centered[i]
-                let rowBase = i * channels
-                for j in i..<channels {
-                    cov[rowBase + j] += vi * centered[j]
+                for rect in added {
+                    accumulator.add(source: fullSource, rect: rect)
                 }
+            } else {
+                accumulator = PCAMomentAccumulator(
+                    channels: roiSource.channels,
+                    preprocess: config.preprocess,
+                    shift: cached.accumulator.shift,
+                    clipUpper: clipUpper
+                )
+                progress?("Расчёт ковариации…")
+                accumulator.add(source: fullSource, rect: region)
             }
+        } else {
+            let shift = cached?.accumulator.shift ?? PCACovarianceEngine.pilotStatistics(
+                source: fullSource,
+                preprocess: config.preprocess,
+                clipTopPercent: 0,
+                pilotSamples: maxSamples,
+                clipCapacity: 0
+            ).mean
+            accumulator = PCAMomentAccumulator(
+                channels: roiSource.channels,
+                preprocess: config.preprocess,
+                shift: shift,
+                clipUpper: clipUpper
+            )
+            progress?("Расчёт ковариации…")
+            accumulator.add(source: fullSource, rect: region)
         }
+        PCAResultCache.shared.storeROIAccumulator(accumulator, rect: region, key: key)
         
-        if usedSamples > 1 {
-            let scale = 1.0 / Double(usedSamples - 1)
-            for i in 0..<channels {
-                for j in i..<channels {
-                    cov[i * channels + j] *= scale
-                    cov[j * channels + i] = cov[i * channels + j]
-                }
-            }
-        }
+        let covarianceResult = accumulator.result()
+        progress?("Собственные векторы…")
+        let decomposition = try SymmetricEigenSolver.topEigenpairs(
+            matrix: covarianceResult.covariance,
+            dimension: accumulator.channels,
+            count: max(3, config.componentCount)
+        )
+        return PCAFittedBasis(
+            basis: decomposition.vectors,
+            mean: covarianceResult.statistics.mean,
+            std: covarianceResult.statistics.std,
+            clipUpper: covarianceResult.statistics.clipUpper,
+            explainedVariance: decomposition.values,
+            totalVariance: decomposition.trace
+        )
+    }
+    
+    /// Вычисляет среднее, std, порог отсечения и базис PCA для произвольного источника спектров
+    /// и возвращает обновлённую конфигурацию
+    static func fitBasis(
+        source: CubeSpectrumSource,
+        config: PCAVisualizationConfig,
+        progress: ((String) -> Void)? = nil
+    ) throws -> PCAVisualizationConfig {
+        let covarianceResult = covariance(source: source, config: config, progress: progress)
         
         progress?("Собственные векторы…")
-        let (basis, eigenValues) = topEigenVectors(fromCovariance: cov, channels: channels, components: 3)
+        let decomposition = try SymmetricEigenSolver.topEigenpairs(
+            matrix: covarianceResult.covariance,
+            dimension: source.channels,
+            count: max(3, config.componentCount)
+        )
         
         var updatedConfig = config
-        updatedConfig.basis = basis
-        updatedConfig.mean = mean
-        updatedConfig.std = std
-        updatedConfig.explainedVariance = eigenValues
-        updatedConfig.sourceCubeID = cube.id
-        updatedConfig.clipUpper = clipUpper
-        
-        progress?("Проекция и нормализация…")
-        return projectWithExistingBasis(
-            cube: cube,
-            layoutAxes: axes,
-            width: regionWidth,
-            height: regionHeight,
-            channels: channels,
-            config: updatedConfig,
-            mean: mean,
-            std: std,
-            basis: basis,
-            region: region
+        updatedConfig.basis = decomposition.vectors
+        updatedConfig.mean = covarianceResult.statistics.mean
+        updatedConfig.std = covarianceResult.statistics.std
+        updatedConfig.explainedVariance = decomposition.values
+        updatedConfig.totalVariance = decomposition.trace
+        updatedConfig.clipUpper = covarianceResult.statistics.clipUpper
+        return updatedConfig
+    }
+    
+    /// Ковариация по подвыборке (≤ `maxSamples` пикселей) или, при `fullCoverage`,
+    /// потоковым проходом по всем пикселям источника
+    static func covariance(
+        source: CubeSpectrumSource,
+        config: PCAVisualizationConfig,
+        maxSamples: Int = 50_000,
+        clipCapacity: Int? = nil,
+        progress: ((String) -> Void)? = nil
+    ) -> PCACovarianceResult {
+        let capacity = clipCapacity ?? min(maxSamples, max(10_000, source.channels * 100))
+        if config.fullCoverage {
+            return PCACovarianceEngine.computeStreaming(
+                source: source,
+                preprocess: config.preprocess,
+                clipTopPercent: config.clipTopPercent,
+                pilotSamples: maxSamples,
+                clipCapacity: capacity,
+                progress: progress
+            )
+        }
+        let sampleStride = max(1, source.pixelCount / maxSamples)
+        return PCACovarianceEngine.compute(
+            source: source,
+            grid: PCASampleGrid(pixelCount: source.pixelCount, stride: sampleStride),
+            preprocess: config.preprocess,
+            clipTopPercent: config.clipTopPercent,
+            clipCapacity: capacity,
+            progress: progress
         )
     }
     
     // MARK: - Projection
     
-    private static func projectWithExistingBasis(
+    /// Проекция области на базис как блочное произведение (пиксели × C)·(C × k):
+    /// спектры плиток собираются во Float32, предобработка (log, отсечение, центрирование,
+    /// стандартизация) применяется к плитке, а SGEMM пишет результат сразу в плоскости компонент.
+    private static func projectComponents(
         cube: HyperCube,
         layoutAxes: (channel: Int, height: Int, width: Int),
-        width: Int,
-        height: Int,
         channels: Int,
-        config: PCAVisualizationConfig,
-        mean: [Double],
-        std: [Double],
-        basis: [[Double]],
+        preprocess: PCAPreprocess,
+        fitted: PCAFittedBasis,
         region: SpectrumROIRect
-    ) -> PCAImageResult {
-        let totalPixels = width * height
-        let mapping = config.mapping
-        let components = basis
+    ) -> PCAProjectionPlanes {
+        let strides = cube.axisStrides(axes: layoutAxes)
+        let pixelCount = region.width * region.height
+        let components = fitted.basis.count
+        let tileRows = 256
+        let standardize = preprocess == .standardize
         
-        var pcMin = Array(repeating: Double.greatestFiniteMagnitude, count: components.count)
-        var pcMax = Array(repeating: -Double.greatestFiniteMagnitude, count: components.count)
-        
-        var projections: [[Double]] = Array(repeating: [Double](repeating: 0.0, count: totalPixels), count: components.count)
-        
-        for linear in 0..<totalPixels {
-            let (hIdx, wIdx) = linearToHW(linear: linear, width: region.width)
-            let srcY = region.minY + hIdx
-            let srcX = region.minX + wIdx
-            var vector = [Double](repeating: 0.0, count: channels)
+        var basisT = [Float](repeating: 0, count: components * channels)
+        for j in 0..<components {
             for c in 0..<channels {
-                var idx3 = [0, 0, 0]
-                idx3[layoutAxes.channel] = c
-                idx3[layoutAxes.height] = srcY
-                idx3[layoutAxes.width] = srcX
-                let idx = cube.linearIndex(i0: idx3[0], i1: idx3[1], i2: idx3[2])
-                var val = cube.getValue(at: idx)
-                val = preprocessValue(val, mode: config.preprocess)
-                if let clip = config.clipUpper, clip.count > c {
-                    val = min(val, clip[c])
-                }
-                val = val - mean[c]
-                if config.preprocess == .standardize {
-                    val /= std[c]
-                }
-                vector[c] = val
-            }
-            
-            for compIndex in 0..<components.count {
-                let dot = dotProduct(vector, components[compIndex])
-                projections[compIndex][linear] = dot
-                pcMin[compIndex] = min(pcMin[compIndex], dot)
-                pcMax[compIndex] = max(pcMax[compIndex], dot)
+                basisT[j * channels + c] = Float(fitted.basis[j][c])
             }
         }
-        
-        let mapped = mapping.clamped(maxComponents: components.count)
-        let pixelsR = toUInt8(normalize(projections[mapped.red], minVal: pcMin[mapped.red], maxVal: pcMax[mapped.red]))
-        let pixelsG = toUInt8(normalize(projections[mapped.green], minVal: pcMin[mapped.green], maxVal: pcMax[mapped.green]))
-        let pixelsB = toUInt8(normalize(projections[mapped.blue], minVal: pcMin[mapped.blue], maxVal: pcMax[mapped.blue]))
-        
-        let image = createRGBImage(r: pixelsR, g: pixelsG, b: pixelsB, width: region.width, height: region.height)
-        return PCAImageResult(image: image, updatedConfig: config)
-    }
-    
-    // MARK: - Math helpers
-    
-    private static func preprocessValue(_ value: Double, mode: PCAPreprocess) -> Double {
-        switch mode {
-        case .none, .meanCenter, .standardize:
-            return value
-        case .log:
-            return log(max(0, value) + 1.0)
+        let meanF = fitted.mean.map { Float($0) }
+        let stdF = fitted.std.map { Float($0) }
+        let clipF: [Float] = (0..<channels).map { c in
+            guard c < fitted.clipUpper.count else { return Float.greatestFiniteMagnitude }
+            return Float(min(fitted.clipUpper[c], Double(Float.greatestFiniteMagnitude)))
         }
-    }
-    
-    private static func linearToHW(linear: Int, width: Int) -> (Int, Int) {
-        let h = linear / width
-        let w = linear % width
-        return (h, w)
-    }
-    
-    private static func topEigenVectors(fromCovariance cov: [Double], channels: Int, components: Int) -> ([[Double]], [Double]) {
-        guard channels > 0 else { return ([], []) }
-        let comps = max(1, min(components, channels))
-        var vectors: [[Double]] = []
-        var eigenValues: [Double] = []
         
-        for _ in 0..<comps {
-            var v = randomUnitVector(length: channels)
-            for _ in 0..<25 {
-                // w = cov * v
-                var w = [Double](repeating: 0.0, count: channels)
-                for i in 0..<channels {
-                    var sum = 0.0
-                    let rowBase = i * channels
-                    for j in 0..<channels {
-                        sum += cov[rowBase + j] * v[j]
-                    }
-                    w[i] = sum
-                }
-                
-                // ортогонализация к уже найденным векторам
-                for prev in vectors {
-                    let proj = dotProduct(w, prev)
-                    for i in 0..<channels {
-                        w[i] -= proj * prev[i]
+        let chunkCount = ParallelCompute.chunkCount(count: pixelCount, minChunk: tileRows)
+        var partialMin = [Float](repeating: Float.greatestFiniteMagnitude, count: chunkCount * components)
+        var partialMax = [Float](repeating: -Float.greatestFiniteMagnitude, count: chunkCount * components)
+        var values = [Float](repeating: 0, count: components * pixelCount)
+        
+        values.withUnsafeMutableBufferPointer { valuesPtr in
+            partialMin.withUnsafeMutableBufferPointer { minPtr in
+                partialMax.withUnsafeMutableBufferPointer { maxPtr in
+                    basisT.withUnsafeBufferPointer { basisPtr in
+                        meanF.withUnsafeBufferPointer { meanPtr in
+                            stdF.withUnsafeBufferPointer { stdPtr in
+                                clipF.withUnsafeBufferPointer { clipPtr in
+                                    let planes = valuesPtr.baseAddress!
+                                    ParallelCompute.forEachChunk(count: pixelCount, minChunk: tileRows) { chunkIndex, range in
+                                        let tile = UnsafeMutablePointer<Float>.allocate(capacity: tileRows * channels)
+                                        defer { tile.deallocate() }
+                                        let n = vDSP_Length(channels)
+                                        
+                                        var start = range.lowerBound
+                                        while start < range.upperBound {
+                                            let end = min(start + tileRows, range.upperBound)
+                                            let rows = end - start
+                                            for r in 0..<rows {
+                                                let linear = start + r
+                                                let y = linear / region.width
+                                                let x = linear - y * region.width
+                                                cube.storage.gather(
+                                                    base: strides.pixelOffset(x: region.minX + x, y: region.minY + y),
+                                                    stride: strides.channelStride,
+                                                    count: channels,
+                                                    into: tile + r * channels
+                                                )
+                                            }
+                                            if preprocess == .log {
+                                                var zero: Float = 0
+                                                vDSP_vthr(tile, 1, &zero, tile, 1, vDSP_Length(rows * channels))
+                                                var count = Int32(rows * channels)
+                                                vvlog1pf(tile, tile, &count)
+                                            }
+                                            for r in 0..<rows {
+                                                let row = tile + r * channels
+                                                vDSP_vmin(row, 1, clipPtr.baseAddress!, 1, row, 1, n)
+                                                vDSP_vsub(meanPtr.baseAddress!, 1, row, 1, row, 1, n)
+                                                if standardize {
+                                                    vDSP_vdiv(stdPtr.baseAddress!, 1, row, 1, row, 1, n)
+                                                }
+                                            }
+                                            // planes[:, start..<end] = Bᵀ · tileᵀ (строки — компоненты)
+                                            cblas_sgemm(
+                                                CblasRowMajor, CblasNoTrans, CblasTrans,
+                                                Int32(components), Int32(rows), Int32(channels),
+                                                1.0, basisPtr.baseAddress!, Int32(channels),
+                                                tile, Int32(channels),
+                                                0.0, planes + start, Int32(pixelCount)
+                                            )
+                                            start = end
+                                        }
+                                        
+                                        for j in 0..<components {
+                                            let segment = planes + j * pixelCount + range.lowerBound
+                                            vDSP_minv(segment, 1, minPtr.baseAddress! + chunkIndex * components + j, vDSP_Length(range.count))
+                                            vDSP_maxv(segment, 1, maxPtr.baseAddress! + chunkIndex * components + j, vDSP_Length(range.count))
+                                        }
+                                    }
+                                }
+                            }
+                        }
                     }
                 }
-                
-                let norm = sqrt(dotProduct(w, w))
-                if norm > 1e-12 {
-                    for i in 0..<channels { v[i] = w[i] / norm }
-                }
             }
-            
-            // Собственное значение
-            var lambda = 0.0
-            for i in 0..<channels {
-                var sum = 0.0
-                let rowBase = i * channels
-                for j in 0..<channels {
-                    sum += cov[rowBase + j] * v[j]
-                }
-                lambda += v[i] * sum
+        }
+        
+        var minValues = [Float](repeating: Float.greatestFiniteMagnitude, count: components)
+        var maxValues = [Float](repeating: -Float.greatestFiniteMagnitude, count: components)
+        for chunk in 0..<chunkCount {
+            for j in 0..<components {
+                minValues[j] = min(minValues[j], partialMin[chunk * components + j])
+                maxValues[j] = max(maxValues[j], partialMax[chunk * components + j])
             }
-            
-            vectors.append(v)
-            eigenValues.append(lambda)
         }
         
-        return (vectors, eigenValues)
+        return PCAProjectionPlanes(
+            width: region.width,
+            height: region.height,
+            componentCount: components,
+            values: values,
+            minValues: minValues,
+            maxValues: maxValues
+        )
     }
     
-    private static func randomUnitVector(length: Int) -> [Double] {
-        var v = (0..<length).map { _ in Double.random(in: -1...1) }
-        let norm = sqrt(dotProduct(v, v))
-        if norm > 1e-12 {
-            for i in 0..<length { v[i] /= norm }
-        }
-        return v
+    /// Перекраска готовых плоскостей компонент в RGB по маппингу
+    private static func composeImage(projection: PCAProjectionPlanes, mapping: PCAComponentMapping) -> NSImage? {
+        guard projection.componentCount > 0 else { return nil }
+        let mapped = mapping.clamped(maxComponents: projection.componentCount)
+        let pixelsR = quantizedPlane(projection, component: mapped.red)
+        let pixelsG = quantizedPlane(projection, component: mapped.green)
+        let pixelsB = quantizedPlane(projection, component: mapped.blue)
+        
+        return createRGBImage(r: pixelsR, g: pixelsG, b: pixelsB, width: projection.width, height: projection.height)
     }
     
-    private static func dotProduct(_ a: [Double], _ b: [Double]) -> Double {
-        guard a.count == b.count else { return 0 }
-        return zip(a, b).reduce(0.0) { partial, pair in
-            partial + pair.0 * pair.1
+    /// Линейное растяжение плоскости компоненты [min, max] → [0, 255]
+    private static func quantizedPlane(_ projection: PCAProjectionPlanes, component: Int) -> [UInt8] {
+        let count = projection.pixelCount
+        let minVal = projection.minValues[component]
+        let maxVal = projection.maxValues[component]
+        let range = maxVal - minVal
+        guard range > 1e-10 else {
+            return [UInt8](repeating: 128, count: count)
+        }
+        
+        var scale = 255.0 / range
+        var offset = -minVal * scale
+        var low: Float = 0
+        var high: Float = 255
+        let scaled = UnsafeMutablePointer<Float>.allocate(capacity: count)
+        defer { scaled.deallocate() }
+        var result = [UInt8](repeating: 0, count: count)
+        projection.values.withUnsafeBufferPointer { valuesPtr in
+            let plane = valuesPtr.baseAddress! + component * count
+            vDSP_vsmsa(plane, 1, &scale, &offset, scaled, 1, vDSP_Length(count))
         }
+        vDSP_vclip(scaled, 1, &low, &high, scaled, 1, vDSP_Length(count))
+        vDSP_vfixru8(scaled, 1, &result, 1, vDSP_Length(count))
+        return result
     }
     
     private static func extractChannel(
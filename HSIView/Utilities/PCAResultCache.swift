@@ -0,0 +1,206 @@
+import Foundation
+
+/// Результат подбора базиса PCA (без параметров отображения)
+struct PCAFittedBasis: Equatable {
+    let basis: [[Double]]
+    let mean: [Double]
+    let std: [Double]
+    let clipUpper: [Double]
+    let explainedVariance: [Double]
+    let totalVariance: Double?
+
+    init(basis: [[Double]], mean: [Double], std: [Double], clipUpper: [Double], explainedVariance: [Double], totalVariance: Double?) {
+        self.basis = basis
+        self.mean = mean
+        self.std = std
+        self.clipUpper = clipUpper
+        self.explainedVariance = explainedVariance
+        self.totalVariance = totalVariance
+    }
+
+    init?(config: PCAVisualizationConfig) {
+        guard let basis = config.basis, let mean = config.mean else { return nil }
+        self.basis = basis
+        self.mean = mean
+        self.std = config.std ?? Array(repeating: 1.0, count: mean.count)
+        self.clipUpper = config.clipUpper ?? []
+        self.explainedVariance = config.explainedVariance ?? []
+        self.totalVariance = config.totalVariance
+    }
+
+    func applied(to config: PCAVisualizationConfig) -> PCAVisualizationConfig {
+        var updated = config
+        updated.basis = basis
+        updated.mean = mean
+        updated.std = std
+        updated.clipUpper = clipUpper
+        updated.explainedVariance = explainedVariance
+        updated.totalVariance = totalVariance
+        return updated
+    }
+}
+
+/// Всё, от чего зависят статистики и собственные векторы
+struct PCABasisKey: Hashable {
+    let cubeID: UUID
+    let layout: CubeLayout
+    let region: SpectrumROIRect
+    let preprocess: PCAPreprocess
+    let clipTopPercent: Double
+    let componentCount: Int
+    /// Статистики по всем пикселям области, а не по подвыборке (ROI считается так всегда)
+    let fullCoverage: Bool
+
+    init(cubeID: UUID, layout: CubeLayout, region: SpectrumROIRect, config: PCAVisualizationConfig, fullCoverage: Bool) {
+        self.cubeID = cubeID
+        self.layout = layout
+        self.region = region
+        self.preprocess = config.preprocess
+        self.clipTopPercent = config.clipTopPercent
+        self.componentCount = config.componentCount
+        self.fullCoverage = fullCoverage
+    }
+}
+
+/// Ключ инкрементального аккумулятора ROI: сдвиг и порог отсечения в нём фиксированы,
+/// поэтому он переиспользуется только при тех же кубе, layout и предобработке
+struct PCAROIAccumulatorKey: Hashable {
+    let cubeID: UUID
+    let layout: CubeLayout
+    let preprocess: PCAPreprocess
+    let clipTopPercent: Double
+}
+
+/// Проекции области на компоненты базиса: `componentCount` плоскостей W×H подряд (Float32)
+struct PCAProjectionPlanes {
+    let width: Int
+    let height: Int
+    let componentCount: Int
+    let values: [Float]
+    let minValues: [Float]
+    let maxValues: [Float]
+
+    var pixelCount: Int { width * height }
+}
+
+/// Кэш промежуточных результатов PCA по кубу и области расчёта.
+/// Смена маппинга компонент превращается в перекраску готовых плоскостей, а
+/// перемещение ROI — в добавление/вычитание изменившихся полос из аккумулятора моментов.
+final class PCAResultCache {
+    static let shared = PCAResultCache()
+
+    private struct ProjectionEntry {
+        let cubeID: UUID
+        let layout: CubeLayout
+        let region: SpectrumROIRect
+        let preprocess: PCAPreprocess
+        let fitted: PCAFittedBasis
+        let projection: PCAProjectionPlanes
+    }
+
+    private let lock = NSLock()
+    private let maxBasisEntries = 8
+    private var basisEntries: [PCABasisKey: PCAFittedBasis] = [:]
+    private var basisOrder: [PCABasisKey] = []
+    private var roiAccumulator: (key: PCAROIAccumulatorKey, rect: SpectrumROIRect, accumulator: PCAMomentAccumulator)?
+    private var projectionEntry: ProjectionEntry?
+
+    func fittedBasis(for key: PCABasisKey) -> PCAFittedBasis? {
+        lock.lock()
+        defer { lock.unlock() }
+        guard let entry = basisEntries[key] else { return nil }
+        if let index = basisOrder.firstIndex(of: key) {
+            basisOrder.remove(at: index)
+        }
+        basisOrder.append(key)
+        return entry
+    }
+
+    func storeFittedBasis(_ fitted: PCAFittedBasis, for key: PCABasisKey) {
+        lock.lock()
+        defer { lock.unlock() }
+        // Результаты для других кубов больше не понадобятся
+        basisOrder.removeAll { $0.cubeID != key.cubeID }
+        basisEntries = basisEntries.filter { $0.key.cubeID == key.cubeID }
+        if let index = basisOrder.firstIndex(of: key) {
+            basisOrder.remove(at: index)
+        }
+        basisOrder.append(key)
+        basisEntries[key] = fitted
+        while basisOrder.count > maxBasisEntries {
+            let evicted = basisOrder.removeFirst()
+            basisEntries.removeValue(forKey: evicted)
+        }
+    }
+
+    func roiAccumulator(for key: PCAROIAccumulatorKey) -> (rect: SpectrumROIRect, accumulator: PCAMomentAccumulator)? {
+        lock.lock()
+        defer { lock.unlock() }
+        guard let entry = roiAccumulator, entry.key == key else { return nil }
+        return (entry.rect, entry.accumulator)
+    }
+
+    func storeROIAccumulator(_ accumulator: PCAMomentAccumulator, rect: SpectrumROIRect, key: PCAROIAccumulatorKey) {
+        lock.lock()
+        defer { lock.unlock() }
+        roiAccumulator = (key, rect, accumulator)
+    }
+
+    func projection(
+        cubeID: UUID,
+        layout: CubeLayout,
+        region: SpectrumROIRect,
+        preprocess: PCAPreprocess,
+        fitted: PCAFittedBasis
+    ) -> PCAProjectionPlanes? {
+        lock.lock()
+        defer { lock.unlock() }
+        guard let entry = projectionEntry,
+              entry.cubeID == cubeID,
+              entry.layout == layout,
+              entry.region == region,
+              entry.preprocess == preprocess,
+              entry.fitted.basis == fitted.basis,
+              entry.fitted.mean == fitted.mean,
+              entry.fitted.std == fitted.std,
+              entry.fitted.clipUpper == fitted.clipUpper else {
+            return nil
+        }
+        return entry.projection
+    }
+
+    /// Хранится только последняя проекция: плоскости занимают k × W × H значений
+    func storeProjection(
+        _ projection: PCAProjectionPlanes,
+        cubeID: UUID,
+        layout: CubeLayout,
+        region: SpectrumROIRect,
+        preprocess: PCAPreprocess,
+        fitted: PCAFittedBasis
+    ) {
+        lock.lock()
+        defer { lock.unlock() }
+        projectionEntry = ProjectionEntry(
+            cubeID: cubeID,
+            layout: layout,
+            region: region,
+            preprocess: preprocess,
+            fitted: fitted,
+            projection: projection
+        )
+    }
+
+    /// Освобождает всё, что относится к другим кубам (nil — весь кэш)
+    func removeAll(except cubeID: UUID? = nil) {
+        lock.lock()
+        defer { lock.unlock() }
+        basisOrder.removeAll { $0.cubeID != cubeID }
+        basisEntries = basisEntries.filter { $0.key.cubeID == cubeID }
+        if roiAccumulator?.key.cubeID != cubeID {
+            roiAccumulator = nil
+        }
+        if projectionEntry?.cubeID != cubeID {
+            projectionEntry = nil
+        }
+    }
+}
@@ -0,0 +1,81 @@
+import Foundation
+
+/// Общие примитивы для многопоточной обработки кубов.
+/// Работа делится на непрерывные диапазоны, которые исполняются через `concurrentPerform`.
+enum ParallelCompute {
+    static var workerCount: Int {
+        max(1, ProcessInfo.processInfo.activeProcessorCount)
+    }
+
+    /// Разбивает `0..<count` на не более чем `maxChunks` непрерывных диапазонов,
+    /// каждый не короче `minChunk` (кроме, возможно, последнего).
+    static func chunkRanges(count: Int, minChunk: Int = 1, maxChunks: Int? = nil) -> [Range<Int>] {
+        guard count > 0 else { return [] }
+        let limit = max(1, maxChunks ?? workerCount)
+        let byMinChunk = max(1, count / max(1, minChunk))
+        let chunkCount = max(1, min(limit, byMinChunk))
+        let baseSize = count / chunkCount
+        let remainder = count % chunkCount
+
+        var ranges: [Range<Int>] = []
+        ranges.reserveCapacity(chunkCount)
+        var start = 0
+        for i in 0..<chunkCount {
+            let size = baseSize + (i < remainder ? 1 : 0)
+            ranges.append(start..<(start + size))
+            start += size
+        }
+        return ranges
+    }
+
+    /// Выполняет `body(chunkIndex, range)` для каждого диапазона параллельно.
+    /// Индекс чанка стабилен и может использоваться для адресации поточных аккумуляторов.
+    static func forEachChunk(
+        count: Int,
+        minChunk: Int = 1,
+        maxChunks: Int? = nil,
+        _ body: (Int, Range<Int>) -> Void
+    ) {
+        let ranges = chunkRanges(count: count, minChunk: minChunk, maxChunks: maxChunks)
+        if ranges.count <= 1 {
+            if let range = ranges.first {
+                body(0, range)
+            }
+            return
+        }
+        DispatchQueue.concurrentPerform(iterations: ranges.count) { index in
+            body(index, ranges[index])
+        }
+    }
+
+    /// Для независимых задач разной стоимости: `workers` потоков разбирают индексы `0..<count`
+    /// по одному из общей очереди, так что освободившийся поток сразу берёт следующую задачу.
+    /// `body(workerIndex, index)`: индекс потока стабилен и может адресовать его рабочие буферы.
+    static func forEachDynamic(count: Int, workers: Int? = nil, _ body: (Int, Int) -> Void) {
+        guard count > 0 else { return }
+        let workerTotal = max(1, min(count, workers ?? workerCount))
+        if workerTotal == 1 {
+            for index in 0..<count {
+                body(0, index)
+            }
+            return
+        }
+        let lock = NSLock()
+        var next = 0
+        DispatchQueue.concurrentPerform(iterations: workerTotal) { worker in
+            while true {
+                lock.lock()
+                let index = next
+                next += 1
+                lock.unlock()
+                guard index < count else { return }
+                body(worker, index)
+            }
+        }
+    }
+
+    /// Количество чанков, которое создаст `forEachChunk` для тех же параметров.
+    static func chunkCount(count: Int, minChunk: Int = 1, maxChunks: Int? = nil) -> Int {
+        chunkRanges(count: count, minChunk: minChunk, maxChunks: maxChunks).count
+    }
+}
@@ -0,0 +1,184 @@
+import Foundation
+import Accelerate
+
+/// Оценка сдвига между двумя изображениями фазовой корреляцией:
+/// нормированный взаимный спектр → обратное БПФ → пик с субпиксельным уточнением.
+/// Спектр опорного изображения считается один раз и переиспользуется для всех каналов;
+/// после инициализации объект только читается, поэтому `estimate` можно вызывать из нескольких потоков.
+final class PhaseCorrelator {
+    struct Estimate {
+        /// Сдвиг содержимого `moving` относительно опорного: moving(x) ≈ reference(x − d)
+        let dx: Double
+        let dy: Double
+        /// Высота пика в долях идеального отклика (1 — чистый сдвиг), мера достоверности
+        let response: Double
+    }
+
+    /// Наибольшая сторона окна анализа; большие кадры обрезаются по центру
+    static let maxSide = 512
+    static let minSide = 16
+
+    let width: Int
+    let height: Int
+    private let originX: Int
+    private let originY: Int
+    private let log2Columns: Int
+    private let log2Rows: Int
+    private let columns: Int
+    private let rows: Int
+    private let setup: FFTSetupD
+    private let window: [Double]
+    private var referenceReal: [Double] = []
+    private var referenceImag: [Double] = []
+
+    /// `reference` — плоскость width × height построчно; nil, если кадр меньше `minSide`
+    init?(reference: [Double], width: Int, height: Int) {
+        guard let log2Columns = Self.log2Side(width), let log2Rows = Self.log2Side(height),
+              reference.count >= width * height,
+              let setup = vDSP_create_fftsetupD(vDSP_Length(max(log2Columns, log2Rows)), FFTRadix(kFFTRadix2)) else {
+            return nil
+        }
+        self.width = width
+        self.height = height
+        self.log2Columns = log2Columns
+        self.log2Rows = log2Rows
+        self.columns = 1 << log2Columns
+        self.rows = 1 << log2Rows
+        self.originX = (width - (1 << log2Columns)) / 2
+        self.originY = (height - (1 << log2Rows)) / 2
+        self.setup = setup
+
+        // Разделимое окно Хэннинга гасит разрыв на краях окна анализа
+        let columnWindow = Self.hann(1 << log2Columns)
+        let rowWindow = Self.hann(1 << log2Rows)
+        var window = [Double](repeating: 0, count: (1 << log2Columns) * (1 << log2Rows))
+        for y in 0..<rowWindow.count {
+            for x in 0..<columnWindow.count {
+                window[y * columnWindow.count + x] = rowWindow[y] * columnWindow[x]
+            }
+        }
+        self.window = window
+
+        // Все неизменяемые свойства заданы — спектр опорного считается теми же методами, что и для каналов
+        var real = [Double](repeating: 0, count: window.count)
+        var imag = [Double](repeating: 0, count: window.count)
+        real.withUnsafeMutableBufferPointer { re in
+            imag.withUnsafeMutableBufferPointer { im in
+                load(reference, into: re.baseAddress!)
+                forward(re.baseAddress!, im.baseAddress!)
+            }
+        }
+        self.referenceReal = real
+        self.referenceImag = imag
+    }
+
+    deinit {
+        vDSP_destroy_fftsetupD(setup)
+    }
+
+    /// Сдвиг `moving` (та же геометрия, что у опорного) относительно опорного изображения
+    func estimate(_ moving: [Double]) -> Estimate? {
+        guard moving.count >= width * height else { return nil }
+        let count = columns * rows
+        let real = UnsafeMutablePointer<Double>.allocate(capacity: count)
+        let imag = UnsafeMutablePointer<Double>.allocate(capacity: count)
+        let magnitude = UnsafeMutablePointer<Double>.allocate(capacity: count)
+        defer {
+            real.deallocate()
+            imag.deallocate()
+            magnitude.deallocate()
+        }
+
+        load(moving, into: real)
+        forward(real, imag)
+
+        // R = M · conj(F) / |M · conj(F)|
+        referenceReal.withUnsafeBufferPointer { refRe in
+            referenceImag.withUnsafeBufferPointer { refIm in
+                var reference = DSPDoubleSplitComplex(
+                    realp: UnsafeMutablePointer(mutating: refRe.baseAddress!),
+                    imagp: UnsafeMutablePointer(mutating: refIm.baseAddress!)
+                )
+                var spectrum = DSPDoubleSplitComplex(realp: real, imagp: imag)
+                vDSP_zvmulD(&reference, 1, &spectrum, 1, &spectrum, 1, vDSP_Length(count), -1)
+                vDSP_zvabsD(&spectrum, 1, magnitude, 1, vDSP_Length(count))
+            }
+        }
+        var threshold = 1e-12
+        vDSP_vthrD(magnitude, 1, &threshold, magnitude, 1, vDSP_Length(count))
+        vDSP_vdivD(magnitude, 1, real, 1, real, 1, vDSP_Length(count))
+        vDSP_vdivD(magnitude, 1, imag, 1, imag, 1, vDSP_Length(count))
+
+        var spectrum = DSPDoubleSplitComplex(realp: real, imagp: imag)
+        vDSP_fft2d_zipD(setup, &spectrum, 1, 0, vDSP_Length(log2Columns), vDSP_Length(log2Rows), FFTDirection(kFFTDirection_Inverse))
+
+        var peak = 0.0
+        var peakIndex: vDSP_Length = 0
+        vDSP_maxviD(real, 1, &peak, &peakIndex, vDSP_Length(count))
+        guard peak.isFinite, peak > 0 else { return nil }
+
+        let px = Int(peakIndex) % columns
+        let py = Int(peakIndex) / columns
+        let subX = Self.parabolicOffset(
+            real[py * columns + (px + columns - 1) % columns],
+            peak,
+            real[py * columns + (px + 1) % columns]
+        )
+        let subY = Self.parabolicOffset(
+            real[((py + rows - 1) % rows) * columns + px],
+            peak,
+            real[((py + 1) % rows) * columns + px]
+        )
+        // Индексы за половиной периода соответствуют отрицательным сдвигам
+        let dx = Double(px < columns / 2 ? px : px - columns) + subX
+        let dy = Double(py < rows / 2 ? py : py - rows) + subY
+        return Estimate(dx: dx, dy: dy, response: peak / Double(count))
+    }
+
+    /// Центральное окно анализа без среднего, умноженное на окно Хэннинга
+    private func load(_ data: [Double], into destination: UnsafeMutablePointer<Double>) {
+        data.withUnsafeBufferPointer { src in
+            window.withUnsafeBufferPointer { win in
+                var sum = 0.0
+                for y in 0..<rows {
+                    let row = src.baseAddress! + (originY + y) * width + originX
+                    (destination + y * columns).update(from: row, count: columns)
+                    for x in 0..<columns {
+                        sum += row[x]
+                    }
+                }
+                var negativeMean = -sum / Double(columns * rows)
+                vDSP_vsaddD(destination, 1, &negativeMean, destination, 1, vDSP_Length(columns * rows))
+                vDSP_vmulD(destination, 1, win.baseAddress!, 1, destination, 1, vDSP_Length(columns * rows))
+            }
+        }
+    }
+
+    /// Прямое 2D БПФ вещественной плоскости на месте: `real` → (real, imag)
+    private func forward(_ real: UnsafeMutablePointer<Double>, _ imag: UnsafeMutablePointer<Double>) {
+        vDSP_vclrD(imag, 1, vDSP_Length(columns * rows))
+        var spectrum = DSPDoubleSplitComplex(realp: real, imagp: imag)
+        vDSP_fft2d_zipD(setup, &spectrum, 1, 0, vDSP_Length(log2Columns), vDSP_Length(log2Rows), FFTDirection(kFFTDirection_Forward))
+    }
+
+    /// Показатель наибольшей степени двойки, не превосходящей min(side, maxSide)
+    private static func log2Side(_ side: Int) -> Int? {
+        guard side >= minSide else { return nil }
+        var log2 = 0
+        while (2 << log2) <= min(side, maxSide) {
+            log2 += 1
+        }
+        return log2
+    }
+
+    private static func hann(_ count: Int) -> [Double] {
+        (0..<count).map { 0.5 - 0.5 * cos(2 * Double.pi * Double($0) / Double(count - 1)) }
+    }
+
+    /// Вершина параболы через три соседних отсчёта, в пределах ±0.5
+    private static func parabolicOffset(_ left: Double, _ center: Double, _ right: Double) -> Double {
+        let denominator = left - 2 * center + right
+        guard denominator < -1e-12 else { return 0 }
+        return max(-0.5, min(0.5, 0.5 * (left - right) / denominator))
+    }
+}
@@ -0,0 +1,179 @@
+import Foundation
+import AppKit
+
+/// Уменьшенная копия куба для интерактивного предпросмотра операций пайплайна
+struct PipelinePreviewProxy {
+    let cube: HyperCube
+    /// Шаг прореживания по пространству (одинаков по обеим осям, поэтому переживает поворот и транспонирование)
+    let spatialStep: Int
+    /// Индексы исходных каналов, оставленных в прокси
+    let channelIndices: [Int]
+}
+
+/// Предпросмотр операции на прокси-кубе: пространственное прореживание до `maxSide`
+/// и, если операции не зависят от номеров каналов, прореживание спектра.
+enum PipelinePreviewRenderer {
+    static let maxSide = 256
+    static let maxChannels = 24
+
+    /// Операции, результат которых не зависит от номеров и количества каналов
+    static func isBandAgnostic(_ operation: PipelineOperation) -> Bool {
+        switch operation.type {
+        case .normalization, .channelwiseNormalization, .dataTypeConversion, .clipping,
+             .rotation, .transpose, .resize, .spatialCrop:
+            return true
+        case .spectralTrim, .calibration, .spectralInterpolation, .spectralAlignment, .customPython:
+            return false
+        }
+    }
+
+    /// Операции, которые можно быстро выполнить на прокси
+    static func isPreviewable(_ operation: PipelineOperation) -> Bool {
+        switch operation.type {
+        case .spectralAlignment, .customPython:
+            return false
+        default:
+            return true
+        }
+    }
+
+    static func makeProxy(
+        of cube: HyperCube,
+        layout: CubeLayout,
+        keepChannel: Int?,
+        subsampleBands: Bool
+    ) -> PipelinePreviewProxy? {
+        guard let axes = cube.axes(for: layout) else { return nil }
+        let strides = cube.axisStrides(axes: axes)
+        let step = max(1, Int((Double(max(strides.width, strides.height)) / Double(maxSide)).rounded(.up)))
+        let outWidth = (strides.width + step - 1) / step
+        let outHeight = (strides.height + step - 1) / step
+
+        var channelIndices = Array(0..<strides.channels)
+        if subsampleBands, strides.channels > maxChannels {
+            let bandStep = Double(strides.channels - 1) / Double(maxChannels - 1)
+            var picked = Set((0..<maxChannels).map { Int((Double($0) * bandStep).rounded()) })
+            if let keepChannel, keepChannel >= 0, keepChannel < strides.channels {
+                picked.insert(keepChannel)
+            }
+            channelIndices = picked.sorted()
+        }
+
+        var newDims = [0, 0, 0]
+        newDims[axes.channel] = channelIndices.count
+        newDims[axes.height] = outHeight
+        newDims[axes.width] = outWidth
+        let outStrides = [newDims[1] * newDims[2], newDims[2], 1]
+
+        func sample<T>(_ source: [T]) -> [T] {
+            return [T](unsafeUninitializedCapacity: newDims[0] * newDims[1] * newDims[2]) { buffer, initializedCount in
+                source.withUnsafeBufferPointer { src in
+                    for (c, channel) in channelIndices.enumerated() {
+                        for y in 0..<outHeight {
+                            for x in 0..<outWidth {
+                                let dst = c * outStrides[axes.channel] + y * outStrides[axes.height] + x * outStrides[axes.width]
+                                (buffer.baseAddress! + dst).initialize(to: src[strides.offset(channel: channel, x: x * step, y: y * step)])
+                            }
+                        }
+                    }
+                }
+                initializedCount = newDims[0] * newDims[1] * newDims[2]
+            }
+        }
+
+        let storage: DataStorage
+        switch cube.storage {
+        case .float64(let arr): storage = .float64(sample(arr))
+        case .float32(let arr): storage = .float32(sample(arr))
+        case .int8(let arr): storage = .int8(sample(arr))
+        case .int16(let arr): storage = .int16(sample(arr))
+        case .int32(let arr): storage = .int32(sample(arr))
+        case .uint8(let arr): storage = .uint8(sample(arr))
+        case .uint16(let arr): storage = .uint16(sample(arr))
+        }
+
+        let wavelengths: [Double]? = cube.wavelengths.flatMap { wl in
+            wl.count == strides.channels ? channelIndices.map { wl[$0] } : nil
+        }
+        let proxy = HyperCube(
+            dims: (newDims[0], newDims[1], newDims[2]),
+            storage: storage,
+            sourceFormat: cube.sourceFormat,
+            isFortranOrder: false,
+            wavelengths: wavelengths,
+            geoReference: nil
+        )
+        return PipelinePreviewProxy(cube: proxy, spatialStep: step, channelIndices: channelIndices)
+    }
+
+    /// Переводит пространственные параметры операции в координаты прокси
+    static func scaled(_ operation: PipelineOperation, spatialStep step: Int) -> PipelineOperation {
+        guard step > 1 else { return operation }
+        var scaled = operation
+        switch operation.type {
+        case .spatialCrop:
+            if var params = operation.cropParameters {
+                params.left /= step
+                params.top /= step
+                params.right = max(params.left, params.right / step)
+                params.bottom = max(params.top, params.bottom / step)
+                params.autoCropSettings = nil
+                params.autoCropResult = nil
+                scaled.cropParameters = params
+            }
+        case .resize:
+            if var params = operation.resizeParameters {
+                params.targetWidth = max(1, (params.targetWidth + step - 1) / step)
+                params.targetHeight = max(1, (params.targetHeight + step - 1) / step)
+                scaled.resizeParameters = params
+            }
+        default:
+            break
+        }
+        return scaled
+    }
+
+    /// Выполняет `operations` на прокси; непредпросматриваемые операции пропускаются
+    static func apply(_ operations: [PipelineOperation], to proxy: PipelinePreviewProxy) -> HyperCube {
+        operations.reduce(proxy.cube) { current, operation in
+            guard isPreviewable(operation) else { return current }
+            return scaled(operation, spatialStep: proxy.spatialStep).apply(to: current) ?? current
+        }
+    }
+
+    /// Изображение канала результата (номер канала приводится к прокси)
+    static func render(
+        _ cube: HyperCube,
+        layout: CubeLayout,
+        channel: Int,
+        proxy: PipelinePreviewProxy
+    ) -> NSImage? {
+        let channelCount = cube.channelCount(for: layout)
+        guard channelCount > 0 else { return nil }
+        var index = channel
+        if proxy.channelIndices.count == channelCount,
+           let position = proxy.channelIndices.firstIndex(where: { $0 >= channel }) {
+            index = position
+        }
+        index = max(0, min(index, channelCount - 1))
+        return ImageRenderer.renderGrayscale(cube: cube, layout: layout, channelIndex: index)
+    }
+}
+
+/// Потокобезопасный номер последнего запроса предпросмотра
+final class PreviewGenerationCounter {
+    private let lock = NSLock()
+    private var current = 0
+
+    var value: Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return current
+    }
+
+    func set(_ newValue: Int) {
+        lock.lock()
+        current = newValue
+        lock.unlock()
+    }
+}
@@ -0,0 +1,192 @@
+import Foundation
+import Accelerate
+
+/// Статистика спектров сразу для нескольких классов за один проход по кубу.
+/// Куб читается блоками строк: каналы строки собираются в плоскости, транспонируются
+/// в спектры пикселей, и каждый спектр добавляется ко всем классам, которым принадлежит пиксель.
+/// Потоки обрабатывают свои полосы строк в отдельных аккумуляторах; слияние идёт в порядке полос.
+enum SpectralClassAggregator {
+    /// Равномерные корзины на [lowerBound, upperBound]; значения за границами попадают в крайние корзины
+    struct HistogramSpec {
+        let bins: Int
+        let lowerBound: Double
+        let upperBound: Double
+    }
+
+    struct Statistics {
+        let classCount: Int
+        let channels: Int
+        /// Число пикселей каждого класса
+        let counts: [Int]
+        /// Суммы и суммы квадратов, класс × канал
+        let sums: [Double]
+        let sumSquares: [Double]
+        let histogramSpec: HistogramSpec?
+        /// Класс × канал × корзина; пусто без `histogramSpec`
+        let histograms: [Int]
+
+        func mean(ofClass index: Int) -> [Double]? {
+            guard index >= 0, index < classCount, counts[index] > 0 else { return nil }
+            let scale = 1.0 / Double(counts[index])
+            return sums[(index * channels)..<((index + 1) * channels)].map { $0 * scale }
+        }
+
+        /// Дисперсия по генеральной совокупности
+        func variance(ofClass index: Int) -> [Double]? {
+            guard let mean = mean(ofClass: index) else { return nil }
+            let scale = 1.0 / Double(counts[index])
+            return (0..<channels).map { ch in
+                max(0, sumSquares[index * channels + ch] * scale - mean[ch] * mean[ch])
+            }
+        }
+
+        func histogram(ofClass index: Int, channel: Int) -> ArraySlice<Int>? {
+            guard let spec = histogramSpec, index >= 0, index < classCount, channel >= 0, channel < channels else {
+                return nil
+            }
+            let start = (index * channels + channel) * spec.bins
+            return histograms[start..<(start + spec.bins)]
+        }
+    }
+
+    /// `layers[k]` — маска класса k размером width × height (ненулевое значение — пиксель входит в класс).
+    /// Слои могут пересекаться. nil, если слоёв нет или размеры не совпадают с кубом.
+    static func accumulate(
+        cube: HyperCube,
+        strides: CubeAxisStrides,
+        layers: [[UInt8]],
+        histogram: HistogramSpec? = nil
+    ) -> Statistics? {
+        let classCount = layers.count
+        let channels = strides.channels
+        let width = strides.width
+        let height = strides.height
+        let pixelCount = width * height
+        guard classCount > 0, channels > 0, pixelCount > 0,
+              layers.allSatisfy({ $0.count >= pixelCount }) else {
+            return nil
+        }
+        if let histogram, histogram.bins <= 0 || !(histogram.upperBound > histogram.lowerBound) {
+            return nil
+        }
+
+        let bins = histogram?.bins ?? 0
+        let histogramLower = histogram?.lowerBound ?? 0
+        let histogramScale = histogram.map { Double($0.bins) / ($0.upperBound - $0.lowerBound) } ?? 0
+        let words = (classCount + 63) / 64
+        let stride = classCount * channels
+        let histogramStride = stride * bins
+        let minRows = max(1, 16_384 / width)
+        let chunkCount = ParallelCompute.chunkCount(count: height, minChunk: minRows)
+
+        var partialCounts = [Int](repeating: 0, count: chunkCount * classCount)
+        var partialSums = [Double](repeating: 0, count: chunkCount * stride)
+        var partialSquares = [Double](repeating: 0, count: chunkCount * stride)
+        var partialHistograms = [Int](repeating: 0, count: chunkCount * histogramStride)
+
+        partialCounts.withUnsafeMutableBufferPointer { countsBuffer in
+            partialSums.withUnsafeMutableBufferPointer { sumsBuffer in
+                partialSquares.withUnsafeMutableBufferPointer { squaresBuffer in
+                    partialHistograms.withUnsafeMutableBufferPointer { histogramBuffer in
+                        ParallelCompute.forEachChunk(count: height, minChunk: minRows) { chunk, rows in
+                            let counts = countsBuffer.baseAddress! + chunk * classCount
+                            let sums = sumsBuffer.baseAddress! + chunk * stride
+                            let squares = squaresBuffer.baseAddress! + chunk * stride
+                            let histograms = bins > 0 ? histogramBuffer.baseAddress! + chunk * histogramStride : nil
+
+                            let planes = UnsafeMutablePointer<Double>.allocate(capacity: channels * width)
+                            let spectra = UnsafeMutablePointer<Double>.allocate(capacity: width * channels)
+                            let membership = UnsafeMutablePointer<UInt64>.allocate(capacity: width * words)
+                            defer {
+                                planes.deallocate()
+                                spectra.deallocate()
+                                membership.deallocate()
+                            }
+
+                            for y in rows {
+                                // Принадлежность пикселей строки классам — битовые маски по 64 класса
+                                membership.initialize(repeating: 0, count: width * words)
+                                var rowHasMembers = false
+                                for k in 0..<classCount {
+                                    let word = k / 64
+                                    let bit = UInt64(1) << UInt64(k % 64)
+                                    layers[k].withUnsafeBufferPointer { layer in
+                                        let row = layer.baseAddress! + y * width
+                                        for x in 0..<width where row[x] != 0 {
+                                            membership[x * words + word] |= bit
+                                            rowHasMembers = true
+                                        }
+                                    }
+                                }
+                                guard rowHasMembers else { continue }
+
+                                for ch in 0..<channels {
+                                    cube.storage.gather(
+                                        base: strides.offset(channel: ch, x: 0, y: y),
+                                        stride: strides.widthStride,
+                                        count: width,
+                                        into: planes + ch * width
+                                    )
+                                }
+                                // channels × width → width × channels: спектр пикселя непрерывен
+                                vDSP_mtransD(planes, 1, spectra, 1, vDSP_Length(width), vDSP_Length(channels))
+
+                                for x in 0..<width {
+                                    let spectrum = spectra + x * channels
+                                    for word in 0..<words {
+                                        var bits = membership[x * words + word]
+                                        while bits != 0 {
+                                            let k = word * 64 + bits.trailingZeroBitCount
+                                            bits &= bits - 1
+                                            counts[k] += 1
+                                            let classSums = sums + k * channels
+                                            let classSquares = squares + k * channels
+                                            vDSP_vaddD(classSums, 1, spectrum, 1, classSums, 1, vDSP_Length(channels))
+                                            vDSP_vmaD(spectrum, 1, spectrum, 1, classSquares, 1, classSquares, 1, vDSP_Length(channels))
+                                            guard let histograms else { continue }
+                                            let classHistograms = histograms + k * channels * bins
+                                            for ch in 0..<channels {
+                                                let position = (spectrum[ch] - histogramLower) * histogramScale
+                                                guard !position.isNaN else { continue }
+                                                let bin = position <= 0 ? 0 : (position >= Double(bins) ? bins - 1 : Int(position))
+                                                classHistograms[ch * bins + bin] += 1
+                                            }
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // Слияние полос по порядку — результат не зависит от планирования потоков
+        var counts = [Int](repeating: 0, count: classCount)
+        var sums = [Double](repeating: 0, count: stride)
+        var sumSquares = [Double](repeating: 0, count: stride)
+        var histograms = [Int](repeating: 0, count: histogramStride)
+        for chunk in 0..<chunkCount {
+            for k in 0..<classCount {
+                counts[k] += partialCounts[chunk * classCount + k]
+            }
+            for i in 0..<stride {
+                sums[i] += partialSums[chunk * stride + i]
+                sumSquares[i] += partialSquares[chunk * stride + i]
+            }
+            for i in 0..<histogramStride {
+                histograms[i] += partialHistograms[chunk * histogramStride + i]
+            }
+        }
+
+        return Statistics(
+            classCount: classCount,
+            channels: channels,
+            counts: counts,
+            sums: sums,
+            sumSquares: sumSquares,
+            histogramSpec: histogram,
+            histograms: histograms
+        )
+    }
+}
@@ -0,0 +1,161 @@
+import Foundation
+import Accelerate
+
+enum SpectralClassificationMethod {
+    /// Наименьший спектральный угол
+    case spectralAngle
+    /// Наименьшее евклидово расстояние до опорного спектра
+    case nearestCentroid
+}
+
+struct SpectralClassificationResult {
+    let width: Int
+    let height: Int
+    /// width × height построчно: 0 — не классифицирован, k + 1 — опорный спектр k
+    let classMap: [UInt8]
+    /// Число пикселей каждого опорного спектра
+    let pixelCounts: [Int]
+}
+
+/// Попиксельная классификация куба по набору опорных спектров.
+/// Пиксели строки обрабатываются плитками: каналы плитки собираются в матрицу (канал × пиксель, Double),
+/// и оценки всех классов для плитки получаются одним DGEMM (классы × каналы) · (каналы × пиксели).
+/// Угол и евклидово расстояние выражаются через те же скалярные произведения и нормы;
+/// счёт идёт в Double, потому что оценка центроидов 2 r·p − ‖r‖² теряет точность в Float
+/// при близких опорных спектрах с большой яркостью.
+/// Полосы строк обрабатываются параллельно, у каждого потока свои буферы.
+enum SpectralClassifier {
+    /// Классов не больше, чем помещается в карту UInt8
+    static let maxClasses = 255
+    static let tilePixels = 512
+
+    /// `references` — опорные спектры на сетке каналов куба. `maxAngle` (радианы) для SAM
+    /// оставляет неклассифицированными пиксели, угол которых до лучшего класса больше порога.
+    static func classify(
+        cube: HyperCube,
+        strides: CubeAxisStrides,
+        references: [[Double]],
+        method: SpectralClassificationMethod,
+        maxAngle: Double? = nil
+    ) -> SpectralClassificationResult? {
+        let channels = strides.channels
+        let width = strides.width
+        let height = strides.height
+        let classCount = min(references.count, maxClasses)
+        guard classCount > 0, channels > 0, width > 0, height > 0,
+              references.prefix(classCount).allSatisfy({ $0.count == channels }) else {
+            return nil
+        }
+
+        // Матрица классов: для SAM — единичные векторы, для центроидов — исходные спектры и их ‖r‖²
+        var referenceMatrix = [Double](repeating: 0, count: classCount * channels)
+        var referenceNormsSquared = [Double](repeating: 0, count: classCount)
+        var usable = [Bool](repeating: false, count: classCount)
+        for k in 0..<classCount {
+            let reference = references[k]
+            guard reference.allSatisfy({ $0.isFinite }) else { continue }
+            let normSquared = reference.reduce(0) { $0 + $1 * $1 }
+            let scale: Double
+            switch method {
+            case .spectralAngle:
+                guard normSquared > 0 else { continue }
+                scale = 1 / sqrt(normSquared)
+            case .nearestCentroid:
+                scale = 1
+            }
+            for ch in 0..<channels {
+                referenceMatrix[k * channels + ch] = reference[ch] * scale
+            }
+            referenceNormsSquared[k] = normSquared
+            usable[k] = true
+        }
+        guard usable.contains(true) else { return nil }
+        let minCosine = maxAngle.map { cos(max(0, min(Double.pi, $0))) }
+
+        let chunkCount = ParallelCompute.chunkCount(count: height)
+        var classMap = [UInt8](repeating: 0, count: width * height)
+        var partialCounts = [Int](repeating: 0, count: chunkCount * classCount)
+
+        classMap.withUnsafeMutableBufferPointer { mapBuffer in
+            partialCounts.withUnsafeMutableBufferPointer { countsBuffer in
+                referenceMatrix.withUnsafeBufferPointer { referencePtr in
+                    ParallelCompute.forEachChunk(count: height) { chunk, rows in
+                        let counts = countsBuffer.baseAddress! + chunk * classCount
+                        let tileCapacity = min(tilePixels, width)
+                        let tile = UnsafeMutablePointer<Double>.allocate(capacity: channels * tileCapacity)
+                        let scores = UnsafeMutablePointer<Double>.allocate(capacity: classCount * tileCapacity)
+                        let pixelNormsSquared = UnsafeMutablePointer<Double>.allocate(capacity: tileCapacity)
+                        defer {
+                            tile.deallocate()
+                            scores.deallocate()
+                            pixelNormsSquared.deallocate()
+                        }
+
+                        for y in rows {
+                            var x0 = 0
+                            while x0 < width {
+                                let count = min(tileCapacity, width - x0)
+                                for ch in 0..<channels {
+                                    cube.storage.gather(
+                                        base: strides.offset(channel: ch, x: x0, y: y),
+                                        stride: strides.widthStride,
+                                        count: count,
+                                        into: tile + ch * count
+                                    )
+                                }
+                                // ‖p‖² каждого пикселя плитки
+                                vDSP_vclrD(pixelNormsSquared, 1, vDSP_Length(count))
+                                for ch in 0..<channels {
+                                    let plane = tile + ch * count
+                                    vDSP_vmaD(plane, 1, plane, 1, pixelNormsSquared, 1, pixelNormsSquared, 1, vDSP_Length(count))
+                                }
+                                // scores[k, i] = r_k · p_i
+                                cblas_dgemm(
+                                    CblasRowMajor, CblasNoTrans, CblasNoTrans,
+                                    Int32(classCount), Int32(count), Int32(channels),
+                                    1, referencePtr.baseAddress!, Int32(channels),
+                                    tile, Int32(count),
+                                    0, scores, Int32(count)
+                                )
+
+                                let mapRow = mapBuffer.baseAddress! + y * width + x0
+                                for i in 0..<count {
+                                    let normSquared = pixelNormsSquared[i]
+                                    guard normSquared.isFinite else { continue }
+                                    var best = -1
+                                    var bestScore = -Double.infinity
+                                    for k in 0..<classCount where usable[k] {
+                                        let dot = scores[k * count + i]
+                                        // Для SAM ‖p‖ общий множитель — достаточно наибольшего r̂·p;
+                                        // для центроидов argmin ‖p − r‖² = argmax (2 r·p − ‖r‖²)
+                                        let score = method == .spectralAngle ? dot : 2 * dot - referenceNormsSquared[k]
+                                        if score > bestScore {
+                                            bestScore = score
+                                            best = k
+                                        }
+                                    }
+                                    guard best >= 0 else { continue }
+                                    if method == .spectralAngle {
+                                        guard normSquared > 0 else { continue }
+                                        if let minCosine, bestScore / normSquared.squareRoot() < minCosine { continue }
+                                    }
+                                    mapRow[i] = UInt8(best + 1)
+                                    counts[best] += 1
+                                }
+                                x0 += count
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        var pixelCounts = [Int](repeating: 0, count: classCount)
+        for chunk in 0..<chunkCount {
+            for k in 0..<classCount {
+                pixelCounts[k] += partialCounts[chunk * classCount + k]
+            }
+        }
+        return SpectralClassificationResult(width: width, height: height, classMap: classMap, pixelCounts: pixelCounts)
+    }
+}
@@ -0,0 +1,188 @@
+import Foundation
+import Accelerate
+
+/// Интегральные изображения всех каналов куба в одной таблице (H + 1) × (W + 1) × C:
+/// спектры соседних узлов лежат подряд, поэтому средний спектр любого прямоугольника —
+/// четыре непрерывных вектора длины C. Накопление в Float64 независимо от типа хранения.
+/// NaN и ±Inf в таблицу не попадают: они считаются в отдельной таблице той же формы,
+/// и канал прямоугольника с такими значениями даёт NaN, как при прямом усреднении.
+final class SpectralIntegralIndex {
+    let cubeID: UUID
+    let axes: (channel: Int, height: Int, width: Int)
+    let width: Int
+    let height: Int
+    let channels: Int
+    private let table: [Double]
+    /// Интегральные счётчики нечисловых значений; nil, если в кубе их нет
+    private let nonFiniteCounts: [Int32]?
+
+    /// Объём таблицы в байтах для заданных размеров
+    static func estimatedBytes(width: Int, height: Int, channels: Int) -> Int {
+        (width + 1) * (height + 1) * channels * MemoryLayout<Double>.stride
+    }
+
+    /// Таблица строится, только если помещается в этот бюджет
+    static var defaultMemoryBudget: Int {
+        min(Int(clamping: ProcessInfo.processInfo.physicalMemory / 8), 2 << 30)
+    }
+
+    /// nil, если куб пуст или таблица не помещается в `memoryBudget`
+    init?(cube: HyperCube, axes: (channel: Int, height: Int, width: Int), memoryBudget: Int = SpectralIntegralIndex.defaultMemoryBudget) {
+        let strides = cube.axisStrides(axes: axes)
+        let width = strides.width
+        let height = strides.height
+        let channels = strides.channels
+        guard width > 0, height > 0, channels > 0,
+              Self.estimatedBytes(width: width, height: height, channels: channels) <= memoryBudget else {
+            return nil
+        }
+
+        let nodeStride = channels
+        let rowStride = (width + 1) * channels
+        var table = [Double](repeating: 0, count: (height + 1) * rowStride)
+        var rowsWithNonFinite = [Bool](repeating: false, count: height)
+        table.withUnsafeMutableBufferPointer { buffer in
+            let base = buffer.baseAddress!
+            // Префиксные суммы вдоль строк: строки независимы
+            rowsWithNonFinite.withUnsafeMutableBufferPointer { flags in
+                ParallelCompute.forEachChunk(count: height) { _, rows in
+                    let spectrum = UnsafeMutablePointer<Double>.allocate(capacity: channels)
+                    defer { spectrum.deallocate() }
+                    for y in rows {
+                        let row = base + (y + 1) * rowStride
+                        var hasNonFinite = false
+                        for x in 0..<width {
+                            cube.storage.gather(
+                                base: strides.offset(channel: 0, x: x, y: y),
+                                stride: strides.channelStride,
+                                count: channels,
+                                into: spectrum
+                            )
+                            for c in 0..<channels where !spectrum[c].isFinite {
+                                spectrum[c] = 0
+                                hasNonFinite = true
+                            }
+                            vDSP_vaddD(row + x * nodeStride, 1, spectrum, 1, row + (x + 1) * nodeStride, 1, vDSP_Length(channels))
+                        }
+                        flags[y] = hasNonFinite
+                    }
+                }
+            }
+            // Накопление вниз по столбцам: строки идут по порядку, полосы столбцов — параллельно
+            guard height > 1 else { return }
+            ParallelCompute.forEachChunk(count: width, minChunk: max(1, 4_096 / channels)) { _, columns in
+                let start = (columns.lowerBound + 1) * nodeStride
+                let length = vDSP_Length(columns.count * nodeStride)
+                for y in 2...height {
+                    let row = base + y * rowStride + start
+                    vDSP_vaddD(row - rowStride, 1, row, 1, row, 1, length)
+                }
+            }
+        }
+
+        var nonFiniteCounts: [Int32]?
+        if rowsWithNonFinite.contains(true) {
+            let countBytes = (height + 1) * rowStride * MemoryLayout<Int32>.stride
+            guard Self.estimatedBytes(width: width, height: height, channels: channels) + countBytes <= memoryBudget else {
+                return nil
+            }
+            nonFiniteCounts = Self.nonFiniteCounts(cube: cube, strides: strides, rowsWithNonFinite: rowsWithNonFinite)
+        }
+
+        self.cubeID = cube.id
+        self.axes = axes
+        self.width = width
+        self.height = height
+        self.channels = channels
+        self.table = table
+        self.nonFiniteCounts = nonFiniteCounts
+    }
+
+    /// Интегральная таблица числа нечисловых значений по каналам, той же формы, что и основная
+    private static func nonFiniteCounts(cube: HyperCube, strides: CubeAxisStrides, rowsWithNonFinite: [Bool]) -> [Int32] {
+        let width = strides.width
+        let height = strides.height
+        let channels = strides.channels
+        let rowStride = (width + 1) * channels
+        var counts = [Int32](repeating: 0, count: (height + 1) * rowStride)
+        counts.withUnsafeMutableBufferPointer { buffer in
+            let base = buffer.baseAddress!
+            ParallelCompute.forEachChunk(count: height) { _, rows in
+                let spectrum = UnsafeMutablePointer<Double>.allocate(capacity: channels)
+                defer { spectrum.deallocate() }
+                for y in rows where rowsWithNonFinite[y] {
+                    let row = base + (y + 1) * rowStride
+                    for x in 0..<width {
+                        cube.storage.gather(
+                            base: strides.offset(channel: 0, x: x, y: y),
+                            stride: strides.channelStride,
+                            count: channels,
+                            into: spectrum
+                        )
+                        let previous = row + x * channels
+                        let node = previous + channels
+                        for c in 0..<channels {
+                            node[c] = previous[c] + (spectrum[c].isFinite ? 0 : 1)
+                        }
+                    }
+                }
+            }
+            guard height > 1 else { return }
+            ParallelCompute.forEachChunk(count: width, minChunk: max(1, 4_096 / channels)) { _, columns in
+                let start = (columns.lowerBound + 1) * channels
+                let length = columns.count * channels
+                for y in 2...height {
+                    let row = base + y * rowStride + start
+                    for i in 0..<length {
+                        row[i] += row[i - rowStride]
+                    }
+                }
+            }
+        }
+        return counts
+    }
+
+    func matches(cube: HyperCube, axes: (channel: Int, height: Int, width: Int)) -> Bool {
+        cube.id == cubeID && axes == self.axes
+    }
+
+    /// Средний спектр прямоугольника [minX, minX + width) × [minY, minY + height); nil за пределами кадра
+    func meanSpectrum(minX: Int, minY: Int, width rectWidth: Int, height rectHeight: Int) -> [Double]? {
+        guard rectWidth > 0, rectHeight > 0, minX >= 0, minY >= 0,
+              minX + rectWidth <= width, minY + rectHeight <= height else {
+            return nil
+        }
+        let rowStride = (width + 1) * channels
+        let x1 = minX + rectWidth
+        let y1 = minY + rectHeight
+        var result = [Double](repeating: 0, count: channels)
+        table.withUnsafeBufferPointer { buffer in
+            result.withUnsafeMutableBufferPointer { out in
+                let base = buffer.baseAddress!
+                let n = vDSP_Length(channels)
+                let bottomRight = base + y1 * rowStride + x1 * channels
+                let topRight = base + minY * rowStride + x1 * channels
+                let bottomLeft = base + y1 * rowStride + minX * channels
+                let topLeft = base + minY * rowStride + minX * channels
+                let dst = out.baseAddress!
+                // (BR − TR) − (BL − TL), затем деление на площадь
+                vDSP_vsubD(topRight, 1, bottomRight, 1, dst, 1, n)
+                vDSP_vsubD(bottomLeft, 1, dst, 1, dst, 1, n)
+                vDSP_vaddD(dst, 1, topLeft, 1, dst, 1, n)
+                var area = Double(rectWidth * rectHeight)
+                vDSP_vsdivD(dst, 1, &area, dst, 1, n)
+            }
+        }
+        nonFiniteCounts?.withUnsafeBufferPointer { buffer in
+            let base = buffer.baseAddress!
+            let bottomRight = base + y1 * rowStride + x1 * channels
+            let topRight = base + minY * rowStride + x1 * channels
+            let bottomLeft = base + y1 * rowStride + minX * channels
+            let topLeft = base + minY * rowStride + minX * channels
+            for c in 0..<channels where bottomRight[c] - topRight[c] - bottomLeft[c] + topLeft[c] > 0 {
+                result[c] = .nan
+            }
+        }
+        return result
+    }
+}
@@ -0,0 +1,220 @@
+import Foundation
+
+/// Квантильные спектры (медиана, процентили) по набору пикселей без полной сортировки.
+/// Для каждого канала значения собираются в переиспользуемый буфер потока и k-й элемент
+/// находится интроселектом; для 8- и 16-битных кубов — точный подсчёт по гистограмме за O(n).
+/// Каналы обрабатываются параллельно; число потоков выбора ограничено бюджетом памяти буферов.
+enum SpectralQuantileAggregator {
+    /// 16-битная гистограмма (65 536 корзин) выгоднее выбора начиная с такого числа пикселей
+    static let wideHistogramMinPixels = 32_768
+    /// Суммарный размер буферов выбора всех потоков (по n значений Double на поток)
+    static let selectionScratchBudget = 512 << 20
+
+    /// Спектр квантиля `quantile` ∈ [0, 1]. Между соседними порядковыми статистиками —
+    /// линейная интерполяция, поэтому 0.5 даёт обычную медиану (среднее двух центральных при чётном n).
+    /// `pixelOffsets` — смещения пикселей в плоскости канала (`CubeAxisStrides.pixelOffset`).
+    static func quantileSpectrum(
+        cube: HyperCube,
+        strides: CubeAxisStrides,
+        pixelOffsets: [Int],
+        quantile: Double = 0.5
+    ) -> [Double]? {
+        guard !pixelOffsets.isEmpty, strides.channels > 0 else { return nil }
+        let rank = Rank(quantile: quantile, count: pixelOffsets.count)
+        let wide = pixelOffsets.count >= wideHistogramMinPixels
+
+        switch cube.storage {
+        case .float64(let arr):
+            return select(arr, strides: strides, offsets: pixelOffsets, rank: rank) { $0 }
+        case .float32(let arr):
+            return select(arr, strides: strides, offsets: pixelOffsets, rank: rank) { Double($0) }
+        case .int32(let arr):
+            return select(arr, strides: strides, offsets: pixelOffsets, rank: rank) { Double($0) }
+        case .uint8(let arr):
+            return histogram(arr, strides: strides, offsets: pixelOffsets, rank: rank, bins: 256,
+                             bin: { Int($0) }, value: { Double($0) })
+        case .int8(let arr):
+            return histogram(arr, strides: strides, offsets: pixelOffsets, rank: rank, bins: 256,
+                             bin: { Int($0) + 128 }, value: { Double($0 - 128) })
+        case .uint16(let arr):
+            guard wide else {
+                return select(arr, strides: strides, offsets: pixelOffsets, rank: rank) { Double($0) }
+            }
+            return histogram(arr, strides: strides, offsets: pixelOffsets, rank: rank, bins: 65_536,
+                             bin: { Int($0) }, value: { Double($0) })
+        case .int16(let arr):
+            guard wide else {
+                return select(arr, strides: strides, offsets: pixelOffsets, rank: rank) { Double($0) }
+            }
+            return histogram(arr, strides: strides, offsets: pixelOffsets, rank: rank, bins: 65_536,
+                             bin: { Int($0) + 32_768 }, value: { Double($0 - 32_768) })
+        }
+    }
+
+    /// Смещения всех пикселей прямоугольника построчно
+    static func pixelOffsets(strides: CubeAxisStrides, minX: Int, minY: Int, width: Int, height: Int) -> [Int] {
+        var offsets: [Int] = []
+        offsets.reserveCapacity(width * height)
+        for y in minY..<(minY + height) {
+            for x in minX..<(minX + width) {
+                offsets.append(strides.pixelOffset(x: x, y: y))
+            }
+        }
+        return offsets
+    }
+
+    /// Позиция квантиля между порядковыми статистиками `lower` и `upper`
+    private struct Rank {
+        let lower: Int
+        let upper: Int
+        let fraction: Double
+
+        init(quantile: Double, count: Int) {
+            let position = min(1, max(0, quantile)) * Double(count - 1)
+            lower = min(count - 1, Int(position.rounded(.down)))
+            upper = min(count - 1, lower + 1)
+            fraction = position - Double(lower)
+        }
+
+        @inline(__always)
+        func blend(_ low: Double, _ high: Double) -> Double {
+            fraction > 0 ? low * (1 - fraction) + high * fraction : low
+        }
+    }
+
+    private static func select<T>(
+        _ source: [T],
+        strides: CubeAxisStrides,
+        offsets: [Int],
+        rank: Rank,
+        convert: (T) -> Double
+    ) -> [Double] {
+        let count = offsets.count
+        var result = [Double](repeating: 0, count: strides.channels)
+        // Большие маски на многоядерной машине иначе держат workerCount копий набора пикселей
+        let workers = max(1, selectionScratchBudget / max(1, count * MemoryLayout<Double>.stride))
+        source.withUnsafeBufferPointer { src in
+            offsets.withUnsafeBufferPointer { offsets in
+                result.withUnsafeMutableBufferPointer { out in
+                    ParallelCompute.forEachChunk(count: strides.channels, maxChunks: workers) { _, channels in
+                        let scratch = UnsafeMutablePointer<Double>.allocate(capacity: count)
+                        defer { scratch.deallocate() }
+                        for channel in channels {
+                            let plane = src.baseAddress! + channel * strides.channelStride
+                            for i in 0..<count {
+                                scratch[i] = convert(plane[offsets[i]])
+                            }
+                            introselect(scratch, count: count, k: rank.lower)
+                            let low = scratch[rank.lower]
+                            var high = low
+                            if rank.upper > rank.lower {
+                                // После выбора справа от k только элементы не меньше — следующая статистика их минимум
+                                high = scratch[rank.upper]
+                                for i in (rank.upper + 1)..<count where scratch[i] < high {
+                                    high = scratch[i]
+                                }
+                            }
+                            out[channel] = rank.blend(low, high)
+                        }
+                    }
+                }
+            }
+        }
+        return result
+    }
+
+    private static func histogram<T>(
+        _ source: [T],
+        strides: CubeAxisStrides,
+        offsets: [Int],
+        rank: Rank,
+        bins: Int,
+        bin: (T) -> Int,
+        value: (Int) -> Double
+    ) -> [Double] {
+        var result = [Double](repeating: 0, count: strides.channels)
+        source.withUnsafeBufferPointer { src in
+            offsets.withUnsafeBufferPointer { offsets in
+                result.withUnsafeMutableBufferPointer { out in
+                    ParallelCompute.forEachChunk(count: strides.channels) { _, channels in
+                        let counts = UnsafeMutablePointer<Int>.allocate(capacity: bins)
+                        defer { counts.deallocate() }
+                        for channel in channels {
+                            counts.initialize(repeating: 0, count: bins)
+                            let plane = src.baseAddress! + channel * strides.channelStride
+                            for offset in offsets {
+                                counts[bin(plane[offset])] += 1
+                            }
+                            var cumulative = 0
+                            var low = 0.0
+                            var high = 0.0
+                            for b in 0..<bins where counts[b] > 0 {
+                                let previous = cumulative
+                                cumulative += counts[b]
+                                if previous <= rank.lower, cumulative > rank.lower {
+                                    low = value(b)
+                                }
+                                if cumulative > rank.upper {
+                                    high = value(b)
+                                    break
+                                }
+                            }
+                            out[channel] = rank.blend(low, high)
+                        }
+                    }
+                }
+            }
+        }
+        return result
+    }
+
+    /// Переставляет `values` так, что на месте `k` стоит k-я порядковая статистика, слева — не больше,
+    /// справа — не меньше. Разбиение Хоара с опорным по медиане трёх; при вырождении — сортировка отрезка.
+    private static func introselect(_ values: UnsafeMutablePointer<Double>, count: Int, k: Int) {
+        var left = 0
+        var right = count - 1
+        var depthLimit = 2 * (Int.bitWidth - count.leadingZeroBitCount)
+        while right > left {
+            if depthLimit == 0 {
+                UnsafeMutableBufferPointer(start: values + left, count: right - left + 1).sort()
+                return
+            }
+            depthLimit -= 1
+
+            let mid = left + (right - left) / 2
+            if values[mid] < values[left] { values.swapAt(mid, left) }
+            if values[right] < values[left] { values.swapAt(right, left) }
+            if values[right] < values[mid] { values.swapAt(right, mid) }
+            let pivot = values[mid]
+
+            var i = left
+            var j = right
+            while i <= j {
+                while values[i] < pivot { i += 1 }
+                while pivot < values[j] { j -= 1 }
+                if i <= j {
+                    values.swapAt(i, j)
+                    i += 1
+                    j -= 1
+                }
+            }
+            // [left, j] ≤ pivot, [i, right] ≥ pivot, между ними — равные pivot
+            if k <= j {
+                right = j
+            } else if k >= i {
+                left = i
+            } else {
+                return
+            }
+        }
+    }
+}
+
+private extension UnsafeMutablePointer where Pointee == Double {
+    @inline(__always)
+    func swapAt(_ a: Int, _ b: Int) {
+        let tmp = self[a]
+        self[a] = self[b]
+        self[b] = tmp
+    }
+}
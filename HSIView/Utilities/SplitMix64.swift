@@ -0,0 +1,19 @@
+import Foundation
+
+/// Детерминированный генератор SplitMix64: одинаковое зерно даёт одинаковую
+/// последовательность на любом потоке, поэтому результаты итерационных методов воспроизводимы.
+struct SplitMix64: RandomNumberGenerator {
+    private var state: UInt64
+
+    init(seed: UInt64) {
+        state = seed
+    }
+
+    mutating func next() -> UInt64 {
+        state &+= 0x9E37_79B9_7F4A_7C15
+        var z = state
+        z = (z ^ (z >> 30)) &* 0xBF58_476D_1CE4_E5B9
+        z = (z ^ (z >> 27)) &* 0x94D0_49BB_1331_11EB
+        return z ^ (z >> 31)
+    }
+}
@@ -0,0 +1,90 @@
+import Foundation
+
+/// Интегральное изображение (summed-area table) одной плоскости:
+/// среднее по любой ячейке сетки за четыре обращения к таблице.
+struct SummedAreaTable {
+    let width: Int
+    let height: Int
+    /// (width + 1) × (height + 1), первая строка и первый столбец нулевые
+    let sums: [Double]
+
+    /// `data` — плоскость width × height построчно
+    init(_ data: [Double], width: Int, height: Int) {
+        self.width = width
+        self.height = height
+        let stride = width + 1
+        var sums = [Double](repeating: 0, count: stride * (height + 1))
+        data.withUnsafeBufferPointer { src in
+            sums.withUnsafeMutableBufferPointer { table in
+                for y in 0..<height {
+                    var rowSum = 0.0
+                    let above = y * stride
+                    let current = (y + 1) * stride
+                    let srcRow = y * width
+                    for x in 0..<width {
+                        rowSum += src[srcRow + x]
+                        table[current + x + 1] = table[above + x + 1] + rowSum
+                    }
+                }
+            }
+        }
+        self.sums = sums
+    }
+
+    /// Усредняет прямоугольник (x, y, w, h) по сетке gridWidth × gridHeight ячеек:
+    /// каждая ячейка — среднее по своей доле прямоугольника (не меньше одного пикселя).
+    /// `columnBounds` и `rowBounds` — рабочие буферы на gridWidth + 1 и gridHeight + 1 элементов.
+    func sampleGrid(
+        x: Int,
+        y: Int,
+        width w: Int,
+        height h: Int,
+        gridWidth: Int,
+        gridHeight: Int,
+        columnBounds: UnsafeMutablePointer<Int>,
+        rowBounds: UnsafeMutablePointer<Int>,
+        into destination: UnsafeMutablePointer<Double>
+    ) {
+        for i in 0...gridWidth {
+            columnBounds[i] = x + (i * w) / gridWidth
+        }
+        for j in 0...gridHeight {
+            rowBounds[j] = y + (j * h) / gridHeight
+        }
+        let stride = width + 1
+        sums.withUnsafeBufferPointer { table in
+            for j in 0..<gridHeight {
+                let y0 = rowBounds[j]
+                let y1 = max(rowBounds[j + 1], y0 + 1)
+                let top = y0 * stride
+                let bottom = y1 * stride
+                let out = destination + j * gridWidth
+                for i in 0..<gridWidth {
+                    let x0 = columnBounds[i]
+                    let x1 = max(columnBounds[i + 1], x0 + 1)
+                    let total = table[bottom + x1] - table[top + x1] - table[bottom + x0] + table[top + x0]
+                    out[i] = total / Double((x1 - x0) * (y1 - y0))
+                }
+            }
+        }
+    }
+
+    func sampledGrid(x: Int, y: Int, width w: Int, height h: Int, gridWidth: Int, gridHeight: Int) -> [Double] {
+        let columnBounds = UnsafeMutablePointer<Int>.allocate(capacity: gridWidth + 1)
+        let rowBounds = UnsafeMutablePointer<Int>.allocate(capacity: gridHeight + 1)
+        defer {
+            columnBounds.deallocate()
+            rowBounds.deallocate()
+        }
+        var grid = [Double](repeating: 0, count: gridWidth * gridHeight)
+        grid.withUnsafeMutableBufferPointer { out in
+            sampleGrid(
+                x: x, y: y, width: w, height: h,
+                gridWidth: gridWidth, gridHeight: gridHeight,
+                columnBounds: columnBounds, rowBounds: rowBounds,
+                into: out.baseAddress!
+            )
+        }
+        return grid
+    }
+}
@@ -0,0 +1,130 @@
+import Foundation
+import Accelerate
+
+struct SymmetricEigenDecomposition {
+    /// Собственные векторы по убыванию собственных значений, каждый длины n
+    let vectors: [[Double]]
+    let values: [Double]
+    /// След матрицы (для ковариации — суммарная дисперсия)
+    let trace: Double
+}
+
+enum SymmetricEigenSolverError: Error {
+    case invalidInput
+    case notConverged(info: Int)
+    case inaccurateResult(residual: Double)
+}
+
+/// Старшие собственные пары симметричной матрицы через LAPACK `dsyevr`
+/// (тридиагонализация Хаусхолдера + MRRR). Результат детерминирован: знак каждого
+/// вектора фиксируется так, чтобы наибольшая по модулю компонента была положительной.
+enum SymmetricEigenSolver {
+    static func topEigenpairs(
+        matrix: [Double],
+        dimension n: Int,
+        count requested: Int
+    ) throws -> SymmetricEigenDecomposition {
+        guard n > 0, matrix.count == n * n, requested > 0 else {
+            throw SymmetricEigenSolverError.invalidInput
+        }
+        guard matrix.allSatisfy({ $0.isFinite }) else {
+            throw SymmetricEigenSolverError.invalidInput
+        }
+        let k = min(requested, n)
+
+        var trace = 0.0
+        for i in 0..<n {
+            trace += matrix[i * n + i]
+        }
+
+        // dsyevr разрушает входную матрицу
+        var a = matrix
+        var jobz = CChar(UInt8(ascii: "V"))
+        var range = CChar(UInt8(ascii: "I"))
+        var uplo = CChar(UInt8(ascii: "U"))
+        var order = __CLPK_integer(n)
+        var lda = __CLPK_integer(n)
+        var vl = 0.0
+        var vu = 0.0
+        var il = __CLPK_integer(n - k + 1)
+        var iu = __CLPK_integer(n)
+        var abstol = 0.0
+        var found: __CLPK_integer = 0
+        var w = [Double](repeating: 0, count: n)
+        var z = [Double](repeating: 0, count: n * k)
+        var ldz = __CLPK_integer(n)
+        var isuppz = [__CLPK_integer](repeating: 0, count: 2 * max(1, k))
+        var info: __CLPK_integer = 0
+
+        // Запрос размера рабочих буферов
+        var workQuery = 0.0
+        var iworkQuery: __CLPK_integer = 0
+        var lwork: __CLPK_integer = -1
+        var liwork: __CLPK_integer = -1
+        dsyevr_(&jobz, &range, &uplo, &order, &a, &lda, &vl, &vu, &il, &iu, &abstol,
+                &found, &w, &z, &ldz, &isuppz, &workQuery, &lwork, &iworkQuery, &liwork, &info)
+        guard info == 0 else {
+            throw SymmetricEigenSolverError.notConverged(info: Int(info))
+        }
+
+        lwork = __CLPK_integer(workQuery)
+        liwork = iworkQuery
+        var work = [Double](repeating: 0, count: max(1, Int(lwork)))
+        var iwork = [__CLPK_integer](repeating: 0, count: max(1, Int(liwork)))
+        dsyevr_(&jobz, &range, &uplo, &order, &a, &lda, &vl, &vu, &il, &iu, &abstol,
+                &found, &w, &z, &ldz, &isuppz, &work, &lwork, &iwork, &liwork, &info)
+        guard info == 0, Int(found) == k else {
+            throw SymmetricEigenSolverError.notConverged(info: Int(info))
+        }
+
+        // LAPACK возвращает пары по возрастанию; столбцы z — собственные векторы
+        var vectors: [[Double]] = []
+        var values: [Double] = []
+        vectors.reserveCapacity(k)
+        values.reserveCapacity(k)
+        for column in stride(from: k - 1, through: 0, by: -1) {
+            var v = Array(z[(column * n)..<((column + 1) * n)])
+            if let pivot = v.indices.max(by: { abs(v[$0]) < abs(v[$1]) }), v[pivot] < 0 {
+                for i in 0..<n { v[i] = -v[i] }
+            }
+            vectors.append(v)
+            values.append(w[column])
+        }
+
+        let residual = maxRelativeResidual(matrix: matrix, dimension: n, vectors: vectors, values: values)
+        guard residual < 1e-6 else {
+            throw SymmetricEigenSolverError.inaccurateResult(residual: residual)
+        }
+
+        return SymmetricEigenDecomposition(vectors: vectors, values: values, trace: trace)
+    }
+
+    /// max ‖A·v − λ·v‖ / max(‖A‖∞, ε) по всем найденным парам
+    private static func maxRelativeResidual(
+        matrix: [Double],
+        dimension n: Int,
+        vectors: [[Double]],
+        values: [Double]
+    ) -> Double {
+        var normA = 0.0
+        for i in 0..<n {
+            var rowSum = 0.0
+            for j in 0..<n { rowSum += abs(matrix[i * n + j]) }
+            normA = max(normA, rowSum)
+        }
+        let scale = max(normA, Double.leastNormalMagnitude)
+
+        var worst = 0.0
+        var av = [Double](repeating: 0, count: n)
+        for (v, lambda) in zip(vectors, values) {
+            cblas_dgemv(CblasRowMajor, CblasNoTrans, Int32(n), Int32(n), 1.0, matrix, Int32(n), v, 1, 0.0, &av, 1)
+            var norm = 0.0
+            for i in 0..<n {
+                let r = av[i] - lambda * v[i]
+                norm += r * r
+            }
+            worst = max(worst, sqrt(norm) / scale)
+        }
+        return worst
+    }
+}
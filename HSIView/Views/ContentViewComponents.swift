@@ -22,6 +22,18 @@ struct LibraryExportToastView: View {
                 Text("\(state.completed) / \(state.total)")
                     .font(.system(size: 10, design: .monospaced))
                     .foregroundColor(.secondary)
+                if let throughput = throughputText {
+                    Text(throughput)
+                        .font(.system(size: 10, design: .monospaced))
+                        .foregroundColor(.secondary)
+                }
+                if !state.activeNames.isEmpty {
+                    Text(state.activeNames.joined(separator: ", "))
+                        .font(.system(size: 10))
+                        .foregroundColor(.secondary)
+                        .lineLimit(1)
+                        .truncationMode(.middle)
+                }
             case .success, .failure:
                 Text(AppLocalizer.localized(state.message ?? defaultMessage))
                     .font(.system(size: 11))
@@ -33,6 +45,17 @@ struct LibraryExportToastView: View {
         .shadow(color: Color.black.opacity(0.2), radius: 10, x: 0, y: 6)
     }
     
+    private var throughputText: String? {
+        guard state.completed > 0,
+              let cubesPerMinute = state.cubesPerMinute,
+              let gigabytesPerSecond = state.gigabytesPerSecond else { return nil }
+        return String(
+            format: AppLocalizer.localized("%.1f куб/мин · %.2f ГБ/с"),
+            cubesPerMinute,
+            gigabytesPerSecond
+        )
+    }
+    
     private var titleText: String {
         switch state.phase {
         case .running:
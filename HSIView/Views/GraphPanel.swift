@@ -1,4 +1,5 @@
 import SwiftUI
+import AppKit
 import Charts
 
 struct GraphPanel: View {
@@ -482,9 +483,28 @@ private struct SampleRow: View {
             Button(state.localized("Копировать")) {
                 state.copySpectrumSample(sample)
             }
+            Button(state.localized("graph.library_matches.menu")) {
+                state.findLibrarySpectrumMatches(for: sample)
+            }
+            .disabled(state.librarySpectrumCache.entries.isEmpty)
+        }
+        .popover(isPresented: libraryMatchesPresented, arrowEdge: .trailing) {
+            LibraryMatchesPopover(sample: sample)
+                .environmentObject(state)
         }
     }
     
+    private var libraryMatchesPresented: Binding<Bool> {
+        Binding(
+            get: { state.librarySpectrumMatchResult?.sampleID == sample.id },
+            set: { isPresented in
+                if !isPresented, state.librarySpectrumMatchResult?.sampleID == sample.id {
+                    state.librarySpectrumMatchResult = nil
+                }
+            }
+        )
+    }
+    
     private func startEditing() {
         nameText = sample.displayName ?? ""
         isEditing = true
@@ -496,6 +516,78 @@ private struct SampleRow: View {
     }
 }
 
+/// Ближайшие к точке спектры библиотеки (SAM или SID) по индексу `LibrarySpectrumIndex`
+private struct LibraryMatchesPopover: View {
+    @EnvironmentObject var state: AppState
+    let sample: SpectrumSample
+    
+    private var metric: Binding<LibrarySpectrumIndex.Metric> {
+        Binding(
+            get: { state.librarySpectrumMatchResult?.metric ?? .spectralAngle },
+            set: { state.findLibrarySpectrumMatches(for: sample, metric: $0) }
+        )
+    }
+    
+    var body: some View {
+        VStack(alignment: .leading, spacing: 8) {
+            Text(state.localized("graph.library_matches.title"))
+                .font(.system(size: 11, weight: .semibold))
+            Picker("", selection: metric) {
+                Text(state.localized("graph.library_matches.metric.sam"))
+                    .tag(LibrarySpectrumIndex.Metric.spectralAngle)
+                Text(state.localized("graph.library_matches.metric.sid"))
+                    .tag(LibrarySpectrumIndex.Metric.spectralInformationDivergence)
+            }
+            .pickerStyle(.segmented)
+            .labelsHidden()
+            
+            if let matches = state.librarySpectrumMatchResult?.matches {
+                if matches.isEmpty {
+                    Text(state.localized("graph.library_matches.empty"))
+                        .font(.system(size: 10))
+                        .foregroundColor(.secondary)
+                } else {
+                    ForEach(Array(matches.enumerated()), id: \.offset) { _, match in
+                        matchRow(match)
+                    }
+                }
+            } else {
+                ProgressView()
+                    .controlSize(.small)
+            }
+        }
+        .padding(10)
+        .frame(width: 260)
+    }
+    
+    private func matchRow(_ match: LibrarySpectrumIndex.Match) -> some View {
+        let palette = SpectrumColorPalette.colors
+        let color = palette.isEmpty ? NSColor.systemPink : palette[match.reference.colorIndex % palette.count]
+        let libraryName = state.librarySpectrumCache.entries[match.reference.libraryID]?.displayName
+            ?? match.reference.libraryID
+        let score = state.librarySpectrumMatchResult?.metric == .spectralInformationDivergence
+            ? String(format: "%.4f", match.score)
+            : String(format: "%.2f°", match.score * 180 / .pi)
+        return HStack(spacing: 8) {
+            Circle()
+                .fill(Color(nsColor: color))
+                .frame(width: 8, height: 8)
+            VStack(alignment: .leading, spacing: 1) {
+                Text(match.reference.name)
+                    .font(.system(size: 10))
+                    .lineLimit(1)
+                Text(libraryName)
+                    .font(.system(size: 9))
+                    .foregroundColor(.secondary)
+                    .lineLimit(1)
+            }
+            Spacer()
+            Text(score)
+                .font(.system(size: 10, design: .monospaced))
+        }
+    }
+}
+
 private struct ROISampleRow: View {
     @EnvironmentObject var state: AppState
     let sample: SpectrumROISample
@@ -110,6 +110,9 @@ struct OperationEditorView: View {
                     ScrollView {
                         VStack(spacing: 16) {
                             editorContent(for: op)
+                            if showsPreview(for: op) {
+                                previewSection
+                            }
                         }
                         .padding(16)
                     }
@@ -123,10 +126,112 @@ struct OperationEditorView: View {
         .frame(width: editorSize.width, height: editorSize.height)
         .onAppear {
             loadLocalState()
+            schedulePreview(commitWhenSettled: false)
         }
         .onChange(of: operation?.id) {
             loadLocalState()
         }
+        // Ключ сравнивает параметры без строкового представления, эталоны калибровки — по буферу
+        .onChange(of: previewOperation().map { PipelineOperationContentKey($0) }) {
+            schedulePreview(commitWhenSettled: true)
+        }
+        .onChange(of: state.pipelinePreviewEnabled) {
+            schedulePreview(commitWhenSettled: false)
+        }
+        .onDisappear {
+            state.cancelPipelinePreview()
+        }
+    }
+
+    // MARK: - Предпросмотр
+
+    private func showsPreview(for op: PipelineOperation) -> Bool {
+        op.type != .spatialCrop && PipelinePreviewRenderer.isPreviewable(op)
+    }
+
+    /// Операция с текущими несохранёнными параметрами (только для предпросматриваемых типов)
+    private func previewOperation() -> PipelineOperation? {
+        guard var op = operation, showsPreview(for: op) else { return nil }
+        switch op.type {
+        case .normalization, .channelwiseNormalization:
+            op.normalizationType = localNormalizationType
+            op.normalizationParams = localNormalizationParams
+            op.preserveDataType = localPreserveDataType
+        case .dataTypeConversion:
+            op.targetDataType = localTargetDataType
+            op.autoScale = localAutoScale
+        case .clipping:
+            op.clippingParams = localClippingParams
+        case .rotation:
+            op.rotationAngle = localRotationAngle
+        case .transpose:
+            var normalized = localTransposeParams
+            let cleaned = normalized.normalizedOrder
+            normalized.order = cleaned.isEmpty ? localTransposeParams.order.uppercased() : cleaned
+            op.transposeParameters = normalized
+        case .resize:
+            op.resizeParameters = localResizeParams
+        case .spectralTrim:
+            op.spectralTrimParams = localSpectralTrimParams
+        case .calibration:
+            op.calibrationParams = localCalibrationParams
+        case .spectralInterpolation:
+            var params = localSpectralInterpolationParams
+            if spectralInterpolationTargetMode == .manual {
+                params.targetWavelengths = nil
+            }
+            params.isConfiguredByUser = true
+            op.spectralInterpolationParams = params
+        case .spatialCrop, .spectralAlignment, .customPython:
+            return nil
+        }
+        return op
+    }
+
+    /// При автоприменении полный расчёт запускается, когда параметры перестают меняться
+    private func schedulePreview(commitWhenSettled: Bool) {
+        guard let op = previewOperation() else { return }
+        let onSettled: (() -> Void)? = commitWhenSettled && state.pipelineAutoApply ? {
+            saveLocalState()
+            state.applyPipeline()
+        } : nil
+        state.requestPipelinePreview(for: op, onSettled: onSettled)
+    }
+
+    private var previewSection: some View {
+        VStack(alignment: .leading, spacing: 8) {
+            HStack {
+                Toggle(state.localized("Предпросмотр"), isOn: $state.pipelinePreviewEnabled)
+                    .toggleStyle(.switch)
+                    .controlSize(.small)
+                Spacer()
+                if state.pipelinePreviewEnabled, let duration = state.pipelinePreviewDuration {
+                    Text(String(format: "%.0f ms", duration * 1000))
+                        .font(.system(size: 10, design: .monospaced))
+                        .foregroundColor(.secondary)
+                }
+            }
+            if state.pipelinePreviewEnabled {
+                ZStack {
+                    RoundedRectangle(cornerRadius: 6)
+                        .fill(Color(NSColor.controlBackgroundColor))
+                    if let image = state.pipelinePreviewImage {
+                        Image(nsImage: image)
+                            .resizable()
+                            .interpolation(.none)
+                            .aspectRatio(contentMode: .fit)
+                            .padding(4)
+                    } else {
+                        ProgressView()
+                            .controlSize(.small)
+                    }
+                }
+                .frame(height: 180)
+                Text(state.localized("Уменьшенная копия куба; полный расчёт запускается после остановки изменений"))
+                    .font(.system(size: 10))
+                    .foregroundColor(.secondary)
+            }
+        }
     }
 
     private var editorSize: CGSize {
@@ -555,6 +660,12 @@ struct OperationEditorView: View {
                     }
                     .pickerStyle(.segmented)
                     .frame(maxWidth: 240)
+                    
+                    Toggle(state.localized("Сглаживание при уменьшении"), isOn: $localResizeParams.antialias)
+                        .font(.system(size: 11))
+                    Text(state.localized("Ядро расширяется пропорционально масштабу, чтобы избежать муара"))
+                        .font(.system(size: 10))
+                        .foregroundColor(.secondary)
                 }
             }
             
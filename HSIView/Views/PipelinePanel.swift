@@ -150,6 +150,42 @@ struct PipelinePanel: View {
         selectedOperation = nil
     }
     
+    /// Сохраняет пайплайн в JSON для консольной утилиты `hsiview-batch`.
+    /// Неподдерживаемые операции попадают в файл как `unsupported`, и утилита завершится с ошибкой.
+    private func saveBatchSpec() {
+        let (spec, unsupported) = PipelineBatchSpec.make(from: state.pipelineOperations, layout: state.activeLayout)
+        let encoder = JSONEncoder()
+        encoder.outputFormatting = [.prettyPrinted, .sortedKeys]
+        let data: Data
+        do {
+            data = try encoder.encode(spec)
+        } catch {
+            state.loadError = LF("pipeline.batch_spec.save_failed", error.localizedDescription)
+            return
+        }
+        
+        let panel = NSSavePanel()
+        panel.canCreateDirectories = true
+        panel.isExtensionHidden = false
+        panel.allowedContentTypes = [.json]
+        let baseName = state.cubeURL?.deletingPathExtension().lastPathComponent ?? "pipeline"
+        panel.nameFieldStringValue = "\(baseName)_pipeline.json"
+        if unsupported.isEmpty {
+            panel.message = state.localized("Сохранить пайплайн для пакетной обработки")
+        } else {
+            let names = unsupported.map { $0.displayName }.joined(separator: ", ")
+            panel.message = LF("pipeline.batch_spec.unsupported_operations", names)
+        }
+        panel.prompt = state.localized("Сохранить")
+        
+        guard panel.runModal() == .OK, let url = panel.url else { return }
+        do {
+            try data.write(to: url, options: .atomic)
+        } catch {
+            state.loadError = LF("pipeline.batch_spec.save_failed", error.localizedDescription)
+        }
+    }
+    
     private var footer: some View {
         VStack(spacing: 8) {
             HStack(spacing: 8) {
@@ -275,6 +311,10 @@ struct PipelinePanel: View {
         .disabled(state.pipelineOperationClipboard == nil)
         
         if !state.pipelineOperations.isEmpty {
+            Button(state.localized("Сохранить для пакетной обработки…")) {
+                saveBatchSpec()
+            }
+            
             Divider()
             Button(state.localized("Очистить")) {
                 state.clearPipeline()
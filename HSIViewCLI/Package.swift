@@ -0,0 +1,32 @@
+// swift-tools-version:5.9
+import PackageDescription
+
+let package = Package(
+    name: "HSIViewCLI",
+    platforms: [.macOS(.v13)],
+    products: [
+        .executable(name: "hsiview-batch", targets: ["hsiview-batch"]),
+        .executable(name: "hsiview-transpose-bench", targets: ["transpose-bench"])
+    ],
+    targets: [
+        // MatHelper.c и TiffHelper.c из приложения, без копирования исходников
+        .target(
+            name: "CHSIHelpers",
+            path: "Sources/CHSIHelpers",
+            linkerSettings: [
+                .linkedLibrary("z"),
+                .linkedLibrary("tiff")
+            ]
+        ),
+        .executableTarget(
+            name: "hsiview-batch",
+            dependencies: ["CHSIHelpers"],
+            path: "Sources/hsiview-batch"
+        ),
+        // Бенчмарк перестановки осей; CubePermutation.swift и ParallelCompute.swift — ссылки на файлы приложения
+        .executableTarget(
+            name: "transpose-bench",
+            path: "Sources/transpose-bench"
+        )
+    ]
+)
@@ -0,0 +1,2 @@
+// Общий исходник с приложением
+#include "../../../HSIView/TiffHelper.c"
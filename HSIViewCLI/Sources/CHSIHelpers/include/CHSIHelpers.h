@@ -0,0 +1,8 @@
+// CHSIHelpers.h
+#ifndef CHSIHelpers_h
+#define CHSIHelpers_h
+
+#include "../../../../HSIView/MatHelper.h"
+#include "../../../../HSIView/TiffHelper.h"
+
+#endif /* CHSIHelpers_h */
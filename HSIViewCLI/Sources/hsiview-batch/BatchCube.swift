@@ -0,0 +1,185 @@
+import Foundation
+
+/// Тип элементов куба; названия совпадают с `DataType` приложения
+enum BatchDataType: String {
+    case float64 = "Float64"
+    case float32 = "Float32"
+    case int8 = "Int8"
+    case int16 = "Int16"
+    case int32 = "Int32"
+    case uint8 = "UInt8"
+    case uint16 = "UInt16"
+
+    var isInteger: Bool {
+        switch self {
+        case .float64, .float32: return false
+        default: return true
+        }
+    }
+
+    var bytesPerElement: Int {
+        switch self {
+        case .float64: return 8
+        case .float32, .int32: return 4
+        case .int16, .uint16: return 2
+        case .int8, .uint8: return 1
+        }
+    }
+
+    var range: (min: Double, max: Double) {
+        switch self {
+        case .float64: return (-Double.greatestFiniteMagnitude, Double.greatestFiniteMagnitude)
+        case .float32: return (-Double(Float.greatestFiniteMagnitude), Double(Float.greatestFiniteMagnitude))
+        case .int8: return (Double(Int8.min), Double(Int8.max))
+        case .int16: return (Double(Int16.min), Double(Int16.max))
+        case .int32: return (Double(Int32.min), Double(Int32.max))
+        case .uint8: return (0, 255)
+        case .uint16: return (0, 65535)
+        }
+    }
+
+    /// Значение, которое будет записано в файл этого типа
+    func quantize(_ value: Double) -> Double {
+        switch self {
+        case .float64: return value
+        case .float32: return Double(Float(value))
+        default:
+            let bounds = range
+            return min(bounds.max, max(bounds.min, value.rounded()))
+        }
+    }
+}
+
+/// Порядок осей в файле; повторяет `CubeLayout` приложения
+enum BatchLayout: String {
+    case auto = "Auto"
+    case chw = "CHW"
+    case cwh = "CWH"
+    case hcw = "HCW"
+    case hwc = "HWC"
+    case wch = "WCH"
+    case whc = "WHC"
+
+    init?(argument: String) {
+        let upper = argument.uppercased()
+        if upper == "AUTO" {
+            self = .auto
+        } else {
+            self.init(rawValue: upper)
+        }
+    }
+
+    /// Номера осей файла для канала, высоты и ширины
+    func axes(for dims: [Int]) -> (channel: Int, height: Int, width: Int) {
+        switch self {
+        case .auto:
+            let channel = dims.firstIndex(of: dims.min() ?? dims[0]) ?? 0
+            let other = [0, 1, 2].filter { $0 != channel }
+            return (channel, other[0], other[1])
+        case .chw: return (0, 1, 2)
+        case .cwh: return (0, 2, 1)
+        case .hcw: return (1, 0, 2)
+        case .hwc: return (2, 0, 1)
+        case .wch: return (1, 2, 0)
+        case .whc: return (2, 1, 0)
+        }
+    }
+
+    /// Явная раскладка, в которой оси файла совпадают с `axes`
+    static func explicit(_ axes: (channel: Int, height: Int, width: Int)) -> BatchLayout {
+        var letters: [Character] = ["C", "C", "C"]
+        letters[axes.channel] = "C"
+        letters[axes.height] = "H"
+        letters[axes.width] = "W"
+        return BatchLayout(rawValue: String(letters)) ?? .chw
+    }
+}
+
+/// Куб в памяти утилиты: значения Float64 по каналам (C, H, W, C-порядок).
+/// `dataType` — тип, в котором куб будет записан; `layout` — порядок осей на выходе.
+struct BatchCube {
+    var channels: Int
+    var height: Int
+    var width: Int
+    var values: [Double]
+    var dataType: BatchDataType
+    var layout: BatchLayout
+    var wavelengths: [Double]?
+
+    var planeSize: Int { height * width }
+    var totalElements: Int { channels * height * width }
+
+    /// Пересобирает данные из файла с осями `dims` и шагами `strides` в порядок CHW
+    static func gather(
+        dims: [Int],
+        strides: [Int],
+        layout: BatchLayout,
+        dataType: BatchDataType,
+        wavelengths: [Double]?,
+        read: (Int) -> Double
+    ) -> BatchCube {
+        let axes = layout.axes(for: dims)
+        let channels = dims[axes.channel]
+        let height = dims[axes.height]
+        let width = dims[axes.width]
+        let channelStride = strides[axes.channel]
+        let heightStride = strides[axes.height]
+        let widthStride = strides[axes.width]
+        let plane = height * width
+
+        var values = [Double](repeating: 0, count: channels * plane)
+        values.withUnsafeMutableBufferPointer { dst in
+            DispatchQueue.concurrentPerform(iterations: channels) { c in
+                let base = c * channelStride
+                for y in 0..<height {
+                    let row = base + y * heightStride
+                    let out = c * plane + y * width
+                    for x in 0..<width {
+                        dst[out + x] = read(row + x * widthStride)
+                    }
+                }
+            }
+        }
+        return BatchCube(
+            channels: channels,
+            height: height,
+            width: width,
+            values: values,
+            dataType: dataType,
+            layout: layout == .auto ? .explicit(axes) : layout,
+            wavelengths: wavelengths?.count == channels ? wavelengths : nil
+        )
+    }
+
+    /// Тот же массив с другим прочтением осей: порядок данных на выходе не меняется,
+    /// меняется только то, какие оси считаются каналами, высотой и шириной
+    func reinterpreted(as target: BatchLayout) -> BatchCube {
+        let axes = layout.axes(for: [channels, height, width])
+        var dims = [0, 0, 0]
+        var strides = [0, 0, 0]
+        dims[axes.channel] = channels
+        dims[axes.height] = height
+        dims[axes.width] = width
+        strides[axes.channel] = planeSize
+        strides[axes.height] = width
+        strides[axes.width] = 1
+        guard target.axes(for: dims) != axes else { return self }
+        return values.withUnsafeBufferPointer { source in
+            BatchCube.gather(
+                dims: dims,
+                strides: strides,
+                layout: target,
+                dataType: dataType,
+                wavelengths: wavelengths,
+                read: { source[$0] }
+            )
+        }
+    }
+
+    /// Шаги по осям для C- или Fortran-порядка
+    static func strides(for dims: [Int], fortranOrder: Bool) -> [Int] {
+        fortranOrder
+            ? [1, dims[0], dims[0] * dims[1]]
+            : [dims[1] * dims[2], dims[2], 1]
+    }
+}
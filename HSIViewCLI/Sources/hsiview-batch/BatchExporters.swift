@@ -0,0 +1,206 @@
+import Foundation
+import CHSIHelpers
+
+enum BatchExportFormat: String {
+    case npy
+    case envi
+    case tiff
+}
+
+/// Запись результатов потоком: куб выгружается построчно в порядке осей `cube.layout`
+/// через буфер фиксированного размера, без полной копии в выходном типе.
+enum BatchExporter {
+    static let chunkBytes = 4 << 20
+
+    @discardableResult
+    static func export(_ cube: BatchCube, format: BatchExportFormat, to directory: URL, baseName: String) throws -> URL {
+        switch format {
+        case .npy:
+            let url = directory.appendingPathComponent(baseName).appendingPathExtension("npy")
+            try writeNpy(cube, to: url)
+            return url
+        case .envi:
+            let url = directory.appendingPathComponent(baseName).appendingPathExtension("dat")
+            try writeEnvi(cube, to: url)
+            return url
+        case .tiff:
+            let url = directory.appendingPathComponent(baseName).appendingPathExtension("tiff")
+            try writeTiff(cube, to: url)
+            return url
+        }
+    }
+
+    // MARK: - NPY
+
+    private static func writeNpy(_ cube: BatchCube, to url: URL) throws {
+        let shape = outputShape(cube)
+        let descr: String
+        switch cube.dataType {
+        case .float64: descr = "<f8"
+        case .float32: descr = "<f4"
+        case .int8: descr = "|i1"
+        case .int16: descr = "<i2"
+        case .int32: descr = "<i4"
+        case .uint8: descr = "|u1"
+        case .uint16: descr = "<u2"
+        }
+        var header = "{'descr': '\(descr)', 'fortran_order': False, 'shape': (\(shape.map(String.init).joined(separator: ", ")),), }"
+        // Заголовок дополняется пробелами до кратности 64 вместе с 10 байтами преамбулы
+        let unpadded = 10 + header.utf8.count + 1
+        header += String(repeating: " ", count: (64 - unpadded % 64) % 64) + "\n"
+
+        var preamble = Data([0x93, 0x4E, 0x55, 0x4D, 0x50, 0x59, 0x01, 0x00])
+        let length = UInt16(header.utf8.count)
+        preamble.append(UInt8(length & 0xFF))
+        preamble.append(UInt8(length >> 8))
+        preamble.append(Data(header.utf8))
+
+        try stream(cube, order: cube.layout, to: url, prefix: preamble)
+    }
+
+    // MARK: - ENVI
+
+    /// ENVI не имеет знакового байта (тип 1 беззнаковый), поэтому Int8 записывается как Int16
+    private static func writeEnvi(_ cube: BatchCube, to url: URL) throws {
+        var cube = cube
+        if cube.dataType == .int8 {
+            cube.dataType = .int16
+        }
+        try stream(cube, order: .chw, to: url, prefix: Data())
+
+        let enviType: Int
+        switch cube.dataType {
+        case .uint8: enviType = 1
+        case .int8, .int16: enviType = 2
+        case .int32: enviType = 3
+        case .float32: enviType = 4
+        case .float64: enviType = 5
+        case .uint16: enviType = 12
+        }
+        var lines = [
+            "ENVI",
+            "description = {HSIView batch export}",
+            "samples = \(cube.width)",
+            "lines = \(cube.height)",
+            "bands = \(cube.channels)",
+            "header offset = 0",
+            "file type = ENVI Standard",
+            "data type = \(enviType)",
+            "interleave = bsq",
+            "byte order = 0"
+        ]
+        if let wavelengths = cube.wavelengths {
+            lines.append("wavelength = {\(wavelengths.map { String($0) }.joined(separator: ", "))}")
+        }
+        let headerURL = url.deletingPathExtension().appendingPathExtension("hdr")
+        do {
+            try (lines.joined(separator: "\n") + "\n").write(to: headerURL, atomically: true, encoding: .utf8)
+        } catch {
+            throw BatchError.writeFailed(headerURL.lastPathComponent)
+        }
+    }
+
+    // MARK: - TIFF
+
+    private static func writeTiff(_ cube: BatchCube, to url: URL) throws {
+        let bits: Int32
+        switch cube.dataType {
+        case .uint8: bits = 8
+        case .uint16: bits = 16
+        default:
+            throw BatchError.unsupportedFormat("TIFF export needs UInt8 or UInt16 data, got \(cube.dataType.rawValue)")
+        }
+        // TiffHelper.c пишет пиксели подряд: (H, W, C)
+        let bytes = encode(cube, order: .hwc)
+        let written = bytes.withUnsafeBytes { raw in
+            url.path.withCString { path in
+                write_tiff_cube_contig(path, raw.baseAddress, cube.width, cube.height, cube.channels, bits)
+            }
+        }
+        guard written else { throw BatchError.writeFailed(url.lastPathComponent) }
+    }
+
+    // MARK: - Потоковая запись
+
+    /// Размеры на выходе в порядке осей `layout`
+    static func outputShape(_ cube: BatchCube) -> [Int] {
+        let axes = cube.layout.axes(for: [0, 0, 0])
+        var shape = [0, 0, 0]
+        shape[axes.channel] = cube.channels
+        shape[axes.height] = cube.height
+        shape[axes.width] = cube.width
+        return shape
+    }
+
+    private static func stream(_ cube: BatchCube, order: BatchLayout, to url: URL, prefix: Data) throws {
+        guard FileManager.default.createFile(atPath: url.path, contents: prefix),
+              let handle = FileHandle(forWritingAtPath: url.path) else {
+            throw BatchError.writeFailed(url.lastPathComponent)
+        }
+        defer { handle.closeFile() }
+        handle.seekToEndOfFile()
+
+        var buffer = Data()
+        buffer.reserveCapacity(chunkBytes)
+        forEachRow(cube, order: order) { row in
+            append(row, as: cube.dataType, to: &buffer)
+            if buffer.count >= chunkBytes {
+                handle.write(buffer)
+                buffer.removeAll(keepingCapacity: true)
+            }
+        }
+        if !buffer.isEmpty {
+            handle.write(buffer)
+        }
+    }
+
+    private static func encode(_ cube: BatchCube, order: BatchLayout) -> Data {
+        var buffer = Data()
+        buffer.reserveCapacity(cube.totalElements * cube.dataType.bytesPerElement)
+        forEachRow(cube, order: order) { row in
+            append(row, as: cube.dataType, to: &buffer)
+        }
+        return buffer
+    }
+
+    /// Перебирает куб строками вдоль последней оси `order`
+    private static func forEachRow(_ cube: BatchCube, order: BatchLayout, _ body: ([Double]) -> Void) {
+        let axes = order.axes(for: [0, 0, 0])
+        var extent = [0, 0, 0]
+        var stride = [0, 0, 0]
+        extent[axes.channel] = cube.channels
+        extent[axes.height] = cube.height
+        extent[axes.width] = cube.width
+        stride[axes.channel] = cube.planeSize
+        stride[axes.height] = cube.width
+        stride[axes.width] = 1
+
+        var row = [Double](repeating: 0, count: extent[2])
+        cube.values.withUnsafeBufferPointer { values in
+            for i0 in 0..<extent[0] {
+                for i1 in 0..<extent[1] {
+                    let base = i0 * stride[0] + i1 * stride[1]
+                    for i2 in 0..<extent[2] {
+                        row[i2] = values[base + i2 * stride[2]]
+                    }
+                    body(row)
+                }
+            }
+        }
+    }
+
+    private static func append(_ row: [Double], as dataType: BatchDataType, to buffer: inout Data) {
+        func write<T>(_ converted: [T]) {
+            converted.withUnsafeBytes { buffer.append(contentsOf: $0) }
+        }
+        switch dataType {
+        case .float64: write(row.map { $0.bitPattern.littleEndian })
+        case .float32: write(row.map { Float($0).bitPattern.littleEndian })
+        case .int8: write(row.map { Int8(clamping: Int($0.rounded())) })
+        case .int16: write(row.map { Int16(clamping: Int($0.rounded())).littleEndian })
+        case .int32: write(row.map { Int32(clamping: Int($0.rounded())).littleEndian })
+        case .uint8: write(row.map { UInt8(clamping: Int($0.rounded())) })
+        case .uint16: write(row.map { UInt16(clamping: Int($0.rounded())).littleEndian })
+        }
+    }
+}
@@ -0,0 +1,351 @@
+import Foundation
+import CHSIHelpers
+
+enum BatchError: Error, CustomStringConvertible {
+    case invalidArguments(String)
+    case unsupportedFormat(String)
+    case readFailed(String)
+    case invalidPipeline(String)
+    case writeFailed(String)
+
+    var description: String {
+        switch self {
+        case .invalidArguments(let text): return text
+        case .unsupportedFormat(let text): return "unsupported format: \(text)"
+        case .readFailed(let text): return "read failed: \(text)"
+        case .invalidPipeline(let text): return "invalid pipeline: \(text)"
+        case .writeFailed(let text): return "write failed: \(text)"
+        }
+    }
+}
+
+/// Загрузка кубов без AppKit: NPY и ENVI читаются из отображённого в память файла,
+/// MAT и TIFF — через общие с приложением C-хелперы.
+enum BatchLoader {
+    static let enviExtensions: Set<String> = ["dat", "hdr", "img", "bsq", "bil", "bip", "raw"]
+
+    static func load(_ url: URL, layout: BatchLayout) throws -> BatchCube {
+        let ext = url.pathExtension.lowercased()
+        switch ext {
+        case "npy":
+            return try loadNpy(url, layout: layout)
+        case "mat":
+            return try loadMat(url, layout: layout)
+        case "tif", "tiff":
+            return try loadTiff(url, layout: layout)
+        default:
+            if enviExtensions.contains(ext) {
+                return try loadEnvi(url)
+            }
+            throw BatchError.unsupportedFormat(url.lastPathComponent)
+        }
+    }
+
+    // MARK: - NPY
+
+    private static func loadNpy(_ url: URL, layout: BatchLayout) throws -> BatchCube {
+        let data = try Data(contentsOf: url, options: .alwaysMapped)
+        guard data.count > 10, data.prefix(6) == Data([0x93, 0x4E, 0x55, 0x4D, 0x50, 0x59]) else {
+            throw BatchError.readFailed("\(url.lastPathComponent): not an NPY file")
+        }
+        let major = data[data.startIndex + 6]
+        let headerLength: Int
+        let headerStart: Int
+        if major == 1 {
+            headerLength = Int(data[data.startIndex + 8]) | Int(data[data.startIndex + 9]) << 8
+            headerStart = 10
+        } else {
+            guard data.count > 12 else { throw BatchError.readFailed(url.lastPathComponent) }
+            headerLength = (0..<4).reduce(0) { $0 | Int(data[data.startIndex + 8 + $1]) << (8 * $1) }
+            headerStart = 12
+        }
+        guard let header = String(data: data[(data.startIndex + headerStart)..<(data.startIndex + headerStart + headerLength)], encoding: .ascii),
+              let descr = npyValue(of: "descr", in: header),
+              let shapeText = npyValue(of: "shape", in: header) else {
+            throw BatchError.readFailed("\(url.lastPathComponent): bad NPY header")
+        }
+        let fortranOrder = header.contains("'fortran_order': True")
+        var shape = shapeText
+            .trimmingCharacters(in: CharacterSet(charactersIn: "()"))
+            .split(separator: ",")
+            .compactMap { Int($0.trimmingCharacters(in: .whitespaces)) }
+        if shape.count == 2 {
+            shape.append(1)
+        }
+        guard shape.count == 3, shape.allSatisfy({ $0 > 0 }) else {
+            throw BatchError.unsupportedFormat("\(url.lastPathComponent): shape \(shapeText)")
+        }
+
+        let byteOrder = descr.first ?? "<"
+        let code = String(descr.dropFirst())
+        let bigEndian = byteOrder == ">"
+        let dataType: BatchDataType
+        switch code {
+        case "f8": dataType = .float64
+        case "f4": dataType = .float32
+        case "i1": dataType = .int8
+        case "i2": dataType = .int16
+        case "i4": dataType = .int32
+        case "u1": dataType = .uint8
+        case "u2": dataType = .uint16
+        default: throw BatchError.unsupportedFormat("\(url.lastPathComponent): dtype \(descr)")
+        }
+
+        let offset = headerStart + headerLength
+        let count = shape.reduce(1, *)
+        guard data.count - offset >= count * dataType.bytesPerElement else {
+            throw BatchError.readFailed("\(url.lastPathComponent): truncated data")
+        }
+        return data.withUnsafeBytes { raw in
+            let payload = UnsafeRawBufferPointer(rebasing: raw[offset...])
+            return BatchCube.gather(
+                dims: shape,
+                strides: BatchCube.strides(for: shape, fortranOrder: fortranOrder),
+                layout: layout,
+                dataType: dataType,
+                wavelengths: nil,
+                read: reader(for: dataType, bytes: payload, bigEndian: bigEndian)
+            )
+        }
+    }
+
+    private static func npyValue(of key: String, in header: String) -> String? {
+        guard let keyRange = header.range(of: "'\(key)':") else { return nil }
+        let rest = header[keyRange.upperBound...].trimmingCharacters(in: .whitespaces)
+        if rest.hasPrefix("(") {
+            guard let close = rest.firstIndex(of: ")") else { return nil }
+            return String(rest[...close])
+        }
+        if rest.hasPrefix("'") {
+            let body = rest.dropFirst()
+            guard let close = body.firstIndex(of: "'") else { return nil }
+            return String(body[..<close])
+        }
+        return nil
+    }
+
+    // MARK: - ENVI
+
+    private static func loadEnvi(_ url: URL) throws -> BatchCube {
+        let base = url.deletingPathExtension()
+        let headerURL = url.pathExtension.lowercased() == "hdr" ? url : base.appendingPathExtension("hdr")
+        let dataURL: URL
+        if url.pathExtension.lowercased() == "hdr" {
+            guard let found = ["dat", "img", "bsq", "bil", "bip", "raw"]
+                .map({ base.appendingPathExtension($0) })
+                .first(where: { FileManager.default.fileExists(atPath: $0.path) }) else {
+                throw BatchError.readFailed("\(url.lastPathComponent): binary file not found")
+            }
+            dataURL = found
+        } else {
+            dataURL = url
+        }
+
+        let header = try BatchEnviHeader.parse(headerURL)
+        let dataType: BatchDataType
+        switch header.dataType {
+        case 1: dataType = .uint8
+        case 2: dataType = .int16
+        case 3: dataType = .int32
+        case 4: dataType = .float32
+        case 5: dataType = .float64
+        case 12: dataType = .uint16
+        default: throw BatchError.unsupportedFormat("\(headerURL.lastPathComponent): data type \(header.dataType)")
+        }
+
+        // Оси файла: bsq = (C, H, W), bil = (H, C, W), bip = (H, W, C)
+        let dims: [Int]
+        let layout: BatchLayout
+        switch header.interleave {
+        case "bil":
+            dims = [header.lines, header.bands, header.samples]
+            layout = .hcw
+        case "bip":
+            dims = [header.lines, header.samples, header.bands]
+            layout = .hwc
+        default:
+            dims = [header.bands, header.lines, header.samples]
+            layout = .chw
+        }
+
+        let data = try Data(contentsOf: dataURL, options: .alwaysMapped)
+        let count = dims.reduce(1, *)
+        guard data.count - header.headerOffset >= count * dataType.bytesPerElement else {
+            throw BatchError.readFailed("\(dataURL.lastPathComponent): size does not match header")
+        }
+        var cube = data.withUnsafeBytes { raw in
+            let payload = UnsafeRawBufferPointer(rebasing: raw[header.headerOffset...])
+            return BatchCube.gather(
+                dims: dims,
+                strides: BatchCube.strides(for: dims, fortranOrder: false),
+                layout: layout,
+                dataType: dataType,
+                wavelengths: header.wavelengths,
+                read: reader(for: dataType, bytes: payload, bigEndian: header.byteOrder == 1)
+            )
+        }
+        // Приложение держит ENVI-кубы в порядке (H, W, C) независимо от interleave
+        cube.layout = .hwc
+        return cube
+    }
+
+    // MARK: - MAT / TIFF
+
+    private static func loadMat(_ url: URL, layout: BatchLayout) throws -> BatchCube {
+        var cube = MatCube3D(data: nil, dims: (0, 0, 0), rank: 0, data_type: MAT_DATA_FLOAT64)
+        var name = [CChar](repeating: 0, count: 256)
+        let loaded = url.path.withCString { path in
+            load_first_3d_double_cube(path, &cube, &name, name.count)
+        }
+        guard loaded, let pointer = cube.data else {
+            throw BatchError.readFailed(url.lastPathComponent)
+        }
+        defer { free_cube(&cube) }
+
+        let dims = [Int(cube.dims.0), Int(cube.dims.1), Int(cube.dims.2)]
+        let dataType: BatchDataType
+        switch cube.data_type {
+        case MAT_DATA_FLOAT32: dataType = .float32
+        case MAT_DATA_UINT8: dataType = .uint8
+        case MAT_DATA_UINT16: dataType = .uint16
+        case MAT_DATA_INT8: dataType = .int8
+        case MAT_DATA_INT16: dataType = .int16
+        default: dataType = .float64
+        }
+        let bytes = UnsafeRawBufferPointer(start: pointer, count: dims.reduce(1, *) * dataType.bytesPerElement)
+        // MATLAB хранит массивы по столбцам
+        return BatchCube.gather(
+            dims: dims,
+            strides: BatchCube.strides(for: dims, fortranOrder: true),
+            layout: layout,
+            dataType: dataType,
+            wavelengths: nil,
+            read: reader(for: dataType, bytes: bytes, bigEndian: false)
+        )
+    }
+
+    private static func loadTiff(_ url: URL, layout: BatchLayout) throws -> BatchCube {
+        var cube = TiffCube3D(data: nil, dims: (0, 0, 0), rank: 0)
+        let loaded = url.path.withCString { load_tiff_cube($0, &cube) }
+        guard loaded, let pointer = cube.data else {
+            throw BatchError.readFailed(url.lastPathComponent)
+        }
+        defer { free_tiff_cube(&cube) }
+
+        let dims = [Int(cube.dims.0), Int(cube.dims.1), Int(cube.dims.2)]
+        let bytes = UnsafeRawBufferPointer(start: pointer, count: dims.reduce(1, *) * MemoryLayout<Double>.size)
+        let readValue = reader(for: .float64, bytes: bytes, bigEndian: false)
+        // TiffHelper.c отдаёт куб в column-major значениями 0…255; приложение хранит TIFF как UInt8
+        return BatchCube.gather(
+            dims: dims,
+            strides: BatchCube.strides(for: dims, fortranOrder: true),
+            layout: layout,
+            dataType: .uint8,
+            wavelengths: nil,
+            read: { BatchDataType.uint8.quantize(readValue($0)) }
+        )
+    }
+
+    // MARK: - Чтение элементов
+
+    private static func reader(
+        for dataType: BatchDataType,
+        bytes: UnsafeRawBufferPointer,
+        bigEndian: Bool
+    ) -> (Int) -> Double {
+        let hostIsBigEndian = 1.bigEndian == 1
+        let swap = bigEndian != hostIsBigEndian
+        switch dataType {
+        case .float64:
+            return { index in
+                let bits = bytes.loadUnaligned(fromByteOffset: index * 8, as: UInt64.self)
+                return Double(bitPattern: swap ? bits.byteSwapped : bits)
+            }
+        case .float32:
+            return { index in
+                let bits = bytes.loadUnaligned(fromByteOffset: index * 4, as: UInt32.self)
+                return Double(Float(bitPattern: swap ? bits.byteSwapped : bits))
+            }
+        case .int32:
+            return { index in
+                let value = bytes.loadUnaligned(fromByteOffset: index * 4, as: Int32.self)
+                return Double(swap ? value.byteSwapped : value)
+            }
+        case .int16:
+            return { index in
+                let value = bytes.loadUnaligned(fromByteOffset: index * 2, as: Int16.self)
+                return Double(swap ? value.byteSwapped : value)
+            }
+        case .uint16:
+            return { index in
+                let value = bytes.loadUnaligned(fromByteOffset: index * 2, as: UInt16.self)
+                return Double(swap ? value.byteSwapped : value)
+            }
+        case .int8:
+            return { index in Double(Int8(bitPattern: bytes[index])) }
+        case .uint8:
+            return { index in Double(bytes[index]) }
+        }
+    }
+}
+
+/// Минимальный разбор ENVI .hdr: размеры, тип, порядок байт, длины волн
+struct BatchEnviHeader {
+    var samples = 0
+    var lines = 0
+    var bands = 0
+    var dataType = 0
+    var interleave = "bsq"
+    var byteOrder = 0
+    var headerOffset = 0
+    var wavelengths: [Double]?
+
+    static func parse(_ url: URL) throws -> BatchEnviHeader {
+        guard let text = (try? String(contentsOf: url, encoding: .utf8))
+                ?? (try? String(contentsOf: url, encoding: .isoLatin1)) else {
+            throw BatchError.readFailed(url.lastPathComponent)
+        }
+        var fields: [String: String] = [:]
+        var pendingKey: String?
+        var pendingValue = ""
+        for line in text.components(separatedBy: .newlines) {
+            if let key = pendingKey {
+                pendingValue += " " + line
+                if line.contains("}") {
+                    fields[key] = pendingValue
+                    pendingKey = nil
+                }
+                continue
+            }
+            guard let equals = line.firstIndex(of: "=") else { continue }
+            let key = line[..<equals].trimmingCharacters(in: .whitespaces).lowercased()
+            let value = line[line.index(after: equals)...].trimmingCharacters(in: .whitespaces)
+            if value.hasPrefix("{") && !value.contains("}") {
+                pendingKey = key
+                pendingValue = value
+            } else {
+                fields[key] = value
+            }
+        }
+
+        var header = BatchEnviHeader()
+        header.samples = Int(fields["samples"] ?? "") ?? 0
+        header.lines = Int(fields["lines"] ?? "") ?? 0
+        header.bands = Int(fields["bands"] ?? "") ?? 0
+        header.dataType = Int(fields["data type"] ?? "") ?? 0
+        header.interleave = (fields["interleave"] ?? "bsq").lowercased()
+        header.byteOrder = Int(fields["byte order"] ?? "") ?? 0
+        header.headerOffset = Int(fields["header offset"] ?? "") ?? 0
+        if let list = fields["wavelength"] {
+            let values = list
+                .trimmingCharacters(in: CharacterSet(charactersIn: "{} "))
+                .split(separator: ",")
+                .compactMap { Double($0.trimmingCharacters(in: .whitespaces)) }
+            header.wavelengths = values.isEmpty ? nil : values
+        }
+        guard header.samples > 0, header.lines > 0, header.bands > 0 else {
+            throw BatchError.readFailed("\(url.lastPathComponent): missing dimensions")
+        }
+        return header
+    }
+}
@@ -0,0 +1,438 @@
+import Foundation
+
+/// Переносимые версии движков пайплайна. Семантика повторяет `CubeNormalizer`,
+/// `DataTypeConverter`, `CubeClipper`, `CubeRotator`, `CubeSpatialCropper` и
+/// `CubeResizer` приложения; расчёт идёт в Float64 по каналам параллельно,
+/// а при `computePrecision` = Float32 нормализация считается в Float, как в приложении.
+enum BatchOperations {
+    static func apply(_ operation: BatchOperationSpec, to cube: BatchCube) throws -> BatchCube {
+        switch operation.type {
+        case "normalization":
+            return try normalize(cube, operation)
+        case "clipping":
+            return clip(cube, lower: operation.lower ?? 0, upper: operation.upper ?? 1)
+        case "dataTypeConversion":
+            guard let name = operation.dataType, let target = BatchDataType(rawValue: name) else {
+                throw BatchError.invalidPipeline("dataTypeConversion: unknown type \(operation.dataType ?? "nil")")
+            }
+            return convert(cube, to: target, autoScale: operation.autoScale ?? true)
+        case "rotation":
+            return rotate(cube, quarterTurns: ((operation.degrees ?? 0) / 90 % 4 + 4) % 4)
+        case "transpose":
+            guard let order = operation.order, let layout = BatchLayout(argument: order), layout != .auto else {
+                throw BatchError.invalidPipeline("transpose: bad order \(operation.order ?? "nil")")
+            }
+            // Данные хранятся в CHW; перестановка осей меняет только порядок записи
+            var result = cube
+            result.layout = layout
+            return result
+        case "spatialCrop":
+            return crop(
+                cube,
+                left: operation.left ?? 0,
+                right: operation.right ?? cube.width - 1,
+                top: operation.top ?? 0,
+                bottom: operation.bottom ?? cube.height - 1
+            )
+        case "resize":
+            return resize(
+                cube,
+                width: operation.width ?? cube.width,
+                height: operation.height ?? cube.height,
+                nearest: operation.algorithm == "nearest",
+                float32: operation.computesInFloat32
+            )
+        case "spectralTrim":
+            return trim(cube, start: operation.startChannel ?? 0, end: operation.endChannel ?? cube.channels - 1)
+        default:
+            throw BatchError.invalidPipeline("unsupported operation \(operation.type)")
+        }
+    }
+
+    // MARK: - Нормализация
+
+    /// Порог вырожденного диапазона канала, как в `CubeNormalizer.applyChannelwise`
+    private static let channelRangeEpsilon = 1e-10
+
+    private static func normalize(_ cube: BatchCube, _ operation: BatchOperationSpec) throws -> BatchCube {
+        let method = operation.method ?? "none"
+        guard method != "none" else { return cube }
+        let channelwise = operation.channelwise ?? false
+        let groups = channelwise ? cube.channels : 1
+        let groupSize = channelwise ? cube.planeSize : cube.totalElements
+        let float32 = operation.computesInFloat32
+
+        var result = cube
+        var outputType = BatchDataType.float64
+        // Общая нормализация постоянного куба возвращает его без изменений;
+        // по каналам постоянный канал заполняется targetMin (min-max) или 0
+        var isConstant = false
+        switch method {
+        case "minMax", "minMaxCustom":
+            let targetMin = method == "minMax" ? 0 : operation.minValue ?? 0
+            let targetMax = method == "minMax" ? 1 : operation.maxValue ?? 1
+            result.values.withUnsafeMutableBufferPointer { values in
+                forEachGroup(groups, size: groupSize) { range in
+                    let (lo, hi) = extrema(values, range)
+                    if float32 {
+                        let (loF, hiF) = (Float(lo), Float(hi))
+                        let sourceRange = hiF - loF
+                        let targetMinF = Float(targetMin)
+                        guard channelwise ? sourceRange > Float(channelRangeEpsilon) : hiF > loF else {
+                            if channelwise {
+                                for i in range { values[i] = Double(targetMinF) }
+                            } else {
+                                isConstant = true
+                            }
+                            return
+                        }
+                        let targetRange = Float(targetMax - targetMin)
+                        for i in range {
+                            values[i] = Double(targetMinF + (Float(values[i]) - loF) / sourceRange * targetRange)
+                        }
+                        return
+                    }
+                    guard channelwise ? hi - lo > channelRangeEpsilon : hi > lo else {
+                        if channelwise {
+                            for i in range { values[i] = targetMin }
+                        } else {
+                            isConstant = true
+                        }
+                        return
+                    }
+                    let scale = (targetMax - targetMin) / (hi - lo)
+                    for i in range { values[i] = targetMin + (values[i] - lo) * scale }
+                }
+            }
+            outputType = float32
+                ? .float32
+                : preservedType(cube, operation, targetMin: targetMin, targetMax: targetMax)
+        case "manualRange":
+            let sourceMin = operation.sourceMin ?? 0
+            let sourceMax = operation.sourceMax ?? 1
+            let targetMin = operation.targetMin ?? 0
+            let targetMax = operation.targetMax ?? 1
+            guard sourceMax > sourceMin else { return cube }
+            if float32 {
+                let (sourceMinF, sourceMaxF) = (Float(sourceMin), Float(sourceMax))
+                let sourceRange = sourceMaxF - sourceMinF
+                let targetMinF = Float(targetMin)
+                let targetRange = Float(targetMax - targetMin)
+                mapAll(&result.values) {
+                    Double(targetMinF + (max(sourceMinF, min(sourceMaxF, Float($0))) - sourceMinF) / sourceRange * targetRange)
+                }
+                outputType = .float32
+            } else {
+                let scale = (targetMax - targetMin) / (sourceMax - sourceMin)
+                mapAll(&result.values) { targetMin + (max(sourceMin, min(sourceMax, $0)) - sourceMin) * scale }
+                outputType = preservedType(cube, operation, targetMin: targetMin, targetMax: targetMax)
+            }
+        case "percentile":
+            let lower = operation.lowerPercentile ?? 2
+            let upper = operation.upperPercentile ?? 98
+            result.values.withUnsafeMutableBufferPointer { values in
+                forEachGroup(groups, size: groupSize) { range in
+                    var sorted = Array(values[range])
+                    sorted.sort()
+                    let last = sorted.count - 1
+                    let lo = sorted[max(0, min(last, Int(Double(last) * lower / 100)))]
+                    let hi = sorted[max(0, min(last, Int(Double(last) * upper / 100)))]
+                    guard channelwise ? hi - lo > channelRangeEpsilon : hi > lo else {
+                        if channelwise {
+                            for i in range { values[i] = 0 }
+                        } else {
+                            isConstant = true
+                        }
+                        return
+                    }
+                    for i in range { values[i] = (max(lo, min(hi, values[i])) - lo) / (hi - lo) }
+                }
+            }
+        case "zScore":
+            result.values.withUnsafeMutableBufferPointer { values in
+                forEachGroup(groups, size: groupSize) { range in
+                    var sum = 0.0
+                    for i in range { sum += values[i] }
+                    let mean = sum / Double(range.count)
+                    var squares = 0.0
+                    for i in range { squares += (values[i] - mean) * (values[i] - mean) }
+                    let std = (squares / Double(range.count)).squareRoot()
+                    guard channelwise ? std > channelRangeEpsilon : std > 0 else {
+                        if channelwise {
+                            for i in range { values[i] = 0 }
+                        } else {
+                            isConstant = true
+                        }
+                        return
+                    }
+                    for i in range { values[i] = (values[i] - mean) / std }
+                }
+            }
+        case "log":
+            if float32 {
+                mapAll(&result.values) { Double(Foundation.log(max(0, Float($0)) + 1)) }
+            } else {
+                mapAll(&result.values) { Foundation.log(max(0, $0) + 1) }
+            }
+        case "sqrt":
+            if float32 {
+                mapAll(&result.values) { Double(max(0, Float($0)).squareRoot()) }
+            } else {
+                mapAll(&result.values) { max(0, $0).squareRoot() }
+            }
+        default:
+            throw BatchError.invalidPipeline("normalization: unknown method \(method)")
+        }
+        if isConstant { return cube }
+
+        // Процентили и Z-Score считают статистику в Float64 и округляют результат до Float32
+        if float32, outputType == .float64 {
+            outputType = .float32
+            if method == "percentile" || method == "zScore" {
+                mapAll(&result.values) { BatchDataType.float32.quantize($0) }
+            }
+        }
+        // По каналам приложение сохраняет тип для любого метода, если результат в него помещается
+        if channelwise, !float32 {
+            outputType = preservedChannelwiseType(cube, operation, values: result.values)
+        }
+        if outputType.isInteger {
+            mapAll(&result.values) { outputType.quantize($0) }
+        }
+        result.dataType = outputType
+        return result
+    }
+
+    /// Тип результата общей min-max и ручного диапазона при включённом сохранении типа
+    private static func preservedType(
+        _ cube: BatchCube,
+        _ operation: BatchOperationSpec,
+        targetMin: Double,
+        targetMax: Double
+    ) -> BatchDataType {
+        guard operation.preserveDataType == true else { return .float64 }
+        let bounds = cube.dataType.range
+        return !cube.dataType.isInteger || (targetMin >= bounds.min && targetMax <= bounds.max)
+            ? cube.dataType
+            : .float64
+    }
+
+    /// Тип результата поканальной нормализации: исходный, если фактический диапазон
+    /// значений в него помещается (Int32 не сохраняется, как в приложении)
+    private static func preservedChannelwiseType(
+        _ cube: BatchCube,
+        _ operation: BatchOperationSpec,
+        values: [Double]
+    ) -> BatchDataType {
+        guard operation.preserveDataType == true else { return .float64 }
+        switch cube.dataType {
+        case .float32, .float64:
+            return cube.dataType
+        case .int32:
+            return .float64
+        default:
+            let (lo, hi) = values.withUnsafeBufferPointer { extrema($0, 0..<$0.count) }
+            let bounds = cube.dataType.range
+            return lo >= bounds.min && hi <= bounds.max ? cube.dataType : .float64
+        }
+    }
+
+    // MARK: - Тип данных и обрезка значений
+
+    private static func convert(_ cube: BatchCube, to target: BatchDataType, autoScale: Bool) -> BatchCube {
+        guard cube.dataType != target else { return cube }
+        var result = cube
+        let bounds = target.range
+        var scaled = false
+        if autoScale {
+            let (lo, hi) = result.values.withUnsafeBufferPointer { extrema($0, 0..<$0.count) }
+            if hi > lo {
+                let scale = (bounds.max - bounds.min) / (hi - lo)
+                mapAll(&result.values) { target.quantize(bounds.min + ($0 - lo) * scale) }
+                scaled = true
+            }
+        }
+        if !scaled {
+            mapAll(&result.values) { target.quantize($0) }
+        }
+        result.dataType = target
+        return result
+    }
+
+    private static func clip(_ cube: BatchCube, lower: Double, upper: Double) -> BatchCube {
+        var result = cube
+        let isInteger = cube.dataType.isInteger
+        mapAll(&result.values) { value in
+            let clamped = max(lower, min(upper, value))
+            return isInteger ? clamped.rounded(.towardZero) : clamped
+        }
+        return result
+    }
+
+    // MARK: - Пространственные операции
+
+    /// Поворот по часовой стрелке на `quarterTurns` × 90°
+    private static func rotate(_ cube: BatchCube, quarterTurns: Int) -> BatchCube {
+        guard quarterTurns != 0 else { return cube }
+        let (oldWidth, oldHeight) = (cube.width, cube.height)
+        let swapsAxes = quarterTurns % 2 == 1
+        let newWidth = swapsAxes ? oldHeight : oldWidth
+        let newHeight = swapsAxes ? oldWidth : oldHeight
+        return remapPlanes(cube, width: newWidth, height: newHeight) { x, y in
+            switch quarterTurns {
+            case 1: return (y, oldHeight - 1 - x)
+            case 2: return (oldWidth - 1 - x, oldHeight - 1 - y)
+            default: return (oldWidth - 1 - y, x)
+            }
+        }
+    }
+
+    private static func crop(_ cube: BatchCube, left: Int, right: Int, top: Int, bottom: Int) -> BatchCube {
+        let left = min(max(left, 0), cube.width - 1)
+        let right = min(max(right, left), cube.width - 1)
+        let top = min(max(top, 0), cube.height - 1)
+        let bottom = min(max(bottom, top), cube.height - 1)
+        return remapPlanes(cube, width: right - left + 1, height: bottom - top + 1) { x, y in
+            (x + left, y + top)
+        }
+    }
+
+    /// Ближайший сосед сохраняет тип; билинейная интерполяция даёт Float64 или Float32 по `float32`
+    private static func resize(_ cube: BatchCube, width: Int, height: Int, nearest: Bool, float32: Bool) -> BatchCube {
+        guard width > 0, height > 0 else { return cube }
+        let scaleX = Double(cube.width) / Double(width)
+        let scaleY = Double(cube.height) / Double(height)
+        if nearest {
+            return remapPlanes(cube, width: width, height: height) { x, y in
+                let srcX = Int(((Double(x) + 0.5) * scaleX - 0.5).rounded())
+                let srcY = Int(((Double(y) + 0.5) * scaleY - 0.5).rounded())
+                return (min(max(0, srcX), cube.width - 1), min(max(0, srcY), cube.height - 1))
+            }
+        }
+
+        // Билинейная интерполяция; точки за границей кадра считаются нулями, как в приложении
+        let srcWidth = cube.width
+        let srcHeight = cube.height
+        let srcPlane = cube.planeSize
+        let plane = width * height
+        var values = [Double](repeating: 0, count: cube.channels * plane)
+        cube.values.withUnsafeBufferPointer { src in
+            values.withUnsafeMutableBufferPointer { dst in
+                DispatchQueue.concurrentPerform(iterations: cube.channels) { c in
+                    let base = c * srcPlane
+                    func sample(_ x: Int, _ y: Int) -> Double {
+                        guard x >= 0, y >= 0, x < srcWidth, y < srcHeight else { return 0 }
+                        return src[base + y * srcWidth + x]
+                    }
+                    for y in 0..<height {
+                        let fy = (Double(y) + 0.5) * scaleY - 0.5
+                        let y0 = Int(fy.rounded(.down))
+                        let ty = fy - Double(y0)
+                        for x in 0..<width {
+                            let fx = (Double(x) + 0.5) * scaleX - 0.5
+                            let x0 = Int(fx.rounded(.down))
+                            let tx = fx - Double(x0)
+                            let top = sample(x0, y0) * (1 - tx) + sample(x0 + 1, y0) * tx
+                            let bottom = sample(x0, y0 + 1) * (1 - tx) + sample(x0 + 1, y0 + 1) * tx
+                            let value = top * (1 - ty) + bottom * ty
+                            dst[c * plane + y * width + x] = float32 ? Double(Float(value)) : value
+                        }
+                    }
+                }
+            }
+        }
+        var result = cube
+        result.width = width
+        result.height = height
+        result.values = values
+        result.dataType = float32 ? .float32 : .float64
+        return result
+    }
+
+    /// Новый куб `width`×`height`, каждый пиксель которого берётся из `source(x, y)` исходного
+    private static func remapPlanes(
+        _ cube: BatchCube,
+        width: Int,
+        height: Int,
+        source: (Int, Int) -> (x: Int, y: Int)
+    ) -> BatchCube {
+        let srcWidth = cube.width
+        let srcPlane = cube.planeSize
+        let plane = width * height
+        var offsets = [Int](repeating: 0, count: plane)
+        for y in 0..<height {
+            for x in 0..<width {
+                let (sx, sy) = source(x, y)
+                offsets[y * width + x] = sy * srcWidth + sx
+            }
+        }
+        var values = [Double](repeating: 0, count: cube.channels * plane)
+        cube.values.withUnsafeBufferPointer { src in
+            values.withUnsafeMutableBufferPointer { dst in
+                offsets.withUnsafeBufferPointer { map in
+                    DispatchQueue.concurrentPerform(iterations: cube.channels) { c in
+                        let srcBase = c * srcPlane
+                        let dstBase = c * plane
+                        for i in 0..<plane {
+                            dst[dstBase + i] = src[srcBase + map[i]]
+                        }
+                    }
+                }
+            }
+        }
+        var result = cube
+        result.width = width
+        result.height = height
+        result.values = values
+        return result
+    }
+
+    // MARK: - Спектральные операции
+
+    private static func trim(_ cube: BatchCube, start: Int, end: Int) -> BatchCube {
+        let first = min(max(start, 0), cube.channels - 1)
+        let last = min(max(end, first), cube.channels - 1)
+        var result = cube
+        result.channels = last - first + 1
+        result.values = Array(cube.values[(first * cube.planeSize)..<((last + 1) * cube.planeSize)])
+        result.wavelengths = cube.wavelengths.map { Array($0[first...last]) }
+        return result
+    }
+
+    // MARK: - Вспомогательные
+
+    private static func forEachGroup(_ groups: Int, size: Int, _ body: (Range<Int>) -> Void) {
+        DispatchQueue.concurrentPerform(iterations: groups) { group in
+            body((group * size)..<((group + 1) * size))
+        }
+    }
+
+    private static func extrema(_ values: UnsafeMutableBufferPointer<Double>, _ range: Range<Int>) -> (Double, Double) {
+        extrema(UnsafeBufferPointer(values), range)
+    }
+
+    private static func extrema(_ values: UnsafeBufferPointer<Double>, _ range: Range<Int>) -> (Double, Double) {
+        var lo = Double.greatestFiniteMagnitude
+        var hi = -Double.greatestFiniteMagnitude
+        for i in range {
+            lo = min(lo, values[i])
+            hi = max(hi, values[i])
+        }
+        return (lo, hi)
+    }
+
+    /// Поэлементное преобразование блоками на всех ядрах
+    private static func mapAll(_ values: inout [Double], _ transform: (Double) -> Double) {
+        let count = values.count
+        let blocks = max(1, min(ProcessInfo.processInfo.activeProcessorCount * 4, count / 65_536))
+        values.withUnsafeMutableBufferPointer { buffer in
+            DispatchQueue.concurrentPerform(iterations: blocks) { block in
+                let start = block * count / blocks
+                let end = (block + 1) * count / blocks
+                for i in start..<end {
+                    buffer[i] = transform(buffer[i])
+                }
+            }
+        }
+    }
+}
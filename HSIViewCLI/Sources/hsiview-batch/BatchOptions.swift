@@ -0,0 +1,91 @@
+import Foundation
+
+struct BatchOptions {
+    var pipelineURL: URL
+    var outputDirectory: URL
+    var format: BatchExportFormat = .npy
+    /// Раскладка входных файлов; по умолчанию берётся из описания пайплайна
+    var layout: BatchLayout?
+    var jobs: Int = max(1, ProcessInfo.processInfo.activeProcessorCount / 4)
+    var inputs: [URL] = []
+
+    static let usage = """
+    usage: hsiview-batch --pipeline <spec.json> --output <dir> [options] <files...>
+
+    options:
+      --pipeline <file>   pipeline saved by HSIView ("Save for Batch Processing…")
+      --output <dir>      output directory (created if missing)
+      --format <fmt>      npy (default), envi, tiff
+      --layout <order>    input axis order: Auto, CHW, HWC, ... (overrides the pipeline)
+      --jobs <n>          cubes processed at once (default: cores / 4)
+      --list <file>       read input paths from a file, one per line
+    """
+
+    static func parse(_ arguments: [String]) throws -> BatchOptions {
+        var pipeline: URL?
+        var output: URL?
+        var format = BatchExportFormat.npy
+        var layout: BatchLayout?
+        var jobs: Int?
+        var inputs: [URL] = []
+
+        var iterator = arguments.makeIterator()
+        func value(for flag: String) throws -> String {
+            guard let next = iterator.next() else {
+                throw BatchError.invalidArguments("missing value for \(flag)")
+            }
+            return next
+        }
+
+        while let argument = iterator.next() {
+            switch argument {
+            case "--pipeline":
+                pipeline = URL(fileURLWithPath: try value(for: argument))
+            case "--output":
+                output = URL(fileURLWithPath: try value(for: argument), isDirectory: true)
+            case "--format":
+                let text = try value(for: argument)
+                guard let parsed = BatchExportFormat(rawValue: text.lowercased()) else {
+                    throw BatchError.unsupportedFormat(text)
+                }
+                format = parsed
+            case "--layout":
+                let text = try value(for: argument)
+                guard let parsed = BatchLayout(argument: text) else {
+                    throw BatchError.invalidArguments("unknown layout \(text)")
+                }
+                layout = parsed
+            case "--jobs":
+                let text = try value(for: argument)
+                guard let parsed = Int(text), parsed > 0 else {
+                    throw BatchError.invalidArguments("bad --jobs \(text)")
+                }
+                jobs = parsed
+            case "--list":
+                let listURL = URL(fileURLWithPath: try value(for: argument))
+                guard let text = try? String(contentsOf: listURL, encoding: .utf8) else {
+                    throw BatchError.readFailed(listURL.path)
+                }
+                inputs += text
+                    .components(separatedBy: .newlines)
+                    .map { $0.trimmingCharacters(in: .whitespaces) }
+                    .filter { !$0.isEmpty && !$0.hasPrefix("#") }
+                    .map { URL(fileURLWithPath: $0) }
+            default:
+                inputs.append(URL(fileURLWithPath: argument))
+            }
+        }
+
+        guard let pipeline, let output, !inputs.isEmpty else {
+            throw BatchError.invalidArguments("--pipeline, --output and at least one input are required")
+        }
+        var options = BatchOptions(pipelineURL: pipeline, outputDirectory: output)
+        options.format = format
+        options.layout = layout
+        if let jobs {
+            options.jobs = jobs
+        }
+        options.inputs = inputs
+        return options
+    }
+}
@@ -0,0 +1,71 @@
+import Foundation
+
+/// JSON-описание пайплайна, которое сохраняет приложение
+/// (`HSIView/Models/PipelineBatchSpec.swift`, «Сохранить для пакетной обработки…»).
+struct BatchPipelineSpec: Decodable {
+    static let currentVersion = 1
+
+    var version: Int?
+    /// Раскладка осей исходных файлов (Auto, CHW, HWC, …)
+    var layout: String?
+    var operations: [BatchOperationSpec]
+}
+
+struct BatchOperationSpec: Decodable {
+    var type: String
+    /// Раскладка осей, в которой операция читает куб; без неё — раскладка предыдущего шага
+    var layout: String?
+    /// Точность нормализации и ресайза: Float32 даёт результат Float32, как в приложении
+    var computePrecision: String?
+    /// Операция приложения, которую утилита не выполняет (`type == "unsupported"`)
+    var operation: String?
+    var method: String?
+    var channelwise: Bool?
+    var preserveDataType: Bool?
+    var minValue: Double?
+    var maxValue: Double?
+    var sourceMin: Double?
+    var sourceMax: Double?
+    var targetMin: Double?
+    var targetMax: Double?
+    var lowerPercentile: Double?
+    var upperPercentile: Double?
+    var lower: Double?
+    var upper: Double?
+    var dataType: String?
+    var autoScale: Bool?
+    var degrees: Int?
+    var order: String?
+    var left: Int?
+    var right: Int?
+    var top: Int?
+    var bottom: Int?
+    var width: Int?
+    var height: Int?
+    var algorithm: String?
+    var startChannel: Int?
+    var endChannel: Int?
+
+    var computesInFloat32: Bool { computePrecision == BatchDataType.float32.rawValue }
+}
+
+extension BatchPipelineSpec {
+    static func load(_ url: URL) throws -> BatchPipelineSpec {
+        let data = try Data(contentsOf: url)
+        let spec: BatchPipelineSpec
+        do {
+            spec = try JSONDecoder().decode(BatchPipelineSpec.self, from: data)
+        } catch {
+            throw BatchError.invalidPipeline("\(url.lastPathComponent): \(error)")
+        }
+        if let version = spec.version, version > currentVersion {
+            throw BatchError.invalidPipeline("unsupported version \(version)")
+        }
+        // Пропуск шага дал бы другой результат, чем в приложении, поэтому такой пайплайн не выполняется
+        let unsupported = spec.operations.filter { $0.type == "unsupported" }.map { $0.operation ?? "unknown" }
+        if !unsupported.isEmpty {
+            throw BatchError.invalidPipeline("operations not supported by hsiview-batch: \(unsupported.joined(separator: ", "))")
+        }
+        return spec
+    }
+}
@@ -0,0 +1,162 @@
+import Foundation
+
+/// Время этапов обработки одного файла
+struct BatchStageTimes {
+    var load: TimeInterval = 0
+    var pipeline: TimeInterval = 0
+    var export: TimeInterval = 0
+
+    static func += (lhs: inout BatchStageTimes, rhs: BatchStageTimes) {
+        lhs.load += rhs.load
+        lhs.pipeline += rhs.pipeline
+        lhs.export += rhs.export
+    }
+}
+
+/// Обрабатывает файлы параллельно, не более `jobs` кубов одновременно.
+/// Каждый куб загружается, проходит пайплайн и сразу записывается на диск,
+/// поэтому в памяти держатся только кубы, которые сейчас в работе.
+final class BatchRunner {
+    let options: BatchOptions
+    let spec: BatchPipelineSpec
+
+    private let outputLock = NSLock()
+
+    init(options: BatchOptions, spec: BatchPipelineSpec) {
+        self.options = options
+        self.spec = spec
+    }
+
+    /// Возвращает число файлов, завершившихся с ошибкой
+    func run() -> Int {
+        let layout = options.layout ?? spec.layout.flatMap(BatchLayout.init(argument:)) ?? .auto
+        let inputs = plannedInputs(options.inputs)
+        let slots = DispatchSemaphore(value: options.jobs)
+        let group = DispatchGroup()
+        let queue = DispatchQueue(label: "hsiview-batch.files", attributes: .concurrent)
+        let start = Date()
+
+        var totals = BatchStageTimes()
+        var failures = 0
+        var elementsProcessed = 0
+
+        log("processing \(inputs.count) file(s), \(options.jobs) at a time, \(spec.operations.count) operation(s)")
+        for (input, baseName) in inputs {
+            slots.wait()
+            group.enter()
+            queue.async {
+                defer {
+                    slots.signal()
+                    group.leave()
+                }
+                var times = BatchStageTimes()
+                do {
+                    let (output, elements) = try self.process(input, baseName: baseName, layout: layout, times: &times)
+                    self.outputLock.lock()
+                    totals += times
+                    elementsProcessed += elements
+                    self.outputLock.unlock()
+                    let stages = String(
+                        format: "load %.2fs  pipeline %.2fs  export %.2fs",
+                        times.load, times.pipeline, times.export
+                    )
+                    self.log("\(input.lastPathComponent)  \(stages)  -> \(output.lastPathComponent)")
+                } catch {
+                    self.outputLock.lock()
+                    failures += 1
+                    self.outputLock.unlock()
+                    self.log("\(input.lastPathComponent)  FAILED: \(error)")
+                }
+            }
+        }
+        group.wait()
+
+        let elapsed = Date().timeIntervalSince(start)
+        let succeeded = inputs.count - failures
+        log(String(
+            format: "done: %d ok, %d failed in %.2fs (%.1f cubes/min, %.2f GB/s); stage totals: load %.2fs, pipeline %.2fs, export %.2fs",
+            succeeded,
+            failures,
+            elapsed,
+            elapsed > 0 ? Double(succeeded) / elapsed * 60 : 0,
+            elapsed > 0 ? Double(elementsProcessed * MemoryLayout<Double>.size) / elapsed / 1_000_000_000 : 0,
+            totals.load,
+            totals.pipeline,
+            totals.export
+        ))
+        return failures
+    }
+
+    /// Возвращает путь результата и число элементов обработанного куба
+    private func process(
+        _ input: URL,
+        baseName: String,
+        layout: BatchLayout,
+        times: inout BatchStageTimes
+    ) throws -> (URL, Int) {
+        var clock = Date()
+        var cube = try BatchLoader.load(input, layout: layout)
+        let elements = cube.totalElements
+        times.load = Date().timeIntervalSince(clock)
+
+        clock = Date()
+        for operation in spec.operations {
+            // --layout задаёт раскладку всего прогона; иначе каждая операция читает куб в своей
+            if options.layout == nil, let name = operation.layout {
+                guard let operationLayout = BatchLayout(argument: name) else {
+                    throw BatchError.invalidPipeline("\(operation.type): unknown layout \(name)")
+                }
+                cube = cube.reinterpreted(as: operationLayout)
+            }
+            cube = try BatchOperations.apply(operation, to: cube)
+        }
+        times.pipeline = Date().timeIntervalSince(clock)
+
+        clock = Date()
+        let output = try BatchExporter.export(
+            cube,
+            format: options.format,
+            to: options.outputDirectory,
+            baseName: baseName
+        )
+        times.export = Date().timeIntervalSince(clock)
+        return (output, elements)
+    }
+
+    /// Убирает повторы входов (в том числе пару .hdr/.dat одного ENVI-куба) и назначает
+    /// каждому кубу уникальное имя результата: совпадающие имена получают суффикс `_2`, `_3`, …
+    private func plannedInputs(_ urls: [URL]) -> [(url: URL, baseName: String)] {
+        var seenCubes = Set<String>()
+        var usedNames = Set<String>()
+        var planned: [(url: URL, baseName: String)] = []
+        for url in urls {
+            let standardized = url.standardizedFileURL
+            let isEnvi = BatchLoader.enviExtensions.contains(standardized.pathExtension.lowercased())
+            let cubeKey = isEnvi ? standardized.deletingPathExtension().path : standardized.path
+            guard seenCubes.insert(cubeKey).inserted else {
+                log("\(url.lastPathComponent)  skipped: same cube is already in the input list")
+                continue
+            }
+            let stem = standardized.deletingPathExtension().lastPathComponent
+            var baseName = stem
+            var suffix = 2
+            while usedNames.contains(baseName.lowercased()) {
+                baseName = "\(stem)_\(suffix)"
+                suffix += 1
+            }
+            usedNames.insert(baseName.lowercased())
+            if baseName != stem {
+                log("\(url.path)  output renamed to \(baseName): name clashes with an earlier input")
+            }
+            planned.append((standardized, baseName))
+        }
+        return planned
+    }
+
+    private func log(_ message: String) {
+        outputLock.lock()
+        print(message)
+        fflush(stdout)
+        outputLock.unlock()
+    }
+}
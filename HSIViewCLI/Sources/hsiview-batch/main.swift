@@ -0,0 +1,18 @@
+import Foundation
+
+let arguments = Array(CommandLine.arguments.dropFirst())
+if arguments.isEmpty || arguments.contains("--help") || arguments.contains("-h") {
+    print(BatchOptions.usage)
+    exit(arguments.isEmpty ? 1 : 0)
+}
+
+do {
+    let options = try BatchOptions.parse(arguments)
+    let spec = try BatchPipelineSpec.load(options.pipelineURL)
+    try FileManager.default.createDirectory(at: options.outputDirectory, withIntermediateDirectories: true)
+    let failures = BatchRunner(options: options, spec: spec).run()
+    exit(failures == 0 ? 0 : 2)
+} catch {
+    FileHandle.standardError.write(Data("hsiview-batch: \(error)\n".utf8))
+    exit(1)
+}
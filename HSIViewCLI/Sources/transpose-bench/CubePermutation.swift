@@ -0,0 +1 @@
+../../../HSIView/Utilities/CubePermutation.swift
\ No newline at end of file
@@ -0,0 +1 @@
+../../../HSIView/Utilities/ParallelCompute.swift
\ No newline at end of file
@@ -0,0 +1,197 @@
+import Foundation
+
+// Сравнение блочной перестановки осей (CubePermutation.swift из приложения, подключён ссылкой)
+// с прежним поэлементным CubeTransposer.remap на всех парах раскладок и обоих порядках памяти.
+
+let usage = """
+usage: hsiview-transpose-bench [--channels n] [--height n] [--width n] [--type f64|f32|u16|u8] [--repeat n]
+
+Transposes a synthetic cube between every pair of the six layouts, in C and Fortran order,
+checks that the blocked kernel matches the per-element reference, and prints timings.
+"""
+
+let layouts = ["CHW", "CWH", "HCW", "HWC", "WCH", "WHC"]
+
+typealias Axes = (channel: Int, height: Int, width: Int)
+
+func axes(of layout: String) -> Axes {
+    let letters = Array(layout)
+    return (letters.firstIndex(of: "C")!, letters.firstIndex(of: "H")!, letters.firstIndex(of: "W")!)
+}
+
+/// Прежняя реализация из CubeTransposer без изменений — эталон и база для сравнения
+func legacyRemap<T>(
+    source: [T],
+    output: inout [T],
+    srcDims: [Int],
+    dstDims: [Int],
+    sourceAxes: Axes,
+    targetAxes: Axes,
+    isFortran: Bool
+) {
+    func linearIndex(dims: [Int], fortran: Bool, i0: Int, i1: Int, i2: Int) -> Int {
+        if fortran {
+            return i0 + dims[0] * (i1 + dims[1] * i2)
+        }
+        return i2 + dims[2] * (i1 + dims[1] * i0)
+    }
+
+    let channelCount = srcDims[sourceAxes.channel]
+    let height = srcDims[sourceAxes.height]
+    let width = srcDims[sourceAxes.width]
+
+    for c in 0..<channelCount {
+        for y in 0..<height {
+            for x in 0..<width {
+                var srcIdx = [0, 0, 0]
+                srcIdx[sourceAxes.channel] = c
+                srcIdx[sourceAxes.height] = y
+                srcIdx[sourceAxes.width] = x
+
+                var dstIdx = [0, 0, 0]
+                dstIdx[targetAxes.channel] = c
+                dstIdx[targetAxes.height] = y
+                dstIdx[targetAxes.width] = x
+
+                let srcLinear = linearIndex(dims: srcDims, fortran: isFortran, i0: srcIdx[0], i1: srcIdx[1], i2: srcIdx[2])
+                let dstLinear = linearIndex(dims: dstDims, fortran: isFortran, i0: dstIdx[0], i1: dstIdx[1], i2: dstIdx[2])
+                output[dstLinear] = source[srcLinear]
+            }
+        }
+    }
+}
+
+func blockedPermute<T>(_ source: [T], srcDims: [Int], permutation: [Int], isFortran: Bool) -> [T] {
+    let count = source.count
+    return [T](unsafeUninitializedCapacity: count) { buffer, initializedCount in
+        source.withUnsafeBytes { raw in
+            CubePermutation.permute(
+                source: raw.baseAddress!,
+                destination: UnsafeMutableRawPointer(buffer.baseAddress!),
+                elementSize: MemoryLayout<T>.stride,
+                sourceDims: srcDims,
+                permutation: permutation,
+                fortranOrder: isFortran
+            )
+        }
+        initializedCount = count
+    }
+}
+
+func bestTime(repeats: Int, _ body: () -> Void) -> TimeInterval {
+    var best = TimeInterval.infinity
+    for _ in 0..<repeats {
+        let start = Date()
+        body()
+        best = min(best, Date().timeIntervalSince(start))
+    }
+    return best
+}
+
+/// Возвращает число несовпавших случаев
+func run<T: Equatable>(_: T.Type, channels: Int, height: Int, width: Int, repeats: Int, make: (Int) -> T) -> Int {
+    let total = channels * height * width
+    let source = (0..<total).map(make)
+    let bytes = Double(total * MemoryLayout<T>.stride)
+    var mismatches = 0
+    var legacyTotal = 0.0
+    var blockedTotal = 0.0
+
+    print("pair        order  legacy ms  blocked ms  speedup  blocked GB/s")
+    for isFortran in [false, true] {
+        for from in layouts {
+            let sourceAxes = axes(of: from)
+            var srcDims = [0, 0, 0]
+            srcDims[sourceAxes.channel] = channels
+            srcDims[sourceAxes.height] = height
+            srcDims[sourceAxes.width] = width
+
+            for to in layouts where to != from {
+                let targetAxes = axes(of: to)
+                var dstDims = [0, 0, 0]
+                dstDims[targetAxes.channel] = channels
+                dstDims[targetAxes.height] = height
+                dstDims[targetAxes.width] = width
+                var permutation = [0, 1, 2]
+                permutation[targetAxes.channel] = sourceAxes.channel
+                permutation[targetAxes.height] = sourceAxes.height
+                permutation[targetAxes.width] = sourceAxes.width
+
+                var reference = source
+                let legacy = bestTime(repeats: repeats) {
+                    legacyRemap(
+                        source: source,
+                        output: &reference,
+                        srcDims: srcDims,
+                        dstDims: dstDims,
+                        sourceAxes: sourceAxes,
+                        targetAxes: targetAxes,
+                        isFortran: isFortran
+                    )
+                }
+                var blocked: [T] = []
+                let fast = bestTime(repeats: repeats) {
+                    blocked = blockedPermute(source, srcDims: srcDims, permutation: permutation, isFortran: isFortran)
+                }
+                let matches = blocked == reference
+                if !matches {
+                    mismatches += 1
+                }
+                legacyTotal += legacy
+                blockedTotal += fast
+
+                let order = isFortran ? "F" : "C"
+                let timings = String(
+                    format: "%9.1f  %10.1f  %6.1fx  %12.2f",
+                    legacy * 1000,
+                    fast * 1000,
+                    fast > 0 ? legacy / fast : 0,
+                    fast > 0 ? 2 * bytes / fast / 1_000_000_000 : 0
+                )
+                print("\(from)→\(to)  \(order)      \(timings)\(matches ? "" : "  MISMATCH")")
+            }
+        }
+    }
+    print(String(
+        format: "total: legacy %.2fs, blocked %.2fs (%.1fx), %d mismatch(es)",
+        legacyTotal, blockedTotal, blockedTotal > 0 ? legacyTotal / blockedTotal : 0, mismatches
+    ))
+    return mismatches
+}
+
+var channels = 128
+var height = 256
+var width = 256
+var type = "f32"
+var repeats = 3
+
+var iterator = CommandLine.arguments.dropFirst().makeIterator()
+while let argument = iterator.next() {
+    guard argument != "--help", let text = iterator.next() else {
+        print(usage)
+        exit(argument == "--help" ? 0 : 1)
+    }
+    switch argument {
+    case "--channels": channels = Int(text) ?? channels
+    case "--height": height = Int(text) ?? height
+    case "--width": width = Int(text) ?? width
+    case "--repeat": repeats = max(1, Int(text) ?? repeats)
+    case "--type": type = text
+    default:
+        print(usage)
+        exit(1)
+    }
+}
+
+print("cube \(channels)×\(height)×\(width) \(type), best of \(repeats), \(ParallelCompute.workerCount) worker(s)")
+let mismatches: Int
+switch type {
+case "f64": mismatches = run(Double.self, channels: channels, height: height, width: width, repeats: repeats) { Double($0) }
+case "f32": mismatches = run(Float.self, channels: channels, height: height, width: width, repeats: repeats) { Float($0 % 16_777_216) }
+case "u16": mismatches = run(UInt16.self, channels: channels, height: height, width: width, repeats: repeats) { UInt16(truncatingIfNeeded: $0) }
+case "u8": mismatches = run(UInt8.self, channels: channels, height: height, width: width, repeats: repeats) { UInt8(truncatingIfNeeded: $0) }
+default:
+    print(usage)
+    exit(1)
+}
+exit(mismatches == 0 ? 0 : 2)